@@ -0,0 +1,233 @@
+/*
+ * affinity.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#define _GNU_SOURCE
+
+#define DEBUG_SUBSYSTEM DEBUG_ROOM
+#include "debug.h"
+
+#include "format.h"
+#include "affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+/*
+ * Parse a list of CPUs, like "0-3,8"
+ *
+ * RETURN (int count)
+ * - >=0 | The number of CPUs
+ * -  -1 | Bad list
+ */
+int cpus_parse(int* cpus, size_t max, const char* string)
+{
+  size_t count = 0;
+
+  while(*string)
+  {
+    if(!isdigit((unsigned char) *string)) return -1;
+
+    char* end;
+
+    long first = strtol(string, &end, 10);
+    long last  = first;
+
+    if(*end == '-')
+    {
+      if(!isdigit((unsigned char) end[1])) return -1;
+
+      last = strtol(end + 1, &end, 10);
+    }
+
+    if(last < first || last >= CPU_SETSIZE) return -1;
+
+    for(long cpu = first; cpu <= last; cpu++)
+    {
+      if(count >= max) return -1;
+
+      cpus[count++] = cpu;
+    }
+
+    if(*end == ',') end++;
+
+    else if(*end != '\0') return -1;
+
+    string = end;
+  }
+
+  return count;
+}
+
+/*
+ * Pin a thread to one CPU
+ *
+ * RETURN (int status)
+ * - 0 | Success, or cpu is CPU_NONE
+ * - 1 | Failed to set affinity
+ */
+int thread_cpu_set(pthread_t thread, int cpu)
+{
+  if(cpu == CPU_NONE) return 0;
+
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+
+  CPU_SET(cpu, &set);
+
+  if(pthread_setaffinity_np(thread, sizeof(set), &set) != 0)
+  {
+    error_print("Failed to pin thread to CPU %d", cpu);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Get the NUMA node of a CPU, from the nodeN entry in sysfs
+ *
+ * RETURN (int node)
+ * - >=0 | The node of the CPU, 0 without NUMA
+ * -  -1 | The CPU does not exist
+ */
+int cpu_node_get(int cpu)
+{
+  if(cpu < 0) return NODE_NONE;
+
+  char path[64];
+
+  format_string(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+  DIR* dir = opendir(path);
+
+  if(!dir)
+  {
+    // Without sysfs every CPU is on node 0, if it is online
+    return (cpu < sysconf(_SC_NPROCESSORS_CONF)) ? 0 : NODE_NONE;
+  }
+
+  int node = 0;
+
+  struct dirent* entry;
+
+  while((entry = readdir(dir)))
+  {
+    if(strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char) entry->d_name[4]))
+    {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  }
+
+  closedir(dir);
+
+  return node;
+}
+
+/*
+ * Get the NUMA node of the page of memory
+ *
+ * The page must have been touched, or it is not placed yet
+ *
+ * RETURN (int node)
+ * - >=0 | The node of the page
+ * -  -1 | Failed to get node
+ */
+int memory_node_get(const void* memory)
+{
+  int node;
+
+  if(syscall(SYS_get_mempolicy, &node, NULL, 0, memory, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+  {
+    return NODE_NONE;
+  }
+
+  return node;
+}
+
+/*
+ * Allocate pages on a NUMA node
+ *
+ * The pages are preferred, not bound, to the node, so that
+ * the allocation works when the node is full. The pages are
+ * touched here, so that they are placed before they are used.
+ *
+ * Without node (NODE_NONE) or without NUMA support in the kernel,
+ * the pages are placed on the node of the first thread to touch them
+ *
+ * RETURN (void* memory)
+ * - NULL | Failed to map memory
+ */
+void* node_alloc(size_t size, int node)
+{
+  void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if(memory == MAP_FAILED) return NULL;
+
+  if(node >= 0 && node < (int) (sizeof(unsigned long) * 8))
+  {
+    unsigned long mask = 1UL << node;
+
+    if(syscall(SYS_mbind, memory, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0) != 0)
+    {
+      info_print("Failed to bind memory to node %d", node);
+    }
+  }
+
+  memset(memory, 0, size);
+
+  return memory;
+}
+
+/*
+ * Free memory from node_alloc
+ */
+void node_free(void* memory, size_t size)
+{
+  if(memory) munmap(memory, size);
+}
+
+/*
+ * Check that memory used by a thread is on the node of its CPU,
+ * and report it if it is not
+ *
+ * The warning goes to stderr whatever the debug filter is,
+ * since the filter hides every debug message by default
+ *
+ * RETURN (bool is_local)
+ * - true  | Same node, or the placement is not known
+ * - false | The memory is on another node
+ */
+bool placement_check(const char* name, int cpu, const void* memory)
+{
+  int cpu_node    = cpu_node_get(cpu);
+  int memory_node = memory_node_get(memory);
+
+  if(cpu_node == NODE_NONE || memory_node == NODE_NONE) return true;
+
+  if(cpu_node != memory_node)
+  {
+    fprintf(stderr, "Cross-node placement: %s runs on node %d (CPU %d) but its memory is on node %d\n", name, cpu_node, cpu, memory_node);
+
+    return false;
+  }
+
+  info_print("Placement: %s runs on node %d (CPU %d) with local memory", name, cpu_node, cpu);
+
+  return true;
+}
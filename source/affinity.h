@@ -0,0 +1,44 @@
+/*
+ * affinity.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * The maximum number of CPUs in a list
+ */
+#define CPUS_MAX  256
+
+/*
+ * No CPU or NUMA node, for threads that are not pinned
+ * and memory that is not bound
+ */
+#define CPU_NONE  -1
+#define NODE_NONE -1
+
+extern int   cpus_parse(int* cpus, size_t max, const char* string);
+
+extern int   thread_cpu_set(pthread_t thread, int cpu);
+
+
+extern int   cpu_node_get(int cpu);
+
+extern int   memory_node_get(const void* memory);
+
+extern void* node_alloc(size_t size, int node);
+
+extern void  node_free(void* memory, size_t size);
+
+
+extern bool  placement_check(const char* name, int cpu, const void* memory);
+
+#endif // AFFINITY_H
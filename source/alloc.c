@@ -0,0 +1,172 @@
+/*
+ * alloc.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "alloc.h"
+
+#if ALLOC_STATS
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <malloc.h>
+#include <openssl/crypto.h>
+
+/*
+ * The counters of a tag, updated by every thread
+ *
+ * The sizes are the usable sizes of malloc, so that
+ * tag_free knows the size without a header before the memory
+ */
+typedef struct
+{
+  _Alignas(64) atomic_size_t allocs; // Allocations since the start
+  atomic_size_t live;                // Allocations that are not freed
+  atomic_size_t bytes;               // Bytes that are not freed
+  atomic_size_t peak;                // The most bytes at once
+} alloc_stats_t;
+
+static alloc_stats_t alloc_stats[ALLOC_TAG_COUNT];
+
+static const char* alloc_tag_names[ALLOC_TAG_COUNT] =
+{
+  "room", "socket", "crypto", "ui", "log"
+};
+
+/*
+ * Count size more bytes of tag, and raise the peak
+ */
+void tag_count_add(alloc_tag_t tag, size_t size)
+{
+  alloc_stats_t* stats = &alloc_stats[tag];
+
+  atomic_fetch_add_explicit(&stats->allocs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->live, 1, memory_order_relaxed);
+
+  size_t bytes = atomic_fetch_add_explicit(&stats->bytes, size, memory_order_relaxed) + size;
+
+  size_t peak = atomic_load_explicit(&stats->peak, memory_order_relaxed);
+
+  while(bytes > peak && !atomic_compare_exchange_weak_explicit(&stats->peak, &peak, bytes, memory_order_relaxed, memory_order_relaxed));
+}
+
+/*
+ * Count size less bytes of tag
+ */
+void tag_count_sub(alloc_tag_t tag, size_t size)
+{
+  alloc_stats_t* stats = &alloc_stats[tag];
+
+  atomic_fetch_sub_explicit(&stats->live, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&stats->bytes, size, memory_order_relaxed);
+}
+
+/*
+ * Count memory from malloc, if there is any
+ */
+static inline void* tag_memory_add(alloc_tag_t tag, void* memory)
+{
+  if(memory) tag_count_add(tag, malloc_usable_size(memory));
+
+  return memory;
+}
+
+void* tag_malloc(alloc_tag_t tag, size_t size)
+{
+  return tag_memory_add(tag, malloc(size));
+}
+
+void* tag_calloc(alloc_tag_t tag, size_t count, size_t size)
+{
+  return tag_memory_add(tag, calloc(count, size));
+}
+
+/*
+ * The old memory is counted as freed only if realloc succeeds,
+ * since it is left as it is otherwise
+ */
+void* tag_realloc(alloc_tag_t tag, void* memory, size_t size)
+{
+  size_t old_size = memory ? malloc_usable_size(memory) : 0;
+
+  void* new_memory = realloc(memory, size);
+
+  if(!new_memory) return NULL;
+
+  if(memory) tag_count_sub(tag, old_size);
+
+  return tag_memory_add(tag, new_memory);
+}
+
+char* tag_strdup(alloc_tag_t tag, const char* string)
+{
+  return tag_memory_add(tag, strdup(string));
+}
+
+char* tag_strndup(alloc_tag_t tag, const char* string, size_t length)
+{
+  return tag_memory_add(tag, strndup(string, length));
+}
+
+void tag_free(alloc_tag_t tag, void* memory)
+{
+  if(!memory) return;
+
+  tag_count_sub(tag, malloc_usable_size(memory));
+
+  free(memory);
+}
+
+static void* crypto_malloc(size_t size, const char* file, int line)
+{
+  return tag_malloc(ALLOC_CRYPTO, size);
+}
+
+static void* crypto_realloc(void* memory, size_t size, const char* file, int line)
+{
+  return tag_realloc(ALLOC_CRYPTO, memory, size);
+}
+
+static void crypto_free(void* memory, const char* file, int line)
+{
+  tag_free(ALLOC_CRYPTO, memory);
+}
+
+/*
+ * Count the memory of libcrypto under the crypto tag
+ *
+ * This must be called before libcrypto allocates anything,
+ * first in main
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | libcrypto has already allocated
+ */
+int alloc_crypto_hook(void)
+{
+  return CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free) ? 0 : 1;
+}
+
+/*
+ * Print the memory of every tag
+ */
+void alloc_stats_print(FILE* stream)
+{
+  fprintf(stream, "%-8s %10s %10s %10s %10s\n", "memory", "allocs", "live", "live kB", "peak kB");
+
+  for(int tag = 0; tag < ALLOC_TAG_COUNT; tag++)
+  {
+    alloc_stats_t* stats = &alloc_stats[tag];
+
+    fprintf(stream, "%-8s %10zu %10zu %10.1f %10.1f\n", alloc_tag_names[tag],
+      atomic_load_explicit(&stats->allocs, memory_order_relaxed),
+      atomic_load_explicit(&stats->live, memory_order_relaxed),
+      atomic_load_explicit(&stats->bytes, memory_order_relaxed) / 1024.0,
+      atomic_load_explicit(&stats->peak, memory_order_relaxed) / 1024.0);
+  }
+}
+
+#endif // ALLOC_STATS
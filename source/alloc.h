@@ -0,0 +1,85 @@
+/*
+ * alloc.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The memory of every tag is counted if ALLOC_STATS is 1,
+ * and else the tagged calls are plain malloc and free
+ */
+#ifndef ALLOC_STATS
+#define ALLOC_STATS 0
+#endif
+
+/*
+ * The subsystems that memory is counted by
+ */
+typedef enum
+{
+  ALLOC_ROOM,   // Rooms and the peer registry
+  ALLOC_SOCKET, // Frame buffers and the message scratch
+  ALLOC_CRYPTO, // Keys and contexts inside libcrypto
+  ALLOC_UI,     // Lines on their way to the screen
+  ALLOC_LOG,    // Debug rings and trace events
+  ALLOC_TAG_COUNT
+} alloc_tag_t;
+
+#if ALLOC_STATS
+
+/*
+ * Memory from tag_malloc must be freed with tag_free,
+ * with the same tag, or it is counted as live forever
+ */
+extern void* tag_malloc(alloc_tag_t tag, size_t size);
+
+extern void* tag_calloc(alloc_tag_t tag, size_t count, size_t size);
+
+extern void* tag_realloc(alloc_tag_t tag, void* memory, size_t size);
+
+extern char* tag_strdup(alloc_tag_t tag, const char* string);
+
+extern char* tag_strndup(alloc_tag_t tag, const char* string, size_t length);
+
+extern void  tag_free(alloc_tag_t tag, void* memory);
+
+/*
+ * Count memory that is not from malloc, like mapped pages
+ */
+extern void  tag_count_add(alloc_tag_t tag, size_t size);
+
+extern void  tag_count_sub(alloc_tag_t tag, size_t size);
+
+
+extern int   alloc_crypto_hook(void);
+
+extern void  alloc_stats_print(FILE* stream);
+
+#else // ALLOC_STATS
+
+#define tag_malloc(tag, size)           malloc(size)
+#define tag_calloc(tag, count, size)    calloc(count, size)
+#define tag_realloc(tag, memory, size)  realloc(memory, size)
+#define tag_strdup(tag, string)         strdup(string)
+#define tag_strndup(tag, string, length) strndup(string, length)
+#define tag_free(tag, memory)           free(memory)
+
+#define tag_count_add(tag, size) ((void) 0)
+#define tag_count_sub(tag, size) ((void) 0)
+
+#define alloc_stats_print(stream) ((void) 0)
+
+static inline int alloc_crypto_hook(void) { return 0; }
+
+#endif // ALLOC_STATS
+
+#endif // ALLOC_H
@@ -0,0 +1,293 @@
+/*
+ * bench-affinity - benchmark of thread placement on loopback latency
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-affinity [CPUS]
+ *
+ * A frame is sent back and forth over a loopback TCP connection,
+ * between a client and an echo thread. The round trip is measured
+ * with the threads unpinned, pinned to the same CPU, to two CPUs on one node
+ * and, if CPUS has CPUs on two NUMA nodes, to CPUs on different nodes.
+ *
+ * CPUS is a list like "0-3", by default every online CPU
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../affinity.h"
+#include "../frame.h"
+#include "../hist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define ROUND_COUNT 20000
+#define FRAME_DATA  256
+
+typedef struct
+{
+  int fd;
+  int cpu;
+} echo_arg_t;
+
+static hist_t hist;
+
+/*
+ * Read exactly size bytes
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of file or error
+ */
+static int read_all(int fd, uint8_t* buffer, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t amount = read(fd, buffer, size);
+
+    if(amount <= 0) return 1;
+
+    buffer += amount;
+    size   -= amount;
+  }
+
+  return 0;
+}
+
+/*
+ * Write exactly size bytes
+ */
+static int write_all(int fd, const uint8_t* buffer, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t amount = write(fd, buffer, size);
+
+    if(amount <= 0) return 1;
+
+    buffer += amount;
+    size   -= amount;
+  }
+
+  return 0;
+}
+
+/*
+ * Send every frame back, into a buffer on the node of the thread
+ */
+static void* echo_routine(void* arg)
+{
+  echo_arg_t* echo = arg;
+
+  thread_cpu_set(pthread_self(), echo->cpu);
+
+  frame_buffer_t buffer;
+
+  if(frame_buffer_create(&buffer, FRAME_HEAD_SIZE + FRAME_DATA, cpu_node_get(echo->cpu)) != 0)
+  {
+    return NULL;
+  }
+
+  while(read_all(echo->fd, buffer.data, buffer.size) == 0)
+  {
+    if(write_all(echo->fd, buffer.data, buffer.size) != 0) break;
+  }
+
+  frame_buffer_free(&buffer);
+
+  return NULL;
+}
+
+/*
+ * Create a connected pair of loopback TCP sockets
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create sockets
+ */
+static int loopback_pair_create(int fds[2])
+{
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if(listen_fd == -1) return 1;
+
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t length = sizeof(addr);
+
+  if(bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+     listen(listen_fd, 1) != 0 ||
+     getsockname(listen_fd, (struct sockaddr*) &addr, &length) != 0 ||
+     (fds[0] = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+  {
+    close(listen_fd);
+
+    return 1;
+  }
+
+  if(connect(fds[0], (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+     (fds[1] = accept(listen_fd, NULL, NULL)) == -1)
+  {
+    close(fds[0]);
+
+    close(listen_fd);
+
+    return 1;
+  }
+
+  close(listen_fd);
+
+  int flag = 1;
+
+  setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  return 0;
+}
+
+/*
+ * Run the round trips with the client on one CPU and the echo on another
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to connect or to send
+ */
+static int placement_bench(const char* name, int client_cpu, int echo_cpu)
+{
+  int fds[2];
+
+  if(loopback_pair_create(fds) != 0) return 1;
+
+  echo_arg_t arg = { fds[1], echo_cpu };
+
+  pthread_t thread;
+
+  if(pthread_create(&thread, NULL, echo_routine, &arg) != 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+
+    return 1;
+  }
+
+  thread_cpu_set(pthread_self(), client_cpu);
+
+  frame_buffer_t buffer;
+
+  int status = frame_buffer_create(&buffer, FRAME_HEAD_SIZE + FRAME_DATA, cpu_node_get(client_cpu));
+
+  if(status == 0 && client_cpu != CPU_NONE)
+  {
+    placement_check("client", client_cpu, buffer.data);
+  }
+
+  hist_reset(&hist);
+
+  for(int round = 0; buffer.data && round < ROUND_COUNT; round++)
+  {
+    uint64_t start = hist_time_get();
+
+    if(write_all(fds[0], buffer.data, buffer.size) != 0 ||
+       read_all(fds[0], buffer.data, buffer.size) != 0)
+    {
+      status = 1;
+      break;
+    }
+
+    hist_record(&hist, hist_time_get() - start);
+  }
+
+  shutdown(fds[0], SHUT_RDWR);
+
+  pthread_join(thread, NULL);
+
+  close(fds[0]);
+  close(fds[1]);
+
+  frame_buffer_free(&buffer);
+
+  printf("%-12s %6d %6d %10.1f %10.1f %10.1f\n", name, client_cpu, echo_cpu,
+    hist_percentile_get(&hist, 50.0) / 1e3,
+    hist_percentile_get(&hist, 99.0) / 1e3,
+    hist_max_get(&hist) / 1e3);
+
+  return status;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  // Only the table and the placement warnings are printed
+  debug_filter_set(DEBUG_FILTER_NONE);
+
+  int cpus[CPUS_MAX];
+  int count;
+
+  if(argc >= 2)
+  {
+    if((count = cpus_parse(cpus, CPUS_MAX, argv[1])) <= 0)
+    {
+      fprintf(stderr, "bench-affinity: Bad list of CPUs: %s\n", argv[1]);
+
+      return 1;
+    }
+  }
+  else
+  {
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(count > CPUS_MAX) count = CPUS_MAX;
+
+    for(int index = 0; index < count; index++) cpus[index] = index;
+  }
+
+  // Find a CPU on the node of the first CPU, and one on another node
+  int local_cpu  = CPU_NONE;
+  int remote_cpu = CPU_NONE;
+
+  for(int index = 1; index < count; index++)
+  {
+    bool is_local = (cpu_node_get(cpus[index]) == cpu_node_get(cpus[0]));
+
+    if(is_local && local_cpu == CPU_NONE) local_cpu = cpus[index];
+
+    if(!is_local && remote_cpu == CPU_NONE) remote_cpu = cpus[index];
+  }
+
+  printf("%-12s %6s %6s %10s %10s %10s\n", "placement", "client", "echo", "p50 us", "p99 us", "max us");
+
+  int status = placement_bench("unpinned", CPU_NONE, CPU_NONE);
+
+  status |= placement_bench("same cpu", cpus[0], cpus[0]);
+
+  if(local_cpu != CPU_NONE) status |= placement_bench("same node", cpus[0], local_cpu);
+
+  if(remote_cpu != CPU_NONE) status |= placement_bench("cross node", cpus[0], remote_cpu);
+
+  if(status != 0)
+  {
+    fprintf(stderr, "bench-affinity: Failed to run round trips\n");
+
+    return 1;
+  }
+
+  return 0;
+}
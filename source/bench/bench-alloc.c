@@ -0,0 +1,653 @@
+/*
+ * bench-alloc - check that the message path allocates nothing
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-alloc [MESSAGES]
+ *
+ * Messages are sent from one peer to another over a socketpair,
+ * MESSAGES times, by default 10000, through the same calls as the client:
+ * message_send, frames_recv, data_verify and message_read.
+ *
+ * Then the messages go through the threads of the client: lines are
+ * written to the input thread, sent by the network thread to a room
+ * on a unix socket, where a peer of the bench sends them back, and
+ * the replies are printed by the UI thread, one message at a time
+ *
+ * malloc is wrapped to count the allocations of both runs, after
+ * a warm-up, and the check fails if there are any.
+ *
+ * Allocations inside libcrypto are exempt, since the Ed25519 and
+ * X25519 calls of OpenSSL allocate internally, and can't be avoided
+ * from the outside. They are counted apart, through CRYPTO_set_mem_functions,
+ * and the check fails if there are more than CRYPTO_ALLOCS_MAX a frame
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../bunker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#define MESSAGE_COUNT  10000
+#define WARMUP_COUNT   100
+
+#define SOCKET_PATH    "/tmp/bench-alloc.sock"
+
+#define MESSAGE_TEXT   "The quick brown fox jumps over the lazy dog, every time"
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* memory, size_t size);
+extern void  __libc_free(void* memory);
+
+/*
+ * The most libcrypto allocations for a frame that is sent,
+ * which is signed, verified and has its message key wrapped
+ *
+ * OpenSSL 3 allocates about 12 times for that
+ */
+#define CRYPTO_ALLOCS_MAX 16
+
+// The threads of the second run allocate at once
+static atomic_bool counting = false;
+
+static atomic_size_t path_allocs   = 0;
+static atomic_size_t crypto_allocs = 0;
+
+void* malloc(size_t size)
+{
+  if(counting) path_allocs++;
+
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+  if(counting) path_allocs++;
+
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* memory, size_t size)
+{
+  if(counting) path_allocs++;
+
+  return __libc_realloc(memory, size);
+}
+
+void free(void* memory)
+{
+  __libc_free(memory);
+}
+
+static void* crypto_malloc(size_t size, const char* file, int line)
+{
+  if(counting) crypto_allocs++;
+
+  return __libc_malloc(size);
+}
+
+static void* crypto_realloc(void* memory, size_t size, const char* file, int line)
+{
+  if(counting) crypto_allocs++;
+
+  return __libc_realloc(memory, size);
+}
+
+static void crypto_free(void* memory, const char* file, int line)
+{
+  __libc_free(memory);
+}
+
+typedef struct
+{
+  sign_key_t        key;
+  peer_t            peer;    // The other peer, as this peer knows it
+  message_scratch_t scratch;
+  frame_buffer_t    buffer;
+  mux_t             mux;
+  int               fd;
+} side_t;
+
+static side_t sides[2];
+
+/*
+ * Send a message from one side and read it on the other,
+ * like the client does when it recieves a text frame
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to send message
+ * - 2 | Failed to recieve frame
+ * - 3 | Failed to verify frame
+ * - 4 | Failed to read message
+ */
+static int message_round(side_t* sender, side_t* reciever)
+{
+  size_t length = sizeof(MESSAGE_TEXT) - 1;
+
+  if(message_send(&sender->mux, &sender->scratch, &sender->key, MESSAGE_TEXT, length, &sender->peer, 1) != 0) return 1;
+
+  frame_t frame;
+
+  if(frames_recv(reciever->fd, &reciever->buffer, &frame, 1) != 1) return 2;
+
+  frame_sign_t sign;
+
+  if(frame_sign_get(&sign, &frame) != 0) return 3;
+
+  if(data_verify(sign.sign, sign.public, sign.digest, DIGEST_SIZE) != 0) return 3;
+
+  if(message_read(reciever->scratch.text, &length, MESSAGE_SCRATCH_SIZE, sign.data, sign.size, &reciever->peer, reciever->key.public) != 0) return 4;
+
+  if(strcmp(reciever->scratch.text, MESSAGE_TEXT) != 0) return 4;
+
+  return 0;
+}
+
+/*
+ * Run rounds from the first side to the second
+ *
+ * The sender is always the same, like the network thread of a client,
+ * that always signs with its own key
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | A round failed
+ */
+static int rounds_run(long count)
+{
+  for(long round = 0; round < count; round++)
+  {
+    int status = message_round(&sides[0], &sides[1]);
+
+    if(status != 0)
+    {
+      fprintf(stderr, "bench-alloc: Round %ld failed (%d)\n", round, status);
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Create the keys, buffers and socketpair of both sides
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed
+ */
+static int sides_create(void)
+{
+  int fds[2];
+
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return 1;
+
+  uint8_t secret[SECRET_SIZE];
+
+  if(secret_create(secret) != 0) return 1;
+
+  for(int index = 0; index < 2; index++)
+  {
+    side_t* side = &sides[index];
+
+    side->fd = fds[index];
+
+    if(sign_key_create(&side->key) != 0 ||
+       message_scratch_create(&side->scratch) != 0 ||
+       frame_buffer_create(&side->buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0 ||
+       mux_init(&side->mux, side->fd, side->key.public) != 0)
+    {
+      return 1;
+    }
+
+    side->peer.name = (index == 0) ? "bob" : "alice";
+
+    memcpy(side->peer.secret, secret, SECRET_SIZE);
+  }
+
+  memcpy(sides[0].peer.public, sides[1].key.public, SIGN_PUBLIC_SIZE);
+  memcpy(sides[1].peer.public, sides[0].key.public, SIGN_PUBLIC_SIZE);
+
+  return 0;
+}
+
+/*
+ * Free the keys, buffers and socketpair of both sides
+ */
+static void sides_free(void)
+{
+  for(int index = 0; index < 2; index++)
+  {
+    side_t* side = &sides[index];
+
+    sign_key_free(&side->key);
+
+    message_scratch_free(&side->scratch);
+
+    mux_free(&side->mux);
+
+    frame_buffer_free(&side->buffer);
+
+    if(side->fd > 0) close(side->fd);
+  }
+
+  crypto_thread_free();
+}
+
+/*
+ * The peer in the room of the second run, that sends back
+ * every message of the client, like another client would
+ */
+static side_t     far;
+static wrap_key_t far_wrap;
+
+static bool far_keyed = false;
+
+/*
+ * Learn the keys of the client from its key frame,
+ * and send the own keys back
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create the secret
+ * - 2 | Failed to send the key frame
+ */
+static int far_key_handle(const frame_sign_t* sign)
+{
+  if(sign->size < WRAP_PUBLIC_SIZE) return 1;
+
+  if(wrap_secret_create(far.peer.secret, &far_wrap, sign->data) != 0) return 1;
+
+  memcpy(far.peer.public, sign->public, SIGN_PUBLIC_SIZE);
+
+  far.peer.name = "alice";
+
+  uint8_t body[WRAP_PUBLIC_SIZE + 3];
+
+  memcpy(body, far_wrap.public, WRAP_PUBLIC_SIZE);
+
+  memcpy(body + WRAP_PUBLIC_SIZE, "bob", 3);
+
+  uint8_t* frame;
+  size_t   frame_size;
+
+  if(frame_signed_create(&frame, &frame_size, FRAME_KEY, MUX_STREAM_CHAT, &far.key, body, sizeof(body)) != 0) return 2;
+
+  int status = mux_write(&far.mux, MUX_STREAM_CHAT, frame, frame_size);
+
+  free(frame);
+
+  far_keyed = true;
+
+  return (status == 0) ? 0 : 2;
+}
+
+/*
+ * Verify a frame from the client, and send its message back
+ *
+ * The client sends its key frame again when it learns the keys
+ * of the peer, which is not handled again
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to verify the frame
+ * - 2 | Failed to handle the frame
+ */
+static int far_frame_handle(const frame_t* frame)
+{
+  frame_sign_t sign;
+
+  if(frame_sign_get(&sign, frame) != 0) return 1;
+
+  if(data_verify(sign.sign, sign.public, sign.digest, DIGEST_SIZE) != 0) return 1;
+
+  if(frame->type == FRAME_KEY) return far_keyed ? 0 : (far_key_handle(&sign) == 0) ? 0 : 2;
+
+  if(frame->type != FRAME_TEXT || !far_keyed) return 2;
+
+  size_t length;
+
+  if(message_read(far.scratch.text, &length, MESSAGE_SCRATCH_SIZE, sign.data, sign.size, &far.peer, far.key.public) != 0) return 2;
+
+  if(message_send(&far.mux, &far.scratch, &far.key, far.scratch.text, length, &far.peer, 1) != 0) return 2;
+
+  return 0;
+}
+
+/*
+ * Read the frames of the client, until its network thread stops
+ */
+static void* far_routine(void* arg)
+{
+  frame_t frames[64];
+
+  while(true)
+  {
+    ssize_t count = frames_recv(far.fd, &far.buffer, frames, 64);
+
+    if(count == -3) continue;
+
+    if(count <= 0) break;
+
+    for(ssize_t index = 0; index < count; index++)
+    {
+      int status = mux_frame_recv(&far.mux, &frames[index]);
+
+      if(status != 0 && status != 2) continue;
+
+      if((status = far_frame_handle(&frames[index])) != 0)
+      {
+        fprintf(stderr, "bench-alloc: The peer failed to handle a frame (%d)\n", status);
+      }
+    }
+
+    if(mux_waiting(&far.mux)) mux_flush(&far.mux);
+  }
+
+  crypto_thread_free();
+
+  return NULL;
+}
+
+static FILE* input_stream;
+static FILE* ui_stream;
+
+static void* input_routine(void* arg)
+{
+  input_run(input_stream);
+
+  return NULL;
+}
+
+static void* network_routine(void* arg)
+{
+  sessions_run(CPU_NONE);
+
+  return NULL;
+}
+
+static void* ui_routine(void* arg)
+{
+  ui_run(ui_stream);
+
+  return NULL;
+}
+
+/*
+ * Read a line that the UI thread printed, a byte at a time,
+ * so that nothing is buffered past it
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The UI thread stopped, or the line is too long
+ */
+static int line_read(int fd, char* line, size_t size)
+{
+  for(size_t length = 0; length + 1 < size; length++)
+  {
+    if(read(fd, &line[length], 1) != 1) return 1;
+
+    if(line[length] == '\n')
+    {
+      line[length + 1] = '\0';
+
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Write a line to the input thread, and read the reply of the peer
+ * from the UI thread
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | A round failed
+ */
+static int thread_rounds_run(int input_fd, int ui_fd, long count)
+{
+  char line[256];
+
+  for(long round = 0; round < count; round++)
+  {
+    if(write(input_fd, MESSAGE_TEXT "\n", sizeof(MESSAGE_TEXT)) != sizeof(MESSAGE_TEXT) ||
+       line_read(ui_fd, line, sizeof(line)) != 0 ||
+       strcmp(line, "bob: " MESSAGE_TEXT "\n") != 0)
+    {
+      fprintf(stderr, "bench-alloc: Thread round %ld failed\n", round);
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Join a room on a unix socket, with the peer of the bench in it,
+ * and run the input, network and UI threads of the client, with
+ * rounds of messages through them
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to join the room
+ * - 2 | Failed to start the threads
+ * - 3 | A round failed
+ */
+static int threads_run(long count)
+{
+  int listen_fd = unix_server_socket_create(SOCKET_PATH);
+
+  if(listen_fd < 0) return 1;
+
+  char* addresses[1] = { "unix:" SOCKET_PATH };
+  int   ports[1]     = { 0 };
+  char* rooms[1]     = { NULL };
+
+  // Heartbeats and limits would drop or delay the messages of the rounds
+  session_ping  = 0;
+  session_limit = 0;
+
+  int status = 0;
+
+  if(sign_key_create(&far.key) != 0 ||
+     wrap_key_create(&far_wrap) != 0 ||
+     message_scratch_create(&far.scratch) != 0 ||
+     frame_buffer_create(&far.buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0 ||
+     sessions_join("alice", addresses, ports, rooms, 1) != 0 || session_count != 1 ||
+     (far.fd = accept(listen_fd, NULL, NULL)) == -1 ||
+     mux_init(&far.mux, far.fd, far.key.public) != 0 ||
+     room_buffers_create() != 0)
+  {
+    status = 1;
+  }
+
+  int input_fds[2] = { -1, -1 };
+  int ui_fds[2]    = { -1, -1 };
+
+  if(status == 0 && (pipe(input_fds) != 0 || pipe(ui_fds) != 0 ||
+     !(input_stream = fdopen(input_fds[0], "r")) || !(ui_stream = fdopen(ui_fds[1], "w"))))
+  {
+    status = 1;
+  }
+
+  pthread_t threads[4];
+
+  void* (*routines[4])(void*) = { far_routine, input_routine, network_routine, ui_routine };
+
+  size_t created = 0;
+
+  for(; status == 0 && created < 4; created++)
+  {
+    if(pthread_create(&threads[created], NULL, routines[created], NULL) != 0) status = 2;
+  }
+
+  char line[256];
+
+  // The client shows the peer joining, before it can send to it
+  if(status == 0 && (line_read(ui_fds[0], line, sizeof(line)) != 0 || strcmp(line, "bob joined\n") != 0))
+  {
+    status = 3;
+  }
+
+  if(status == 0) status = thread_rounds_run(input_fds[1], ui_fds[0], WARMUP_COUNT) ? 3 : 0;
+
+  counting = true;
+
+  if(status == 0) status = thread_rounds_run(input_fds[1], ui_fds[0], count) ? 3 : 0;
+
+  counting = false;
+
+  // End of input stops the network thread, which stops the others
+  if(input_fds[1] != -1) close(input_fds[1]);
+
+  if(status != 0 && far.fd > 0) shutdown(far.fd, SHUT_RDWR);
+
+  for(size_t index = 0; index < created; index++) pthread_join(threads[index], NULL);
+
+  if(input_stream) fclose(input_stream);
+  else if(input_fds[0] != -1) close(input_fds[0]);
+
+  if(ui_stream) fclose(ui_stream);
+  else if(ui_fds[1] != -1) close(ui_fds[1]);
+
+  if(ui_fds[0] != -1) close(ui_fds[0]);
+
+  room_buffers_free();
+
+  sessions_free();
+
+  sign_key_free(&far.key);
+
+  wrap_key_free(&far_wrap);
+
+  message_scratch_free(&far.scratch);
+
+  mux_free(&far.mux);
+
+  frame_buffer_free(&far.buffer);
+
+  if(far.fd > 0) close(far.fd);
+
+  close(listen_fd);
+
+  unlink(SOCKET_PATH);
+
+  return status;
+}
+
+/*
+ * Print the allocations of a run, and check them
+ *
+ * A message is sent in one frame in the path run,
+ * and in two in the thread run, since it is sent back
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The run allocated, or libcrypto allocated more than allowed
+ */
+static int allocs_check(const char* run, long count, long frames)
+{
+  size_t path   = atomic_exchange(&path_allocs, 0);
+  size_t crypto = atomic_exchange(&crypto_allocs, 0);
+
+  printf("%-10ld %10zu %14.2f  %s\n", count, path, (double) path / count, run);
+
+  printf("%-10ld %10zu %14.2f  %s libcrypto (exempt)\n", count, crypto, (double) crypto / count, run);
+
+  int status = 0;
+
+  if(path > 0)
+  {
+    fprintf(stderr, "bench-alloc: The %s run allocated %zu times\n", run, path);
+
+    status = 1;
+  }
+
+  if(crypto > (size_t) frames * CRYPTO_ALLOCS_MAX)
+  {
+    fprintf(stderr, "bench-alloc: libcrypto allocated more than %d times a frame in the %s run\n", CRYPTO_ALLOCS_MAX, run);
+
+    status = 1;
+  }
+
+  return status;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  // This must be done before libcrypto allocates anything
+  if(!CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free))
+  {
+    fprintf(stderr, "bench-alloc: Failed to set libcrypto allocator\n");
+
+    return 1;
+  }
+
+  // The sockets of the thread run would print between the rows
+  debug_filter_set(DEBUG_FILTER_NONE);
+
+  long count = (argc >= 2) ? atol(argv[1]) : MESSAGE_COUNT;
+
+  if(count < 1) count = 1;
+
+  if(sides_create() != 0)
+  {
+    fprintf(stderr, "bench-alloc: Failed to create peers\n");
+
+    sides_free();
+
+    return 1;
+  }
+
+  // The first messages create the contexts and the verify cache
+  int status = rounds_run(WARMUP_COUNT);
+
+  counting = true;
+
+  if(status == 0) status = rounds_run(count);
+
+  counting = false;
+
+  sides_free();
+
+  if(status != 0) return 1;
+
+  printf("%-10s %10s %14s\n", "messages", "allocs", "allocs/message");
+
+  status = allocs_check("path", count, count);
+
+  int threads_status = threads_run(count);
+
+  if(threads_status != 0)
+  {
+    fprintf(stderr, "bench-alloc: The thread run failed (%d)\n", threads_status);
+
+    return 1;
+  }
+
+  status |= allocs_check("threads", count, 2 * count);
+
+  return status;
+}
@@ -0,0 +1,573 @@
+/*
+ * bench-attach - check that attachments stream in constant memory
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-attach [MEGABYTES]
+ *
+ * A file of MEGABYTES, by default 64, is sent by SENDER_COUNT peers
+ * at the same time to a reciever, through a relay thread that sends
+ * every whole frame to every other peer, like the relay of a room.
+ * So the chunks of the senders come in between each other on the
+ * attachment stream, and every peer gets the windows of every other.
+ *
+ * The peers use the same calls as the client: attachment_chunk_send
+ * on the sending mux, and mux_frame_recv, data_verify,
+ * attachment_chunk_read and attachment_chunk_store on the recieving
+ * side, which writes every file to the directory of its sender
+ * in ATTACHMENT_DIR.
+ *
+ * The check fails if a recieved file is not the same as the sent one,
+ * or if the most memory of the process grows by more than RSS_GROWTH_MAX
+ * during the transfer, since a chunk at a time should be in memory
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../bunker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define FILE_MEGABYTES   64
+
+#define FILE_NAME        "bench-attach.bin"
+#define FILE_PATH        "/tmp/" FILE_NAME
+
+#define RSS_GROWTH_MAX   (8 * 1024 * 1024)
+
+#define SENDER_COUNT     2
+
+// The reciever is the side after the senders
+#define RECIEVER         SENDER_COUNT
+#define SIDE_COUNT       (SENDER_COUNT + 1)
+
+typedef struct
+{
+  sign_key_t        key;
+  peer_t            peer;    // The reciever, as a sender knows it
+  message_scratch_t scratch;
+  frame_buffer_t    buffer;
+  mux_t             mux;
+  int               fd;
+} side_t;
+
+static side_t sides[SIDE_COUNT];
+
+// The senders, as the reciever knows them
+static peer_t senders[SENDER_COUNT];
+
+// Where the reciever saved the whole file of every sender
+static char saved_paths[SENDER_COUNT][ATTACHMENT_PATH_SIZE];
+
+// The ends of the sockets of the sides, that the relay has
+static int            relay_fds[SIDE_COUNT];
+static frame_buffer_t relay_buffers[SIDE_COUNT];
+
+static atomic_bool relay_running;
+
+// 0 while the files are sent, 1 when they are whole, and 2 on failure
+static atomic_int reciever_status;
+
+/*
+ * Get the most memory that the process has used, in bytes
+ */
+static size_t rss_max_get(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  return (size_t) usage.ru_maxrss * 1024;
+}
+
+/*
+ * Write a file of size bytes, a chunk at a time, where every byte
+ * depends on its offset, so that a chunk in the wrong place is seen
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to write the file
+ */
+static int source_file_create(size_t size)
+{
+  static uint8_t chunk[ATTACHMENT_CHUNK_SIZE];
+
+  remove(FILE_PATH);
+
+  for(size_t offset = 0; offset < size; offset += sizeof(chunk))
+  {
+    size_t length = (size - offset < sizeof(chunk)) ? size - offset : sizeof(chunk);
+
+    for(size_t index = 0; index < length; index++)
+    {
+      size_t position = offset + index;
+
+      chunk[index] = (position * 2654435761U) >> 13;
+    }
+
+    if(file_chunk_write(chunk, length, FILE_PATH, offset) != length) return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Compare a recieved file with the sent one, a chunk at a time
+ *
+ * RETURN (bool is_same)
+ */
+static bool files_compare(const char* path, size_t size)
+{
+  static uint8_t chunks[2][ATTACHMENT_CHUNK_SIZE];
+
+  if(file_size_get(path) != size) return false;
+
+  for(size_t offset = 0; offset < size; offset += ATTACHMENT_CHUNK_SIZE)
+  {
+    size_t length = (size - offset < ATTACHMENT_CHUNK_SIZE) ? size - offset : ATTACHMENT_CHUNK_SIZE;
+
+    if(file_chunk_read(chunks[0], length, FILE_PATH, offset) != length ||
+       file_chunk_read(chunks[1], length, path, offset) != length ||
+       memcmp(chunks[0], chunks[1], length) != 0) return false;
+  }
+
+  return true;
+}
+
+/*
+ * Remove a recieved file, and the directories of its sender
+ */
+static void saved_file_remove(const char* path)
+{
+  char dir[ATTACHMENT_PATH_SIZE + 7];
+
+  snprintf(dir, sizeof(dir), "%s", path);
+
+  char* slash = strrchr(dir, '/');
+
+  remove(path);
+
+  if(!slash) return;
+
+  strcpy(slash, "/.parts");
+
+  rmdir(dir);
+
+  *slash = '\0';
+
+  rmdir(dir);
+}
+
+/*
+ * Stop the transfer when something failed, if it is not over,
+ * and wake the reciever, which would wait for chunks that never come
+ */
+static void transfer_fail(void)
+{
+  int expected = 0;
+
+  if(atomic_compare_exchange_strong(&reciever_status, &expected, 2))
+  {
+    shutdown(sides[RECIEVER].fd, SHUT_RDWR);
+  }
+}
+
+/*
+ * Send a whole frame that the relay got from one side to every other side
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to write to a side
+ */
+static int relay_frame_send(size_t from, const frame_t* frame)
+{
+  uint8_t head[FRAME_HEAD_SIZE];
+
+  frame_head_write(head, frame->type, frame->flags, frame->stream, frame->size);
+
+  for(size_t index = 0; index < SIDE_COUNT; index++)
+  {
+    if(index == from) continue;
+
+    if(socket_write(relay_fds[index], (char*) head, FRAME_HEAD_SIZE) != FRAME_HEAD_SIZE ||
+       socket_write(relay_fds[index], (char*) frame->data, frame->size) != frame->size) return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Send the frames of every side to every other side,
+ * whole and in the order that they came in
+ */
+static void* relay_routine(void* arg)
+{
+  frame_t frames[64];
+
+  while(atomic_load(&relay_running))
+  {
+    struct pollfd fds[SIDE_COUNT];
+
+    int timeout = 10;
+
+    for(size_t index = 0; index < SIDE_COUNT; index++)
+    {
+      fds[index] = (struct pollfd) { .fd = relay_fds[index], .events = POLLIN };
+
+      // Frames that were read, but not parsed
+      if(frames_waiting(&relay_buffers[index])) timeout = 0;
+    }
+
+    if(poll(fds, SIDE_COUNT, timeout) < 0) continue;
+
+    for(size_t index = 0; index < SIDE_COUNT; index++)
+    {
+      if(!(fds[index].revents & POLLIN) && !frames_waiting(&relay_buffers[index])) continue;
+
+      ssize_t count = frames_recv(relay_fds[index], &relay_buffers[index], frames, 64);
+
+      // The side is gone, and is not polled anymore
+      if(count == 0 || count == -1 || count == -2) relay_fds[index] = -1;
+
+      for(ssize_t frame = 0; frame < count; frame++)
+      {
+        if(relay_frame_send(index, &frames[frame]) != 0) transfer_fail();
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Handle a whole file frame, like the client does
+ *
+ * RETURN (int status)
+ * - 0 | Success, the attachment is not whole yet
+ * - 1 | Success, and the attachment is whole
+ * - 2 | Failed to verify, read or store the chunk
+ */
+static int file_frame_handle(side_t* reciever, const frame_t* frame)
+{
+  frame_sign_t sign;
+
+  if(frame->type != FRAME_FILE || frame_sign_get(&sign, frame) != 0) return 2;
+
+  if(data_verify(sign.sign, sign.public, sign.digest, DIGEST_SIZE) != 0) return 2;
+
+  peer_t* sender = peer_get(senders, SENDER_COUNT, sign.public);
+
+  if(!sender) return 2;
+
+  attachment_chunk_t chunk;
+
+  if(attachment_chunk_read(&chunk, &reciever->scratch, sign.data, sign.size, sender, reciever->key.public) != 0) return 2;
+
+  int status = attachment_chunk_store(saved_paths[sender - senders], &chunk);
+
+  return (status == 0 || status == 1) ? status : 2;
+}
+
+/*
+ * Read the frames of the senders, until every attachment is whole
+ *
+ * The mux of the reciever grants every sender its window
+ * as it reads the chunks of that sender
+ */
+static void* reciever_routine(void* arg)
+{
+  side_t* reciever = &sides[RECIEVER];
+
+  frame_t frames[64];
+
+  size_t whole = 0;
+
+  while(atomic_load(&reciever_status) == 0)
+  {
+    ssize_t count = frames_recv(reciever->fd, &reciever->buffer, frames, 64);
+
+    if(count == -3) continue;
+
+    if(count <= 0)
+    {
+      transfer_fail();
+
+      break;
+    }
+
+    for(ssize_t index = 0; atomic_load(&reciever_status) == 0 && index < count; index++)
+    {
+      int mux_status = mux_frame_recv(&reciever->mux, &frames[index]);
+
+      if(mux_status == -1) transfer_fail();
+
+      if(mux_status != 0 && mux_status != 2) continue;
+
+      int frame_status = file_frame_handle(reciever, &frames[index]);
+
+      if(frame_status == 1 && ++whole == SENDER_COUNT) atomic_store(&reciever_status, 1);
+
+      if(frame_status == 2) transfer_fail();
+    }
+
+    if(mux_waiting(&reciever->mux) && mux_flush(&reciever->mux) < 0) transfer_fail();
+  }
+
+  return NULL;
+}
+
+/*
+ * Send the attachment of a sender, with ATTACHMENT_QUEUED chunks waiting
+ * in the mux, like the network thread of the client
+ *
+ * The sender also gets the chunks of the other senders from the relay,
+ * and grants them windows, like every peer of a room
+ */
+static void* sender_routine(void* arg)
+{
+  side_t* sender = arg;
+
+  attachment_t attachment;
+
+  bool is_open = (attachment_open(&attachment, FILE_PATH, 0) == 0);
+
+  int status = is_open ? 0 : 1;
+
+  mux_stream_open(&sender->mux, ATTACHMENT_STREAM, FRAME_PRIORITY_BULK);
+
+  frame_t frames[64];
+
+  while(status == 0 && atomic_load(&reciever_status) == 0)
+  {
+    while(attachment.offset < attachment.size && mux_stream_queued(&sender->mux, ATTACHMENT_STREAM) < ATTACHMENT_QUEUED)
+    {
+      if(attachment_chunk_send(&sender->mux, &sender->scratch, &sender->key, &attachment, &sender->peer, 1) != 0)
+      {
+        status = 2;
+
+        break;
+      }
+    }
+
+    struct pollfd fd = { .fd = sender->fd, .events = POLLIN | (mux_waiting(&sender->mux) ? POLLOUT : 0) };
+
+    int timeout = frames_waiting(&sender->buffer) ? 0 : 10;
+
+    if(poll(&fd, 1, timeout) < 0) continue;
+
+    if((fd.revents & POLLOUT) && mux_flush(&sender->mux) < 0) status = 2;
+
+    // The windows of the other peers, and the chunks of the other senders
+    if((fd.revents & POLLIN) || frames_waiting(&sender->buffer))
+    {
+      ssize_t count = frames_recv(sender->fd, &sender->buffer, frames, 64);
+
+      for(ssize_t index = 0; index < count; index++) mux_frame_recv(&sender->mux, &frames[index]);
+    }
+  }
+
+  if(is_open) attachment_close(&attachment);
+
+  if(status != 0) transfer_fail();
+
+  return NULL;
+}
+
+/*
+ * Create the keys, buffers and sockets of every side, and the secret
+ * that every sender shares with the reciever
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed
+ */
+static int sides_create(void)
+{
+  for(size_t index = 0; index < SIDE_COUNT; index++)
+  {
+    side_t* side = &sides[index];
+
+    int fds[2];
+
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return 1;
+
+    side->fd = fds[0];
+
+    relay_fds[index] = fds[1];
+
+    if(sign_key_create(&side->key) != 0 ||
+       message_scratch_create(&side->scratch) != 0 ||
+       frame_buffer_create(&side->buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0 ||
+       frame_buffer_create(&relay_buffers[index], FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0 ||
+       mux_init(&side->mux, side->fd, side->key.public) != 0)
+    {
+      return 1;
+    }
+  }
+
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    uint8_t secret[SECRET_SIZE];
+
+    if(secret_create(secret) != 0) return 1;
+
+    sides[index].peer.name = "bob";
+
+    memcpy(sides[index].peer.secret, secret, SECRET_SIZE);
+    memcpy(sides[index].peer.public, sides[RECIEVER].key.public, SIGN_PUBLIC_SIZE);
+
+    senders[index].name = (index == 0) ? "alice" : "carol";
+
+    memcpy(senders[index].secret, secret, SECRET_SIZE);
+    memcpy(senders[index].public, sides[index].key.public, SIGN_PUBLIC_SIZE);
+  }
+
+  return 0;
+}
+
+/*
+ * Free the keys, buffers and sockets of every side
+ */
+static void sides_free(void)
+{
+  for(size_t index = 0; index < SIDE_COUNT; index++)
+  {
+    side_t* side = &sides[index];
+
+    sign_key_free(&side->key);
+
+    message_scratch_free(&side->scratch);
+
+    mux_free(&side->mux);
+
+    frame_buffer_free(&side->buffer);
+
+    frame_buffer_free(&relay_buffers[index]);
+
+    if(side->fd > 0) close(side->fd);
+
+    if(relay_fds[index] > 0) close(relay_fds[index]);
+  }
+
+  crypto_thread_free();
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  long megabytes = (argc >= 2) ? atol(argv[1]) : FILE_MEGABYTES;
+
+  if(megabytes < 1) megabytes = FILE_MEGABYTES;
+
+  size_t size = (size_t) megabytes * 1024 * 1024;
+
+  if(source_file_create(size) != 0)
+  {
+    fprintf(stderr, "bench-attach: Failed to create %s\n", FILE_PATH);
+
+    return 1;
+  }
+
+  if(sides_create() != 0)
+  {
+    fprintf(stderr, "bench-attach: Failed to create peers\n");
+
+    sides_free();
+
+    return 1;
+  }
+
+  size_t rss_start = rss_max_get();
+
+  uint64_t start = hist_time_get();
+
+  atomic_store(&relay_running, true);
+
+  pthread_t relay_thread;
+  pthread_t reciever_thread;
+  pthread_t sender_threads[SENDER_COUNT];
+
+  pthread_create(&relay_thread, NULL, relay_routine, NULL);
+
+  pthread_create(&reciever_thread, NULL, reciever_routine, NULL);
+
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    pthread_create(&sender_threads[index], NULL, sender_routine, &sides[index]);
+  }
+
+  // The senders go on until the reciever has every file
+  pthread_join(reciever_thread, NULL);
+
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    pthread_join(sender_threads[index], NULL);
+  }
+
+  atomic_store(&relay_running, false);
+
+  // The relay may wait to write to a side that doesn't read anymore
+  for(size_t index = 0; index < SIDE_COUNT; index++)
+  {
+    shutdown(sides[index].fd, SHUT_RDWR);
+  }
+
+  pthread_join(relay_thread, NULL);
+
+  double elapsed = (hist_time_get() - start) / 1e9;
+
+  size_t rss_growth = rss_max_get() - rss_start;
+
+  sides_free();
+
+  if(atomic_load(&reciever_status) != 1)
+  {
+    fprintf(stderr, "bench-attach: Transfer failed\n");
+
+    return 1;
+  }
+
+  int status = 0;
+
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    if(!files_compare(saved_paths[index], size))
+    {
+      fprintf(stderr, "bench-attach: The file of %s is not the sent one\n", senders[index].name);
+
+      status = 1;
+    }
+
+    saved_file_remove(saved_paths[index]);
+  }
+
+  remove(FILE_PATH);
+
+  printf("%-10s %10s %10s %12s\n", "MB", "senders", "MB/s", "rss growth kB");
+
+  printf("%-10ld %10d %10.1f %12zu\n", megabytes, SENDER_COUNT, megabytes * SENDER_COUNT / elapsed, rss_growth / 1024);
+
+  if(rss_growth > RSS_GROWTH_MAX)
+  {
+    fprintf(stderr, "bench-attach: Memory grew by %zu kB\n", rss_growth / 1024);
+
+    status = 1;
+  }
+
+  return status;
+}
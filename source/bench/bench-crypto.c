@@ -0,0 +1,465 @@
+/*
+ * bench-crypto - benchmark of the crypto steps
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-crypto [THRESHOLDS]
+ *
+ * THRESHOLDS is a csv file with lines of "name,ns,baseline",
+ * and the benchmark fails if a step takes more ns/op than ns.
+ * The baseline is the recorded time that ns is set from
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../crypto.h"
+#include "../file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Every step is run in BENCH_ROUNDS rounds of at least BENCH_TIME seconds,
+ * and the fastest round counts, so that a busy host doesn't fail the step
+ */
+#define BENCH_TIME    0.05
+#define BENCH_ROUNDS  10
+
+#define MESSAGE_SIZE  64
+#define MESSAGE_MAX   16384
+#define SENDER_COUNT  4
+#define MEMBER_COUNT  16
+
+typedef struct
+{
+  const char* name;
+  int       (*routine)(size_t size);
+  size_t      size;
+  size_t      ops;   // Operations done by one call to routine
+} bench_t;
+
+typedef struct
+{
+  char*  name;
+  double ns;
+} threshold_t;
+
+static sign_key_t keys[SENDER_COUNT];
+
+static wrap_key_t wrap_keys[2];
+
+static uint8_t secrets[MEMBER_COUNT * SECRET_SIZE];
+static uint8_t wraps[MEMBER_COUNT * WRAP_SIZE];
+static uint8_t group_key[SECRET_SIZE];
+
+static uint8_t message_key[SECRET_SIZE];
+static uint8_t message_wrap[WRAP_SIZE];
+
+static uint8_t messages[SENDER_COUNT][MESSAGE_SIZE];
+static uint8_t signs[SENDER_COUNT][SIGN_SIZE];
+
+static uint8_t plain[MESSAGE_MAX];
+static uint8_t cipher[MESSAGE_MAX + AEAD_EXTRA_SIZE];
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Get the cycle counter, or 0 if there is none
+ */
+static uint64_t cycles_get(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int sign_keygen_bench(size_t size)
+{
+  sign_key_t key;
+
+  if(sign_key_create(&key) != 0) return 1;
+
+  sign_key_free(&key);
+
+  return 0;
+}
+
+static int wrap_keygen_bench(size_t size)
+{
+  wrap_key_t key;
+
+  if(wrap_key_create(&key) != 0) return 1;
+
+  wrap_key_free(&key);
+
+  return 0;
+}
+
+static int wrap_secret_bench(size_t size)
+{
+  uint8_t secret[SECRET_SIZE];
+
+  return wrap_secret_create(secret, &wrap_keys[0], wrap_keys[1].public);
+}
+
+static int key_wrap_bench(size_t size)
+{
+  return key_wrap(message_wrap, message_key, secrets);
+}
+
+static int key_unwrap_bench(size_t size)
+{
+  uint8_t key[SECRET_SIZE];
+
+  return key_unwrap(key, message_wrap, secrets);
+}
+
+static int encrypt_bench(size_t size)
+{
+  return data_encrypt(cipher, message_key, plain, size);
+}
+
+/*
+ * The cipher text is created once per size, before the decrypt step
+ */
+static int decrypt_bench(size_t size)
+{
+  return data_decrypt(plain, message_key, cipher, size + AEAD_EXTRA_SIZE);
+}
+
+static int sign_bench(size_t size)
+{
+  return data_sign(signs[0], &keys[0], messages[0], size);
+}
+
+/*
+ * The senders take turns, like the frames of a room do,
+ * so that the keys are looked up in the cache of the thread
+ */
+static int verify_bench(size_t size)
+{
+  static size_t sender = 0;
+
+  sender = (sender + 1) % SENDER_COUNT;
+
+  return data_verify(signs[sender], keys[sender].public, messages[sender], size);
+}
+
+static int group_rekey_bench(size_t size)
+{
+  return group_rekey(group_key, wraps, secrets, size);
+}
+
+static bench_t benches[] =
+{
+  { "sign-keygen",   sign_keygen_bench,  0,            1 },
+  { "wrap-keygen",   wrap_keygen_bench,  0,            1 },
+  { "wrap-secret",   wrap_secret_bench,  0,            1 },
+  { "key-wrap",      key_wrap_bench,     0,            1 },
+  { "key-unwrap",    key_unwrap_bench,   0,            1 },
+  { "encrypt-64",    encrypt_bench,      64,           1 },
+  { "decrypt-64",    decrypt_bench,      64,           1 },
+  { "encrypt-1024",  encrypt_bench,      1024,         1 },
+  { "decrypt-1024",  decrypt_bench,      1024,         1 },
+  { "encrypt-16384", encrypt_bench,      16384,        1 },
+  { "decrypt-16384", decrypt_bench,      16384,        1 },
+  { "sign",          sign_bench,         MESSAGE_SIZE, 1 },
+  { "verify",        verify_bench,       MESSAGE_SIZE, 1 },
+  { "group-rekey",   group_rekey_bench,  MEMBER_COUNT, 1 }
+};
+
+/*
+ * Create the keys and data that the steps use
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create keys
+ */
+static int bench_data_create(void)
+{
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    if(sign_key_create(&keys[index]) != 0) return 1;
+  }
+
+  if(wrap_key_create(&wrap_keys[0]) != 0) return 1;
+
+  if(wrap_key_create(&wrap_keys[1]) != 0) return 1;
+
+  for(size_t index = 0; index < MEMBER_COUNT; index++)
+  {
+    if(secret_create(secrets + index * SECRET_SIZE) != 0) return 1;
+  }
+
+  if(secret_create(message_key) != 0) return 1;
+
+  if(key_wrap(message_wrap, message_key, secrets) != 0) return 1;
+
+  for(size_t index = 0; index < sizeof(plain); index++)
+  {
+    plain[index] = rand();
+  }
+
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    memcpy(messages[index], plain + index, MESSAGE_SIZE);
+
+    if(data_sign(signs[index], &keys[index], messages[index], MESSAGE_SIZE) != 0) return 1;
+  }
+
+  return 0;
+}
+
+/*
+ *
+ */
+static void bench_data_free(void)
+{
+  for(size_t index = 0; index < SENDER_COUNT; index++)
+  {
+    sign_key_free(&keys[index]);
+  }
+
+  wrap_key_free(&wrap_keys[0]);
+
+  wrap_key_free(&wrap_keys[1]);
+}
+
+/*
+ * Run the step in rounds, and get the time of the fastest round
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The step failed
+ */
+static int bench_run(const bench_t* bench, double* ns, double* cycles)
+{
+  // The decrypt steps need cipher text of the right size
+  if(bench->routine == decrypt_bench)
+  {
+    if(encrypt_bench(bench->size) != 0) return 1;
+  }
+
+  // Warm up
+  if(bench->routine(bench->size) != 0) return 1;
+
+  *ns = 0;
+
+  for(size_t round = 0; round < BENCH_ROUNDS; round++)
+  {
+    size_t count = 0;
+
+    double   start_time   = time_get();
+    uint64_t start_cycles = cycles_get();
+
+    double elapsed;
+
+    do
+    {
+      if(bench->routine(bench->size) != 0) return 1;
+
+      count++;
+
+      elapsed = time_get() - start_time;
+    }
+    while(elapsed < BENCH_TIME * 1e9);
+
+    uint64_t end_cycles = cycles_get();
+
+    size_t ops = count * bench->ops;
+
+    if(*ns == 0 || elapsed / ops < *ns)
+    {
+      *ns     = elapsed / ops;
+      *cycles = (double) (end_cycles - start_cycles) / ops;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Load the thresholds file
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to read file
+ */
+static int thresholds_load(threshold_t** thresholds, size_t* count, const char* filepath)
+{
+  *thresholds = NULL;
+  *count = 0;
+
+  size_t file_size = file_size_get(filepath);
+
+  if(file_size == 0) return 1;
+
+  char* buffer = malloc(sizeof(char) * (file_size + 1));
+
+  if(!buffer) return 1;
+
+  if(file_read(buffer, file_size, filepath) != file_size)
+  {
+    free(buffer);
+
+    return 1;
+  }
+
+  buffer[file_size] = '\0';
+
+  char* save;
+
+  for(char* line = strtok_r(buffer, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+  {
+    char* comma = strchr(line, ',');
+
+    if(line[0] == '#' || !comma) continue;
+
+    *comma = '\0';
+
+    threshold_t* new_thresholds = realloc(*thresholds, sizeof(threshold_t) * (*count + 1));
+
+    if(!new_thresholds) break;
+
+    *thresholds = new_thresholds;
+
+    (*thresholds)[*count] = (threshold_t) { strdup(line), atof(comma + 1) };
+
+    (*count)++;
+  }
+
+  free(buffer);
+
+  return 0;
+}
+
+/*
+ *
+ */
+static void thresholds_free(threshold_t** thresholds, size_t count)
+{
+  for(size_t index = 0; index < count; index++)
+  {
+    free((*thresholds)[index].name);
+  }
+
+  free(*thresholds);
+
+  *thresholds = NULL;
+}
+
+/*
+ * Get the threshold of a step
+ *
+ * RETURN (double ns)
+ * - 0 | The step has no threshold
+ */
+static double threshold_get(const threshold_t* thresholds, size_t count, const char* name)
+{
+  for(size_t index = 0; index < count; index++)
+  {
+    if(strcmp(thresholds[index].name, name) == 0) return thresholds[index].ns;
+  }
+
+  return 0;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  threshold_t* thresholds = NULL;
+  size_t       threshold_count = 0;
+
+  if(argc >= 2 && thresholds_load(&thresholds, &threshold_count, argv[1]) != 0)
+  {
+    fprintf(stderr, "bench-crypto: Failed to read thresholds: %s\n", argv[1]);
+
+    return 1;
+  }
+
+  if(bench_data_create() != 0)
+  {
+    fprintf(stderr, "bench-crypto: Failed to create keys\n");
+
+    bench_data_free();
+
+    thresholds_free(&thresholds, threshold_count);
+
+    return 1;
+  }
+
+  int status = 0;
+
+  printf("%-16s %12s %12s %12s %12s\n", "step", "ns/op", "cycles/op", "op/s", "max ns/op");
+
+  for(size_t index = 0; index < sizeof(benches) / sizeof(bench_t); index++)
+  {
+    const bench_t* bench = &benches[index];
+
+    double ns, cycles;
+
+    if(bench_run(bench, &ns, &cycles) != 0)
+    {
+      printf("%-16s FAILED\n", bench->name);
+
+      status = 1;
+
+      continue;
+    }
+
+    double limit = threshold_get(thresholds, threshold_count, bench->name);
+
+    // A step over its limit is run once more, in case the host was busy
+    double again_ns, again_cycles;
+
+    if(limit > 0 && ns > limit && bench_run(bench, &again_ns, &again_cycles) == 0 && again_ns < ns)
+    {
+      ns     = again_ns;
+      cycles = again_cycles;
+    }
+
+    printf("%-16s %12.0f %12.0f %12.0f %12.0f", bench->name, ns, cycles, 1e9 / ns, limit);
+
+    if(limit > 0 && ns > limit)
+    {
+      printf("  REGRESSION");
+
+      status = 1;
+    }
+
+    printf("\n");
+  }
+
+  bench_data_free();
+
+  thresholds_free(&thresholds, threshold_count);
+
+  return status;
+}
@@ -0,0 +1,173 @@
+/*
+ * bench-format - benchmark of format.h against snprintf
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * Every format is printed by both, and the benchmark
+ * fails if the strings are not the same
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The minimum time that every format is run for
+ */
+#define BENCH_TIME 0.2
+
+/*
+ * The messages in the repo are shorter than this
+ */
+#define STRING_SIZE 256
+
+typedef struct
+{
+  const char* name;
+  int       (*routine)(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index);
+} bench_t;
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+static int room_line_bench(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index)
+{
+  return print(string, size, "%s,%s:%d", "room", "127.0.0.1", 5555 + index);
+}
+
+static int socket_bench(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index)
+{
+  return print(string, size, "Connected socket (%s:%d)", "192.168.100.200", index);
+}
+
+static int debug_line_bench(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index)
+{
+  return print(string, size, "[%s] [ %s ]: %s\n", "12:34:56.78", "INFO ", "Received 64 frames");
+}
+
+static int integers_bench(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index)
+{
+  return print(string, size, "%d %ld %lld %zu", -index, 1234567L * index, -9876543210LL * index, (size_t) index);
+}
+
+static int cut_bench(int (*print)(char*, size_t, const char*, ...), char* string, size_t size, int index)
+{
+  return print(string, 16, "Dropped %lu messages", (unsigned long) index * 1000003);
+}
+
+static bench_t benches[] =
+{
+  { "room-line",  room_line_bench  },
+  { "socket",     socket_bench     },
+  { "debug-line", debug_line_bench },
+  { "integers",   integers_bench   },
+  { "cut",        cut_bench        }
+};
+
+/*
+ * Run the format with the print function until BENCH_TIME has passed
+ *
+ * RETURN (double ns)
+ * - Nanoseconds per print
+ */
+static double bench_run(const bench_t* bench, int (*print)(char*, size_t, const char*, ...))
+{
+  char string[STRING_SIZE];
+
+  size_t count = 0;
+
+  double start = time_get();
+  double elapsed;
+
+  do
+  {
+    for(int index = 0; index < 1000; index++)
+    {
+      bench->routine(print, string, sizeof(string), index);
+    }
+
+    count += 1000;
+
+    elapsed = time_get() - start;
+  }
+  while(elapsed < BENCH_TIME * 1e9);
+
+  return elapsed / count;
+}
+
+/*
+ * Check that the format gives the same string and length as snprintf
+ *
+ * RETURN (int status)
+ * - 0 | The strings are the same
+ * - 1 | The strings are not the same
+ */
+static int bench_check(const bench_t* bench)
+{
+  char format_string_buffer[STRING_SIZE];
+  char snprintf_buffer[STRING_SIZE];
+
+  for(int index = 0; index < 1000; index += 7)
+  {
+    int format_length   = bench->routine(format_string, format_string_buffer, sizeof(format_string_buffer), index);
+    int snprintf_length = bench->routine(snprintf, snprintf_buffer, sizeof(snprintf_buffer), index);
+
+    if(format_length != snprintf_length || strcmp(format_string_buffer, snprintf_buffer) != 0)
+    {
+      fprintf(stderr, "bench-format: %s: \"%s\" is not \"%s\"\n", bench->name, format_string_buffer, snprintf_buffer);
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  int status = 0;
+
+  printf("%-16s %12s %12s %12s\n", "format", "format ns", "snprintf ns", "speedup");
+
+  for(size_t index = 0; index < sizeof(benches) / sizeof(bench_t); index++)
+  {
+    const bench_t* bench = &benches[index];
+
+    if(bench_check(bench) != 0)
+    {
+      printf("%-16s FAILED\n", bench->name);
+
+      status = 1;
+
+      continue;
+    }
+
+    double format_ns   = bench_run(bench, format_string);
+    double snprintf_ns = bench_run(bench, snprintf);
+
+    printf("%-16s %12.1f %12.1f %11.2fx\n", bench->name, format_ns, snprintf_ns, snprintf_ns / format_ns);
+  }
+
+  return status;
+}
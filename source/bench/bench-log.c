@@ -0,0 +1,104 @@
+/*
+ * bench-log - benchmark of the debug messages
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * Only the time of the calling thread is measured,
+ * the writer thread writes the messages to /dev/null
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+// Every message is measured, none is suppressed
+#define DEBUG_RATE_MAX 0
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define ROUND_COUNT 200
+#define EVENT_COUNT 500
+
+/*
+ * Nanoseconds to let the writer thread empty the ring between rounds
+ */
+#define ROUND_SLEEP 5000000
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Print messages like the ones in socket.c
+ *
+ * RETURN (double ns)
+ * - Nanoseconds per message
+ */
+static double messages_bench(void)
+{
+  struct timespec sleep = { 0, ROUND_SLEEP };
+
+  double elapsed = 0;
+
+  for(int round = 0; round < ROUND_COUNT; round++)
+  {
+    double start = time_get();
+
+    for(int index = 0; index < EVENT_COUNT; index++)
+    {
+      info_print("Connected socket (%s:%d)", "127.0.0.1", index);
+    }
+
+    elapsed += time_get() - start;
+
+    nanosleep(&sleep, NULL);
+  }
+
+  return elapsed / (ROUND_COUNT * EVENT_COUNT);
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  if(debug_file_open("/dev/null") != 0)
+  {
+    fprintf(stderr, "bench-log: Failed to open /dev/null\n");
+
+    return 1;
+  }
+
+  double text_ns = messages_bench();
+
+  if(debug_binary_open("/dev/null") != 0)
+  {
+    fprintf(stderr, "bench-log: Failed to open /dev/null\n");
+
+    return 1;
+  }
+
+  double binary_ns = messages_bench();
+
+  debug_file_close();
+
+  printf("%-16s %12s\n", "mode", "ns/message");
+  printf("%-16s %12.1f\n", "text", text_ns);
+  printf("%-16s %12.1f\n", "binary", binary_ns);
+
+  return 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * bench-message - check the encrypted message format, and time it
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-message
+ *
+ * The text of a message is encrypted with AES-256-GCM under a new
+ * message key, and the message key is wrapped for every recipient,
+ * with the secret that the sender shares with them from X25519 and HKDF.
+ * The recipients are the peers that the sender knows, and a message
+ * is signed by the sender, like every other frame
+ *
+ * The checks fail if
+ * - a recipient can't read the text, with 1, 16 and PEERS_MAX recipients
+ * - a peer that is not a recipient can read it
+ * - a recipient with another secret can read it
+ * - a message with any byte changed, or cut short, is read
+ * - the same text is encrypted the same twice
+ *
+ * Then message_create and message_read are timed for every number
+ * of recipients, where the reader is the last recipient
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../bunker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The minimum time that every step is run for
+ */
+#define BENCH_TIME   0.2
+
+#define MESSAGE_TEXT "The quick brown fox jumps over the lazy dog, every time"
+
+// The recipients, as the sender knows them
+static peer_t peers[PEERS_MAX];
+
+// The sender, as every recipient knows it
+static peer_t senders[PEERS_MAX];
+
+static uint8_t bodies[2][MESSAGE_SCRATCH_SIZE];
+
+static char text[MESSAGE_SCRATCH_SIZE];
+
+/*
+ * Create the keys of the sender and of every recipient,
+ * and the secret that the sender shares with each of them,
+ * from both sides
+ *
+ * The public signing keys of the recipients are only used
+ * to find their wraps, so they are random bytes
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create the keys, or the secrets are not the same
+ */
+static int peers_create(void)
+{
+  wrap_key_t sender;
+
+  if(wrap_key_create(&sender) != 0) return 1;
+
+  int status = 0;
+
+  for(size_t index = 0; status == 0 && index < PEERS_MAX; index++)
+  {
+    wrap_key_t recipient;
+
+    if(wrap_key_create(&recipient) != 0)
+    {
+      status = 1;
+
+      break;
+    }
+
+    if(secret_create(peers[index].public) != 0 ||
+       wrap_secret_create(peers[index].secret, &sender, recipient.public) != 0 ||
+       wrap_secret_create(senders[index].secret, &recipient, sender.public) != 0 ||
+       memcmp(peers[index].secret, senders[index].secret, SECRET_SIZE) != 0)
+    {
+      status = 1;
+    }
+
+    peers[index].name   = "recipient";
+    senders[index].name = "sender";
+
+    wrap_key_free(&recipient);
+  }
+
+  wrap_key_free(&sender);
+
+  return status;
+}
+
+/*
+ * Create a message of MESSAGE_TEXT for count recipients
+ *
+ * RETURN (same as message_create)
+ */
+static int body_create(uint8_t* body, size_t* size, size_t count)
+{
+  return message_create(body, size, MESSAGE_SCRATCH_SIZE, MESSAGE_TEXT, sizeof(MESSAGE_TEXT) - 1, peers, count);
+}
+
+/*
+ * Read a message as a recipient, with the public key of the recipient
+ * and the secret of another, which are the same for a real recipient
+ *
+ * RETURN (same as message_read)
+ */
+static int body_read(const uint8_t* body, size_t size, size_t recipient, size_t secret)
+{
+  size_t length;
+
+  int status = message_read(text, &length, sizeof(text), body, size, &senders[secret], peers[recipient].public);
+
+  if(status == 0 && (length != sizeof(MESSAGE_TEXT) - 1 || strcmp(text, MESSAGE_TEXT) != 0)) return 5;
+
+  return status;
+}
+
+/*
+ * Check that every recipient reads the text,
+ * and that the peers after them can't
+ */
+static bool recipients_check(size_t count)
+{
+  size_t size;
+
+  if(body_create(bodies[0], &size, count) != 0) return false;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    if(body_read(bodies[0], size, index, index) != 0) return false;
+  }
+
+  for(size_t index = count; index < PEERS_MAX; index++)
+  {
+    if(body_read(bodies[0], size, index, index) != 2) return false;
+  }
+
+  return true;
+}
+
+/*
+ * Check that a recipient with the secret of another peer can't read the text
+ */
+static bool secret_check(void)
+{
+  size_t size;
+
+  if(body_create(bodies[0], &size, 2) != 0) return false;
+
+  return body_read(bodies[0], size, 0, 1) == 3 && body_read(bodies[0], size, 1, 0) == 3;
+}
+
+/*
+ * Check that a message with any bit of a byte flipped, or cut short,
+ * is not read, which covers the count, the ids, the wraps, the nonce,
+ * the cipher and the tag
+ */
+static bool tamper_check(void)
+{
+  size_t size;
+
+  if(body_create(bodies[0], &size, 1) != 0) return false;
+
+  for(size_t index = 0; index < size; index++)
+  {
+    for(int bit = 0; bit < 8; bit++)
+    {
+      memcpy(bodies[1], bodies[0], size);
+
+      bodies[1][index] ^= 1 << bit;
+
+      if(body_read(bodies[1], size, 0, 0) == 0) return false;
+    }
+  }
+
+  for(size_t cut = 0; cut < size; cut++)
+  {
+    if(body_read(bodies[0], cut, 0, 0) == 0) return false;
+  }
+
+  return body_read(bodies[0], size, 0, 0) == 0;
+}
+
+/*
+ * Check that the same text is never encrypted the same,
+ * since every message has a new key and nonces
+ */
+static bool fresh_check(void)
+{
+  size_t sizes[2];
+
+  if(body_create(bodies[0], &sizes[0], 1) != 0 || body_create(bodies[1], &sizes[1], 1) != 0) return false;
+
+  size_t head_size = 1 + PEER_ID_SIZE;
+
+  // The wraps, and the nonce and cipher of the text, are after the id
+  return sizes[0] == sizes[1] && memcmp(bodies[0] + head_size, bodies[1] + head_size, sizes[0] - head_size) != 0;
+}
+
+/*
+ * Run the checks, and print the result of each
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | A check failed
+ */
+static int checks_run(void)
+{
+  struct
+  {
+    const char* name;
+    bool        is_passed;
+  } checks[] =
+  {
+    { "1 recipient",     recipients_check(1) },
+    { "16 recipients",   recipients_check(16) },
+    { "255 recipients",  recipients_check(PEERS_MAX) },
+    { "other secret",    secret_check() },
+    { "tamper and cut",  tamper_check() },
+    { "new key",         fresh_check() }
+  };
+
+  int status = 0;
+
+  for(size_t index = 0; index < sizeof(checks) / sizeof(*checks); index++)
+  {
+    printf("%-16s %s\n", checks[index].name, checks[index].is_passed ? "ok" : "FAILED");
+
+    if(!checks[index].is_passed) status = 1;
+  }
+
+  return status;
+}
+
+/*
+ * Time message_create and message_read for count recipients
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | A message failed
+ */
+static int count_bench(size_t count)
+{
+  double ns[2];
+
+  size_t size;
+
+  for(int step = 0; step < 2; step++)
+  {
+    uint64_t start = hist_time_get();
+    uint64_t now   = start;
+
+    size_t ops = 0;
+
+    for(; now - start < BENCH_TIME * 1e9; ops++, now = hist_time_get())
+    {
+      int status = (step == 0) ? body_create(bodies[0], &size, count) :
+        body_read(bodies[0], size, count - 1, count - 1);
+
+      if(status != 0) return 1;
+    }
+
+    ns[step] = (double) (now - start) / ops;
+  }
+
+  printf("%-12zu %12zu %12.0f %12.0f\n", count, size, ns[0], ns[1]);
+
+  return 0;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  if(peers_create() != 0)
+  {
+    fprintf(stderr, "bench-message: Failed to create keys\n");
+
+    return 1;
+  }
+
+  int status = checks_run();
+
+  printf("\n%-12s %12s %12s %12s\n", "recipients", "bytes", "create ns", "read ns");
+
+  size_t counts[] = { 1, 16, PEERS_MAX };
+
+  for(size_t index = 0; index < sizeof(counts) / sizeof(*counts); index++)
+  {
+    if(count_bench(counts[index]) != 0)
+    {
+      fprintf(stderr, "bench-message: Failed to time %zu recipients\n", counts[index]);
+
+      status = 1;
+    }
+  }
+
+  crypto_thread_free();
+
+  return status;
+}
@@ -0,0 +1,379 @@
+/*
+ * bench-mux - benchmark of chat frames behind a bulk transfer
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-mux [SECONDS]
+ *
+ * A chat frame is sent every CHAT_INTERVAL_MS over a socketpair,
+ * while a bulk stream keeps BULK_QUEUED large frames waiting. The
+ * reader takes READ_RATE bytes a second, like a slow link, so frames
+ * wait in the mux of the sender. The transfer runs for SECONDS,
+ * by default 2, in each mode:
+ *
+ * - fifo | The bulk stream has chat priority, so a chat frame waits
+ *          behind every bulk frame before it, like on one plain socket
+ * - mux  | The bulk stream has bulk priority, so a chat frame only
+ *          waits behind the chunk that is being written
+ *
+ * The check fails if a bulk frame is not put together whole,
+ * or if a chat frame is lost
+ */
+
+#define _GNU_SOURCE
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../mux.h"
+#include "../hist.h"
+#include "../affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#define RUN_SECONDS      2
+
+#define CHAT_INTERVAL_MS 5
+
+#define BULK_STREAM      1
+#define BULK_SIZE        60000
+#define BULK_QUEUED      2
+
+#define READ_RATE        (8.0 * 1024 * 1024)
+
+#define LATE_MS          200
+
+/*
+ * The socket buffers are small, so that the frames wait in the mux
+ */
+#define SOCKET_BUFFER    16384
+
+typedef struct
+{
+  const char* name;
+  uint8_t     priority;  // Of the bulk stream
+} bench_mode_t;
+
+static const bench_mode_t modes[] =
+{
+  { "fifo", FRAME_PRIORITY_CHAT },
+  { "mux",  FRAME_PRIORITY_BULK }
+};
+
+#define MODE_COUNT (sizeof(modes) / sizeof(modes[0]))
+
+/*
+ * The keys that the chunks of the writer and the reader are known by
+ */
+static const uint8_t publics[2][SIGN_PUBLIC_SIZE] = { { 1 }, { 2 } };
+
+static hist_t hist;
+
+static atomic_bool running;
+
+static uint64_t chat_count;
+static uint64_t bulk_count;
+static uint64_t errors;
+
+/*
+ * Handle a whole frame that the reader got
+ */
+static void frame_check(const frame_t* frame)
+{
+  if(frame->stream == MUX_STREAM_CHAT)
+  {
+    if(frame->size != 8)
+    {
+      errors++;
+
+      return;
+    }
+
+    hist_record(&hist, hist_time_get() - number_read(frame->data, 8));
+
+    chat_count++;
+
+    return;
+  }
+
+  // Every byte of a bulk frame is its number
+  uint8_t number = bulk_count & 0xff;
+
+  if(frame->size != BULK_SIZE || frame->data[0] != number || frame->data[BULK_SIZE - 1] != number)
+  {
+    errors++;
+  }
+
+  bulk_count++;
+}
+
+/*
+ * Read frames at READ_RATE, and grant the sender more of the bulk stream
+ */
+static void* reader_routine(void* arg)
+{
+  int sockfd = *(int*) arg;
+
+  mux_t mux;
+
+  frame_buffer_t buffer;
+
+  if(mux_init(&mux, sockfd, publics[1]) != 0 || frame_buffer_create(&buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0)
+  {
+    errors++;
+
+    return NULL;
+  }
+
+  uint64_t start = hist_time_get();
+
+  uint64_t total = 0;
+
+  frame_t frames[64];
+
+  while(atomic_load(&running))
+  {
+    struct pollfd fd = { .fd = sockfd, .events = POLLIN };
+
+    if(poll(&fd, 1, 10) <= 0) continue;
+
+    ssize_t count = frames_recv(sockfd, &buffer, frames, 64);
+
+    if(count == -3) continue;
+
+    if(count <= 0) break;
+
+    for(ssize_t index = 0; index < count; index++)
+    {
+      total += FRAME_HEAD_SIZE + frames[index].size;
+
+      int status = mux_frame_recv(&mux, &frames[index]);
+
+      if(status == -1) errors++;
+
+      if(status == 0 || status == 2) frame_check(&frames[index]);
+    }
+
+    if(mux_waiting(&mux)) mux_flush(&mux);
+
+    // Sleep until the bytes are within the rate
+    uint64_t due = start + total / READ_RATE * 1e9;
+
+    uint64_t now = hist_time_get();
+
+    if(due > now)
+    {
+      struct timespec sleep = { .tv_sec = (due - now) / 1000000000, .tv_nsec = (due - now) % 1000000000 };
+
+      nanosleep(&sleep, NULL);
+    }
+  }
+
+  frame_buffer_free(&buffer);
+
+  mux_free(&mux);
+
+  return NULL;
+}
+
+/*
+ * Get the bulk frames that wait in the mux, written or not
+ */
+static size_t bulk_waiting_get(const mux_t* mux, const bench_mode_t* mode)
+{
+  if(mode->priority != FRAME_PRIORITY_BULK)
+  {
+    return mux->queues[1].length / (FRAME_HEAD_SIZE + BULK_SIZE);
+  }
+
+  size_t count = 0;
+
+  for(size_t index = 0; index < MUX_STREAMS; index++)
+  {
+    if(mux->streams[index].id != BULK_STREAM) continue;
+
+    for(const mux_bulk_t* bulk = mux->streams[index].head; bulk; bulk = bulk->next) count++;
+  }
+
+  return count;
+}
+
+/*
+ * Send chat and bulk frames for RUN_SECONDS
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create socketpair or mux
+ * - 2 | Failed to write
+ */
+static int mode_run(const bench_mode_t* mode, int seconds, double* mbps)
+{
+  int fds[2];
+
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return 1;
+
+  int size = SOCKET_BUFFER;
+
+  for(int index = 0; index < 2; index++)
+  {
+    setsockopt(fds[index], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fds[index], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  }
+
+  mux_t mux;
+
+  frame_buffer_t buffer;
+
+  if(mux_init(&mux, fds[0], publics[0]) != 0 ||
+     mux_stream_open(&mux, BULK_STREAM, mode->priority) != 0 ||
+     frame_buffer_create(&buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0) return 1;
+
+  hist_reset(&hist);
+
+  chat_count = 0;
+  bulk_count = 0;
+
+  atomic_store(&running, true);
+
+  pthread_t thread;
+
+  pthread_create(&thread, NULL, reader_routine, &fds[1]);
+
+  static uint8_t bulk[BULK_SIZE];
+
+  uint64_t start = hist_time_get();
+  uint64_t end   = start + (uint64_t) seconds * 1000000000;
+
+  uint64_t chats = 0;
+  uint64_t bulks = 0;
+
+  int status = 0;
+
+  frame_t frames[64];
+
+  uint64_t now;
+
+  while(status == 0 && (now = hist_time_get()) < end)
+  {
+    uint64_t due = start + chats * CHAT_INTERVAL_MS * 1000000ULL;
+
+    if(due <= now)
+    {
+      uint8_t chat[8];
+
+      number_write(chat, now, 8);
+
+      if(mux_frame_send(&mux, MUX_STREAM_CHAT, FRAME_TEXT, chat, sizeof(chat)) != 0) status = 2;
+
+      chats++;
+
+      continue;
+    }
+
+    while(status == 0 && bulk_waiting_get(&mux, mode) < BULK_QUEUED)
+    {
+      memset(bulk, bulks & 0xff, BULK_SIZE);
+
+      if(mux_frame_send(&mux, BULK_STREAM, FRAME_TEXT, bulk, BULK_SIZE) != 0) status = 2;
+
+      bulks++;
+    }
+
+    struct pollfd fd = { .fd = fds[0], .events = POLLIN | (mux_waiting(&mux) ? POLLOUT : 0) };
+
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = due - now };
+
+    if(ppoll(&fd, 1, &timeout, NULL) <= 0) continue;
+
+    if((fd.revents & POLLOUT) && mux_flush(&mux) < 0) status = 2;
+
+    // The window frames of the reader
+    if(fd.revents & POLLIN)
+    {
+      ssize_t count = frames_recv(fds[0], &buffer, frames, 64);
+
+      for(ssize_t index = 0; index < count; index++) mux_frame_recv(&mux, &frames[index]);
+    }
+  }
+
+  double elapsed = (hist_time_get() - start) / 1e9;
+
+  atomic_store(&running, false);
+
+  pthread_join(thread, NULL);
+
+  *mbps = bulk_count * BULK_SIZE / elapsed / (1024 * 1024);
+
+  // The chat frames of the last LATE_MS may still be on their way
+  if(chat_count + LATE_MS / CHAT_INTERVAL_MS < chats) status = 3;
+
+  frame_buffer_free(&buffer);
+
+  mux_free(&mux);
+
+  close(fds[0]);
+  close(fds[1]);
+
+  return status;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  int seconds = (argc >= 2) ? atoi(argv[1]) : RUN_SECONDS;
+
+  if(seconds <= 0) seconds = RUN_SECONDS;
+
+  printf("%-6s %10s %10s %10s %10s %10s\n", "mode", "chats", "p50 ms", "p99 ms", "max ms", "bulk MB/s");
+
+  int status = 0;
+
+  for(size_t index = 0; index < MODE_COUNT; index++)
+  {
+    const bench_mode_t* mode = &modes[index];
+
+    double mbps = 0;
+
+    int result = mode_run(mode, seconds, &mbps);
+
+    if(result != 0)
+    {
+      fprintf(stderr, "bench-mux: %s failed (%d)\n", mode->name, result);
+
+      status = 1;
+
+      continue;
+    }
+
+    printf("%-6s %10lu %10.2f %10.2f %10.2f %10.1f\n", mode->name, chat_count,
+           hist_percentile_get(&hist, 50.0) / 1e6,
+           hist_percentile_get(&hist, 99.0) / 1e6,
+           hist_max_get(&hist) / 1e6, mbps);
+  }
+
+  if(errors > 0)
+  {
+    fprintf(stderr, "bench-mux: %lu bad frames\n", errors);
+
+    status = 1;
+  }
+
+  return status;
+}
@@ -0,0 +1,186 @@
+/*
+ * bench-pool - benchmark of the work-stealing pool
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-pool [WORKERS]
+ *
+ * The pool is run with 1 to WORKERS workers, by default
+ * the number of cores, and the speedup is against 1 worker
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The number of tasks of the flat step, and
+ * the depth of the tree of tasks of the spawn step
+ */
+#define TASK_COUNT  20000
+#define SPAWN_DEPTH 14
+
+/*
+ * Iterations of work in every task, around 10 us
+ */
+#define TASK_WORK   4000
+
+static pool_t pool;
+
+static atomic_ullong checksum;
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Work that the compiler can't remove
+ */
+static void work_task(void* arg)
+{
+  uint64_t value = (uintptr_t) arg;
+
+  for(int index = 0; index < TASK_WORK; index++)
+  {
+    value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+
+  atomic_fetch_add_explicit(&checksum, value, memory_order_relaxed);
+}
+
+/*
+ * Split into two tasks until the leaves, which do the work
+ *
+ * The tasks are pushed to the deque of the worker,
+ * so the other workers must steal them
+ */
+static void spawn_task(void* arg)
+{
+  uintptr_t depth = (uintptr_t) arg;
+
+  if(depth == 0)
+  {
+    work_task(arg);
+
+    return;
+  }
+
+  pool_submit(&pool, spawn_task, (void*) (depth - 1), TASK_NORMAL, POOL_ANY_WORKER);
+  pool_submit(&pool, spawn_task, (void*) (depth - 1), TASK_NORMAL, POOL_ANY_WORKER);
+}
+
+/*
+ * Submit every task from the main thread, to the shared queue
+ */
+static void flat_bench(void)
+{
+  for(uintptr_t index = 0; index < TASK_COUNT; index++)
+  {
+    pool_submit(&pool, work_task, (void*) index, TASK_NORMAL, POOL_ANY_WORKER);
+  }
+
+  pool_wait(&pool);
+}
+
+/*
+ * Submit one task, that spawns a tree of tasks
+ */
+static void spawn_bench(void)
+{
+  pool_submit(&pool, spawn_task, (void*) SPAWN_DEPTH, TASK_NORMAL, POOL_ANY_WORKER);
+
+  pool_wait(&pool);
+}
+
+/*
+ * Give every worker its own tasks, with the affinity hint
+ */
+static void mailbox_bench(void)
+{
+  for(uintptr_t index = 0; index < TASK_COUNT; index++)
+  {
+    pool_submit(&pool, work_task, (void*) index, TASK_NORMAL, index % pool.worker_count);
+  }
+
+  pool_wait(&pool);
+}
+
+typedef struct
+{
+  const char* name;
+  void      (*routine)(void);
+  size_t      tasks;
+} bench_t;
+
+static bench_t benches[] =
+{
+  { "flat",    flat_bench,    TASK_COUNT },
+  { "spawn",   spawn_bench,   1 << SPAWN_DEPTH },
+  { "mailbox", mailbox_bench, TASK_COUNT }
+};
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  long max_workers = (argc >= 2) ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(max_workers < 1) max_workers = 1;
+
+  double base_ns[sizeof(benches) / sizeof(bench_t)];
+
+  printf("%-10s %8s %12s %12s %10s\n", "step", "workers", "ns/task", "tasks/s", "speedup");
+
+  for(long workers = 1; workers <= max_workers; workers = (workers < max_workers && workers * 2 > max_workers) ? max_workers : workers * 2)
+  {
+    if(pool_create(&pool, workers) != 0)
+    {
+      fprintf(stderr, "bench-pool: Failed to create pool of %ld workers\n", workers);
+
+      return 1;
+    }
+
+    for(size_t index = 0; index < sizeof(benches) / sizeof(bench_t); index++)
+    {
+      const bench_t* bench = &benches[index];
+
+      // Warm up
+      bench->routine();
+
+      double start = time_get();
+
+      bench->routine();
+
+      double ns = (time_get() - start) / bench->tasks;
+
+      if(workers == 1) base_ns[index] = ns;
+
+      printf("%-10s %8ld %12.0f %12.0f %9.2fx\n", bench->name, workers, ns, 1e9 / ns, base_ns[index] / ns);
+    }
+
+    pool_free(&pool);
+  }
+
+  return 0;
+}
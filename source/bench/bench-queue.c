@@ -0,0 +1,441 @@
+/*
+ * bench-queue - benchmark of the lock-free queues
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-queue
+ *
+ * The SPSC and MPSC queues are compared to a queue
+ * with a mutex and condition variables, both in throughput
+ * and in the latency of handing an item to a waiting thread
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define QUEUE_SIZE     1024
+
+/*
+ * The number of items of a throughput step,
+ * and the number of round trips of a latency step
+ */
+#define ITEM_COUNT     2000000
+#define ROUND_COUNT    20000
+
+#define BATCH_SIZE     32
+#define PRODUCER_COUNT 4
+
+/*
+ * Bounded queue with a mutex, that blocks in push and pop
+ */
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+  void**          items;
+  size_t          size;
+  size_t          head;
+  size_t          tail;
+} mutex_queue_t;
+
+/*
+ * The operations of a queue, where push blocks until
+ * every item is pushed, and pop until some item is popped
+ */
+typedef struct
+{
+  const char* name;
+  int       (*create)(void* queue, size_t size);
+  void      (*free)(void* queue);
+  void      (*push)(void* queue, void* const* items, size_t count);
+  size_t    (*pop)(void* queue, void** items, size_t max);
+  bool        is_multi; // Can have multiple producers
+} queue_ops_t;
+
+typedef struct
+{
+  const queue_ops_t* ops;
+  void*              queue;
+  void*              reply; // Queue of the latency step, that is pushed back to
+  size_t             count;
+  size_t             batch;
+} bench_arg_t;
+
+static int mutex_queue_create(void* arg, size_t size)
+{
+  mutex_queue_t* queue = arg;
+
+  if(!(queue->items = malloc(sizeof(void*) * size))) return 1;
+
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+
+  queue->size = size;
+  queue->head = 0;
+  queue->tail = 0;
+
+  return 0;
+}
+
+static void mutex_queue_free(void* arg)
+{
+  mutex_queue_t* queue = arg;
+
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+
+  free(queue->items);
+}
+
+static void mutex_queue_push(void* arg, void* const* items, size_t count)
+{
+  mutex_queue_t* queue = arg;
+
+  pthread_mutex_lock(&queue->lock);
+
+  for(size_t index = 0; index < count; index++)
+  {
+    while(queue->tail - queue->head == queue->size)
+    {
+      pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    queue->items[queue->tail++ % queue->size] = items[index];
+  }
+
+  pthread_cond_signal(&queue->not_empty);
+
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static size_t mutex_queue_pop(void* arg, void** items, size_t max)
+{
+  mutex_queue_t* queue = arg;
+
+  pthread_mutex_lock(&queue->lock);
+
+  while(queue->tail == queue->head)
+  {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+
+  size_t count = 0;
+
+  while(count < max && queue->head != queue->tail)
+  {
+    items[count++] = queue->items[queue->head++ % queue->size];
+  }
+
+  pthread_cond_broadcast(&queue->not_full);
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return count;
+}
+
+static int spsc_create(void* queue, size_t size)
+{
+  return spsc_queue_create(queue, size);
+}
+
+static void spsc_free(void* queue)
+{
+  spsc_queue_free(queue);
+}
+
+static void spsc_push(void* queue, void* const* items, size_t count)
+{
+  while(count > 0)
+  {
+    size_t pushed = spsc_queue_push(queue, items, count);
+
+    if(pushed == 0) sched_yield();
+
+    items += pushed;
+    count -= pushed;
+  }
+}
+
+static size_t spsc_pop(void* queue, void** items, size_t max)
+{
+  size_t count;
+
+  while((count = spsc_queue_pop(queue, items, max)) == 0)
+  {
+    queue_wait(((spsc_queue_t*) queue)->fd);
+  }
+
+  return count;
+}
+
+static int mpsc_create(void* queue, size_t size)
+{
+  return mpsc_queue_create(queue, size);
+}
+
+static void mpsc_free(void* queue)
+{
+  mpsc_queue_free(queue);
+}
+
+static void mpsc_push(void* queue, void* const* items, size_t count)
+{
+  while(count > 0)
+  {
+    size_t pushed = mpsc_queue_push(queue, items, count);
+
+    if(pushed == 0) sched_yield();
+
+    items += pushed;
+    count -= pushed;
+  }
+}
+
+static size_t mpsc_pop(void* queue, void** items, size_t max)
+{
+  size_t count;
+
+  while((count = mpsc_queue_pop(queue, items, max)) == 0)
+  {
+    queue_wait(((mpsc_queue_t*) queue)->fd);
+  }
+
+  return count;
+}
+
+static const queue_ops_t queue_ops[] =
+{
+  { "spsc",  spsc_create,        spsc_free,        spsc_push,        spsc_pop,        false },
+  { "mpsc",  mpsc_create,        mpsc_free,        mpsc_push,        mpsc_pop,        true  },
+  { "mutex", mutex_queue_create, mutex_queue_free, mutex_queue_push, mutex_queue_pop, true  }
+};
+
+/*
+ * The queue types share storage, so every type fits
+ */
+typedef union
+{
+  spsc_queue_t  spsc;
+  mpsc_queue_t  mpsc;
+  mutex_queue_t mutex;
+} any_queue_t;
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Push count items, batch items at a time
+ */
+static void* producer_routine(void* arg)
+{
+  bench_arg_t* bench = arg;
+
+  void* items[BATCH_SIZE];
+
+  for(size_t index = 0; index < bench->count; index += bench->batch)
+  {
+    size_t count = (bench->count - index < bench->batch) ? bench->count - index : bench->batch;
+
+    for(size_t item = 0; item < count; item++)
+    {
+      items[item] = (void*) (uintptr_t) (index + item + 1);
+    }
+
+    bench->ops->push(bench->queue, items, count);
+  }
+
+  return NULL;
+}
+
+/*
+ * Pop items from the queue and push them back to the reply queue,
+ * until a NULL item is popped
+ */
+static void* echo_routine(void* arg)
+{
+  bench_arg_t* bench = arg;
+
+  void* item;
+
+  while(bench->ops->pop(bench->queue, &item, 1) > 0 && item)
+  {
+    bench->ops->push(bench->reply, &item, 1);
+  }
+
+  return NULL;
+}
+
+/*
+ * Push ITEM_COUNT items from the producers, and pop them
+ *
+ * RETURN (double ns)
+ * - The time per item, or -1 if the items were lost
+ */
+static double throughput_bench(const queue_ops_t* ops, size_t producers, size_t batch)
+{
+  any_queue_t queue;
+
+  if(ops->create(&queue, QUEUE_SIZE) != 0) return -1;
+
+  pthread_t   threads[PRODUCER_COUNT];
+  bench_arg_t args[PRODUCER_COUNT];
+
+  double start = time_get();
+
+  for(size_t index = 0; index < producers; index++)
+  {
+    args[index] = (bench_arg_t) { ops, &queue, NULL, ITEM_COUNT / producers, batch };
+
+    pthread_create(&threads[index], NULL, producer_routine, &args[index]);
+  }
+
+  void*  items[BATCH_SIZE];
+  size_t total = 0;
+
+  uint64_t checksum = 0;
+
+  while(total < (ITEM_COUNT / producers) * producers)
+  {
+    size_t count = ops->pop(&queue, items, batch);
+
+    for(size_t index = 0; index < count; index++)
+    {
+      checksum += (uintptr_t) items[index];
+    }
+
+    total += count;
+  }
+
+  double ns = (time_get() - start) / total;
+
+  for(size_t index = 0; index < producers; index++)
+  {
+    pthread_join(threads[index], NULL);
+  }
+
+  ops->free(&queue);
+
+  uint64_t count = ITEM_COUNT / producers;
+
+  return (checksum == producers * count * (count + 1) / 2) ? ns : -1;
+}
+
+/*
+ * Send an item to a waiting thread and wait for it to come back
+ *
+ * RETURN (double ns)
+ * - The time of one handoff, half of a round trip
+ */
+static double latency_bench(const queue_ops_t* ops)
+{
+  any_queue_t queue, reply;
+
+  if(ops->create(&queue, QUEUE_SIZE) != 0) return -1;
+
+  if(ops->create(&reply, QUEUE_SIZE) != 0)
+  {
+    ops->free(&queue);
+
+    return -1;
+  }
+
+  bench_arg_t arg = { ops, &queue, &reply, 0, 1 };
+
+  pthread_t thread;
+
+  pthread_create(&thread, NULL, echo_routine, &arg);
+
+  void* item = (void*) 1;
+
+  double start = time_get();
+
+  for(size_t round = 0; round < ROUND_COUNT; round++)
+  {
+    ops->push(&queue, &item, 1);
+
+    ops->pop(&reply, &item, 1);
+  }
+
+  double ns = (time_get() - start) / ROUND_COUNT / 2;
+
+  item = NULL;
+
+  ops->push(&queue, &item, 1);
+
+  pthread_join(thread, NULL);
+
+  ops->free(&queue);
+  ops->free(&reply);
+
+  return ns;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  printf("%-7s %-12s %10s %14s\n", "queue", "step", "ns/item", "items/s");
+
+  for(size_t index = 0; index < sizeof(queue_ops) / sizeof(queue_ops_t); index++)
+  {
+    const queue_ops_t* ops = &queue_ops[index];
+
+    struct { const char* name; size_t producers; size_t batch; } steps[] =
+    {
+      { "single",  1,              1 },
+      { "batch",   1,              BATCH_SIZE },
+      { "multi",   PRODUCER_COUNT, 1 }
+    };
+
+    for(size_t step = 0; step < sizeof(steps) / sizeof(steps[0]); step++)
+    {
+      if(steps[step].producers > 1 && !ops->is_multi) continue;
+
+      double ns = throughput_bench(ops, steps[step].producers, steps[step].batch);
+
+      if(ns < 0)
+      {
+        fprintf(stderr, "bench-queue: %s lost items in step %s\n", ops->name, steps[step].name);
+
+        return 1;
+      }
+
+      printf("%-7s %-12s %10.1f %14.0f\n", ops->name, steps[step].name, ns, 1e9 / ns);
+    }
+
+    double ns = latency_bench(ops);
+
+    printf("%-7s %-12s %10.1f %14s\n", ops->name, "handoff", ns, "-");
+  }
+
+  return 0;
+}
@@ -0,0 +1,660 @@
+/*
+ * bench-rudp - benchmark of the datagram transport under loss
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-rudp [MESSAGES]
+ *
+ * MESSAGES chat messages, by default 5000, are sent at MESSAGE_RATE
+ * a second between two UDP sockets on loopback. Every datagram goes
+ * through a shim that holds it for DELAY_MS, drops some of them and
+ * holds some of them for REORDER_MS more, so they arrive after later
+ * ones. The acknowledgements go through the same shim.
+ *
+ * The messages are sent on STREAM_COUNT streams, like the messages of
+ * as many peers, and then on one stream, where a lost packet holds back
+ * every later message like it does on TCP.
+ *
+ * Loopback TCP can't be made to lose segments without netem, so the
+ * recieved TCP segments go through the same shim instead: the same
+ * delay, reordering and loss. A lost segment comes TCP_RECOVERY_MS
+ * later, like a retransmission of a TCP with SACK and RACK, and the
+ * segments are released in order, like TCP delivers them.
+ *
+ * The check fails if a message is lost, delivered twice,
+ * or delivered before an earlier message of its stream
+ */
+
+#define _GNU_SOURCE
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../rudp.h"
+#include "../frame.h"
+#include "../hist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MESSAGE_COUNT 5000
+
+#define MESSAGE_RATE  5000
+
+/*
+ * The size of a message, about a short chat message
+ */
+#define MESSAGE_SIZE  200
+
+#define STREAM_COUNT  8
+
+/*
+ * The one way delay of the shim, and the extra delay of reordered datagrams
+ */
+#define DELAY_MS      5
+#define REORDER_MS    3
+
+#define REORDER_RATE  0.05
+
+/*
+ * The extra delay of a lost TCP segment: the acknowledgement of a later
+ * segment comes back after a round trip, the segment is sent again
+ * after the reorder window of a quarter round trip, and comes after
+ * the delay, so it is a round trip and a quarter late
+ */
+#define TCP_RECOVERY_MS (2 * DELAY_MS + (2 * DELAY_MS) / 4)
+
+/*
+ * The pacing rate, that is well above the messages
+ */
+#define PACE_RATE     (10.0 * 1024 * 1024)
+
+/*
+ * The datagrams that the shim holds in each direction
+ */
+#define HOLD_COUNT    4096
+
+#define WAIT_MAX_NS   1000000000ULL
+
+typedef struct
+{
+  uint64_t release;
+  size_t   size;
+  uint8_t  data[RUDP_DATAGRAM_MAX];
+} held_t;
+
+/*
+ * Held datagrams in the order they are released,
+ * because every datagram of a queue is held as long
+ */
+typedef struct
+{
+  held_t* items;
+  size_t  head;
+  size_t  count;
+} hold_t;
+
+typedef struct
+{
+  int     sockfd;
+  rudp_t* rudp;
+  hold_t  holds[2];  // The datagrams on time, and the reordered ones
+} end_t;
+
+typedef struct
+{
+  const char* name;
+  bool        is_tcp;
+  int         streams;
+  double      loss;
+} bench_mode_t;
+
+static const bench_mode_t modes[] =
+{
+  { "tcp",     true,  1,            0.00 },
+  { "ordered", false, 1,            0.00 },
+  { "streams", false, STREAM_COUNT, 0.00 },
+  { "tcp",     true,  1,            0.01 },
+  { "ordered", false, 1,            0.01 },
+  { "streams", false, STREAM_COUNT, 0.01 },
+  { "tcp",     true,  1,            0.05 },
+  { "ordered", false, 1,            0.05 },
+  { "streams", false, STREAM_COUNT, 0.05 }
+};
+
+#define MODE_COUNT (sizeof(modes) / sizeof(modes[0]))
+
+static const bench_mode_t* mode;
+
+static hist_t hist;
+
+static wheel_t wheel;
+
+static end_t ends[2];
+
+static bool*    delivered;
+static size_t   delivered_count;
+static int64_t  stream_last[STREAM_COUNT];
+static size_t   errors;
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+/*
+ * Fast random numbers
+ */
+static uint64_t random_get(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return seed;
+}
+
+static double random_unit_get(void)
+{
+  return (random_get() >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+ * Hold a datagram until it is released, unless it is lost
+ */
+static void hold_push(hold_t* hold, const uint8_t* data, size_t size, uint64_t release)
+{
+  if(hold->count == HOLD_COUNT) return;
+
+  held_t* held = &hold->items[(hold->head + hold->count) % HOLD_COUNT];
+
+  held->release = release;
+  held->size    = size;
+
+  memcpy(held->data, data, size);
+
+  hold->count++;
+}
+
+/*
+ * Send the held datagrams that are due, and get the time until the next one
+ */
+static uint64_t hold_release(hold_t* hold, int sockfd, uint64_t now)
+{
+  while(hold->count > 0)
+  {
+    held_t* held = &hold->items[hold->head];
+
+    if(held->release > now) return held->release - now;
+
+    if(send(sockfd, held->data, held->size, 0) == -1 && errno != ECONNREFUSED)
+    {
+      perror("bench-rudp: send");
+    }
+
+    hold->head = (hold->head + 1) % HOLD_COUNT;
+
+    hold->count--;
+  }
+
+  return WAIT_MAX_NS;
+}
+
+/*
+ * The shim between the connection and its socket
+ */
+static void end_output(void* arg, const uint8_t* datagram, size_t size)
+{
+  end_t* end = arg;
+
+  if(random_unit_get() < mode->loss) return;
+
+  uint64_t release = hist_time_get() + DELAY_MS * 1000000ULL;
+
+  if(random_unit_get() < REORDER_RATE)
+  {
+    hold_push(&end->holds[1], datagram, size, release + REORDER_MS * 1000000ULL);
+  }
+  else hold_push(&end->holds[0], datagram, size, release);
+}
+
+/*
+ * Record a message, and check that it comes once and in order
+ */
+static void message_handle(const uint8_t* message, size_t size, uint16_t stream)
+{
+  uint64_t now = hist_time_get();
+
+  if(size != MESSAGE_SIZE)
+  {
+    errors++;
+
+    return;
+  }
+
+  uint64_t time   = number_read(message, 8);
+  uint32_t number = number_read(message + 8, 4);
+
+  if(number >= MESSAGE_COUNT || delivered[number] || (int64_t) number <= stream_last[stream])
+  {
+    errors++;
+
+    return;
+  }
+
+  delivered[number] = true;
+
+  stream_last[stream] = number;
+
+  delivered_count++;
+
+  hist_record(&hist, now - time);
+}
+
+/*
+ * Handle the held TCP segments that are due, and get the time until the next one
+ */
+static uint64_t hold_deliver(hold_t* hold, uint64_t now)
+{
+  while(hold->count > 0)
+  {
+    held_t* held = &hold->items[hold->head];
+
+    if(held->release > now) return held->release - now;
+
+    message_handle(held->data, held->size, 0);
+
+    hold->head = (hold->head + 1) % HOLD_COUNT;
+
+    hold->count--;
+  }
+
+  return WAIT_MAX_NS;
+}
+
+static void end_deliver(void* arg, uint16_t stream, const uint8_t* message, size_t size)
+{
+  message_handle(message, size, stream);
+}
+
+/*
+ * Create a pair of connected sockets on loopback
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed
+ */
+static int sockets_create(int* first, int* second, bool is_tcp)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t addrlen = sizeof(addr);
+
+  if(is_tcp)
+  {
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+
+    if(server == -1 ||
+       bind(server, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+       listen(server, 1) == -1 ||
+       getsockname(server, (struct sockaddr*) &addr, &addrlen) == -1 ||
+       (*first = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+       connect(*first, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+       (*second = accept(server, NULL, NULL)) == -1)
+    {
+      if(server != -1) close(server);
+
+      return 1;
+    }
+
+    close(server);
+
+    int flag = 1;
+
+    setsockopt(*first, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    return 0;
+  }
+
+  struct sockaddr_in addrs[2];
+
+  int* sockfds[2] = { first, second };
+
+  for(int index = 0; index < 2; index++)
+  {
+    addrs[index] = addr;
+
+    addrlen = sizeof(addrs[index]);
+
+    if((*sockfds[index] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) == -1 ||
+       bind(*sockfds[index], (struct sockaddr*) &addrs[index], sizeof(addrs[index])) == -1 ||
+       getsockname(*sockfds[index], (struct sockaddr*) &addrs[index], &addrlen) == -1) return 1;
+  }
+
+  if(connect(*first,  (struct sockaddr*) &addrs[1], sizeof(addrs[1])) == -1 ||
+     connect(*second, (struct sockaddr*) &addrs[0], sizeof(addrs[0])) == -1) return 1;
+
+  return 0;
+}
+
+/*
+ * Read the datagrams of an end
+ */
+static void end_recv(end_t* end, uint64_t now)
+{
+  uint8_t datagram[RUDP_DATAGRAM_MAX];
+
+  ssize_t size;
+
+  while((size = recv(end->sockfd, datagram, sizeof(datagram), 0)) > 0)
+  {
+    if(rudp_input(end->rudp, datagram, size, now) != 0) errors++;
+  }
+}
+
+/*
+ * Sleep in poll on the sockets, for at most wait nanoseconds
+ */
+static void ends_poll(int first, int second, uint64_t wait)
+{
+  struct pollfd fds[2] =
+  {
+    { .fd = first,  .events = POLLIN },
+    { .fd = second, .events = POLLIN }
+  };
+
+  struct timespec timeout = { .tv_sec = wait / 1000000000, .tv_nsec = wait % 1000000000 };
+
+  ppoll(fds, 2, &timeout, NULL);
+}
+
+static inline uint64_t wait_min(uint64_t a, uint64_t b)
+{
+  return (a < b) ? a : b;
+}
+
+/*
+ * Send the messages over the datagram transport
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create sockets
+ * - 2 | Not every message was delivered in time
+ */
+static int rudp_run(size_t count, uint64_t* resent)
+{
+  uint64_t start = hist_time_get();
+
+  if(sockets_create(&ends[0].sockfd, &ends[1].sockfd, false) != 0) return 1;
+
+  wheel_init(&wheel, 1000000, start);
+
+  for(int index = 0; index < 2; index++)
+  {
+    ends[index].rudp = rudp_create(&wheel, PACE_RATE, end_output, end_deliver, &ends[index], start);
+  }
+
+  uint64_t deadline = start + (count * 1000000000ULL / MESSAGE_RATE) + 10 * 1000000000ULL;
+
+  size_t sent = 0;
+
+  uint8_t message[MESSAGE_SIZE] = { 0 };
+
+  uint64_t now;
+
+  while(delivered_count < count && (now = hist_time_get()) < deadline)
+  {
+    uint64_t wait = WAIT_MAX_NS;
+
+    while(sent < count)
+    {
+      uint64_t due = start + sent * 1000000000ULL / MESSAGE_RATE;
+
+      if(due > now)
+      {
+        wait = due - now;
+
+        break;
+      }
+
+      number_write(message, due, 8);
+      number_write(message + 8, sent, 4);
+
+      if(rudp_send(ends[0].rudp, sent % mode->streams, message, MESSAGE_SIZE, now) != 0) break;
+
+      sent++;
+    }
+
+    wheel_advance(&wheel, now);
+
+    for(int index = 0; index < 2; index++)
+    {
+      end_t* end = &ends[index];
+
+      uint64_t pace = rudp_flush(end->rudp, now);
+
+      if(pace > 0) wait = wait_min(wait, pace);
+
+      for(int hold = 0; hold < 2; hold++)
+      {
+        wait = wait_min(wait, hold_release(&end->holds[hold], end->sockfd, now));
+      }
+    }
+
+    int timeout = wheel_timeout_get(&wheel, now);
+
+    if(timeout >= 0) wait = wait_min(wait, (uint64_t) timeout * 1000000);
+
+    if(wait > 0) ends_poll(ends[0].sockfd, ends[1].sockfd, wait);
+
+    now = hist_time_get();
+
+    for(int index = 0; index < 2; index++) end_recv(&ends[index], now);
+  }
+
+  *resent = ends[0].rudp->stats.resent;
+
+  for(int index = 0; index < 2; index++)
+  {
+    rudp_free(&ends[index].rudp);
+
+    close(ends[index].sockfd);
+  }
+
+  return (delivered_count < count) ? 2 : 0;
+}
+
+/*
+ * Send the messages over loopback TCP, where every recieved segment
+ * goes through the shim before it is handled
+ *
+ * A lost segment is held for TCP_RECOVERY_MS more, once for every time
+ * it is lost, and a segment is never released before an earlier one
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create sockets
+ * - 2 | Not every message was delivered in time
+ */
+static int tcp_run(size_t count)
+{
+  int sender, reciever;
+
+  if(sockets_create(&sender, &reciever, true) != 0) return 1;
+
+  uint64_t start = hist_time_get();
+
+  uint64_t deadline = start + (count * 1000000000ULL / MESSAGE_RATE) + 10 * 1000000000ULL;
+
+  static uint8_t buffer[MESSAGE_SIZE * 64];
+
+  size_t buffered = 0;
+
+  size_t sent = 0;
+
+  uint8_t message[MESSAGE_SIZE] = { 0 };
+
+  hold_t* hold = &ends[1].holds[0];
+
+  uint64_t release_last = 0;
+
+  uint64_t now;
+
+  while(delivered_count < count && (now = hist_time_get()) < deadline)
+  {
+    uint64_t wait = hold_deliver(hold, now);
+
+    while(sent < count)
+    {
+      uint64_t due = start + sent * 1000000000ULL / MESSAGE_RATE;
+
+      if(due > now)
+      {
+        wait = wait_min(wait, due - now);
+
+        break;
+      }
+
+      number_write(message, due, 8);
+      number_write(message + 8, sent, 4);
+
+      if(write(sender, message, MESSAGE_SIZE) != MESSAGE_SIZE) break;
+
+      sent++;
+    }
+
+    struct pollfd fd = { .fd = reciever, .events = POLLIN };
+
+    struct timespec timeout = { .tv_sec = wait / 1000000000, .tv_nsec = wait % 1000000000 };
+
+    if(ppoll(&fd, 1, &timeout, NULL) <= 0) continue;
+
+    ssize_t size = read(reciever, buffer + buffered, sizeof(buffer) - buffered);
+
+    if(size <= 0) break;
+
+    buffered += size;
+
+    now = hist_time_get();
+
+    size_t offset = 0;
+
+    for(; buffered - offset >= MESSAGE_SIZE; offset += MESSAGE_SIZE)
+    {
+      uint64_t release = now + DELAY_MS * 1000000ULL;
+
+      if(random_unit_get() < REORDER_RATE) release += REORDER_MS * 1000000ULL;
+
+      while(random_unit_get() < mode->loss) release += TCP_RECOVERY_MS * 1000000ULL;
+
+      // TCP delivers in order, so a late segment holds back the later ones
+      if(release < release_last) release = release_last;
+
+      release_last = release;
+
+      hold_push(hold, buffer + offset, MESSAGE_SIZE, release);
+    }
+
+    memmove(buffer, buffer + offset, buffered - offset);
+
+    buffered -= offset;
+  }
+
+  close(sender);
+  close(reciever);
+
+  return (delivered_count < count) ? 2 : 0;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  size_t count = (argc >= 2) ? strtoul(argv[1], NULL, 10) : MESSAGE_COUNT;
+
+  if(count == 0 || count > MESSAGE_COUNT * 100) count = MESSAGE_COUNT;
+
+  delivered = malloc(count * sizeof(bool));
+
+  for(int index = 0; index < 2; index++)
+  {
+    for(int hold = 0; hold < 2; hold++)
+    {
+      ends[index].holds[hold].items = malloc(HOLD_COUNT * sizeof(held_t));
+    }
+  }
+
+  printf("%-8s %6s %10s %10s %10s %10s %8s\n", "mode", "loss", "p50 ms", "p99 ms", "p999 ms", "max ms", "resent");
+
+  int status = 0;
+
+  for(size_t index = 0; index < MODE_COUNT; index++)
+  {
+    mode = &modes[index];
+
+    memset(delivered, 0, count * sizeof(bool));
+
+    delivered_count = 0;
+
+    for(int stream = 0; stream < STREAM_COUNT; stream++) stream_last[stream] = -1;
+
+    for(int end = 0; end < 2; end++)
+    {
+      for(int hold = 0; hold < 2; hold++) ends[end].holds[hold].count = 0;
+    }
+
+    hist_reset(&hist);
+
+    uint64_t resent = 0;
+
+    int result = mode->is_tcp ? tcp_run(count) : rudp_run(count, &resent);
+
+    if(result != 0)
+    {
+      fprintf(stderr, "bench-rudp: %s with %.0f%% loss failed (%d), %zu of %zu delivered\n",
+              mode->name, mode->loss * 100, result, delivered_count, count);
+
+      status = 1;
+
+      continue;
+    }
+
+    printf("%-8s %5.0f%% %10.2f %10.2f %10.2f %10.2f %8lu\n", mode->name, mode->loss * 100,
+           hist_percentile_get(&hist, 50.0)  / 1e6,
+           hist_percentile_get(&hist, 99.0)  / 1e6,
+           hist_percentile_get(&hist, 99.9)  / 1e6,
+           hist_max_get(&hist) / 1e6, resent);
+  }
+
+  if(errors > 0)
+  {
+    fprintf(stderr, "bench-rudp: %zu messages out of order, duplicated or bad\n", errors);
+
+    status = 1;
+  }
+
+  for(int index = 0; index < 2; index++)
+  {
+    for(int hold = 0; hold < 2; hold++) free(ends[index].holds[hold].items);
+  }
+
+  free(delivered);
+
+  return status;
+}
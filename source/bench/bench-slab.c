@@ -0,0 +1,263 @@
+/*
+ * bench-slab - soak test of the slab allocator
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-slab [CYCLES]
+ *
+ * Connections are opened and closed CYCLES times, by default
+ * 2000000, with up to LIVE_MAX open at once. Every connection has
+ * a state object, a read buffer and messages of random sizes.
+ *
+ * The same cycles are run with malloc and with a slab pool,
+ * and the soak fails if the RSS of the slab pool grows
+ * after the warm-up, instead of staying flat
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../slab.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CYCLE_COUNT   2000000
+#define LIVE_MAX      512
+#define MESSAGE_COUNT 4
+
+#define STATE_SIZE    384
+#define BUFFER_SIZE   16384
+#define MESSAGE_MAX   4096
+
+/*
+ * The number of RSS samples, the first of which is after the warm-up
+ */
+#define SAMPLE_COUNT  10
+
+/*
+ * The RSS may grow this much after the warm-up, in bytes
+ */
+#define RSS_SLACK     (1024 * 1024)
+
+typedef struct
+{
+  void* state;
+  void* buffer;
+} conn_t;
+
+typedef struct
+{
+  const char* name;
+  void*     (*alloc)(size_t size);
+  void      (*free)(void* item);
+} allocator_t;
+
+static slab_pool_t pool;
+
+static void* pool_alloc(size_t size)
+{
+  return slab_alloc(&pool, size);
+}
+
+static const allocator_t allocators[] =
+{
+  { "malloc", malloc,     free },
+  { "slab",   pool_alloc, slab_free }
+};
+
+static conn_t conns[LIVE_MAX];
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Get the resident set size of the process, in bytes
+ */
+static size_t rss_get(void)
+{
+  FILE* file = fopen("/proc/self/statm", "r");
+
+  if(!file) return 0;
+
+  unsigned long size, resident = 0;
+
+  if(fscanf(file, "%lu %lu", &size, &resident) != 2) resident = 0;
+
+  fclose(file);
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Fast random numbers, the same for both allocators
+ */
+static uint64_t random_get(uint64_t* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+/*
+ * Close a random connection and open a new one in its place,
+ * which sends and recieves a few messages
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate
+ */
+static int cycle_run(const allocator_t* allocator, uint64_t* seed)
+{
+  conn_t* conn = &conns[random_get(seed) % LIVE_MAX];
+
+  allocator->free(conn->buffer);
+  allocator->free(conn->state);
+
+  conn->state  = allocator->alloc(STATE_SIZE);
+  conn->buffer = allocator->alloc(BUFFER_SIZE);
+
+  if(!conn->state || !conn->buffer) return 1;
+
+  memset(conn->state, 0, STATE_SIZE);
+
+  for(int index = 0; index < MESSAGE_COUNT; index++)
+  {
+    size_t size = 32 + random_get(seed) % (MESSAGE_MAX - 32);
+
+    uint8_t* message = allocator->alloc(size);
+
+    if(!message) return 1;
+
+    message[0] = message[size - 1] = index;
+
+    allocator->free(message);
+  }
+
+  return 0;
+}
+
+/*
+ * Run the cycles, and sample the RSS after each part
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate
+ */
+static int soak_run(const allocator_t* allocator, long cycles, size_t rss[SAMPLE_COUNT], double* ns)
+{
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+  memset(conns, 0, sizeof(conns));
+
+  // Warm up by opening every connection
+  for(long cycle = 0; cycle < LIVE_MAX * 4; cycle++)
+  {
+    if(cycle_run(allocator, &seed) != 0) return 1;
+  }
+
+  double start = time_get();
+
+  for(int sample = 0; sample < SAMPLE_COUNT; sample++)
+  {
+    for(long cycle = 0; cycle < cycles / SAMPLE_COUNT; cycle++)
+    {
+      if(cycle_run(allocator, &seed) != 0) return 1;
+    }
+
+    rss[sample] = rss_get();
+  }
+
+  *ns = (time_get() - start) / cycles;
+
+  for(int index = 0; index < LIVE_MAX; index++)
+  {
+    allocator->free(conns[index].buffer);
+    allocator->free(conns[index].state);
+  }
+
+  return 0;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  long cycles = (argc >= 2) ? atol(argv[1]) : CYCLE_COUNT;
+
+  if(cycles < SAMPLE_COUNT) cycles = SAMPLE_COUNT;
+
+  if(slab_pool_create(&pool, SLAB_HUGE) != 0)
+  {
+    fprintf(stderr, "bench-slab: Failed to create pool\n");
+
+    return 1;
+  }
+
+  int status = 0;
+
+  printf("%-8s %12s %12s %12s %12s\n", "alloc", "ns/cycle", "first kB", "last kB", "growth kB");
+
+  for(size_t index = 0; index < sizeof(allocators) / sizeof(allocator_t); index++)
+  {
+    const allocator_t* allocator = &allocators[index];
+
+    size_t rss[SAMPLE_COUNT];
+    double ns;
+
+    if(soak_run(allocator, cycles, rss, &ns) != 0)
+    {
+      fprintf(stderr, "bench-slab: %s failed to allocate\n", allocator->name);
+
+      return 1;
+    }
+
+    size_t max = rss[0];
+
+    for(int sample = 1; sample < SAMPLE_COUNT; sample++)
+    {
+      if(rss[sample] > max) max = rss[sample];
+    }
+
+    long growth = (long) max - (long) rss[0];
+
+    printf("%-8s %12.1f %12zu %12zu %12ld\n", allocator->name, ns, rss[0] / 1024, rss[SAMPLE_COUNT - 1] / 1024, growth / 1024);
+
+    if(allocator->alloc == pool_alloc && growth > RSS_SLACK)
+    {
+      fprintf(stderr, "bench-slab: RSS of slab grew by %ld kB after warm-up\n", growth / 1024);
+
+      status = 1;
+    }
+  }
+
+  printf("\n");
+
+  slab_stats_print(stdout, &pool);
+
+  slab_pool_free(&pool);
+
+  return status;
+}
@@ -0,0 +1,346 @@
+/*
+ * bench-transport - benchmark of the transports of rooms on the same host
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-transport [ROUNDS]
+ *
+ * A forked child echoes frames over loopback TCP, a unix domain
+ * socket and a pair of shared memory rings with eventfds. The round
+ * trip of a frame is measured ROUNDS times, by default 20000, and
+ * then the throughput of a stream of large writes
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../socket.h"
+#include "../shm.h"
+#include "../hist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <netinet/tcp.h>
+
+#define ROUND_COUNT  20000
+
+/*
+ * The size of a frame of the round trips, about a short message
+ */
+#define FRAME_SIZE   256
+
+/*
+ * The bytes of the throughput step, written CHUNK_SIZE at a time
+ */
+#define STREAM_SIZE  (256UL * 1024 * 1024)
+#define CHUNK_SIZE   65536
+
+#define SHM_SIZE     (1024 * 1024)
+
+/*
+ * One end of a duplex transport
+ */
+typedef struct
+{
+  int         fd;
+  shm_pipe_t* send;
+  shm_pipe_t* recv;
+} end_t;
+
+/*
+ * The operations of a transport, where write blocks until
+ * every byte is written, and read until some bytes are read
+ */
+typedef struct
+{
+  const char* name;
+  int       (*create)(end_t* parent, end_t* child);
+  ssize_t   (*write)(end_t* end, const void* data, size_t size);
+  ssize_t   (*read)(end_t* end, void* buffer, size_t size);
+} transport_ops_t;
+
+static shm_pipe_t shm_pipes[2];
+
+/*
+ * Create a connected pair of loopback TCP sockets
+ */
+static int tcp_create(end_t* parent, end_t* child)
+{
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t length = sizeof(addr);
+
+  if(server == -1 || bind(server, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+     listen(server, 1) == -1 || getsockname(server, (struct sockaddr*) &addr, &length) == -1)
+  {
+    if(server != -1) close(server);
+
+    return 1;
+  }
+
+  parent->fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if(parent->fd == -1 || connect(parent->fd, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+  {
+    close(server);
+
+    return 1;
+  }
+
+  child->fd = accept(server, NULL, NULL);
+
+  close(server);
+
+  if(child->fd == -1) return 1;
+
+  // Like the sockets of bunker, frames are not delayed
+  int flag = 1;
+
+  setsockopt(parent->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  setsockopt(child->fd,  IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  return 0;
+}
+
+/*
+ * Create a connected pair of unix domain sockets
+ */
+static int unix_create(end_t* parent, end_t* child)
+{
+  int fds[2];
+
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) return 1;
+
+  parent->fd = fds[0];
+  child->fd  = fds[1];
+
+  return 0;
+}
+
+static ssize_t fd_write(end_t* end, const void* data, size_t size)
+{
+  return socket_write(end->fd, data, size);
+}
+
+static ssize_t fd_read(end_t* end, void* buffer, size_t size)
+{
+  return read(end->fd, buffer, size);
+}
+
+/*
+ * Create two shared memory pipes, one for each direction
+ */
+static int shm_create(end_t* parent, end_t* child)
+{
+  if(shm_pipe_create(&shm_pipes[0], SHM_SIZE) != 0) return 1;
+
+  if(shm_pipe_create(&shm_pipes[1], SHM_SIZE) != 0)
+  {
+    shm_pipe_free(&shm_pipes[0]);
+
+    return 1;
+  }
+
+  *parent = (end_t) { .fd = -1, .send = &shm_pipes[0], .recv = &shm_pipes[1] };
+  *child  = (end_t) { .fd = -1, .send = &shm_pipes[1], .recv = &shm_pipes[0] };
+
+  return 0;
+}
+
+static ssize_t shm_write(end_t* end, const void* data, size_t size)
+{
+  return shm_pipe_write(end->send, data, size);
+}
+
+static ssize_t shm_read(end_t* end, void* buffer, size_t size)
+{
+  return shm_pipe_read(end->recv, buffer, size);
+}
+
+static const transport_ops_t transport_ops[] =
+{
+  { "tcp",  tcp_create,  fd_write,  fd_read },
+  { "unix", unix_create, fd_write,  fd_read },
+  { "shm",  shm_create,  shm_write, shm_read }
+};
+
+/*
+ * Read exactly size bytes
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of file, or failed to read
+ */
+static int read_all(const transport_ops_t* ops, end_t* end, void* buffer, size_t size)
+{
+  size_t index = 0;
+
+  while(index < size)
+  {
+    ssize_t amount = ops->read(end, (uint8_t*) buffer + index, size - index);
+
+    if(amount <= 0) return 1;
+
+    index += amount;
+  }
+
+  return 0;
+}
+
+/*
+ * Echo the frames of the round trips, and then read the stream
+ * and answer with one byte, in the child
+ */
+static int child_run(const transport_ops_t* ops, end_t* end, long rounds)
+{
+  static uint8_t buffer[CHUNK_SIZE];
+
+  for(long round = 0; round < rounds; round++)
+  {
+    if(read_all(ops, end, buffer, FRAME_SIZE) != 0) return 1;
+
+    if(ops->write(end, buffer, FRAME_SIZE) != FRAME_SIZE) return 1;
+  }
+
+  size_t total = 0;
+
+  while(total < STREAM_SIZE)
+  {
+    size_t size = (STREAM_SIZE - total < CHUNK_SIZE) ? STREAM_SIZE - total : CHUNK_SIZE;
+
+    ssize_t amount = ops->read(end, buffer, size);
+
+    if(amount <= 0) return 1;
+
+    total += amount;
+  }
+
+  return (ops->write(end, buffer, 1) == 1) ? 0 : 1;
+}
+
+/*
+ * Measure the round trips and the stream of a transport
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create the transport
+ * - 2 | Failed to fork
+ * - 3 | The echo failed
+ */
+static int transport_bench(const transport_ops_t* ops, long rounds, double* p50, double* p99, double* mbps)
+{
+  end_t parent = { .fd = -1 };
+  end_t child  = { .fd = -1 };
+
+  if(ops->create(&parent, &child) != 0) return 1;
+
+  fflush(stdout);
+
+  pid_t pid = fork();
+
+  if(pid == -1) return 2;
+
+  if(pid == 0)
+  {
+    if(parent.fd != -1) close(parent.fd);
+
+    _exit(child_run(ops, &child, rounds));
+  }
+
+  if(child.fd != -1) close(child.fd);
+
+  static hist_t hist;
+
+  hist_reset(&hist);
+
+  static uint8_t buffer[CHUNK_SIZE];
+
+  memset(buffer, 'x', sizeof(buffer));
+
+  int status = 0;
+
+  for(long round = 0; round < rounds && status == 0; round++)
+  {
+    uint64_t start = hist_time_get();
+
+    if(ops->write(&parent, buffer, FRAME_SIZE) != FRAME_SIZE ||
+       read_all(ops, &parent, buffer, FRAME_SIZE) != 0) status = 3;
+
+    hist_record(&hist, hist_time_get() - start);
+  }
+
+  uint64_t start = hist_time_get();
+
+  for(size_t total = 0; total < STREAM_SIZE && status == 0; total += CHUNK_SIZE)
+  {
+    if(ops->write(&parent, buffer, CHUNK_SIZE) != CHUNK_SIZE) status = 3;
+  }
+
+  // The child answers when it has read the whole stream
+  if(status == 0 && read_all(ops, &parent, buffer, 1) != 0) status = 3;
+
+  double seconds = (hist_time_get() - start) / 1e9;
+
+  if(parent.fd != -1) close(parent.fd);
+
+  int child_status;
+
+  waitpid(pid, &child_status, 0);
+
+  if(!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) status = 3;
+
+  if(parent.send)
+  {
+    shm_pipe_free(&shm_pipes[0]);
+    shm_pipe_free(&shm_pipes[1]);
+  }
+
+  *p50  = hist_percentile_get(&hist, 50.0) / 1e3;
+  *p99  = hist_percentile_get(&hist, 99.0) / 1e3;
+  *mbps = STREAM_SIZE / seconds / 1e6;
+
+  return status;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  long rounds = (argc >= 2) ? atol(argv[1]) : ROUND_COUNT;
+
+  if(rounds < 1) rounds = 1;
+
+  printf("%-10s %12s %12s %12s\n", "transport", "rtt p50 us", "rtt p99 us", "MB/s");
+
+  for(size_t index = 0; index < sizeof(transport_ops) / sizeof(transport_ops_t); index++)
+  {
+    const transport_ops_t* ops = &transport_ops[index];
+
+    double p50, p99, mbps;
+
+    if(transport_bench(ops, rounds, &p50, &p99, &mbps) != 0)
+    {
+      fprintf(stderr, "bench-transport: %s failed\n", ops->name);
+
+      return 1;
+    }
+
+    printf("%-10s %12.2f %12.2f %12.1f\n", ops->name, p50, p99, mbps);
+  }
+
+  return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * bench-wheel - benchmark and check of the timer wheel
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bench-wheel [TIMERS]
+ *
+ * TIMERS timers, by default 100000, are armed with random delays,
+ * like the idle timeouts and heartbeats of as many connections.
+ * Every other timer is cancelled, and the rest are re-armed once
+ * when they expire. The clock is moved by the timeouts that
+ * the wheel gives, like an event loop that sleeps in poll.
+ *
+ * The check fails if a timer expires at another tick than its own,
+ * if a cancelled timer expires, or if a timer never expires
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TIMER_COUNT 100000
+
+#define TICK_SIZE   1000000ULL
+
+/*
+ * The longest delay, in ticks, about 100 seconds
+ */
+#define DELAY_MAX   100000
+
+typedef struct
+{
+  wheel_timer_t timer;
+  uint64_t      expire;    // The tick that the timer should expire at
+  int           fired;     // Number of times the timer has expired
+  bool          cancelled;
+  bool          rearmed;
+} conn_timer_t;
+
+static wheel_t wheel;
+
+static conn_timer_t* timers;
+
+static size_t errors = 0;
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+/*
+ * Get monotonic time in nanoseconds
+ */
+static double time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return timespec.tv_sec * 1e9 + timespec.tv_nsec;
+}
+
+/*
+ * Fast random numbers
+ */
+static uint64_t random_get(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return seed;
+}
+
+/*
+ * Arm a timer with a random delay of whole ticks
+ */
+static void conn_timer_arm(conn_timer_t* conn)
+{
+  uint64_t ticks = 1 + random_get() % DELAY_MAX;
+
+  conn->expire = wheel.tick + ticks;
+
+  wheel_timer_arm(&wheel, &conn->timer, ticks * TICK_SIZE);
+}
+
+/*
+ * Check that the timer expired at its tick, and re-arm it once
+ */
+static void conn_timer_routine(wheel_timer_t* timer, void* arg)
+{
+  conn_timer_t* conn = arg;
+
+  if(conn->cancelled || wheel.tick != conn->expire) errors++;
+
+  conn->fired++;
+
+  if(!conn->rearmed)
+  {
+    conn->rearmed = true;
+
+    conn_timer_arm(conn);
+  }
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  long count = (argc >= 2) ? atol(argv[1]) : TIMER_COUNT;
+
+  if(count < 1) count = 1;
+
+  if(!(timers = calloc(count, sizeof(conn_timer_t))))
+  {
+    fprintf(stderr, "bench-wheel: Failed to allocate timers\n");
+
+    return 1;
+  }
+
+  uint64_t now = 0;
+
+  wheel_init(&wheel, TICK_SIZE, now);
+
+  for(long index = 0; index < count; index++)
+  {
+    wheel_timer_init(&timers[index].timer, conn_timer_routine, &timers[index]);
+  }
+
+  double start = time_get();
+
+  for(long index = 0; index < count; index++) conn_timer_arm(&timers[index]);
+
+  double arm_ns = (time_get() - start) / count;
+
+  start = time_get();
+
+  for(long index = 0; index < count; index += 2)
+  {
+    wheel_timer_cancel(&wheel, &timers[index].timer);
+
+    timers[index].cancelled = true;
+  }
+
+  double cancel_ns = (time_get() - start) / ((count + 1) / 2);
+
+  // Move the clock by the timeouts of the wheel, until every timer has expired
+  size_t wakes   = 0;
+  size_t expired = 0;
+
+  start = time_get();
+
+  while(wheel.count > 0)
+  {
+    int timeout = wheel_timeout_get(&wheel, now);
+
+    now += (uint64_t) timeout * 1000000;
+
+    expired += wheel_advance(&wheel, now);
+
+    wakes++;
+  }
+
+  double advance_ns = (time_get() - start) / (expired ? expired : 1);
+
+  for(long index = 0; index < count; index++)
+  {
+    conn_timer_t* conn = &timers[index];
+
+    if(conn->fired != (conn->cancelled ? 0 : 2)) errors++;
+  }
+
+  free(timers);
+
+  printf("%-10s %10s %10s %10s %10s %10s\n", "timers", "arm ns", "cancel ns", "expire ns", "expired", "wakes");
+
+  printf("%-10ld %10.1f %10.1f %10.1f %10zu %10zu\n", count, arm_ns, cancel_ns, advance_ns, expired, wakes);
+
+  if(errors > 0)
+  {
+    fprintf(stderr, "bench-wheel: %zu timers expired at the wrong tick, or not at all\n", errors);
+
+    return 1;
+  }
+
+  return 0;
+}
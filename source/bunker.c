@@ -3,9 +3,12 @@
  *
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-11-25
+ * Last updated: 2026-10-19
  */
 
+#define FORMAT_IMPLEMENT
+#include "format.h"
+
 #define DEBUG_IMPLEMENT
 #include "debug.h"
 
@@ -14,25 +17,47 @@
 
 #include "bunker.h"
 
+/*
+ * The unix socket that bunker daemon listens on, and bunker attach connects to
+ *
+ * The directory of the socket must only be open to the user
+ */
+#define DAEMON_SOCKET_PATH "../assets/daemon/bunker.sock"
+
 static char doc[] = "bunker - a secure chat room";
 
 static char args_doc[] = "[INFO...]";
 
 static struct argp_option options[] =
 {
-  { "name",  'n', "NAME", 0, "Your nickname in the room" },
-  { "room",  'r', "ROOM", 0, "New name of chat room" },
-  { "debug", 'd', 0,      0, "Show debug messages" },
+  { "name",    'n', "NAME",       0,                   "Your nickname in the room" },
+  { "room",    'r', "ROOM",       0,                   "New name of chat room" },
+  { "debug",   'd', "SUBSYSTEMS", OPTION_ARG_OPTIONAL, "Show debug messages, of all or some of: socket, room, crypto, ui" },
+  { "binary",  'b', 0,            0,                   "Store debug messages in binary" },
+  { "trace",   't', "FILE",       0,                   "Write spans as Chrome trace-event JSON" },
+  { "cpus",    'c', "CPUS",       0,                   "Pin the network, UI and input threads to CPUs, like 2-4" },
+  { "ping",    'p', "MS",         0,                   "Send heartbeats every MS milliseconds, 0 for none (default 1000)" },
+  { "limit",   'l', "MESSAGES",   0,                   "Messages a second from one peer, and from us, 0 for none (default 20)" },
+  { "capture", 'w', "FILE",       0,                   "Write the recieved frames to a capture file, for bunker-replay" },
+  { "socket",  's', "PATH",       0,                   "Unix socket of the daemon (default " DAEMON_SOCKET_PATH ")" },
   { 0 }
 };
 
 struct args
 {
-  char** args;
-  size_t arg_count;
-  char*  name;
-  char*  room;
-  bool   debug;
+  char**       args;
+  size_t       arg_count;
+  char*        name;
+  char*        room;
+  unsigned int filter;
+  bool         binary;
+  char*        trace;
+  int          cpus[CPUS_MAX];
+  int          cpu_count;
+  int          ping;
+  int          limit;
+  char*        capture;
+  char*        socket;
 };
 
 struct args args =
@@ -41,7 +66,14 @@ struct args args =
   .arg_count = 0,
   .name      = NULL,
   .room      = NULL,
-  .debug     = false
+  .filter    = DEBUG_FILTER_NONE,
+  .binary    = false,
+  .trace     = NULL,
+  .cpu_count = 0,
+  .ping      = PING_INTERVAL,
+  .limit     = LIMIT_MESSAGES,
+  .capture   = NULL,
+  .socket    = DAEMON_SOCKET_PATH
 };
 
 /*
@@ -62,7 +94,50 @@ static error_t opt_parse(int key, char* arg, struct argp_state* state)
       break;
 
     case 'd':
-      args->debug = true;
+      // Without subsystems, every debug message is shown
+      if(!arg) args->filter = DEBUG_FILTER_ALL;
+
+      else if(debug_filter_parse(&args->filter, arg) != 0)
+      {
+        argp_error(state, "Unknown debug subsystems: %s", arg);
+      }
+      break;
+
+    case 'b':
+      args->binary = true;
+      break;
+
+    case 't':
+      args->trace = arg;
+      break;
+
+    case 'c':
+      if((args->cpu_count = cpus_parse(args->cpus, CPUS_MAX, arg)) <= 0)
+      {
+        argp_error(state, "Bad list of CPUs: %s", arg);
+      }
+      break;
+
+    case 'p':
+      if((args->ping = atoi(arg)) < 0 || (args->ping == 0 && strcmp(arg, "0") != 0))
+      {
+        argp_error(state, "Bad heartbeat interval: %s", arg);
+      }
+      break;
+
+    case 'l':
+      if((args->limit = atoi(arg)) < 0 || (args->limit == 0 && strcmp(arg, "0") != 0))
+      {
+        argp_error(state, "Bad message limit: %s", arg);
+      }
+      break;
+
+    case 'w':
+      args->capture = arg;
+      break;
+
+    case 's':
+      args->socket = arg;
       break;
 
     case ARGP_KEY_ARG:
@@ -87,34 +162,146 @@ static error_t opt_parse(int key, char* arg, struct argp_state* state)
 }
 
 /*
+ * The room threads, in the order that --cpus pins them
+ */
+typedef enum
+{
+  ROOM_THREAD_NETWORK,
+  ROOM_THREAD_UI,
+  ROOM_THREAD_INPUT
+} room_thread_t;
+
+/*
+ * Pin the calling room thread to its CPU from --cpus,
+ * which are reused from the start if there are fewer CPUs than threads
  *
+ * RETURN (int cpu)
+ * - The CPU of the thread, or CPU_NONE if it is not pinned
  */
-static void send_routine()
+static int room_thread_pin(room_thread_t thread)
 {
+  if(args.cpu_count == 0) return CPU_NONE;
 
+  int cpu = args.cpus[thread % args.cpu_count];
+
+  return (thread_cpu_set(pthread_self(), cpu) == 0) ? cpu : CPU_NONE;
 }
 
 /*
+ * Read lines from stdin, on the CPU of the input thread
+ */
+static void* input_routine(void* arg)
+{
+  room_thread_pin(ROOM_THREAD_INPUT);
+
+  input_run(stdin);
+
+  return NULL;
+}
+
+/*
+ * Run the loop of the network thread, on the node of its CPU
+ */
+static void* network_routine(void* arg)
+{
+  int cpu = room_thread_pin(ROOM_THREAD_NETWORK);
+
+  sessions_run(cpu);
+
+  return NULL;
+}
+
+/*
+ * Print the lines to stdout, on the CPU of the UI thread
+ */
+static void* ui_routine(void* arg)
+{
+  room_thread_pin(ROOM_THREAD_UI);
+
+  ui_run(stdout);
+
+  return NULL;
+}
+
+/*
+ * Run the loop of the daemon, instead of the input and UI threads
+ */
+static void* daemon_routine(void* arg)
+{
+  room_thread_pin(ROOM_THREAD_UI);
+
+  daemon_run();
+
+  return NULL;
+}
+
+/*
+ * Run the input, network and UI threads of the rooms,
+ * until either stdin or every socket is closed
  *
+ * The daemon runs its own thread instead of the input and UI threads,
+ * until it is stopped or every socket is closed
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create queues
+ * - 2 | Failed to start threads
  */
-static void recv_routine()
+static int room_threads_run(bool is_daemon)
 {
+  if(room_buffers_create() != 0)
+  {
+    room_buffers_free();
+
+    return 1;
+  }
 
+  atomic_store(&room_closed, false);
+
+  pthread_t threads[3];
+
+  void* (*routines[3])(void*) = { input_routine, network_routine, ui_routine };
+
+  void* (*daemon_routines[2])(void*) = { network_routine, daemon_routine };
+
+  int status = is_daemon ? threads_start(threads, daemon_routines, 2) : threads_start(threads, routines, 3);
+
+  room_buffers_free();
+
+  return (status == 0) ? 0 : 2;
 }
 
 /*
+ * Join the rooms, with the same name and keys in every room,
+ * and chat in them until end of input or every room is left
  *
+ * The daemon holds the rooms for front-ends instead,
+ * which attach to it over its unix socket
  */
-static void room_routine(const char* address, int port, const char* room)
+static void room_routine(char** addresses, int* ports, char** rooms, size_t count, bool is_daemon)
 {
-  int sockfd = client_socket_create(address, port, args.debug);
+  int daemon_status = is_daemon ? daemon_open(args.socket) : 0;
 
-  printf("Joining: (%s:%d)\n", address, port);
+  if(daemon_status != 0)
+  {
+    static const char* errors[] =
+    {
+      NULL,
+      "Failed to create the directory of the daemon socket",
+      "The directory of the daemon socket is open to other users",
+      "A daemon is already running",
+      "Failed to create daemon socket"
+    };
 
-  socket_close(&sockfd, args.debug);
+    printf("bunker: %s (%s)\n", errors[daemon_status], args.socket);
 
+    return;
+  }
 
-  if(room) printf("Room: (%s)\n", room);
+  for(size_t index = 0; index < count; index++)
+  {
+    if(rooms[index]) printf("Room: (%s)\n", rooms[index]);
+  }
 
   // Input nickname
   char* name;
@@ -137,73 +324,130 @@ static void room_routine(const char* address, int port, const char* room)
 
   printf("Name: %s\n", name);
 
+
+  session_ping  = args.ping;
+  session_limit = args.limit;
+
+  if(sessions_join(name, addresses, ports, rooms, count) != 0)
+  {
+    fprintf(stderr, "Failed to create keys\n");
+
+    if(is_daemon) daemon_close(args.socket);
+
+    free(name);
+
+    return;
+  }
+
+  if(is_daemon && session_count > 0)
+  {
+    printf("Daemon: (%s)\n", args.socket);
+
+    fflush(stdout);
+  }
+
+  if(session_count > 0 && room_threads_run(is_daemon) != 0)
+  {
+    fprintf(stderr, "Failed to start room\n");
+  }
+
+  if(is_daemon) daemon_close(args.socket);
+
+
+  sessions_free();
+
   free(name);
 }
 
 /*
+ * Get the address and port of a room, by its name or address
  *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | No room was found
  */
-static void join_routine(void)
+static int room_resolve(char** address, int* port, char** room, const char* string)
 {
-  // Input chat room
-  char* string;
+  int status = address_and_port_get(address, port, string);
 
-  if(args.arg_count >= 2)
-  {
-    string = strdup(args.args[1]);
-  }
-  else
+  if(status == 0)
   {
-    string = getstr("Room: ");
+    printf("bunker: No room was found (%s)\n", string);
+
+    return 1;
   }
 
+  // If inputted room was a name, store that room name
+  *room = (status == 1) ? strdup(string) : NULL;
 
-  // Get address and port of string
-  char* address;
-  int   port;
+  return 0;
+}
 
-  int status = address_and_port_get(&address, &port, string);
+/*
+ * Join every room of the arguments, or the inputted room,
+ * in this process or in the daemon
+ */
+static void join_routine(bool is_daemon)
+{
+  char*  addresses[SESSIONS_MAX];
+  int    ports[SESSIONS_MAX];
+  char*  rooms[SESSIONS_MAX];
+  size_t count = 0;
 
-  if(status == 0)
+  if(args.arg_count > 1 + SESSIONS_MAX)
   {
-    free(string);
-
-    printf("bunker: No room was found\n");
+    printf("bunker: At most %d rooms can be joined\n", SESSIONS_MAX);
 
     return;
   }
 
-
-  // If inputted room was a name, store that room name
-  char* room = NULL;
-
-  if(status == 1)
+  if(args.arg_count >= 2)
   {
-    room = strdup(string);
+    for(size_t index = 1; index < args.arg_count; index++)
+    {
+      if(room_resolve(&addresses[count], &ports[count], &rooms[count], args.args[index]) == 0) count++;
+    }
   }
+  else
+  {
+    // Input chat room
+    char* string = getstr("Room: ");
 
-  free(string);
+    if(string && room_resolve(&addresses[count], &ports[count], &rooms[count], string) == 0) count++;
+
+    free(string);
+  }
 
 
   // Add or rename room with address and port
-  if(args.room)
+  if(args.room && count == 1)
   {
-    address_and_port_add(address, port, args.room);
+    address_and_port_add(addresses[0], ports[0], args.room);
 
     // Update the room name
-    if(room) free(room);
-  
-    room = strdup(args.room);
+    free(rooms[0]);
+
+    rooms[0] = strdup(args.room);
   }
 
 
-  // Enter room
-  room_routine(address, port, room);
+  // Enter rooms
+  if(count > 0)
+  {
+    TRACE_BEGIN("room_routine");
 
+    room_routine(addresses, ports, rooms, count, is_daemon);
 
-  free(room);
+    TRACE_END("room_routine");
+  }
 
-  free(address);
+
+  for(size_t index = 0; index < count; index++)
+  {
+    free(rooms[index]);
+
+    free(addresses[index]);
+  }
 }
 
 /*
@@ -224,7 +468,11 @@ static void list_routine(void)
   {
     room_t room = rooms[index];
 
-    printf("%s : %s:%d\n", room.name, room.address, room.port);
+    char string[256];
+
+    address_string_write(string, sizeof(string), room.address, room.port);
+
+    printf("%s : %s\n", room.name, string);
   }
 
   rooms_free(&rooms, count);
@@ -339,11 +587,30 @@ static struct argp argp = { options, opt_parse, args_doc, doc };
  */
 int main(int argc, char* argv[])
 {
+  // libcrypto is counted from its first allocation
+  alloc_crypto_hook();
+
   argp_parse(&argp, argc, argv, 0, 0, &args);
 
   srand(time(NULL));
 
-  debug_file_open("output.txt");
+  debug_filter_set(args.filter);
+
+  if(args.trace && trace_open(args.trace) != 0)
+  {
+    fprintf(stderr, "bunker: Failed to start trace\n");
+  }
+
+  if(args.capture && capture_open(args.capture) != 0)
+  {
+    fprintf(stderr, "bunker: Failed to start capture: %s\n", args.capture);
+  }
+
+  if(args.binary)
+  {
+    debug_binary_open("output.bin");
+  }
+  else debug_file_open("output.txt");
 
   info_print("Start main");
 
@@ -352,7 +619,19 @@ int main(int argc, char* argv[])
 
   if(strcmp(command, "join") == 0)
   {
-    join_routine();
+    TRACE_BEGIN("join_routine");
+
+    join_routine(false);
+
+    TRACE_END("join_routine");
+  }
+  else if(strcmp(command, "daemon") == 0)
+  {
+    join_routine(true);
+  }
+  else if(strcmp(command, "attach") == 0)
+  {
+    daemon_attach(args.socket, (args.arg_count >= 2) ? args.args[1] : NULL);
   }
   else if(strcmp(command, "list") == 0)
   {
@@ -374,9 +653,19 @@ int main(int argc, char* argv[])
   
   info_print("Stop main");
 
+  if(trace_close() != 0)
+  {
+    fprintf(stderr, "bunker: Failed to write trace: %s\n", args.trace);
+  }
+
+  if(capture_close() != 0)
+  {
+    fprintf(stderr, "bunker: Failed to write capture: %s\n", args.capture);
+  }
+
   debug_file_close();
 
   free(args.args);
 
   return 0;
-}
+}
\ No newline at end of file
@@ -11,9 +11,24 @@
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
 
 #include "file.h"
 #include "socket.h"
+#include "thread.h"
+#include "queue.h"
+#include "affinity.h"
+#include "crypto.h"
+#include "frame.h"
+#include "hist.h"
+#include "trace.h"
+#include "alloc.h"
+#include "wheel.h"
+#include "limit.h"
+#include "capture.h"
+#include "mux.h"
 
 typedef struct
 {
@@ -22,12 +37,159 @@ typedef struct
   int   port;
 } room_t;
 
+/*
+ * The first bytes of a public signing key, that identify a peer in frames
+ */
+#define PEER_ID_SIZE 8
+
+/*
+ * Heartbeats are sent every PING_INTERVAL milliseconds by default,
+ * and a peer that misses PING_MISSES of them in a row is not responding
+ */
+#define PING_INTERVAL 1000
+#define PING_MISSES   3
+
+/*
+ * The round trips to a peer, from the pongs to our pings
+ *
+ * - srtt   | Smoothed round-trip time, like SRTT of RFC 6298
+ * - rttvar | Smoothed deviation from srtt, like RTTVAR of RFC 6298
+ * - jitter | Smoothed change between round trips, like RFC 3550
+ * - loss   | Smoothed fraction of pings without a pong
+ */
+typedef struct
+{
+  uint64_t srtt;     // Nanoseconds
+  uint64_t rttvar;   // Nanoseconds
+  uint64_t jitter;   // Nanoseconds
+  uint64_t rtt;      // The last round trip, in nanoseconds
+  double   loss;
+  uint64_t sent;     // Pings sent to the peer
+  uint64_t lost;     // Pings without a pong
+  uint32_t misses;   // Pings in a row without a pong
+  bool     waiting;  // The pong of the last ping has not come
+} ping_stats_t;
+
+typedef struct
+{
+  char*        name;
+  uint8_t      public[SIGN_PUBLIC_SIZE];
+  uint8_t      secret[SECRET_SIZE];
+  ping_stats_t ping;
+  limit_t      limit;  // Signed frames from the peer, after they are verified
+  limit_t      files;  // Attachment chunks from the peer, after they are verified
+} peer_t;
+
+/*
+ * By default a peer may send LIMIT_MESSAGES messages a second,
+ * of LIMIT_MESSAGE_BYTES bytes each, and we send no more than that
+ *
+ * The frames of the whole room are limited to LIMIT_ROOM_PEERS peers
+ * at their limit before they are verified, so a flood costs no verifying
+ */
+#define LIMIT_MESSAGES      20
+#define LIMIT_MESSAGE_BYTES 4096
+#define LIMIT_ROOM_PEERS    16
+
+/*
+ * Heartbeats from the whole room, a second
+ */
+#define LIMIT_CONTROL       1000
+
+/*
+ * Bytes of attachment chunks a second, that we send. The chunks of the whole
+ * room are limited like the messages, to LIMIT_ROOM_PEERS peers at their limit
+ *
+ * A peer may send LIMIT_FILE_SLACK times as much, since the chunks that
+ * were sent at the limit come in bunched up after waiting in the sockets,
+ * and a chunk that is dropped makes every chunk after it be dropped too
+ */
+#define LIMIT_FILE_BYTES    (1024 * 1024)
+
+#define LIMIT_FILE_SLACK    2
+
+/*
+ * New peers are admitted at LIMIT_JOINS a second, up to PEERS_MAX peers,
+ * which is the most peers that a message can be wrapped for
+ */
+#define LIMIT_JOINS         5
+#define PEERS_MAX           255
+
+/*
+ * The limits of a room, kept by the network thread
+ *
+ * Our own messages are deferred until they are within the send limit,
+ * and frames from others over their limits are dropped
+ */
+typedef struct
+{
+  limit_t  room;          // Signed frames from every peer
+  limit_t  control;       // Heartbeats from every peer
+  limit_t  files;         // Attachment chunks from every peer
+  limit_t  send;          // Our own messages
+  limit_t  file_send;     // Our own attachment chunks
+  bucket_t joins;         // New peers
+  uint64_t dropped_joins;
+  uint64_t deferred;      // Our messages that waited for the send limit
+} room_limits_t;
+
+/*
+ * Buffers of the message path, that are created when joining a room,
+ * so that sending and recieving a message allocates nothing
+ *
+ * - frame | The signed text frame, with the body created in place
+ * - text  | The decrypted text of a recieved message
+ */
+#define MESSAGE_SCRATCH_SIZE (FRAME_HEAD_SIZE + FRAME_SIZE_MAX)
+
+typedef struct
+{
+  uint8_t* frame;
+  char*    text;
+} message_scratch_t;
+
+/*
+ * The stages of a message, from enter to the screen of a peer
+ *
+ * - input   | Handing the line to the network thread
+ * - encrypt | Encrypting the text with the message key
+ * - wrap    | Wrapping the message key for every peer
+ * - frame   | Signing the body and creating the frame
+ * - send    | Writing the frame to the socket
+ * - recv    | Verifying and handling a read of frames
+ * - decrypt | Unwrapping the message key and decrypting
+ * - render  | Handing the message to the UI thread and printing it
+ */
+typedef enum
+{
+  STAGE_INPUT,
+  STAGE_ENCRYPT,
+  STAGE_WRAP,
+  STAGE_FRAME,
+  STAGE_SEND,
+  STAGE_RECV,
+  STAGE_DECRYPT,
+  STAGE_RENDER,
+  STAGE_COUNT
+} stage_t;
+
+extern hist_t stage_hists[STAGE_COUNT];
+
+extern uint64_t stage_record(stage_t stage, uint64_t start);
+
+extern void     stats_print(FILE* stream);
+
+extern void     limits_print(FILE* stream, const room_limits_t* limits, const peer_t* peers, size_t count);
+
+
 extern int address_and_port_split(char** address, int* port, const char* string);
 
 extern int address_and_port_add(char* address, int port, char* name);
 
 extern int address_and_port_get(char** address, int* port, const char* string);
 
+extern int address_string_write(char* buffer, size_t size, const char* address, int port);
+
 
 extern int  rooms_load(room_t** rooms, size_t* count);
 
@@ -37,4 +199,276 @@ extern void rooms_free(room_t** rooms, size_t count);
 
 extern int room_del(room_t** rooms, size_t* count, const char* name);
 
+
+extern peer_t* peer_get(peer_t* peers, size_t count, const uint8_t* public);
+
+extern peer_t* peer_id_get(peer_t* peers, size_t count, const uint8_t* id);
+
+extern int     peer_add(peer_t** peers, size_t* count, const char* name, size_t length, const uint8_t* public, const uint8_t* secret);
+
+extern void    peers_free(peer_t** peers, size_t count);
+
+
+/*
+ * The text of a message is encrypted with AES-256-GCM under a new
+ * message key, and the message key is wrapped for every peer that
+ * we know, with the secret that we share with them. The secret is
+ * derived with HKDF from X25519 of our key and the key in their key frame
+ *
+ * So the relay only sees cipher, a peer that joins later can't read
+ * earlier messages, and a peer that is not a recipient can't read it.
+ * The text is encrypted once however many peers there are, and
+ * a new key for every message means that its nonce can't repeat
+ *
+ * The frame is signed by the sender, so the recipients and the
+ * wraps can't be changed, and a changed cipher fails the tag
+ */
+extern int  message_create(uint8_t* body, size_t* size, size_t max, const char* text, size_t length, const peer_t* peers, size_t count);
+
+extern int  message_read(char* text, size_t* length, size_t max, const uint8_t* body, size_t size, const peer_t* peer, const uint8_t* public);
+
+extern int  message_scratch_create(message_scratch_t* scratch);
+
+extern void message_scratch_free(message_scratch_t* scratch);
+
+extern int  message_send(mux_t* mux, message_scratch_t* scratch, const sign_key_t* key, const char* text, size_t length, const peer_t* peers, size_t count);
+
+
+/*
+ * An attachment is sent a chunk at a time on a bulk stream of its own,
+ * so the file is never read whole, and chat frames go between the chunks
+ *
+ * Every chunk says where in the file it goes, so the recipients write
+ * it in place in a part file in ATTACHMENT_DIR, and a transfer that
+ * was cut off goes on from an offset with /resume. The part file
+ * gets the name of the attachment when its last byte is written
+ *
+ * The files of a sender are in a directory of their own,
+ * named by the hex of their peer id, so that a sender can't
+ * write over the files of another. A whole file is never
+ * written over, but gets a name with ATTACHMENT_COPIES_MAX
+ * numbers to choose from, like name.1
+ *
+ * The sender keeps ATTACHMENT_QUEUED chunks waiting in the mux
+ */
+#define ATTACHMENT_DIR        "../assets/files"
+
+#define ATTACHMENT_STREAM     1
+
+#define ATTACHMENT_CHUNK_SIZE 32768
+
+#define ATTACHMENT_QUEUED     2
+
+#define ATTACHMENT_NAME_MAX   255
+
+#define ATTACHMENT_COPIES_MAX 100
+
+/*
+ * ATTACHMENT_DIR / peer id, and / name .number after it
+ */
+#define ATTACHMENT_DIR_SIZE   (sizeof(ATTACHMENT_DIR) + 1 + PEER_ID_SIZE * 2)
+
+#define ATTACHMENT_PATH_SIZE  (ATTACHMENT_DIR_SIZE + 1 + ATTACHMENT_NAME_MAX + 5)
+
+/*
+ * An attachment that we send
+ */
+typedef struct
+{
+  char*  path;
+  char*  name;    // The name of the file, without directories
+  size_t size;
+  size_t offset;  // The bytes that are sent
+} attachment_t;
+
+/*
+ * A chunk of an attachment, that is read from a frame
+ */
+typedef struct
+{
+  const uint8_t* sender;  // The public key of the sender
+  const char*    name;
+  size_t         name_length;
+  uint64_t       size;    // Bytes of the whole file
+  uint64_t       offset;  // Where in the file the chunk goes
+  const char*    data;
+  size_t         length;
+} attachment_chunk_t;
+
+extern int  attachment_open(attachment_t* attachment, const char* path, size_t offset);
+
+extern void attachment_close(attachment_t* attachment);
+
+extern size_t attachment_chunk_size_get(const attachment_t* attachment, size_t count);
+
+extern int  attachment_chunk_send(mux_t* mux, message_scratch_t* scratch, const sign_key_t* key, attachment_t* attachment, const peer_t* peers, size_t count);
+
+extern int  attachment_chunk_read(attachment_chunk_t* chunk, message_scratch_t* scratch, const uint8_t* body, size_t size, const peer_t* peer, const uint8_t* public);
+
+extern int  attachment_chunk_store(char* path, const attachment_chunk_t* chunk);
+
+
+/*
+ * A room at a udp: address has the heartbeats and the messages
+ * on streams of their own, so that they don't wait for each other
+ *
+ * The bridge paces the datagrams to UDP_PACE_RATE bytes a second,
+ * and its retransmission timers tick every UDP_TICK_SIZE nanoseconds
+ */
+#define UDP_STREAM_CONTROL  0
+#define UDP_STREAM_MESSAGES 1
+
+#define UDP_PACE_RATE       (1024.0 * 1024)
+#define UDP_TICK_SIZE       1000000
+
+extern int udp_socket_create(const char* address, int port);
+
+
+extern int  ping_send(mux_t* mux, const uint8_t* public, uint32_t sequence, uint64_t time);
+
+extern int  pong_send(mux_t* mux, const uint8_t* public, const uint8_t* ping, size_t size);
+
+extern int  pong_read(const uint8_t** id, uint32_t* sequence, uint64_t* time, const uint8_t* pong, size_t size, const uint8_t* public);
+
+extern bool ping_sample(ping_stats_t* stats, uint64_t rtt);
+
+extern bool ping_miss(ping_stats_t* stats);
+
+extern void pings_print(FILE* stream, const peer_t* peers, size_t count);
+
+
+/*
+ * The number of lines that can wait for the network and UI threads
+ */
+#define LINE_QUEUE_SIZE 64
+#define UI_QUEUE_SIZE   1024
+
+/*
+ * The maximum number of lines handled from one pop
+ */
+#define LINE_POP_MAX 32
+
+/*
+ * The number of pooled lines for the network and UI threads,
+ * and the size of the text of a pooled line
+ *
+ * A longer line, or a line when every pooled line is in use, is allocated
+ */
+#define INPUT_POOL_SIZE LINE_QUEUE_SIZE
+#define UI_POOL_SIZE    256
+#define LINE_TEXT_SIZE  2048
+
+/*
+ * A line that belongs to no room, or that is sent to the active room
+ */
+#define ROOM_NONE -1
+
+typedef struct line_pool_t line_pool_t;
+
+/*
+ * A line of text, that is handed from one thread to another
+ */
+typedef struct
+{
+  uint64_t     time;   // When the line was handed over
+  line_pool_t* pool;   // The pool to give the line back to, NULL if allocated
+  int          room;   // The session of the line, or ROOM_NONE
+  size_t       length;
+  char         text[];
+} line_t;
+
+/*
+ * Lines that are created when joining a room, and reused
+ *
+ * One thread takes lines from a pool and another gives them back,
+ * so the free lines are kept in a SPSC queue
+ */
+struct line_pool_t
+{
+  uint8_t*     lines;
+  spsc_queue_t free;
+};
+
+extern spsc_queue_t line_queue;
+
+extern line_pool_t  input_pool;
+
+extern line_pool_t  ui_pool;
+
+extern mpsc_queue_t ui_queue;
+
+extern atomic_bool  room_closed;
+
+extern int     line_pool_create(line_pool_t* pool, size_t count);
+
+extern void    line_pool_free(line_pool_t* pool);
+
+extern line_t* line_create(line_pool_t* pool, size_t size);
+
+extern void    line_append(line_t* line, const char* text, size_t length);
+
+extern void    line_free(line_t* line);
+
+extern void    ui_line_push(line_t* line);
+
+extern int     room_buffers_create(void);
+
+extern void    room_buffers_free(void);
+
+extern void    input_run(FILE* stream);
+
+extern void    ui_run(FILE* stream);
+
+
+/*
+ * The maximum number of rooms that are joined at once
+ */
+#define SESSIONS_MAX 32
+
+/*
+ * A joined room, with its connection, peers, heartbeats and limits
+ *
+ * Only the network thread sends frames and changes sessions, so they need no locks
+ */
+typedef struct
+{
+  char*          name;           // The name of the room, or its address
+  int            sockfd;
+  mux_t          mux;            // The streams of the socket, that every frame is written through
+  peer_t*        peers;
+  size_t         peer_count;
+  frame_buffer_t buffer;
+  room_limits_t  limits;
+  wheel_timer_t  ping_timer;     // Sends a heartbeat every session_ping milliseconds
+  uint32_t       ping_sequence;
+  attachment_t   attachment;     // The file that is sent, if its path is set
+  wheel_timer_t  file_timer;     // Wakes the network thread, when the next chunk is within the limit
+  bool           closed;
+} session_t;
+
+extern session_t sessions[SESSIONS_MAX];
+
+extern size_t    session_count;
+
+extern int       session_ping;
+
+extern int       session_limit;
+
+extern message_scratch_t scratch;
+
+extern int  sessions_join(char* name, char** addresses, int* ports, char** rooms, size_t count);
+
+extern void sessions_run(int cpu);
+
+extern void sessions_free(void);
+
+
+extern int  daemon_open(const char* path);
+
+extern void daemon_close(const char* path);
+
+extern void daemon_run(void);
+
+extern void daemon_attach(const char* path, const char* room);
+
 #endif // BUNKER_H
@@ -0,0 +1,308 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+
+/*
+ * BODY
+ * - uint64_t size         | Bytes of the whole file
+ * - uint64_t offset       | Where in the file the chunk goes
+ * - uint8_t  length       | Bytes of the name
+ * - char     name[length] | Name of the file
+ * - message               | The chunk, encrypted like a text message
+ */
+#define ATTACHMENT_HEAD_SIZE 17
+
+/*
+ * Check that a name can be a file in ATTACHMENT_DIR, and nowhere else
+ *
+ * A name can't have directories, and can't be hidden, like . and ..
+ */
+static bool attachment_name_is_valid(const char* name, size_t length)
+{
+  if(length == 0 || length > ATTACHMENT_NAME_MAX || name[0] == '.') return false;
+
+  for(size_t index = 0; index < length; index++)
+  {
+    if(name[index] == '/' || name[index] == '\0') return false;
+  }
+
+  return true;
+}
+
+/*
+ * Open a file to send as an attachment, from offset
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The name of the file can't be sent
+ * - 2 | The file is empty, or can't be read
+ * - 3 | The offset is not in the file
+ * - 4 | Failed to allocate memory
+ */
+int attachment_open(attachment_t* attachment, const char* path, size_t offset)
+{
+  const char* slash = strrchr(path, '/');
+
+  const char* name = slash ? slash + 1 : path;
+
+  if(!attachment_name_is_valid(name, strlen(name))) return 1;
+
+  size_t size = file_size_get(path);
+
+  if(size == 0) return 2;
+
+  if(offset >= size) return 3;
+
+  *attachment = (attachment_t)
+  {
+    .path   = tag_strdup(ALLOC_ROOM, path),
+    .name   = tag_strdup(ALLOC_ROOM, name),
+    .size   = size,
+    .offset = offset
+  };
+
+  if(!attachment->path || !attachment->name)
+  {
+    attachment_close(attachment);
+
+    return 4;
+  }
+
+  return 0;
+}
+
+/*
+ * Close an attachment, that is sent or cut off
+ */
+void attachment_close(attachment_t* attachment)
+{
+  tag_free(ALLOC_ROOM, attachment->path);
+  tag_free(ALLOC_ROOM, attachment->name);
+
+  *attachment = (attachment_t) { 0 };
+}
+
+/*
+ * Get the bytes of the signed data of the next chunk, for count peers,
+ * which is what the peers take from their limit of attachments
+ */
+size_t attachment_chunk_size_get(const attachment_t* attachment, size_t count)
+{
+  size_t left = attachment->size - attachment->offset;
+
+  size_t length = (left < ATTACHMENT_CHUNK_SIZE) ? left : ATTACHMENT_CHUNK_SIZE;
+
+  if(count > PEERS_MAX) count = PEERS_MAX;
+
+  size_t message_size = 1 + count * (PEER_ID_SIZE + WRAP_SIZE) + length + AEAD_EXTRA_SIZE;
+
+  return ATTACHMENT_HEAD_SIZE + strlen(attachment->name) + message_size;
+}
+
+/*
+ * Encrypt the next chunk of an attachment for every peer,
+ * and send it in a signed file frame on ATTACHMENT_STREAM
+ *
+ * The chunk is read into the text buffer of scratch, and is
+ * encrypted from there into the frame, so at most a chunk
+ * of the file is in memory, however large the file is
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to read the file
+ * - 2 | Failed to encrypt the chunk
+ * - 3 | Failed to send the chunk
+ */
+int attachment_chunk_send(mux_t* mux, message_scratch_t* scratch, const sign_key_t* key, attachment_t* attachment, const peer_t* peers, size_t count)
+{
+  size_t left = attachment->size - attachment->offset;
+
+  size_t length = (left < ATTACHMENT_CHUNK_SIZE) ? left : ATTACHMENT_CHUNK_SIZE;
+
+  if(file_chunk_read(scratch->text, length, attachment->path, attachment->offset) != length) return 1;
+
+  uint8_t* body = scratch->frame + FRAME_HEAD_SIZE + FRAME_SIGN_SIZE;
+
+  size_t name_length = strlen(attachment->name);
+
+  number_write(body,     attachment->size,   8);
+  number_write(body + 8, attachment->offset, 8);
+
+  body[16] = name_length;
+
+  memcpy(body + ATTACHMENT_HEAD_SIZE, attachment->name, name_length);
+
+  size_t head_size = ATTACHMENT_HEAD_SIZE + name_length;
+
+  size_t size;
+
+  if(message_create(body + head_size, &size, FRAME_SIZE_MAX - FRAME_SIGN_SIZE - head_size, scratch->text, length, peers, count) != 0) return 2;
+
+  size_t frame_size;
+
+  if(frame_signed_write(scratch->frame, &frame_size, FRAME_FILE, ATTACHMENT_STREAM, key, head_size + size) != 0) return 3;
+
+  if(mux_write(mux, ATTACHMENT_STREAM, scratch->frame, frame_size) != 0) return 3;
+
+  attachment->offset += length;
+
+  return 0;
+}
+
+/*
+ * Read a chunk of an attachment from a file frame body, sent by peer
+ *
+ * The data of the chunk is decrypted into the text buffer of scratch,
+ * and the name points into the body
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad chunk
+ * - 2 | The chunk was not wrapped for us
+ * - 3 | Failed to decrypt the chunk
+ */
+int attachment_chunk_read(attachment_chunk_t* chunk, message_scratch_t* scratch, const uint8_t* body, size_t size, const peer_t* peer, const uint8_t* public)
+{
+  if(!chunk || !body || size < ATTACHMENT_HEAD_SIZE) return 1;
+
+  chunk->size        = number_read(body,     8);
+  chunk->offset      = number_read(body + 8, 8);
+  chunk->name_length = body[16];
+  chunk->name        = (const char*) body + ATTACHMENT_HEAD_SIZE;
+
+  size_t head_size = ATTACHMENT_HEAD_SIZE + chunk->name_length;
+
+  if(size < head_size || !attachment_name_is_valid(chunk->name, chunk->name_length)) return 1;
+
+  size_t length;
+
+  int status = message_read(scratch->text, &length, MESSAGE_SCRATCH_SIZE, body + head_size, size - head_size, peer, public);
+
+  if(status == 2) return 2;
+
+  if(status != 0) return (status == 3) ? 3 : 1;
+
+  if(chunk->offset > chunk->size || length > chunk->size - chunk->offset) return 1;
+
+  chunk->sender = peer->public;
+  chunk->data   = scratch->text;
+  chunk->length = length;
+
+  return 0;
+}
+
+/*
+ * Write the directory of the files of the sender of a chunk to path,
+ * which is the hex of the peer id of the sender, and create it
+ * with the .parts directory in it, where the part files are
+ *
+ * RETURN (int length)
+ * - The length of the path
+ */
+static int sender_dir_create(char* path, size_t size, const uint8_t* sender)
+{
+  mkdir(ATTACHMENT_DIR, 0700);
+
+  int length = snprintf(path, size, "%s/", ATTACHMENT_DIR);
+
+  for(size_t index = 0; index < PEER_ID_SIZE; index++)
+  {
+    length += snprintf(path + length, size - length, "%02x", sender[index]);
+  }
+
+  mkdir(path, 0700);
+
+  char parts_path[ATTACHMENT_DIR_SIZE + 7];
+
+  snprintf(parts_path, sizeof(parts_path), "%s/.parts", path);
+
+  mkdir(parts_path, 0700);
+
+  return length;
+}
+
+/*
+ * Give a whole part file a name that no file has, which is
+ * the name of the attachment, or the name with a number after it
+ *
+ * link fails if there is a file with the name,
+ * so a file is never written over
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to give the file a name
+ */
+static int part_file_finish(char* path, const char* part_path, const char* dir, const attachment_chunk_t* chunk)
+{
+  int name_length = (chunk->name_length < ATTACHMENT_NAME_MAX) ? chunk->name_length : ATTACHMENT_NAME_MAX;
+
+  for(int number = 0; number <= ATTACHMENT_COPIES_MAX; number++)
+  {
+    if(number == 0)
+    {
+      snprintf(path, ATTACHMENT_PATH_SIZE, "%s/%.*s", dir, name_length, chunk->name);
+    }
+    else snprintf(path, ATTACHMENT_PATH_SIZE, "%s/%.*s.%d", dir, name_length, chunk->name, number);
+
+    if(link(part_path, path) == 0)
+    {
+      remove(part_path);
+
+      return 0;
+    }
+
+    if(errno != EEXIST) return 1;
+  }
+
+  return 1;
+}
+
+/*
+ * Write a chunk in place in the part file of its attachment,
+ * and give the part file the name of the attachment when it is whole
+ *
+ * The files are in the directory of the sender of the chunk,
+ * so a chunk only starts or ends a part file of its own sender
+ *
+ * The first chunk starts a new part file, and a chunk after bytes
+ * that never came is dropped, so that a part file has no holes.
+ * A chunk that is sent again is written over itself
+ *
+ * PARAMS
+ * - char* path | Buffer of ATTACHMENT_PATH_SIZE, for the path of the whole file
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Success, and the attachment is whole
+ * - 2 | Bytes before the chunk are missing
+ * - 3 | Failed to write the chunk
+ */
+int attachment_chunk_store(char* path, const attachment_chunk_t* chunk)
+{
+  char dir[ATTACHMENT_DIR_SIZE];
+
+  sender_dir_create(dir, sizeof(dir), chunk->sender);
+
+  // The name is already checked, but the length is kept in range
+  int name_length = (chunk->name_length < ATTACHMENT_NAME_MAX) ? chunk->name_length : ATTACHMENT_NAME_MAX;
+
+  // A name can't start with a dot, so no whole file is in .parts
+  char part_path[ATTACHMENT_PATH_SIZE + 7];
+
+  snprintf(part_path, sizeof(part_path), "%s/.parts/%.*s", dir, name_length, chunk->name);
+
+  if(chunk->offset == 0) remove(part_path);
+
+  else if(chunk->offset > file_size_get(part_path)) return 2;
+
+  if(file_chunk_write(chunk->data, chunk->length, part_path, chunk->offset) != chunk->length) return 3;
+
+  if(chunk->offset + chunk->length < chunk->size) return 0;
+
+  return (part_file_finish(path, part_path, dir, chunk) == 0) ? 1 : 3;
+}
@@ -0,0 +1,578 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+#include "../debug.h"
+
+#include <sys/stat.h>
+
+/*
+ * The maximum number of front-ends attached to the daemon
+ */
+#define FRONTS_MAX 16
+
+/*
+ * The lines that the daemon keeps, and shows to a new front-end
+ *
+ * The kept lines are not given back to the pool,
+ * so there must be fewer of them than UI_POOL_SIZE
+ */
+#define HISTORY_LINES 128
+/*
+ * A front-end that is attached to the daemon over the unix socket
+ */
+typedef struct
+{
+  int    fd;
+  int    room;                    // The room it sends to and shows, or ROOM_NONE for all
+  bool   attached;                // It has sent /attach, and is shown lines
+  char   buffer[LINE_TEXT_SIZE];  // The start of a line that is not whole yet
+  size_t length;
+} front_t;
+
+// The unix socket, front-ends and history are only used by the daemon thread
+static int daemon_sockfd = -1;
+
+static front_t fronts[FRONTS_MAX];
+static size_t  front_count = 0;
+
+static line_t* history[HISTORY_LINES];
+static size_t  history_start = 0;
+static size_t  history_count = 0;
+
+/*
+ * Keep a line in the history, instead of freeing it,
+ * and free the oldest line if the history is full
+ */
+static void history_add(line_t* line)
+{
+  if(history_count == HISTORY_LINES)
+  {
+    line_free(history[history_start]);
+
+    history_start = (history_start + 1) % HISTORY_LINES;
+
+    history_count--;
+  }
+
+  history[(history_start + history_count) % HISTORY_LINES] = line;
+
+  history_count++;
+}
+
+/*
+ * Free the lines of the history
+ */
+static void history_free(void)
+{
+  for(size_t index = 0; index < history_count; index++)
+  {
+    line_free(history[(history_start + index) % HISTORY_LINES]);
+  }
+
+  history_start = 0;
+  history_count = 0;
+}
+
+/*
+ * Write text to a front-end, without waiting
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The front-end is gone, or too slow to keep up
+ */
+static int front_text_write(const front_t* front, const char* text, size_t length)
+{
+  size_t index = 0;
+
+  while(index < length)
+  {
+    ssize_t status = send(front->fd, text + index, length - index, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if(status == -1 && errno == EINTR) continue;
+
+    if(status <= 0) return 1;
+
+    index += status;
+  }
+
+  return 0;
+}
+
+/*
+ * Write a line to a front-end, if it shows the room of the line
+ *
+ * RETURN (same as front_text_write)
+ */
+static int front_line_write(const front_t* front, const line_t* line)
+{
+  if(!front->attached) return 0;
+
+  if(front->room != ROOM_NONE && line->room != ROOM_NONE && line->room != front->room) return 0;
+
+  return front_text_write(front, line->text, line->length);
+}
+
+/*
+ * Detach a front-end, and close its socket
+ */
+static void front_close(size_t index)
+{
+  socket_close(&fronts[index].fd);
+
+  fronts[index] = fronts[--front_count];
+}
+
+/*
+ * Find a room by its number or its name
+ *
+ * The names of the sessions are not changed while the threads run,
+ * so the daemon thread can read them
+ *
+ * RETURN (int room)
+ * - ROOM_NONE | No room by that number or name
+ */
+static int front_room_find(const char* string, size_t length)
+{
+  char* end;
+
+  long number = strtol(string, &end, 10);
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    bool is_match = (end == string + length) ? (number == (long) index + 1) :
+      (strlen(sessions[index].name) == length && strncmp(sessions[index].name, string, length) == 0);
+
+    if(is_match) return index;
+  }
+
+  return ROOM_NONE;
+}
+
+/*
+ * Set the room of a front-end, from the rest of /attach or /room
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | No such room, and the front-end is shown every room
+ */
+static int front_room_set(front_t* front, const char* string, size_t length)
+{
+  if(length == 0)
+  {
+    front->room = ROOM_NONE;
+
+    return 0;
+  }
+
+  front->room = front_room_find(string, length);
+
+  return (front->room == ROOM_NONE) ? 1 : 0;
+}
+
+/*
+ * Handle a line from a front-end
+ *
+ * - /attach [ROOM] | Show the history and the lines of ROOM, or of every room
+ * - /room ROOM     | Send the next lines to ROOM, and only show its lines
+ * - /stop          | Stop the daemon
+ *
+ * Other lines are handed to the network thread, like lines from stdin,
+ * with the room of the front-end
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to write to the front-end
+ * - 2 | The daemon should stop
+ */
+static int front_line_handle(front_t* front, const char* text, size_t length)
+{
+  if(length >= 7 && strncmp(text, "/attach", 7) == 0 && (length == 7 || text[7] == ' '))
+  {
+    size_t skip = (length > 7) ? 8 : 7;
+
+    if(front_room_set(front, text + skip, length - skip) != 0)
+    {
+      if(front_text_write(front, "No such room\n", 13) != 0) return 1;
+    }
+
+    front->attached = true;
+
+    for(size_t index = 0; index < history_count; index++)
+    {
+      if(front_line_write(front, history[(history_start + index) % HISTORY_LINES]) != 0) return 1;
+    }
+
+    return 0;
+  }
+
+  if(length > 6 && strncmp(text, "/room ", 6) == 0)
+  {
+    if(front_room_set(front, text + 6, length - 6) != 0)
+    {
+      return front_text_write(front, "No such room\n", 13);
+    }
+
+    const char* name = sessions[front->room].name;
+
+    if(front_text_write(front, "Room: ", 6) != 0 ||
+       front_text_write(front, name, strlen(name)) != 0 ||
+       front_text_write(front, "\n", 1) != 0) return 1;
+
+    return 0;
+  }
+
+  if(length == 5 && strncmp(text, "/stop", 5) == 0) return 2;
+
+  line_t* line = line_create(&input_pool, length);
+
+  if(!line) return 0;
+
+  line_append(line, text, length);
+
+  line->room = front->room;
+  line->time = hist_time_get();
+
+  while(spsc_queue_push(&line_queue, (void* const*) &line, 1) == 0)
+  {
+    if(atomic_load(&room_closed))
+    {
+      line_free(line);
+      break;
+    }
+
+    usleep(1000);
+  }
+
+  return 0;
+}
+
+/*
+ * Read from a front-end, and handle its whole lines
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of file, or failed to read
+ * - 2 | The daemon should stop
+ */
+static int front_read(front_t* front)
+{
+  ssize_t amount = read(front->fd, front->buffer + front->length, sizeof(front->buffer) - front->length);
+
+  if(amount == -1 && errno == EINTR) return 0;
+
+  if(amount <= 0) return 1;
+
+  front->length += amount;
+
+  size_t start = 0;
+
+  for(size_t index = start; index < front->length; index++)
+  {
+    if(front->buffer[index] != '\n') continue;
+
+    size_t length = index - start;
+
+    int status = (length > 0) ? front_line_handle(front, front->buffer + start, length) : 0;
+
+    if(status != 0) return status;
+
+    start = index + 1;
+  }
+
+  // A line that fills the buffer is handled as it is
+  if(start == 0 && front->length == sizeof(front->buffer))
+  {
+    int status = front_line_handle(front, front->buffer, front->length);
+
+    if(status != 0) return status;
+
+    start = front->length;
+  }
+
+  memmove(front->buffer, front->buffer + start, front->length - start);
+
+  front->length -= start;
+
+  return 0;
+}
+
+/*
+ * Hand the lines of front-ends to the network thread, and show
+ * the lines of the network thread to the front-ends, instead of
+ * the input and UI threads, until the network thread stops
+ *
+ * Lines that are shown are kept in the history for new front-ends
+ */
+void daemon_run(void)
+{
+  struct pollfd fds[2 + FRONTS_MAX];
+
+  line_t* lines[LINE_POP_MAX];
+
+  bool is_stopping = false;
+  bool is_stopped  = false;
+
+  while(!is_stopped)
+  {
+    fds[0] = (struct pollfd) { .fd = ui_queue.fd, .events = POLLIN };
+
+    fds[1] = (struct pollfd) { .fd = is_stopping ? -1 : daemon_sockfd, .events = POLLIN };
+
+    for(size_t index = 0; index < front_count; index++)
+    {
+      fds[2 + index] = (struct pollfd) { .fd = fronts[index].fd, .events = POLLIN };
+    }
+
+    size_t poll_count = 2 + front_count;
+
+    if(poll(fds, poll_count, -1) == -1)
+    {
+      if(errno == EINTR) continue;
+
+      break;
+    }
+
+    // The front-ends are read before any is closed, from the back,
+    // since closing one moves the last to its place
+    for(size_t index = poll_count - 2; index-- > 0;)
+    {
+      if(!(fds[2 + index].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+      int status = front_read(&fronts[index]);
+
+      if(status == 2 && !is_stopping)
+      {
+        // The NULL line stops the network thread
+        line_t* line = NULL;
+
+        while(spsc_queue_push(&line_queue, (void* const*) &line, 1) == 0 && !atomic_load(&room_closed))
+        {
+          usleep(1000);
+        }
+
+        is_stopping = true;
+      }
+
+      if(status != 0) front_close(index);
+    }
+
+    if(fds[0].revents & POLLIN)
+    {
+      queue_wait(ui_queue.fd);
+
+      size_t count;
+
+      while((count = mpsc_queue_pop(&ui_queue, (void**) lines, LINE_POP_MAX)) > 0)
+      {
+        for(size_t index = 0; index < count; index++)
+        {
+          line_t* line = lines[index];
+
+          if(!line)
+          {
+            is_stopped = true;
+            continue;
+          }
+
+          for(size_t front_index = front_count; front_index-- > 0;)
+          {
+            if(front_line_write(&fronts[front_index], line) != 0) front_close(front_index);
+          }
+
+          stage_record(STAGE_RENDER, line->time);
+
+          history_add(line);
+        }
+      }
+    }
+
+    if(fds[1].revents & POLLIN)
+    {
+      int fd = accept(daemon_sockfd, NULL, NULL);
+
+      if(fd == -1) continue;
+
+      if(!unix_peer_is_user(fd))
+      {
+        error_print("Dropped front-end of another user");
+
+        close(fd);
+        continue;
+      }
+
+      if(front_count == FRONTS_MAX)
+      {
+        error_print("Dropped front-end over the limit of %d", FRONTS_MAX);
+
+        close(fd);
+        continue;
+      }
+
+      fronts[front_count++] = (front_t) { .fd = fd, .room = ROOM_NONE };
+    }
+  }
+
+  while(front_count > 0) front_close(front_count - 1);
+
+  history_free();
+}
+
+/*
+ * Create the directory of the daemon socket with mode 0700,
+ * or check that it is only open to the user if it is there
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create the directory
+ * - 2 | The directory is open to other users
+ */
+static int daemon_dir_create(const char* path)
+{
+  char dir[strlen(path) + 2];
+
+  strcpy(dir, path);
+
+  char* slash = strrchr(dir, '/');
+
+  if(!slash) strcpy(dir, ".");
+
+  else if(slash == dir) slash[1] = '\0';
+
+  else *slash = '\0';
+
+  if(mkdir(dir, 0700) == -1 && errno != EEXIST) return 1;
+
+  struct stat status;
+
+  if(stat(dir, &status) == -1) return 1;
+
+  if(status.st_uid != getuid() || (status.st_mode & 077)) return 2;
+
+  return 0;
+}
+
+/*
+ * Listen on the unix socket at path, for front-ends to attach to,
+ * in a directory that is only open to the user
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create the directory
+ * - 2 | The directory is open to other users
+ * - 3 | A daemon is already running
+ * - 4 | Failed to create the socket
+ */
+int daemon_open(const char* path)
+{
+  int status = daemon_dir_create(path);
+
+  if(status != 0) return status;
+
+  if((daemon_sockfd = unix_server_socket_create(path)) < 0)
+  {
+    status = (daemon_sockfd == -2) ? 3 : 4;
+
+    daemon_sockfd = -1;
+
+    return status;
+  }
+
+  return 0;
+}
+
+/*
+ * Stop listening on the unix socket at path, and remove it
+ */
+void daemon_close(const char* path)
+{
+  socket_close(&daemon_sockfd);
+
+  unlink(path);
+}
+
+/*
+ * Attach to the daemon at path, and chat in its rooms through it
+ *
+ * The first line to the daemon is /attach, with the room to show,
+ * and after that the bytes are passed through both ways,
+ * so no keys are created and no room is connected to
+ *
+ * PARAMS
+ * - const char* room | The room to show, or NULL for every room
+ */
+void daemon_attach(const char* path, const char* room)
+{
+  int sockfd = unix_client_socket_create(path);
+
+  if(sockfd == -1)
+  {
+    printf("bunker: No daemon is running (%s)\n", path);
+
+    return;
+  }
+
+  char buffer[LINE_TEXT_SIZE];
+
+  int length;
+
+  if(room)
+  {
+    length = snprintf(buffer, sizeof(buffer), "/attach %s\n", room);
+  }
+  else length = snprintf(buffer, sizeof(buffer), "/attach\n");
+
+  if(length >= (int) sizeof(buffer) || socket_write(sockfd, buffer, length) != length)
+  {
+    printf("bunker: Failed to attach to daemon\n");
+
+    socket_close(&sockfd);
+
+    return;
+  }
+
+  struct pollfd fds[2] =
+  {
+    { .fd = STDIN_FILENO, .events = POLLIN },
+    { .fd = sockfd,       .events = POLLIN }
+  };
+
+  while(true)
+  {
+    if(poll(fds, 2, -1) == -1)
+    {
+      if(errno == EINTR) continue;
+
+      break;
+    }
+
+    if(fds[0].revents & (POLLIN | POLLHUP))
+    {
+      ssize_t amount = read(STDIN_FILENO, buffer, sizeof(buffer));
+
+      // At end of input, the daemon detaches us and closes the socket
+      if(amount <= 0)
+      {
+        shutdown(sockfd, SHUT_WR);
+
+        fds[0].fd = -1;
+      }
+      else if(socket_write(sockfd, buffer, amount) != amount) break;
+    }
+
+    if(fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+      ssize_t amount = read(sockfd, buffer, sizeof(buffer));
+
+      if(amount <= 0) break;
+
+      fwrite(buffer, 1, amount, stdout);
+
+      fflush(stdout);
+    }
+  }
+
+  socket_close(&sockfd);
+}
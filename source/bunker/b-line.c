@@ -0,0 +1,282 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+// Lines from the input thread to the network thread, NULL at end of file
+spsc_queue_t line_queue;
+
+// Taken by the input thread and given back by the network thread
+line_pool_t input_pool;
+
+// Taken by the network thread and given back by the UI thread
+line_pool_t ui_pool;
+
+// Lines to print, from the network and input threads, NULL when the network thread stops
+mpsc_queue_t ui_queue;
+
+// Set when the network thread stops, so that no thread waits to hand over a line
+atomic_bool room_closed = false;
+
+/*
+ * Create a pool of count lines, that are all free
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate pool
+ */
+int line_pool_create(line_pool_t* pool, size_t count)
+{
+  size_t line_size = sizeof(line_t) + LINE_TEXT_SIZE;
+
+  if(!(pool->lines = tag_malloc(ALLOC_UI, line_size * count))) return 1;
+
+  if(spsc_queue_create(&pool->free, count) != 0)
+  {
+    tag_free(ALLOC_UI, pool->lines);
+
+    return 1;
+  }
+
+  for(size_t index = 0; index < count; index++)
+  {
+    line_t* line = (line_t*) (pool->lines + index * line_size);
+
+    line->pool = pool;
+
+    spsc_queue_push(&pool->free, (void* const*) &line, 1);
+  }
+
+  return 0;
+}
+
+/*
+ * Free a pool, after every line is given back
+ */
+void line_pool_free(line_pool_t* pool)
+{
+  spsc_queue_free(&pool->free);
+
+  tag_free(ALLOC_UI, pool->lines);
+
+  pool->lines = NULL;
+}
+
+/*
+ * Create an empty line with room for size characters,
+ * from the pool if it fits and a pooled line is free
+ *
+ * RETURN (line_t* line)
+ * - NULL | Failed to allocate line
+ */
+line_t* line_create(line_pool_t* pool, size_t size)
+{
+  line_t* line;
+
+  if(!pool || size >= LINE_TEXT_SIZE || spsc_queue_pop(&pool->free, (void**) &line, 1) == 0)
+  {
+    if(!(line = tag_malloc(ALLOC_UI, sizeof(line_t) + size + 1))) return NULL;
+
+    line->pool = NULL;
+  }
+
+  line->room    = ROOM_NONE;
+  line->length  = 0;
+  line->text[0] = '\0';
+
+  return line;
+}
+
+/*
+ * Append text to a line, which must have room for it
+ */
+void line_append(line_t* line, const char* text, size_t length)
+{
+  memcpy(line->text + line->length, text, length);
+
+  line->length += length;
+
+  line->text[line->length] = '\0';
+}
+
+/*
+ * Give a line back to its pool, or free it if it was allocated
+ */
+void line_free(line_t* line)
+{
+  if(!line) return;
+
+  if(line->pool)
+  {
+    spsc_queue_push(&line->pool->free, (void* const*) &line, 1);
+  }
+  else tag_free(ALLOC_UI, line);
+}
+
+/*
+ * Hand a line to the UI thread, and wait while the queue is full
+ *
+ * The line is freed if the network thread has already stopped,
+ * because then the UI thread might not pop it
+ */
+void ui_line_push(line_t* line)
+{
+  if(!line) return;
+
+  line->time = hist_time_get();
+
+  while(mpsc_queue_push(&ui_queue, (void* const*) &line, 1) == 0)
+  {
+    if(atomic_load(&room_closed))
+    {
+      line_free(line);
+
+      return;
+    }
+
+    usleep(1000);
+  }
+}
+
+/*
+ * Create the queues, lines and buffers of the room threads,
+ * so that the threads don't allocate while passing messages
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create some of them, which room_buffers_free frees
+ */
+int room_buffers_create(void)
+{
+  if(spsc_queue_create(&line_queue, LINE_QUEUE_SIZE) != 0) return 1;
+
+  if(mpsc_queue_create(&ui_queue, UI_QUEUE_SIZE) != 0) return 1;
+
+  if(line_pool_create(&input_pool, INPUT_POOL_SIZE) != 0) return 1;
+
+  if(line_pool_create(&ui_pool, UI_POOL_SIZE) != 0) return 1;
+
+  if(message_scratch_create(&scratch) != 0) return 1;
+
+  return 0;
+}
+
+/*
+ * Free the queues, lines and buffers of the room threads,
+ * after the threads are joined
+ */
+void room_buffers_free(void)
+{
+  line_t* line;
+
+  // Give back the lines that were left in the queues
+  if(line_queue.items)
+  {
+    while(spsc_queue_pop(&line_queue, (void**) &line, 1) > 0) line_free(line);
+  }
+
+  if(ui_queue.slots)
+  {
+    while(mpsc_queue_pop(&ui_queue, (void**) &line, 1) > 0) line_free(line);
+  }
+
+  spsc_queue_free(&line_queue);
+
+  mpsc_queue_free(&ui_queue);
+
+  line_pool_free(&input_pool);
+
+  line_pool_free(&ui_pool);
+
+  message_scratch_free(&scratch);
+}
+
+/*
+ * Read lines from stream and hand them to the network thread,
+ * which is the loop of the input thread
+ *
+ * At end of file NULL is pushed, which stops the network thread
+ */
+void input_run(FILE* stream)
+{
+  char buffer[1024];
+
+  line_t* line = NULL;
+
+  while(!atomic_load(&room_closed) && fgets(buffer, sizeof(buffer), stream))
+  {
+    size_t length = strcspn(buffer, "\n");
+
+    if(length == 0) continue;
+
+    if(!(line = line_create(&input_pool, length))) break;
+
+    line_append(line, buffer, length);
+
+    line->time = hist_time_get();
+
+    while(spsc_queue_push(&line_queue, (void* const*) &line, 1) == 0)
+    {
+      if(atomic_load(&room_closed))
+      {
+        line_free(line);
+        break;
+      }
+
+      usleep(1000);
+    }
+
+    line = NULL;
+  }
+
+  // The NULL line stops the network thread
+  while(spsc_queue_push(&line_queue, (void* const*) &line, 1) == 0 && !atomic_load(&room_closed))
+  {
+    usleep(1000);
+  }
+}
+
+/*
+ * Print the lines from the other threads to stream, a batch at a time,
+ * which is the loop of the UI thread
+ */
+void ui_run(FILE* stream)
+{
+  line_t* lines[LINE_POP_MAX];
+
+  while(true)
+  {
+    size_t count = mpsc_queue_pop(&ui_queue, (void**) lines, LINE_POP_MAX);
+
+    if(count == 0)
+    {
+      if(queue_wait(ui_queue.fd) != 0) break;
+
+      continue;
+    }
+
+    bool is_stopped = false;
+
+    for(size_t index = 0; index < count; index++)
+    {
+      line_t* line = lines[index];
+
+      if(!line)
+      {
+        is_stopped = true;
+        continue;
+      }
+
+      fwrite(line->text, 1, line->length, stream);
+
+      stage_record(STAGE_RENDER, line->time);
+
+      line_free(line);
+    }
+
+    fflush(stream);
+
+    if(is_stopped) break;
+  }
+}
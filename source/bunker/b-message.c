@@ -0,0 +1,216 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+/*
+ * The part of the public signing key that identifies the recipient
+ */
+#define MESSAGE_ID_SIZE    PEER_ID_SIZE
+
+#define MESSAGE_ENTRY_SIZE (MESSAGE_ID_SIZE + WRAP_SIZE)
+
+#define MESSAGE_PEERS_MAX  255
+
+/*
+ * Create the body of a text frame, in a buffer of max bytes
+ *
+ * A new message key encrypts the text, and the message key
+ * is wrapped for every peer with the secret shared with them
+ *
+ * BODY
+ * - uint8_t count                     | Number of recipients
+ * - count * (id[8] + wrap[WRAP_SIZE]) | Wrapped message keys
+ * - cipher                            | Encrypted text
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | The body is larger than max
+ * - 3 | Failed to encrypt message
+ */
+int message_create(uint8_t* body, size_t* size, size_t max, const char* text, size_t length, const peer_t* peers, size_t count)
+{
+  if(!body || !size || !text) return 1;
+
+  if(count > MESSAGE_PEERS_MAX) count = MESSAGE_PEERS_MAX;
+
+  *size = 1 + count * MESSAGE_ENTRY_SIZE + length + AEAD_EXTRA_SIZE;
+
+  if(*size > max) return 2;
+
+  uint8_t key[SECRET_SIZE];
+
+  int status = 0;
+
+  if(secret_create(key) != 0)
+  {
+    status = 3;
+  }
+
+  body[0] = count;
+
+  uint8_t* entry = body + 1;
+
+  uint64_t time = hist_time_get();
+
+  for(size_t index = 0; status == 0 && index < count; index++)
+  {
+    memcpy(entry, peers[index].public, MESSAGE_ID_SIZE);
+
+    if(key_wrap(entry + MESSAGE_ID_SIZE, key, peers[index].secret) != 0)
+    {
+      status = 3;
+    }
+
+    entry += MESSAGE_ENTRY_SIZE;
+  }
+
+  uint64_t wrap_time = stage_record(STAGE_WRAP, time);
+
+  if(status == 0 && data_encrypt(entry, key, text, length) != 0)
+  {
+    status = 3;
+  }
+
+  stage_record(STAGE_ENCRYPT, wrap_time);
+
+  OPENSSL_cleanse(key, sizeof(key));
+
+  return status;
+}
+
+/*
+ * Read the text of a text frame body, sent by peer,
+ * into a buffer of max bytes
+ *
+ * The text ends with a null terminator
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | Message was not wrapped for us
+ * - 3 | Failed to decrypt message
+ * - 4 | The text is larger than max
+ */
+int message_read(char* text, size_t* length, size_t max, const uint8_t* body, size_t size, const peer_t* peer, const uint8_t* public)
+{
+  if(!text || !length || !body || !peer || !public || size < 1) return 1;
+
+  size_t count = body[0];
+
+  size_t head_size = 1 + count * MESSAGE_ENTRY_SIZE;
+
+  if(size < head_size + AEAD_EXTRA_SIZE) return 1;
+
+  uint64_t time = hist_time_get();
+
+  // 1. Find the message key that was wrapped for us
+  const uint8_t* wrap = NULL;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    const uint8_t* entry = body + 1 + index * MESSAGE_ENTRY_SIZE;
+
+    if(memcmp(entry, public, MESSAGE_ID_SIZE) == 0)
+    {
+      wrap = entry + MESSAGE_ID_SIZE;
+
+      break;
+    }
+  }
+
+  if(!wrap) return 2;
+
+  size_t cipher_size = size - head_size;
+
+  *length = cipher_size - AEAD_EXTRA_SIZE;
+
+  if(*length + 1 > max) return 4;
+
+  uint8_t key[SECRET_SIZE];
+
+  if(key_unwrap(key, wrap, peer->secret) != 0) return 3;
+
+  // 2. Decrypt the text with the message key
+  int status = data_decrypt(text, key, body + head_size, cipher_size);
+
+  OPENSSL_cleanse(key, sizeof(key));
+
+  if(status != 0) return 3;
+
+  text[*length] = '\0';
+
+  stage_record(STAGE_DECRYPT, time);
+
+  return 0;
+}
+
+/*
+ * Create the buffers of the message path
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate buffers
+ */
+int message_scratch_create(message_scratch_t* scratch)
+{
+  scratch->frame = tag_malloc(ALLOC_SOCKET, sizeof(uint8_t) * MESSAGE_SCRATCH_SIZE);
+  scratch->text  = tag_malloc(ALLOC_SOCKET, sizeof(char) * MESSAGE_SCRATCH_SIZE);
+
+  if(!scratch->frame || !scratch->text)
+  {
+    message_scratch_free(scratch);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Free the buffers of the message path
+ */
+void message_scratch_free(message_scratch_t* scratch)
+{
+  tag_free(ALLOC_SOCKET, scratch->frame);
+  tag_free(ALLOC_SOCKET, scratch->text);
+
+  scratch->frame = NULL;
+  scratch->text  = NULL;
+}
+
+/*
+ * Encrypt text for every peer and send it in a signed text frame
+ *
+ * The body is created in place in the frame buffer of scratch,
+ * so nothing is allocated or copied, unless the socket is full
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to encrypt message
+ * - 2 | Failed to send message
+ */
+int message_send(mux_t* mux, message_scratch_t* scratch, const sign_key_t* key, const char* text, size_t length, const peer_t* peers, size_t count)
+{
+  uint8_t* body = scratch->frame + FRAME_HEAD_SIZE + FRAME_SIGN_SIZE;
+
+  size_t size;
+
+  if(message_create(body, &size, FRAME_SIZE_MAX - FRAME_SIGN_SIZE, text, length, peers, count) != 0) return 1;
+
+  uint64_t time = hist_time_get();
+
+  size_t frame_size;
+
+  if(frame_signed_write(scratch->frame, &frame_size, FRAME_TEXT, MUX_STREAM_CHAT, key, size) != 0) return 2;
+
+  uint64_t frame_time = stage_record(STAGE_FRAME, time);
+
+  int status = mux_write(mux, MUX_STREAM_CHAT, scratch->frame, frame_size);
+
+  stage_record(STAGE_SEND, frame_time);
+
+  return (status == 0) ? 0 : 2;
+}
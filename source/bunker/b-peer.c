@@ -0,0 +1,119 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+/*
+ * Get the peer with the public key
+ *
+ * RETURN (peer_t* peer)
+ * - NULL | No peer has the public key
+ */
+peer_t* peer_get(peer_t* peers, size_t count, const uint8_t* public)
+{
+  if(!peers || !public) return NULL;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    peer_t* peer = &peers[index];
+
+    if(memcmp(peer->public, public, SIGN_PUBLIC_SIZE) == 0) return peer;
+  }
+
+  return NULL;
+}
+
+/*
+ * Get the peer whose public key starts with id, of PEER_ID_SIZE bytes
+ *
+ * RETURN (peer_t* peer)
+ * - NULL | No peer has the id
+ */
+peer_t* peer_id_get(peer_t* peers, size_t count, const uint8_t* id)
+{
+  if(!peers || !id) return NULL;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    peer_t* peer = &peers[index];
+
+    if(memcmp(peer->public, id, PEER_ID_SIZE) == 0) return peer;
+  }
+
+  return NULL;
+}
+
+/*
+ * Add peer, or update the peer with the same public key
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | Failed to allocate peer
+ */
+int peer_add(peer_t** peers, size_t* count, const char* name, size_t length, const uint8_t* public, const uint8_t* secret)
+{
+  if(!peers || !count || !name || !public || !secret) return 1;
+
+  char* name_copy = tag_strndup(ALLOC_ROOM, name, length);
+
+  if(!name_copy) return 2;
+
+  peer_t* peer = peer_get(*peers, *count, public);
+
+  if(peer)
+  {
+    tag_free(ALLOC_ROOM, peer->name);
+
+    peer->name = name_copy;
+
+    memcpy(peer->secret, secret, SECRET_SIZE);
+
+    return 0;
+  }
+
+  peer_t* new_peers = tag_realloc(ALLOC_ROOM, *peers, sizeof(peer_t) * (*count + 1));
+
+  if(!new_peers)
+  {
+    tag_free(ALLOC_ROOM, name_copy);
+
+    return 2;
+  }
+
+  *peers = new_peers;
+
+  peer = &(*peers)[*count];
+
+  peer->name = name_copy;
+
+  memcpy(peer->public, public, SIGN_PUBLIC_SIZE);
+
+  memcpy(peer->secret, secret, SECRET_SIZE);
+
+  memset(&peer->ping, 0, sizeof(ping_stats_t));
+
+  (*count)++;
+
+  return 0;
+}
+
+/*
+ *
+ */
+void peers_free(peer_t** peers, size_t count)
+{
+  if(!(*peers)) return;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    tag_free(ALLOC_ROOM, (*peers)[index].name);
+
+    OPENSSL_cleanse((*peers)[index].secret, SECRET_SIZE);
+  }
+
+  tag_free(ALLOC_ROOM, *peers);
+
+  *peers = NULL;
+}
@@ -0,0 +1,167 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+/*
+ * PING (20 bytes)
+ * - id[8]           | The sender of the ping
+ * - uint32_t number | Sequence number of the ping, big endian
+ * - uint64_t time   | Clock of the sender when it was sent, big endian
+ *
+ * PONG (28 bytes)
+ * - id[8]           | The sender of the answer
+ * - ping[20]        | The ping, as it was recieved
+ *
+ * Every member of the room answers a ping, and the sender
+ * gets the round trip from its own clock, so no clocks are compared
+ */
+#define PING_SIZE (PEER_ID_SIZE + 4 + 8)
+#define PONG_SIZE (PEER_ID_SIZE + PING_SIZE)
+
+/*
+ * Send a ping to the members of the room
+ *
+ * RETURN (same as mux_frame_send)
+ */
+int ping_send(mux_t* mux, const uint8_t* public, uint32_t sequence, uint64_t time)
+{
+  uint8_t ping[PING_SIZE];
+
+  memcpy(ping, public, PEER_ID_SIZE);
+
+  number_write(ping + PEER_ID_SIZE,     sequence, 4);
+  number_write(ping + PEER_ID_SIZE + 4, time,     8);
+
+  return mux_frame_send(mux, MUX_STREAM_CHAT, FRAME_PING, ping, PING_SIZE);
+}
+
+/*
+ * Answer a ping from another member
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad ping
+ * - 2 | Failed to send pong
+ */
+int pong_send(mux_t* mux, const uint8_t* public, const uint8_t* ping, size_t size)
+{
+  if(!ping || size != PING_SIZE) return 1;
+
+  uint8_t pong[PONG_SIZE];
+
+  memcpy(pong, public, PEER_ID_SIZE);
+
+  memcpy(pong + PEER_ID_SIZE, ping, PING_SIZE);
+
+  return (mux_frame_send(mux, MUX_STREAM_CHAT, FRAME_PONG, pong, PONG_SIZE) == 0) ? 0 : 2;
+}
+
+/*
+ * Read the answer to one of our pings
+ *
+ * The pongs to the pings of other members are ignored
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad pong
+ * - 2 | The pong is not to our ping
+ */
+int pong_read(const uint8_t** id, uint32_t* sequence, uint64_t* time, const uint8_t* pong, size_t size, const uint8_t* public)
+{
+  if(!pong || size != PONG_SIZE) return 1;
+
+  const uint8_t* ping = pong + PEER_ID_SIZE;
+
+  if(memcmp(ping, public, PEER_ID_SIZE) != 0) return 2;
+
+  *id       = pong;
+  *sequence = number_read(ping + PEER_ID_SIZE,     4);
+  *time     = number_read(ping + PEER_ID_SIZE + 4, 8);
+
+  return 0;
+}
+
+/*
+ * Get the absolute difference of two times
+ */
+static inline uint64_t time_diff(uint64_t a, uint64_t b)
+{
+  return (a > b) ? a - b : b - a;
+}
+
+/*
+ * Add a round trip to the estimates of a peer
+ *
+ * RETURN (bool is_back)
+ * - true  | The peer was not responding, and is now
+ * - false | Else
+ */
+bool ping_sample(ping_stats_t* stats, uint64_t rtt)
+{
+  if(stats->srtt == 0)
+  {
+    stats->srtt   = rtt;
+    stats->rttvar = rtt / 2;
+  }
+  else
+  {
+    stats->rttvar = (3 * stats->rttvar + time_diff(stats->srtt, rtt)) / 4;
+    stats->srtt   = (7 * stats->srtt + rtt) / 8;
+
+    uint64_t change = time_diff(stats->rtt, rtt);
+
+    stats->jitter = (15 * stats->jitter + change) / 16;
+  }
+
+  stats->rtt  = rtt;
+  stats->loss = stats->loss * 7 / 8;
+
+  bool is_back = (stats->misses >= PING_MISSES);
+
+  stats->misses  = 0;
+  stats->waiting = false;
+
+  return is_back;
+}
+
+/*
+ * Count a ping that got no pong before the next one
+ *
+ * RETURN (bool is_dead)
+ * - true  | The peer has just stopped responding
+ * - false | Else
+ */
+bool ping_miss(ping_stats_t* stats)
+{
+  stats->loss = stats->loss * 7 / 8 + 1.0 / 8;
+
+  stats->lost++;
+
+  stats->waiting = false;
+
+  return (++stats->misses == PING_MISSES);
+}
+
+/*
+ * Print the round trips to every peer, in milliseconds
+ */
+void pings_print(FILE* stream, const peer_t* peers, size_t count)
+{
+  fprintf(stream, "%-12s %10s %10s %10s %8s %8s %8s\n", "peer", "srtt ms", "rttvar ms", "jitter ms", "loss %", "sent", "lost");
+
+  for(size_t index = 0; index < count; index++)
+  {
+    const ping_stats_t* stats = &peers[index].ping;
+
+    fprintf(stream, "%-12s %10.2f %10.2f %10.2f %8.1f %8llu %8llu%s\n", peers[index].name,
+      stats->srtt   / 1e6,
+      stats->rttvar / 1e6,
+      stats->jitter / 1e6,
+      stats->loss * 100.0,
+      (unsigned long long) stats->sent,
+      (unsigned long long) stats->lost,
+      (stats->misses >= PING_MISSES) ? " not responding" : "");
+  }
+}
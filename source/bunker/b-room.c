@@ -4,7 +4,12 @@
 
 #include "../bunker.h"
 
+#include "../format.h"
+
 /*
+ * A unix: address is kept whole, with port 0,
+ * and a udp: address keeps its prefix
+ *
  * RETURN (int status)
  * - 0 | Success
  * - 1 | String argument not allocated
@@ -15,6 +20,31 @@ int address_and_port_split(char** address, int* port, const char* string)
 {
   if(!string) return 1;
 
+  if(address_is_unix(string))
+  {
+    if(string[UNIX_ADDRESS_PREFIX_SIZE] == '\0') return 2;
+
+    if(address) *address = strdup(string);
+
+    if(port) *port = 0;
+
+    return 0;
+  }
+
+  // The port of a udp: address is after its last colon
+  if(address_is_udp(string))
+  {
+    const char* colon = strrchr(string, ':');
+
+    if(colon - string < UDP_ADDRESS_PREFIX_SIZE + 1) return 3;
+
+    if(address) *address = strndup(string, colon - string);
+
+    if(port) *port = atoi(colon + 1);
+
+    return 0;
+  }
+
   char* string_copy = strdup(string);
 
   char* token;
@@ -187,7 +217,16 @@ static int room_line_create(char** line, room_t room)
 
   char buffer[256];
 
-  if(sprintf(buffer, "%s,%s:%d", room.name, room.address, room.port) < 0)
+  int length;
+
+  if(address_is_unix(room.address))
+  {
+    length = format_string(buffer, sizeof(buffer), "%s,%s", room.name, room.address);
+  }
+  else length = format_string(buffer, sizeof(buffer), "%s,%s:%d", room.name, room.address, room.port);
+
+  // A line that is cut would be read back as another room
+  if(length < 0 || length >= sizeof(buffer))
   {
     return 2;
   }
@@ -523,6 +562,22 @@ static int address_and_port_lookup(char** address, int* port, const char* string
   return 0;
 }
 
+/*
+ * Write an address and port the way they are written by the user,
+ * where a unix: address has no port
+ *
+ * RETURN (same as snprintf)
+ */
+int address_string_write(char* buffer, size_t size, const char* address, int port)
+{
+  if(address_is_unix(address))
+  {
+    return snprintf(buffer, size, "%s", address);
+  }
+
+  return snprintf(buffer, size, "%s:%d", address, port);
+}
+
 /*
  * Get address and port from string
  *
@@ -0,0 +1,1326 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+#include "../debug.h"
+
+/*
+ * The maximum number of frames handled from one read
+ */
+#define RECV_FRAMES_MAX 64
+
+/*
+ * The tick of the timer wheel of the network thread, in nanoseconds
+ */
+#define ROOM_TICK_SIZE 10000000
+
+// Heartbeats every session_ping milliseconds, and session_limit messages
+// a second, which are set from the arguments before the rooms are joined
+int session_ping  = PING_INTERVAL;
+int session_limit = LIMIT_MESSAGES;
+
+// The keys and name are the same in every room
+static sign_key_t sign_key = { 0 };
+static wrap_key_t wrap_key = { 0 };
+
+static char* own_name = NULL;
+
+session_t sessions[SESSIONS_MAX];
+size_t    session_count = 0;
+
+// The room that our lines are sent to, changed with /room
+static size_t session_active = 0;
+
+static size_t session_open_count = 0;
+
+// Buffers of the network thread, for sending and recieving messages
+message_scratch_t scratch;
+
+// Timers of the network thread, expired once every turn of its loop
+static wheel_t wheel;
+
+// Expires when our next message is within the send limit of the active room
+static wheel_timer_t send_timer;
+
+static bool send_ready = false;
+
+// Lines that are popped from line_queue, but not sent yet
+static line_t* send_lines[LINE_POP_MAX];
+static size_t  send_index = 0;
+static size_t  send_count = 0;
+
+/*
+ * Create an empty line with room for size characters, after the name
+ * of the room, which is only shown when more than one room is joined
+ *
+ * RETURN (line_t* line)
+ * - NULL | Failed to allocate line
+ */
+static line_t* session_line_create(const session_t* session, size_t size)
+{
+  size_t length = (session_count > 1) ? strlen(session->name) : 0;
+
+  line_t* line = line_create(&ui_pool, (length > 0) ? length + 3 + size : size);
+
+  if(line) line->room = session - sessions;
+
+  if(line && length > 0)
+  {
+    line_append(line, "[", 1);
+    line_append(line, session->name, length);
+    line_append(line, "] ", 2);
+  }
+
+  return line;
+}
+
+/*
+ * Send the own nickname and public keys in a signed key frame
+ *
+ * BODY
+ * - uint8_t public[WRAP_PUBLIC_SIZE] | X25519 public key
+ * - char    name[]                   | Nickname
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create frame
+ * - 2 | Failed to write frame
+ */
+static int key_frame_send(session_t* session)
+{
+  size_t length = strlen(own_name);
+
+  uint8_t body[WRAP_PUBLIC_SIZE + length];
+
+  memcpy(body, wrap_key.public, WRAP_PUBLIC_SIZE);
+
+  memcpy(body + WRAP_PUBLIC_SIZE, own_name, length);
+
+  uint8_t* frame;
+  size_t   frame_size;
+
+  if(frame_signed_create(&frame, &frame_size, FRAME_KEY, MUX_STREAM_CHAT, &sign_key, body, sizeof(body)) != 0) return 1;
+
+  int status = mux_write(&session->mux, MUX_STREAM_CHAT, frame, frame_size);
+
+  free(frame);
+
+  return (status == 0) ? 0 : 2;
+}
+
+/*
+ * Print the stats through the UI thread, so they are not mixed with messages
+ *
+ * This is done by the network thread, which owns the round trips of the peers.
+ * The peers and limits are those of the active room
+ */
+static void stats_line_push(const session_t* session)
+{
+  char*  text = NULL;
+  size_t size = 0;
+
+  FILE* stream = open_memstream(&text, &size);
+
+  if(!stream) return;
+
+  stats_print(stream);
+
+  pings_print(stream, session->peers, session->peer_count);
+
+  limits_print(stream, &session->limits, session->peers, session->peer_count);
+
+  fclose(stream);
+
+  line_t* line = line_create(NULL, size);
+
+  if(line)
+  {
+    line->room = session - sessions;
+
+    line_append(line, text, size);
+  }
+
+  ui_line_push(line);
+
+  free(text);
+}
+
+/*
+ * Initialize the limit of a peer, of messages a second
+ *
+ * The bytes have room for a whole frame, so a large message
+ * is not dropped by a low limit
+ */
+static void room_limit_init(limit_t* limit, int messages, uint64_t now)
+{
+  double bytes = (messages > 0) ? (double) messages * LIMIT_MESSAGE_BYTES + FRAME_HEAD_SIZE + FRAME_SIZE_MAX : 0;
+
+  limit_init(limit, messages, bytes, now);
+}
+
+/*
+ * Initialize a limit of attachment chunks, of scale times LIMIT_FILE_BYTES
+ *
+ * Only the bytes are limited, since the chunks are all about as large
+ */
+static void file_limit_init(limit_t* limit, int messages, int scale, uint64_t now)
+{
+  double bytes = (messages > 0) ? (double) scale * LIMIT_FILE_BYTES : 0;
+
+  limit_init(limit, 0, bytes, now);
+}
+
+/*
+ * Initialize the limits of the room, where a limit of 0 turns them off
+ */
+static void room_limits_init(room_limits_t* limits, int messages, uint64_t now)
+{
+  int room_messages = messages * LIMIT_ROOM_PEERS;
+
+  room_limit_init(&limits->room, room_messages, now);
+
+  room_limit_init(&limits->send, messages, now);
+
+  file_limit_init(&limits->files, messages, LIMIT_ROOM_PEERS * LIMIT_FILE_SLACK, now);
+
+  file_limit_init(&limits->file_send, messages, 1, now);
+
+  limit_init(&limits->control, (messages > 0) ? LIMIT_CONTROL : 0, 0, now);
+
+  bucket_init(&limits->joins, (messages > 0) ? LIMIT_JOINS : 0, LIMIT_JOINS * LIMIT_BURST, now);
+
+  limits->dropped_joins = 0;
+  limits->deferred      = 0;
+}
+
+/*
+ * Handle a signed frame, which has already been verified
+ */
+static void frame_handle(session_t* session, const frame_t* frame, const frame_sign_t* sign, uint64_t now)
+{
+  switch(frame->type)
+  {
+    case FRAME_KEY:
+    {
+      if(sign->size < WRAP_PUBLIC_SIZE) break;
+
+      peer_t* peer = peer_get(session->peers, session->peer_count, sign->public);
+
+      if(peer && !limit_take(&peer->limit, sign->size, now)) break;
+
+      // A new peer is admitted against the budget of the room
+      if(!peer && (session->peer_count >= PEERS_MAX || !bucket_take(&session->limits.joins, 1, now)))
+      {
+        session->limits.dropped_joins++;
+
+        error_print("Dropped new peer over the join limit");
+        break;
+      }
+
+      const char* name   = (char*) sign->data + WRAP_PUBLIC_SIZE;
+      size_t      length = sign->size - WRAP_PUBLIC_SIZE;
+
+      TRACE_BEGIN("key exchange");
+
+      uint8_t secret[SECRET_SIZE];
+
+      if(wrap_secret_create(secret, &wrap_key, sign->data) != 0)
+      {
+        error_subsystem_print(DEBUG_CRYPTO, "Failed to create secret for peer");
+
+        TRACE_END("key exchange");
+        break;
+      }
+
+      bool is_new = !peer;
+
+      int status = peer_add(&session->peers, &session->peer_count, name, length, sign->public, secret);
+
+      OPENSSL_cleanse(secret, sizeof(secret));
+
+      TRACE_END("key exchange");
+
+      if(status != 0 || !is_new) break;
+
+      room_limit_init(&session->peers[session->peer_count - 1].limit, session_limit, now);
+
+      file_limit_init(&session->peers[session->peer_count - 1].files, session_limit, LIMIT_FILE_SLACK, now);
+
+      line_t* line = session_line_create(session, length + 8);
+
+      if(line)
+      {
+        line_append(line, name, length);
+        line_append(line, " joined\n", 8);
+      }
+
+      ui_line_push(line);
+
+      // Announce the own key to the new peer, who doesn't know it yet
+      key_frame_send(session);
+      break;
+    }
+
+    case FRAME_TEXT:
+    {
+      peer_t* peer = peer_get(session->peers, session->peer_count, sign->public);
+
+      if(!peer)
+      {
+        error_print("Dropped message from unknown peer");
+
+        break;
+      }
+
+      if(!limit_take(&peer->limit, sign->size, now)) break;
+
+      size_t length;
+
+      if(message_read(scratch.text, &length, MESSAGE_SCRATCH_SIZE, sign->data, sign->size, peer, sign_key.public) != 0)
+      {
+        error_subsystem_print(DEBUG_CRYPTO, "Failed to read message from %s", peer->name);
+
+        break;
+      }
+
+      size_t name_length = strlen(peer->name);
+
+      line_t* line = session_line_create(session, name_length + 2 + length + 1);
+
+      if(line)
+      {
+        line_append(line, peer->name, name_length);
+        line_append(line, ": ", 2);
+        line_append(line, scratch.text, length);
+        line_append(line, "\n", 1);
+      }
+
+      ui_line_push(line);
+      break;
+    }
+
+    case FRAME_FILE:
+    {
+      peer_t* peer = peer_get(session->peers, session->peer_count, sign->public);
+
+      if(!peer)
+      {
+        error_print("Dropped attachment from unknown peer");
+
+        break;
+      }
+
+      if(!limit_take(&peer->files, sign->size, now)) break;
+
+      attachment_chunk_t chunk;
+
+      if(attachment_chunk_read(&chunk, &scratch, sign->data, sign->size, peer, sign_key.public) != 0)
+      {
+        error_subsystem_print(DEBUG_CRYPTO, "Failed to read attachment from %s", peer->name);
+
+        break;
+      }
+
+      char path[ATTACHMENT_PATH_SIZE];
+
+      int status = attachment_chunk_store(path, &chunk);
+
+      if(status == 2)
+      {
+        // The name is not ended in the frame, and the formatter has no precision
+        char name[ATTACHMENT_NAME_MAX + 1];
+
+        snprintf(name, sizeof(name), "%.*s", (int) chunk.name_length, chunk.name);
+
+        error_print("Dropped chunk of %s after missing bytes", name);
+
+        break;
+      }
+
+      if(status == 0) break;
+
+      char text[LINE_TEXT_SIZE];
+
+      int length = (status == 1) ?
+        snprintf(text, sizeof(text), "%s sent %.*s (%llu bytes) to %s\n", peer->name, (int) chunk.name_length, chunk.name, (unsigned long long) chunk.size, path) :
+        snprintf(text, sizeof(text), "Failed to save %.*s from %s\n", (int) chunk.name_length, chunk.name, peer->name);
+
+      if(length < 0) break;
+
+      if(length >= (int) sizeof(text)) length = sizeof(text) - 1;
+
+      line_t* line = session_line_create(session, length);
+
+      if(line) line_append(line, text, length);
+
+      ui_line_push(line);
+      break;
+    }
+
+    default:
+      error_subsystem_print(DEBUG_SOCKET, "Dropped frame of unknown type (%d)", frame->type);
+      break;
+  }
+}
+
+/*
+ * Handle a heartbeat, or the answer to one of our own
+ */
+static void control_frame_handle(session_t* session, const frame_t* frame)
+{
+  if(frame->type == FRAME_PING)
+  {
+    if(pong_send(&session->mux, sign_key.public, frame->data, frame->size) == 1)
+    {
+      error_subsystem_print(DEBUG_SOCKET, "Dropped bad ping");
+    }
+
+    return;
+  }
+
+  const uint8_t* id;
+  uint32_t       sequence;
+  uint64_t       time;
+
+  if(pong_read(&id, &sequence, &time, frame->data, frame->size, sign_key.public) != 0) return;
+
+  peer_t* peer = peer_id_get(session->peers, session->peer_count, id);
+
+  uint64_t now = hist_time_get();
+
+  // Only the pong of the last ping counts, since the others are lost already
+  if(!peer || sequence != session->ping_sequence || time > now) return;
+
+  if(ping_sample(&peer->ping, now - time))
+  {
+    size_t length = strlen(peer->name);
+
+    line_t* line = session_line_create(session, length + 21);
+
+    if(line)
+    {
+      line_append(line, peer->name, length);
+      line_append(line, " is responding again\n", 21);
+    }
+
+    ui_line_push(line);
+  }
+}
+
+/*
+ * Send a heartbeat, and count the last one as lost
+ * for the peers that have not answered it
+ */
+static void ping_routine(wheel_timer_t* timer, void* arg)
+{
+  session_t* session = arg;
+
+  for(size_t index = 0; index < session->peer_count; index++)
+  {
+    peer_t* peer = &session->peers[index];
+
+    if(!peer->ping.waiting || !ping_miss(&peer->ping)) continue;
+
+    size_t length = strlen(peer->name);
+
+    line_t* line = session_line_create(session, length + 19);
+
+    if(line)
+    {
+      line_append(line, peer->name, length);
+      line_append(line, " is not responding\n", 19);
+    }
+
+    ui_line_push(line);
+  }
+
+  if(ping_send(&session->mux, sign_key.public, ++session->ping_sequence, hist_time_get()) != 0)
+  {
+    error_subsystem_print(DEBUG_SOCKET, "Failed to send ping");
+  }
+
+  for(size_t index = 0; index < session->peer_count; index++)
+  {
+    session->peers[index].ping.waiting = true;
+    session->peers[index].ping.sent++;
+  }
+
+  wheel_timer_arm(&wheel, timer, (uint64_t) session_ping * 1000000);
+}
+
+/*
+ * Get the limit of the room, that a signed frame is taken from before it is verified
+ */
+static limit_t* room_limit_get(session_t* session, uint8_t type)
+{
+  return (type == FRAME_FILE) ? &session->limits.files : &session->limits.room;
+}
+
+/*
+ * Verify and handle a frame that is put together from chunks at once,
+ * since its data is only valid until the next chunk of its stream
+ */
+static void assembled_frame_handle(session_t* session, const frame_t* frame, uint64_t now)
+{
+  if(FRAME_IS_CONTROL(frame->type) || !limit_take(room_limit_get(session, frame->type), frame->size, now)) return;
+
+  frame_sign_t sign;
+
+  if(frame_sign_get(&sign, frame) != 0)
+  {
+    error_subsystem_print(DEBUG_CRYPTO, "Dropped unsigned frame");
+
+    return;
+  }
+
+  if(data_verify(sign.sign, sign.public, sign.digest, DIGEST_SIZE) == 0)
+  {
+    frame_handle(session, frame, &sign, now);
+  }
+  else error_subsystem_print(DEBUG_CRYPTO, "Dropped frame with invalid signature");
+}
+
+/*
+ * Handle all frames from one read, and verify the signed ones
+ *
+ * Control frames are not signed, and are handled first.
+ * The mux takes the window frames and the chunks of bulk frames first
+ */
+static void frames_handle(session_t* session, frame_t* frames, size_t count)
+{
+  frame_sign_t signs[RECV_FRAMES_MAX];
+
+  size_t sign_count = 0;
+
+  const frame_t* sign_frames[RECV_FRAMES_MAX];
+
+  uint64_t now = hist_time_get();
+
+  for(size_t index = 0; index < count; index++)
+  {
+    int status = mux_frame_recv(&session->mux, &frames[index]);
+
+    if(status == 1) continue;
+
+    if(status == -1)
+    {
+      error_subsystem_print(DEBUG_SOCKET, "Dropped bad frame of stream %d", frames[index].stream);
+
+      continue;
+    }
+
+    if(status == 2)
+    {
+      assembled_frame_handle(session, &frames[index], now);
+
+      continue;
+    }
+
+    if(FRAME_IS_CONTROL(frames[index].type))
+    {
+      if(limit_take(&session->limits.control, frames[index].size, now))
+      {
+        control_frame_handle(session, &frames[index]);
+      }
+
+      continue;
+    }
+
+    // Frames over the limit of the room are dropped before they are verified
+    if(!limit_take(room_limit_get(session, frames[index].type), frames[index].size, now)) continue;
+
+    if(frame_sign_get(&signs[sign_count], &frames[index]) != 0)
+    {
+      error_subsystem_print(DEBUG_CRYPTO, "Dropped unsigned frame");
+
+      continue;
+    }
+
+    sign_frames[sign_count++] = &frames[index];
+  }
+
+  // signs and sign_frames are in the same order
+  for(size_t index = 0; index < sign_count; index++)
+  {
+    frame_sign_t* sign = &signs[index];
+
+    if(data_verify(sign->sign, sign->public, sign->digest, DIGEST_SIZE) == 0)
+    {
+      frame_handle(session, sign_frames[index], sign, now);
+    }
+    else error_subsystem_print(DEBUG_CRYPTO, "Dropped frame with invalid signature");
+  }
+}
+
+/*
+ * Mark the deferred lines as ready to be sent
+ */
+static void send_routine(wheel_timer_t* timer, void* arg)
+{
+  send_ready = true;
+}
+
+/*
+ * Print a line of text from the network thread, that belongs to no room
+ */
+static void text_line_push(const char* text, size_t length)
+{
+  line_t* line = line_create(&ui_pool, length);
+
+  if(line) line_append(line, text, length);
+
+  ui_line_push(line);
+}
+
+/*
+ * Print the joined rooms, and mark the active one
+ */
+static void rooms_line_push(void)
+{
+  char*  text = NULL;
+  size_t size = 0;
+
+  FILE* stream = open_memstream(&text, &size);
+
+  if(!stream) return;
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    const session_t* session = &sessions[index];
+
+    fprintf(stream, "%c %2zu %-20s %4zu peers%s\n", (index == session_active) ? '*' : ' ',
+      index + 1, session->name, session->peer_count, session->closed ? " (left)" : "");
+  }
+
+  fclose(stream);
+
+  line_t* line = line_create(NULL, size);
+
+  if(line) line_append(line, text, size);
+
+  ui_line_push(line);
+
+  free(text);
+}
+
+/*
+ * Make a room the active one, by its number or its name
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | No open room by that number or name
+ */
+static int session_switch(const char* string, size_t length)
+{
+  char* end;
+
+  long number = strtol(string, &end, 10);
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    const session_t* session = &sessions[index];
+
+    bool is_match = (end == string + length) ? (number == (long) index + 1) :
+      (strlen(session->name) == length && strncmp(session->name, string, length) == 0);
+
+    if(!is_match || session->closed) continue;
+
+    session_active = index;
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Print a line about the attachment of a room, like "Sent NAME"
+ */
+static void attachment_line_push(const session_t* session, const char* text, const char* name)
+{
+  size_t text_length = strlen(text);
+  size_t name_length = strlen(name);
+
+  line_t* line = session_line_create(session, text_length + name_length + 1);
+
+  if(line)
+  {
+    line_append(line, text, text_length);
+    line_append(line, name, name_length);
+    line_append(line, "\n", 1);
+  }
+
+  ui_line_push(line);
+}
+
+/*
+ * Start to send a file to a room, from offset
+ *
+ * The chunks are sent by attachments_send, one file at a time
+ */
+static void attachment_start(session_t* session, const char* path, size_t length, size_t offset)
+{
+  static const char* errors[] =
+  {
+    NULL,
+    "The file can't be sent by that name\n",
+    "Failed to read the file\n",
+    "The offset is not in the file\n",
+    "Failed to open the file\n"
+  };
+
+  if(session->closed)
+  {
+    text_line_push("The room is left\n", 17);
+
+    return;
+  }
+
+  if(session->attachment.path)
+  {
+    text_line_push("A file is already being sent\n", 29);
+
+    return;
+  }
+
+  char string[length + 1];
+
+  memcpy(string, path, length);
+
+  string[length] = '\0';
+
+  if(mux_stream_open(&session->mux, ATTACHMENT_STREAM, FRAME_PRIORITY_BULK) != 0)
+  {
+    text_line_push(errors[4], strlen(errors[4]));
+
+    return;
+  }
+
+  int status = attachment_open(&session->attachment, string, offset);
+
+  if(status != 0) text_line_push(errors[status], strlen(errors[status]));
+}
+
+/*
+ * Handle a command line, that starts with a slash,
+ * in the room of the line
+ *
+ * - /stats              | Print the stats of the active room
+ * - /rooms              | Print the joined rooms
+ * - /room ROOM          | Send the next lines to ROOM, a number or a name
+ * - /send FILE          | Send FILE to the room, a chunk at a time
+ * - /resume OFFSET FILE | Send FILE from byte OFFSET, after a transfer was cut off
+ * - /cancel             | Stop sending the file, the chunks that wait are still sent
+ *
+ * RETURN (bool is_command)
+ * - true  | The line was a command, and is handled
+ * - false | The line is a message
+ */
+static bool command_handle(session_t* session, const line_t* line)
+{
+  if(line->length == 6 && strncmp(line->text, "/stats", 6) == 0)
+  {
+    stats_line_push(session);
+  }
+  else if(line->length == 6 && strncmp(line->text, "/rooms", 6) == 0)
+  {
+    rooms_line_push();
+  }
+  else if(line->length > 6 && strncmp(line->text, "/room ", 6) == 0)
+  {
+    if(session_switch(line->text + 6, line->length - 6) != 0)
+    {
+      text_line_push("No such room\n", 13);
+    }
+    else
+    {
+      const char* name = sessions[session_active].name;
+
+      size_t length = strlen(name);
+
+      line_t* new_line = line_create(&ui_pool, 6 + length + 1);
+
+      if(new_line)
+      {
+        line_append(new_line, "Room: ", 6);
+        line_append(new_line, name, length);
+        line_append(new_line, "\n", 1);
+      }
+
+      ui_line_push(new_line);
+    }
+  }
+  else if(line->length > 6 && strncmp(line->text, "/send ", 6) == 0)
+  {
+    attachment_start(session, line->text + 6, line->length - 6, 0);
+  }
+  else if(line->length > 8 && strncmp(line->text, "/resume ", 8) == 0)
+  {
+    char* end;
+
+    unsigned long long offset = strtoull(line->text + 8, &end, 10);
+
+    if(end == line->text + 8 || *end != ' ' || end + 1 == line->text + line->length)
+    {
+      text_line_push("Usage: /resume OFFSET FILE\n", 27);
+    }
+    else attachment_start(session, end + 1, line->text + line->length - (end + 1), offset);
+  }
+  else if(line->length == 7 && strncmp(line->text, "/cancel", 7) == 0)
+  {
+    if(!session->attachment.path)
+    {
+      text_line_push("No file is being sent\n", 22);
+    }
+    else
+    {
+      attachment_line_push(session, "Stopped sending ", session->attachment.name);
+
+      attachment_close(&session->attachment);
+    }
+  }
+  else return false;
+
+  return true;
+}
+
+/*
+ * Leave a room whose connection is closed, and tell the user why
+ *
+ * Another open room becomes the active one, if this one was
+ */
+static void session_close(session_t* session, int error)
+{
+  session->closed = true;
+
+  session_open_count--;
+
+  wheel_timer_cancel(&wheel, &session->ping_timer);
+
+  wheel_timer_cancel(&wheel, &session->file_timer);
+
+  attachment_close(&session->attachment);
+
+  shutdown(session->sockfd, SHUT_RDWR);
+
+  // The heartbeats were not acknowledged within the socket timeout
+  bool is_timeout = (error == ETIMEDOUT);
+
+  // With one room, the user sees that the room is left when bunker stops
+  if(is_timeout || session_count > 1)
+  {
+    line_t* line = session_line_create(session, 32);
+
+    if(line)
+    {
+      if(is_timeout) line_append(line, "Connection to room timed out\n", 29);
+
+      else line_append(line, "Left room\n", 10);
+    }
+
+    ui_line_push(line);
+  }
+
+  if(&sessions[session_active] != session) return;
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    if(sessions[index].closed) continue;
+
+    session_active = index;
+    break;
+  }
+}
+
+/*
+ * Encrypt and send the lines from the input thread, to their room
+ * or else the active room
+ *
+ * A line over the send limit is kept, with the lines after it,
+ * and send_timer is armed for when it is within the limit.
+ * Meanwhile line_queue fills up and the input thread waits,
+ * so nothing is buffered without limit
+ *
+ * RETURN (int status)
+ * - 0 | Success, or the lines are deferred
+ * - 1 | End of input
+ */
+static int lines_send(void)
+{
+  while(true)
+  {
+    if(send_index == send_count)
+    {
+      send_index = 0;
+
+      if((send_count = spsc_queue_pop(&line_queue, (void**) send_lines, LINE_POP_MAX)) == 0) break;
+    }
+
+    line_t* line = send_lines[send_index];
+
+    if(!line) return 1;
+
+    // A line from a front-end of the daemon can have its own room
+    session_t* session = &sessions[(line->room != ROOM_NONE) ? line->room : session_active];
+
+    // Commands are not messages, and are not limited
+    if(line->text[0] == '/' && command_handle(session, line))
+    {
+      send_index++;
+
+      stage_record(STAGE_INPUT, line->time);
+
+      line_free(line);
+      continue;
+    }
+
+    uint64_t now = hist_time_get();
+
+    if(!session->closed)
+    {
+      uint64_t wait = limit_wait_get(&session->limits.send, line->length, now);
+
+      if(wait > 0)
+      {
+        if(!wheel_timer_armed(&send_timer))
+        {
+          wheel_timer_arm(&wheel, &send_timer, wait);
+
+          session->limits.deferred++;
+        }
+
+        return 0;
+      }
+
+      limit_take(&session->limits.send, line->length, now);
+    }
+
+    send_index++;
+
+    stage_record(STAGE_INPUT, line->time);
+
+    if(session->closed)
+    {
+      text_line_push("The room is left\n", 17);
+    }
+    else if(message_send(&session->mux, &scratch, &sign_key, line->text, line->length, session->peers, session->peer_count) != 0)
+    {
+      error_subsystem_print(DEBUG_SOCKET, "Failed to send message");
+
+      session_close(session, errno);
+    }
+
+    line_free(line);
+  }
+
+  return 0;
+}
+
+/*
+ * Wake the network thread, whose next turn sends the chunk
+ * of the attachment that was over the limit
+ */
+static void file_routine(wheel_timer_t* timer, void* arg)
+{
+}
+
+/*
+ * Send the next chunks of the attachment of every room,
+ * while less than ATTACHMENT_QUEUED chunks wait in its mux
+ *
+ * A chunk over the send limit waits for file_timer, and else
+ * the chunks wait for the mux to write the waiting ones, so
+ * the chunks are read from the file as fast as they are sent
+ */
+static void attachments_send(void)
+{
+  uint64_t now = hist_time_get();
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    session_t* session = &sessions[index];
+
+    attachment_t* attachment = &session->attachment;
+
+    if(session->closed || !attachment->path) continue;
+
+    int status = 0;
+
+    while(attachment->offset < attachment->size &&
+          mux_stream_queued(&session->mux, ATTACHMENT_STREAM) < ATTACHMENT_QUEUED)
+    {
+      size_t size = attachment_chunk_size_get(attachment, session->peer_count);
+
+      uint64_t wait = limit_wait_get(&session->limits.file_send, size, now);
+
+      if(wait > 0)
+      {
+        if(!wheel_timer_armed(&session->file_timer))
+        {
+          wheel_timer_arm(&wheel, &session->file_timer, wait);
+        }
+
+        break;
+      }
+
+      limit_take(&session->limits.file_send, size, now);
+
+      if((status = attachment_chunk_send(&session->mux, &scratch, &sign_key, attachment, session->peers, session->peer_count)) != 0)
+      {
+        error_subsystem_print(DEBUG_SOCKET, "Failed to send attachment (%d)", status);
+
+        break;
+      }
+    }
+
+    if(status != 0)
+    {
+      attachment_line_push(session, "Failed to send ", attachment->name);
+    }
+    else if(attachment->offset == attachment->size && mux_stream_queued(&session->mux, ATTACHMENT_STREAM) == 0)
+    {
+      attachment_line_push(session, "Sent ", attachment->name);
+    }
+    else continue;
+
+    attachment_close(attachment);
+  }
+}
+
+/*
+ * Recieve and handle the frames of a room, that are read now
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of file, or failed to recieve, and the room is closed
+ */
+static int session_frames_recv(session_t* session)
+{
+  frame_t frames[RECV_FRAMES_MAX];
+
+  ssize_t count = frames_recv(session->sockfd, &session->buffer, frames, RECV_FRAMES_MAX);
+
+  // The rest of the frame comes with a later read
+  if(count == -3) return 0;
+
+  if(count <= 0)
+  {
+    int error = (count < 0) ? errno : 0;
+
+    if(count < 0) error_subsystem_print(DEBUG_SOCKET, "Failed to recieve frames");
+
+    session_close(session, error);
+
+    return 1;
+  }
+
+  uint64_t time = hist_time_get();
+
+  if(capture_enabled) capture_frames_write(frames, count, time);
+
+  frames_handle(session, frames, count);
+
+  stage_record(STAGE_RECV, time);
+
+  return 0;
+}
+
+/*
+ * Recieve frames from the sockets of every room, and send lines
+ * from the input thread, until end of input or every room is left
+ *
+ * This is the loop of the network thread, which is pinned to cpu.
+ * The rooms share one poll, one timer wheel and the same keys.
+ * The frames of a room are read when its socket is readable,
+ * or when frames are left in its buffer from the last read,
+ * and the timers of the wheel are expired every turn
+ */
+void sessions_run(int cpu)
+{
+  struct pollfd fds[1 + SESSIONS_MAX];
+
+  fds[0] = (struct pollfd) { .fd = line_queue.fd, .events = POLLIN };
+
+  wheel_init(&wheel, ROOM_TICK_SIZE, hist_time_get());
+
+  wheel_timer_init(&send_timer, send_routine, NULL);
+
+  uint64_t now = hist_time_get();
+
+  session_open_count = 0;
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    session_t* session = &sessions[index];
+
+    // The frames are read into memory on the node of the thread
+    if(frame_buffer_create(&session->buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, cpu_node_get(cpu)) != 0)
+    {
+      error_subsystem_print(DEBUG_SOCKET, "Failed to create frame buffer");
+
+      session->buffer.data = NULL;
+
+      session->closed = true;
+    }
+    else if(cpu != CPU_NONE && index == 0) placement_check("network thread", cpu, session->buffer.data);
+
+    fds[1 + index] = (struct pollfd) { .fd = session->closed ? -1 : session->sockfd, .events = POLLIN };
+
+    if(session->closed) continue;
+
+    session_open_count++;
+
+    room_limits_init(&session->limits, session_limit, now);
+
+    wheel_timer_init(&session->ping_timer, ping_routine, session);
+
+    wheel_timer_init(&session->file_timer, file_routine, session);
+
+    if(session_ping > 0) wheel_timer_arm(&wheel, &session->ping_timer, (uint64_t) session_ping * 1000000);
+  }
+
+  while(session_open_count > 0)
+  {
+    // Sleep until the next timer, unless frames are waiting
+    int timeout = wheel_timeout_get(&wheel, hist_time_get());
+
+    for(size_t index = 0; index < session_count; index++)
+    {
+      session_t* session = &sessions[index];
+
+      if(session->closed) continue;
+
+      if(frames_waiting(&session->buffer)) timeout = 0;
+
+      // Frames that the socket didn't take are written when it is writable
+      fds[1 + index].events = POLLIN | (mux_waiting(&session->mux) ? POLLOUT : 0);
+    }
+
+    if(poll(fds, 1 + session_count, timeout) == -1)
+    {
+      if(errno == EINTR) continue;
+
+      break;
+    }
+
+    wheel_advance(&wheel, hist_time_get());
+
+    if(fds[0].revents & POLLIN) queue_wait(line_queue.fd);
+
+    if((fds[0].revents & POLLIN) || send_ready)
+    {
+      send_ready = false;
+
+      if(lines_send() != 0) break;
+    }
+
+    for(size_t index = 0; index < session_count; index++)
+    {
+      session_t* session = &sessions[index];
+
+      if(session->closed) continue;
+
+      if((fds[1 + index].revents & POLLOUT) && mux_flush(&session->mux) < 0)
+      {
+        error_subsystem_print(DEBUG_SOCKET, "Failed to write frames");
+
+        session_close(session, errno);
+
+        fds[1 + index].fd = -1;
+
+        continue;
+      }
+
+      if((fds[1 + index].revents & (POLLIN | POLLHUP | POLLERR)) || frames_waiting(&session->buffer))
+      {
+        if(session_frames_recv(session) != 0) fds[1 + index].fd = -1;
+      }
+
+      // A room can be left while sending, too
+      if(session->closed) fds[1 + index].fd = -1;
+    }
+
+    attachments_send();
+  }
+
+  for(size_t index = 0; index < session_count; index++)
+  {
+    frame_buffer_free(&sessions[index].buffer);
+
+    shutdown(sessions[index].sockfd, SHUT_RDWR);
+  }
+
+  // Free the lines that were deferred, and never sent
+  for(; send_index < send_count; send_index++) line_free(send_lines[send_index]);
+
+  crypto_thread_free();
+
+  atomic_store(&room_closed, true);
+
+  // The NULL line stops the UI thread
+  line_t* line = NULL;
+
+  while(mpsc_queue_push(&ui_queue, (void* const*) &line, 1) == 0) usleep(1000);
+}
+
+/*
+ * Connect to a room, and announce our key in it
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to connect
+ * - 2 | Failed to announce key
+ */
+static int session_connect(session_t* session, const char* address, int port)
+{
+  char string[256];
+
+  address_string_write(string, sizeof(string), address, port);
+
+  TRACE_BEGIN("connect");
+
+  if(address_is_udp(address))
+  {
+    session->sockfd = udp_socket_create(address, port);
+  }
+  else session->sockfd = client_socket_create(address, port);
+
+  TRACE_END("connect");
+
+  if(session->sockfd == -1)
+  {
+    printf("bunker: Failed to join (%s)\n", string);
+
+    return 1;
+  }
+
+  if(mux_init(&session->mux, session->sockfd, sign_key.public) != 0)
+  {
+    printf("bunker: Failed to join (%s)\n", string);
+
+    socket_close(&session->sockfd);
+
+    return 1;
+  }
+
+  printf("Joining: (%s)\n", string);
+
+  // With heartbeats, data is always in flight, so a dead connection is found
+  // within a heartbeat and the timeout. A unix socket has no such timeout,
+  // and a udp: room is found dead by its heartbeats alone
+  if(session_ping > 0 && !address_is_unix(address) && !address_is_udp(address))
+  {
+    socket_timeout_set(session->sockfd, session_ping * PING_MISSES);
+  }
+
+  // Announce nickname and public key to the other clients
+  TRACE_BEGIN("handshake");
+
+  int status = key_frame_send(session);
+
+  TRACE_END("handshake");
+
+  if(status != 0)
+  {
+    fprintf(stderr, "Failed to announce key\n");
+
+    mux_free(&session->mux);
+
+    socket_close(&session->sockfd);
+
+    return 2;
+  }
+
+  return 0;
+}
+
+/*
+ * Create the keys, and join the rooms with the same name and keys,
+ * where a room that can't be joined is left out
+ *
+ * The name must be kept until sessions_free
+ *
+ * RETURN (int status)
+ * - 0 | Success, and session_count rooms are joined
+ * - 1 | Failed to create keys
+ */
+int sessions_join(char* name, char** addresses, int* ports, char** rooms, size_t count)
+{
+  if(sign_key_create(&sign_key) != 0 || wrap_key_create(&wrap_key) != 0)
+  {
+    sign_key_free(&sign_key);
+
+    return 1;
+  }
+
+  own_name = name;
+
+  session_count  = 0;
+  session_active = 0;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    session_t* session = &sessions[session_count];
+
+    *session = (session_t) { .sockfd = -1 };
+
+    if(session_connect(session, addresses[index], ports[index]) != 0) continue;
+
+    if(rooms[index])
+    {
+      session->name = strdup(rooms[index]);
+    }
+    else if((session->name = malloc(strlen(addresses[index]) + 7)))
+    {
+      address_string_write(session->name, strlen(addresses[index]) + 7, addresses[index], ports[index]);
+    }
+
+    if(!session->name)
+    {
+      mux_free(&session->mux);
+
+      socket_close(&session->sockfd);
+      continue;
+    }
+
+    session_count++;
+  }
+
+  return 0;
+}
+
+/*
+ * Leave the joined rooms, after the room threads are joined,
+ * and free the keys
+ */
+void sessions_free(void)
+{
+  for(size_t index = 0; index < session_count; index++)
+  {
+    session_t* session = &sessions[index];
+
+    mux_free(&session->mux);
+
+    attachment_close(&session->attachment);
+
+    socket_close(&session->sockfd);
+
+    peers_free(&session->peers, session->peer_count);
+
+    session->peer_count = 0;
+
+    free(session->name);
+  }
+
+  session_count = 0;
+
+  sign_key_free(&sign_key);
+
+  wrap_key_free(&wrap_key);
+
+  crypto_thread_free();
+
+  own_name = NULL;
+}
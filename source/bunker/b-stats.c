@@ -0,0 +1,83 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+hist_t stage_hists[STAGE_COUNT];
+
+static const char* stage_names[STAGE_COUNT] =
+{
+  "input", "encrypt", "wrap", "frame", "send", "recv", "decrypt", "render"
+};
+
+/*
+ * Record the time of a stage, from start until now,
+ * in its histogram and in the trace
+ *
+ * RETURN (uint64_t time)
+ * - The end of the stage, which can be the start of the next
+ */
+uint64_t stage_record(stage_t stage, uint64_t start)
+{
+  uint64_t time = hist_time_get();
+
+  hist_record(&stage_hists[stage], time - start);
+
+  TRACE_SPAN(stage_names[stage], start, time - start);
+
+  return time;
+}
+
+/*
+ * Print the latency of every stage, in microseconds
+ */
+void stats_print(FILE* stream)
+{
+  fprintf(stream, "%-8s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p999 us", "max us");
+
+  for(int stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    hist_t* hist = &stage_hists[stage];
+
+    fprintf(stream, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", stage_names[stage],
+      (unsigned long long) hist_count_get(hist),
+      hist_percentile_get(hist, 50.0)  / 1e3,
+      hist_percentile_get(hist, 99.0)  / 1e3,
+      hist_percentile_get(hist, 99.9)  / 1e3,
+      hist_max_get(hist) / 1e3);
+  }
+
+  alloc_stats_print(stream);
+
+  fflush(stream);
+}
+
+/*
+ * Print the traffic that was dropped or deferred by the limits
+ */
+void limits_print(FILE* stream, const room_limits_t* limits, const peer_t* peers, size_t count)
+{
+  fprintf(stream, "%-12s %10s %10s\n", "limit", "dropped", "kB");
+
+  fprintf(stream, "%-12s %10llu %10.1f\n", "room",
+    (unsigned long long) limits->room.dropped_frames, limits->room.dropped_bytes / 1024.0);
+
+  fprintf(stream, "%-12s %10llu %10.1f\n", "heartbeat",
+    (unsigned long long) limits->control.dropped_frames, limits->control.dropped_bytes / 1024.0);
+
+  fprintf(stream, "%-12s %10llu %10.1f\n", "files",
+    (unsigned long long) limits->files.dropped_frames, limits->files.dropped_bytes / 1024.0);
+
+  for(size_t index = 0; index < count; index++)
+  {
+    const limit_t* limit = &peers[index].limit;
+
+    fprintf(stream, "%-12s %10llu %10.1f\n", peers[index].name,
+      (unsigned long long) limit->dropped_frames, limit->dropped_bytes / 1024.0);
+  }
+
+  fprintf(stream, "%-12s %10llu\n", "joins", (unsigned long long) limits->dropped_joins);
+
+  fprintf(stream, "%-12s %10llu\n", "deferred", (unsigned long long) limits->deferred);
+}
@@ -0,0 +1,260 @@
+/*
+ *
+ */
+
+#include "../bunker.h"
+
+#include "../rudp.h"
+
+/*
+ * A room over datagrams is bridged to one end of a socket pair,
+ * so the network thread reads and writes its frames like the
+ * frames of any other room, and only the bridge knows of rudp.h
+ *
+ * The bridge thread sends every whole frame that it reads as a message,
+ * with heartbeats on a stream of their own, so that a lost message
+ * doesn't hold back the heartbeats. The relay is expected to put the
+ * frames of every sender on a stream of its own the other way.
+ */
+typedef struct
+{
+  int      sockfd;    // The UDP socket
+  int      streamfd;  // The end of the socket pair of the bridge
+  wheel_t  wheel;
+  rudp_t*  rudp;
+  uint8_t* buffer;    // Read frames that are not sent yet
+  size_t   length;
+  bool     is_full;   // A frame waits for space in the window
+  bool     closed;
+} udp_bridge_t;
+
+#define UDP_BUFFER_SIZE (FRAME_HEAD_SIZE + FRAME_SIZE_MAX)
+
+/*
+ * Send a datagram of the connection
+ *
+ * A datagram that doesn't fit in the socket buffer is lost,
+ * and is sent again like any other lost datagram
+ */
+static void udp_output(void* arg, const uint8_t* datagram, size_t size)
+{
+  udp_bridge_t* bridge = arg;
+
+  send(bridge->sockfd, datagram, size, MSG_NOSIGNAL);
+}
+
+/*
+ * Hand a frame of the room to the network thread
+ */
+static void udp_deliver(void* arg, uint16_t stream, const uint8_t* message, size_t size)
+{
+  udp_bridge_t* bridge = arg;
+
+  if(socket_write(bridge->streamfd, (const char*) message, size) <= 0)
+  {
+    bridge->closed = true;
+  }
+}
+
+/*
+ * Send the whole frames that have been read, while the window has space
+ */
+static void udp_frames_send(udp_bridge_t* bridge, uint64_t now)
+{
+  size_t offset = 0;
+
+  bridge->is_full = false;
+
+  while(bridge->length - offset >= FRAME_HEAD_SIZE)
+  {
+    const uint8_t* frame = bridge->buffer + offset;
+
+    uint32_t size = number_read(frame, 4);
+
+    if(size > FRAME_SIZE_MAX)
+    {
+      bridge->closed = true;
+
+      return;
+    }
+
+    if(bridge->length - offset < FRAME_HEAD_SIZE + size) break;
+
+    uint16_t stream = FRAME_IS_CONTROL(frame[4]) ? UDP_STREAM_CONTROL : UDP_STREAM_MESSAGES;
+
+    int status = rudp_send(bridge->rudp, stream, frame, FRAME_HEAD_SIZE + size, now);
+
+    if(status == 2)
+    {
+      bridge->is_full = true;
+
+      break;
+    }
+
+    if(status != 0)
+    {
+      bridge->closed = true;
+
+      return;
+    }
+
+    offset += FRAME_HEAD_SIZE + size;
+  }
+
+  memmove(bridge->buffer, bridge->buffer + offset, bridge->length - offset);
+
+  bridge->length -= offset;
+}
+
+/*
+ * Read the datagrams from the relay
+ */
+static void udp_datagrams_recv(udp_bridge_t* bridge, uint64_t now)
+{
+  uint8_t datagram[RUDP_DATAGRAM_MAX];
+
+  ssize_t size;
+
+  while((size = recv(bridge->sockfd, datagram, sizeof(datagram), 0)) > 0)
+  {
+    // The relay has started over, and has lost the state of the room
+    if(rudp_input(bridge->rudp, datagram, size, now) == 2)
+    {
+      bridge->closed = true;
+
+      return;
+    }
+  }
+}
+
+/*
+ * Free a bridge and close its sockets
+ */
+static void udp_bridge_free(udp_bridge_t* bridge)
+{
+  rudp_free(&bridge->rudp);
+
+  socket_close(&bridge->sockfd);
+
+  socket_close(&bridge->streamfd);
+
+  free(bridge->buffer);
+
+  free(bridge);
+}
+
+/*
+ * The thread of a bridge, that runs until the network thread
+ * closes its end of the socket pair, or the relay starts over
+ */
+static void* udp_bridge_routine(void* arg)
+{
+  udp_bridge_t* bridge = arg;
+
+  while(!bridge->closed)
+  {
+    uint64_t now = hist_time_get();
+
+    wheel_advance(&bridge->wheel, now);
+
+    if(bridge->is_full) udp_frames_send(bridge, now);
+
+    uint64_t wait = rudp_flush(bridge->rudp, now);
+
+    int timeout = wheel_timeout_get(&bridge->wheel, now);
+
+    if(wait > 0 && (timeout < 0 || (wait + 999999) / 1000000 < timeout))
+    {
+      timeout = (wait + 999999) / 1000000;
+    }
+
+    struct pollfd fds[2] =
+    {
+      { .fd = bridge->streamfd, .events = bridge->is_full ? 0 : POLLIN },
+      { .fd = bridge->sockfd,   .events = POLLIN }
+    };
+
+    if(poll(fds, 2, timeout) == -1)
+    {
+      if(errno == EINTR) continue;
+
+      break;
+    }
+
+    now = hist_time_get();
+
+    if(fds[1].revents & POLLIN) udp_datagrams_recv(bridge, now);
+
+    if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+      ssize_t size = read(bridge->streamfd, bridge->buffer + bridge->length, UDP_BUFFER_SIZE - bridge->length);
+
+      if(size <= 0 && !(size == -1 && errno == EINTR)) break;
+
+      if(size > 0) bridge->length += size;
+
+      udp_frames_send(bridge, now);
+    }
+  }
+
+  udp_bridge_free(bridge);
+
+  return NULL;
+}
+
+/*
+ * Connect to a room over datagrams, at a udp: address
+ *
+ * RETURN (int sockfd)
+ * - >=0 | The socket of the frames of the room
+ * -  -1 | Failed to connect
+ */
+int udp_socket_create(const char* address, int port)
+{
+  int fds[2];
+
+  if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) return -1;
+
+  udp_bridge_t* bridge = calloc(1, sizeof(udp_bridge_t));
+
+  uint64_t now = hist_time_get();
+
+  if(!bridge || !(bridge->buffer = malloc(UDP_BUFFER_SIZE)))
+  {
+    free(bridge);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return -1;
+  }
+
+  bridge->streamfd = fds[1];
+
+  wheel_init(&bridge->wheel, UDP_TICK_SIZE, now);
+
+  if((bridge->sockfd = udp_client_socket_create(address + UDP_ADDRESS_PREFIX_SIZE, port)) == -1 ||
+     !(bridge->rudp = rudp_create(&bridge->wheel, UDP_PACE_RATE, udp_output, udp_deliver, bridge, now)))
+  {
+    udp_bridge_free(bridge);
+
+    close(fds[0]);
+
+    return -1;
+  }
+
+  pthread_t thread;
+
+  if(pthread_create(&thread, NULL, udp_bridge_routine, bridge) != 0)
+  {
+    udp_bridge_free(bridge);
+
+    close(fds[0]);
+
+    return -1;
+  }
+
+  pthread_detach(thread);
+
+  return fds[0];
+}
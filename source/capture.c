@@ -0,0 +1,183 @@
+/*
+ * capture.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "capture.h"
+#include "hist.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The stdio buffer of the capture file, so that a read
+ * of frames is written with one write at most
+ */
+#define CAPTURE_BUFFER_SIZE 262144
+
+bool capture_enabled = false;
+
+static FILE* capture_file = NULL;
+
+static uint64_t capture_start = 0;
+
+/*
+ * Start writing recieved frames to a capture file
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to open file
+ * - 2 | Failed to write head
+ */
+int capture_open(const char* filepath)
+{
+  if(!(capture_file = fopen(filepath, "wb"))) return 1;
+
+  setvbuf(capture_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_REALTIME, &timespec);
+
+  uint8_t head[CAPTURE_HEAD_SIZE];
+
+  memcpy(head, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+
+  number_write(head + CAPTURE_MAGIC_SIZE, (uint64_t) timespec.tv_sec * 1000000000 + timespec.tv_nsec, 8);
+
+  if(fwrite(head, 1, CAPTURE_HEAD_SIZE, capture_file) != CAPTURE_HEAD_SIZE)
+  {
+    fclose(capture_file);
+
+    capture_file = NULL;
+
+    return 2;
+  }
+
+  capture_start = hist_time_get();
+
+  capture_enabled = true;
+
+  return 0;
+}
+
+/*
+ * Stop capturing, and close the capture file
+ *
+ * RETURN (int status)
+ * - 0 | Success, or capturing was not started
+ * - 1 | Failed to write the end of the file
+ */
+int capture_close(void)
+{
+  if(!capture_file) return 0;
+
+  capture_enabled = false;
+
+  int status = fclose(capture_file);
+
+  capture_file = NULL;
+
+  return (status == 0) ? 0 : 1;
+}
+
+/*
+ * Write the frames from one read, that were recieved at time
+ *
+ * A failed write stops the capture, and is seen by capture_close
+ */
+void capture_frames_write(const frame_t* frames, size_t count, uint64_t time)
+{
+  if(!capture_file) return;
+
+  uint64_t offset = (time > capture_start) ? time - capture_start : 0;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    const frame_t* frame = &frames[index];
+
+    uint8_t head[CAPTURE_RECORD_HEAD_SIZE + FRAME_HEAD_SIZE];
+
+    number_write(head, offset, 8);
+
+    uint8_t* frame_head = head + CAPTURE_RECORD_HEAD_SIZE;
+
+    number_write(frame_head, frame->size, 4);
+
+    frame_head[4] = frame->type;
+    frame_head[5] = frame->flags;
+
+    number_write(frame_head + 6, frame->stream, 2);
+
+    if(fwrite(head, 1, sizeof(head), capture_file) != sizeof(head) ||
+       fwrite(frame->data, 1, frame->size, capture_file) != frame->size)
+    {
+      capture_enabled = false;
+
+      return;
+    }
+  }
+}
+
+/*
+ * Read the head of a capture
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Not a capture
+ */
+int capture_head_read(uint64_t* start, const uint8_t* data, size_t size)
+{
+  if(size < CAPTURE_HEAD_SIZE || memcmp(data, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) return 1;
+
+  if(start) *start = number_read(data + CAPTURE_MAGIC_SIZE, 8);
+
+  return 0;
+}
+
+/*
+ * Read the record at offset, and move offset past it
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of capture
+ * - 2 | The record is cut short
+ */
+int capture_record_read(capture_record_t* record, const uint8_t* data, size_t size, size_t* offset)
+{
+  if(*offset >= size) return 1;
+
+  if(size - *offset < CAPTURE_RECORD_HEAD_SIZE + FRAME_HEAD_SIZE) return 2;
+
+  const uint8_t* head = data + *offset;
+
+  const uint8_t* frame_head = head + CAPTURE_RECORD_HEAD_SIZE;
+
+  uint32_t frame_size = number_read(frame_head, 4);
+
+  size_t wire_size = FRAME_HEAD_SIZE + (size_t) frame_size;
+
+  if(size - *offset - CAPTURE_RECORD_HEAD_SIZE < wire_size) return 2;
+
+  record->time = number_read(head, 8);
+
+  record->frame = (frame_t)
+  {
+    .type   = frame_head[4],
+    .flags  = frame_head[5],
+    .stream = number_read(frame_head + 6, 2),
+    .size   = frame_size,
+    .data   = (uint8_t*) frame_head + FRAME_HEAD_SIZE
+  };
+
+  record->wire      = frame_head;
+  record->wire_size = wire_size;
+
+  *offset += CAPTURE_RECORD_HEAD_SIZE + wire_size;
+
+  return 0;
+}
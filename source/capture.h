@@ -0,0 +1,67 @@
+/*
+ * capture.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "frame.h"
+
+/*
+ * A capture file is a head followed by a record for every frame
+ *
+ * HEAD (16 bytes)
+ * - magic[8]        | CAPTURE_MAGIC
+ * - uint64_t start  | Wall clock when the capture started, in nanoseconds
+ *
+ * RECORD
+ * - uint64_t time   | Nanoseconds since the capture started
+ * - frame           | The frame as it was on the wire, head and data
+ *
+ * The integers are big endian, like the frames. The frames are
+ * stored as they were recieved, so messages stay encrypted
+ */
+#define CAPTURE_MAGIC      "BUNKCAP1"
+#define CAPTURE_MAGIC_SIZE 8
+
+#define CAPTURE_HEAD_SIZE  (CAPTURE_MAGIC_SIZE + 8)
+
+#define CAPTURE_RECORD_HEAD_SIZE 8
+
+/*
+ * A record of a capture, that points into the capture
+ */
+typedef struct
+{
+  uint64_t       time;
+  frame_t        frame;
+  const uint8_t* wire;       // The head and data of the frame
+  size_t         wire_size;
+} capture_record_t;
+
+/*
+ * capture_enabled is only changed by capture_open and capture_close,
+ * when no thread is recieving frames
+ */
+extern bool capture_enabled;
+
+extern int  capture_open(const char* filepath);
+
+extern int  capture_close(void);
+
+extern void capture_frames_write(const frame_t* frames, size_t count, uint64_t time);
+
+
+extern int  capture_head_read(uint64_t* start, const uint8_t* data, size_t size);
+
+extern int  capture_record_read(capture_record_t* record, const uint8_t* data, size_t size, size_t* offset);
+
+#endif // CAPTURE_H
@@ -0,0 +1,549 @@
+/*
+ * crypto.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "crypto.h"
+
+#include <string.h>
+
+#include <openssl/rand.h>
+#include <openssl/kdf.h>
+
+/*
+ * The number of distinct sender keys kept by a thread for verifying
+ */
+#define VERIFY_KEY_CACHE 16
+
+/*
+ * A parsed sender key, with a context that is initialized with it
+ */
+typedef struct
+{
+  uint8_t     public[SIGN_PUBLIC_SIZE];
+  EVP_PKEY*   pkey;
+  EVP_MD_CTX* ctx;
+} verify_key_t;
+
+/*
+ * The contexts of a thread, that are created on first use and reused,
+ * so that encrypting, decrypting, signing and verifying messages
+ * don't allocate contexts every time
+ *
+ * They are freed by crypto_thread_free
+ */
+typedef struct
+{
+  EVP_CIPHER_CTX* encrypt;
+  EVP_CIPHER_CTX* decrypt;
+  EVP_MD_CTX*     sign;
+  EVP_PKEY*       sign_pkey; // The key that sign is initialized with
+  EVP_MD_CTX*     digest;
+  verify_key_t    keys[VERIFY_KEY_CACHE];
+  size_t          key_count;
+  size_t          key_next;  // The key to replace when the cache is full
+} crypto_thread_t;
+
+static __thread crypto_thread_t crypto_thread = { 0 };
+
+/*
+ * Free the contexts of the calling thread
+ */
+void crypto_thread_free(void)
+{
+  EVP_CIPHER_CTX_free(crypto_thread.encrypt);
+  EVP_CIPHER_CTX_free(crypto_thread.decrypt);
+
+  EVP_MD_CTX_free(crypto_thread.sign);
+
+  EVP_MD_CTX_free(crypto_thread.digest);
+
+  for(size_t index = 0; index < crypto_thread.key_count; index++)
+  {
+    EVP_MD_CTX_free(crypto_thread.keys[index].ctx);
+
+    EVP_PKEY_free(crypto_thread.keys[index].pkey);
+  }
+
+  memset(&crypto_thread, 0, sizeof(crypto_thread));
+}
+
+/*
+ * Generate a new Ed25519 signing key
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to generate key
+ * - 2 | Failed to get raw public key
+ */
+int sign_key_create(sign_key_t* key)
+{
+  if(!key) return 1;
+
+  key->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "ED25519");
+
+  if(!key->pkey) return 1;
+
+  size_t size = SIGN_PUBLIC_SIZE;
+
+  if(EVP_PKEY_get_raw_public_key(key->pkey, key->public, &size) != 1)
+  {
+    sign_key_free(key);
+
+    return 2;
+  }
+
+  return 0;
+}
+
+/*
+ * Free the signing key
+ */
+void sign_key_free(sign_key_t* key)
+{
+  if(!key) return;
+
+  if(key->pkey) EVP_PKEY_free(key->pkey);
+
+  key->pkey = NULL;
+}
+
+/*
+ * Sign data with signing key
+ *
+ * The context of the thread is kept initialized with the last key,
+ * which it holds a reference to, so it is reused while the key is
+ *
+ * PARAMS
+ * - uint8_t* sign | Buffer of SIGN_SIZE bytes to store signature
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to sign data
+ */
+int data_sign(uint8_t* sign, const sign_key_t* key, const void* data, size_t size)
+{
+  if(!sign || !key || !key->pkey) return 1;
+
+  if(!crypto_thread.sign && !(crypto_thread.sign = EVP_MD_CTX_new())) return 1;
+
+  EVP_MD_CTX* ctx = crypto_thread.sign;
+
+  if(crypto_thread.sign_pkey != key->pkey)
+  {
+    EVP_MD_CTX_reset(ctx);
+
+    crypto_thread.sign_pkey = NULL;
+
+    if(EVP_DigestSignInit(ctx, NULL, NULL, NULL, key->pkey) != 1) return 1;
+
+    crypto_thread.sign_pkey = key->pkey;
+  }
+
+  size_t sign_size = SIGN_SIZE;
+
+  return (EVP_DigestSign(ctx, sign, &sign_size, data, size) == 1) ? 0 : 1;
+}
+
+/*
+ * Get the cached key of a sender, or parse it and replace
+ * the oldest key in the cache of the thread
+ *
+ * RETURN (verify_key_t* key)
+ * - NULL | Failed to parse key or create context
+ */
+static verify_key_t* verify_key_get(const uint8_t* public)
+{
+  for(size_t index = 0; index < crypto_thread.key_count; index++)
+  {
+    verify_key_t* key = &crypto_thread.keys[index];
+
+    if(memcmp(key->public, public, SIGN_PUBLIC_SIZE) == 0) return key;
+  }
+
+  EVP_PKEY* pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, public, SIGN_PUBLIC_SIZE);
+
+  if(!pkey) return NULL;
+
+  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+
+  if(!ctx || EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, pkey) != 1)
+  {
+    EVP_MD_CTX_free(ctx);
+
+    EVP_PKEY_free(pkey);
+
+    return NULL;
+  }
+
+  verify_key_t* key;
+
+  if(crypto_thread.key_count < VERIFY_KEY_CACHE)
+  {
+    key = &crypto_thread.keys[crypto_thread.key_count++];
+  }
+  else
+  {
+    key = &crypto_thread.keys[crypto_thread.key_next];
+
+    crypto_thread.key_next = (crypto_thread.key_next + 1) % VERIFY_KEY_CACHE;
+
+    EVP_MD_CTX_free(key->ctx);
+
+    EVP_PKEY_free(key->pkey);
+  }
+
+  memcpy(key->public, public, SIGN_PUBLIC_SIZE);
+
+  key->pkey = pkey;
+  key->ctx  = ctx;
+
+  return key;
+}
+
+/*
+ * Verify a signature against a raw public key
+ *
+ * Every sender key is parsed once and kept by the thread,
+ * with a context that is initialized with it and reused
+ *
+ * RETURN (int status)
+ * - 0 | Valid signature
+ * - 1 | Invalid signature
+ * - 2 | Failed to parse public key
+ */
+int data_verify(const uint8_t* sign, const uint8_t* public, const void* data, size_t size)
+{
+  if(!sign || !public) return 1;
+
+  verify_key_t* key = verify_key_get(public);
+
+  if(!key) return 2;
+
+  if(EVP_DigestVerify(key->ctx, sign, SIGN_SIZE, data, size) == 1) return 0;
+
+  // The context is initialized again, in case the failure left it unusable
+  EVP_MD_CTX_reset(key->ctx);
+
+  EVP_DigestVerifyInit(key->ctx, NULL, NULL, NULL, key->pkey);
+
+  return 1;
+}
+
+/*
+ * Hash a head and data with SHA-512, as if they were one buffer,
+ * so that data can be signed together with a head without copying it
+ *
+ * PARAMS
+ * - uint8_t* digest | Buffer of DIGEST_SIZE bytes to store digest
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to hash data
+ */
+int data_digest(uint8_t* digest, const void* head, size_t head_size, const void* data, size_t size)
+{
+  if(!digest) return 1;
+
+  if(!crypto_thread.digest && !(crypto_thread.digest = EVP_MD_CTX_new())) return 1;
+
+  EVP_MD_CTX* ctx = crypto_thread.digest;
+
+  unsigned int digest_size = DIGEST_SIZE;
+
+  if(EVP_DigestInit_ex(ctx, EVP_sha512(), NULL) != 1 ||
+     EVP_DigestUpdate(ctx, head, head_size) != 1 ||
+     EVP_DigestUpdate(ctx, data, size) != 1 ||
+     EVP_DigestFinal_ex(ctx, digest, &digest_size) != 1) return 1;
+
+  return 0;
+}
+
+/*
+ * Generate a new X25519 key
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to generate key
+ * - 2 | Failed to get raw public key
+ */
+int wrap_key_create(wrap_key_t* key)
+{
+  if(!key) return 1;
+
+  key->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "X25519");
+
+  if(!key->pkey) return 1;
+
+  size_t size = WRAP_PUBLIC_SIZE;
+
+  if(EVP_PKEY_get_raw_public_key(key->pkey, key->public, &size) != 1)
+  {
+    wrap_key_free(key);
+
+    return 2;
+  }
+
+  return 0;
+}
+
+/*
+ * Free the X25519 key
+ */
+void wrap_key_free(wrap_key_t* key)
+{
+  if(!key) return;
+
+  if(key->pkey) EVP_PKEY_free(key->pkey);
+
+  key->pkey = NULL;
+}
+
+/*
+ * Derive the HKDF-SHA256 secret from a shared X25519 secret
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to derive secret
+ */
+static int shared_secret_derive(uint8_t* secret, const uint8_t* shared, size_t size)
+{
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+
+  if(!ctx) return 1;
+
+  static const char info[] = "bunker wrap";
+
+  size_t secret_size = SECRET_SIZE;
+
+  int status = 0;
+
+  if(EVP_PKEY_derive_init(ctx) != 1 ||
+     EVP_PKEY_CTX_set_hkdf_md(ctx, EVP_sha256()) != 1 ||
+     EVP_PKEY_CTX_set1_hkdf_key(ctx, shared, size) != 1 ||
+     EVP_PKEY_CTX_add1_hkdf_info(ctx, (const uint8_t*) info, sizeof(info) - 1) != 1 ||
+     EVP_PKEY_derive(ctx, secret, &secret_size) != 1)
+  {
+    status = 1;
+  }
+
+  EVP_PKEY_CTX_free(ctx);
+
+  return status;
+}
+
+/*
+ * Create the secret, shared with the owner of the public key,
+ * that is used to wrap message keys for them
+ *
+ * Both sides get the same secret, so it is made once per peer
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to parse public key
+ * - 2 | Failed to exchange keys
+ * - 3 | Failed to derive secret
+ */
+int wrap_secret_create(uint8_t* secret, const wrap_key_t* key, const uint8_t* public)
+{
+  if(!secret || !key || !key->pkey || !public) return 1;
+
+  EVP_PKEY* peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, public, WRAP_PUBLIC_SIZE);
+
+  if(!peer) return 1;
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(key->pkey, NULL);
+
+  uint8_t shared[32];
+  size_t  shared_size = sizeof(shared);
+
+  int status = 0;
+
+  if(!ctx ||
+     EVP_PKEY_derive_init(ctx) != 1 ||
+     EVP_PKEY_derive_set_peer(ctx, peer) != 1 ||
+     EVP_PKEY_derive(ctx, shared, &shared_size) != 1)
+  {
+    status = 2;
+  }
+  else if(shared_secret_derive(secret, shared, shared_size) != 0)
+  {
+    status = 3;
+  }
+
+  OPENSSL_cleanse(shared, sizeof(shared));
+
+  EVP_PKEY_CTX_free(ctx);
+
+  EVP_PKEY_free(peer);
+
+  return status;
+}
+
+/*
+ * Generate a random secret key
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to generate random bytes
+ */
+int secret_create(uint8_t* secret)
+{
+  if(!secret) return 1;
+
+  return (RAND_bytes(secret, SECRET_SIZE) == 1) ? 0 : 1;
+}
+
+/*
+ * Get a cipher context of the thread, that has AES-256-GCM set up,
+ * so that only the key and nonce are set for every message
+ *
+ * RETURN (EVP_CIPHER_CTX* ctx)
+ * - NULL | Failed to create context
+ */
+static EVP_CIPHER_CTX* cipher_ctx_get(EVP_CIPHER_CTX** ctx, int encrypt)
+{
+  if(*ctx) return *ctx;
+
+  if(!(*ctx = EVP_CIPHER_CTX_new())) return NULL;
+
+  if(EVP_CipherInit_ex(*ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, encrypt) != 1)
+  {
+    EVP_CIPHER_CTX_free(*ctx);
+
+    *ctx = NULL;
+  }
+
+  return *ctx;
+}
+
+/*
+ * Encrypt data with AES-256-GCM
+ *
+ * PARAMS
+ * - uint8_t* cipher | Buffer of (size + AEAD_EXTRA_SIZE) bytes
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to encrypt data
+ */
+int data_encrypt(uint8_t* cipher, const uint8_t* secret, const void* data, size_t size)
+{
+  if(!cipher || !secret || (!data && size > 0)) return 1;
+
+  uint8_t* nonce = cipher;
+  uint8_t* text  = cipher + AEAD_NONCE_SIZE;
+  uint8_t* tag   = text + size;
+
+  if(RAND_bytes(nonce, AEAD_NONCE_SIZE) != 1) return 1;
+
+  EVP_CIPHER_CTX* ctx = cipher_ctx_get(&crypto_thread.encrypt, 1);
+
+  if(!ctx) return 1;
+
+  int length;
+  int status = 0;
+
+  if(EVP_EncryptInit_ex(ctx, NULL, NULL, secret, nonce) != 1 ||
+     EVP_EncryptUpdate(ctx, text, &length, data, size) != 1 ||
+     EVP_EncryptFinal_ex(ctx, text + length, &length) != 1 ||
+     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, AEAD_TAG_SIZE, tag) != 1)
+  {
+    status = 1;
+  }
+
+  return status;
+}
+
+/*
+ * Decrypt and authenticate AES-256-GCM cipher text
+ *
+ * PARAMS
+ * - void*  data | Buffer of (size - AEAD_EXTRA_SIZE) bytes
+ * - size_t size | Size of cipher text, including nonce and tag
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | Failed to decrypt or authenticate data
+ */
+int data_decrypt(void* data, const uint8_t* secret, const uint8_t* cipher, size_t size)
+{
+  if(!data || !secret || !cipher || size < AEAD_EXTRA_SIZE) return 1;
+
+  size_t text_size = size - AEAD_EXTRA_SIZE;
+
+  const uint8_t* nonce = cipher;
+  const uint8_t* text  = cipher + AEAD_NONCE_SIZE;
+  const uint8_t* tag   = text + text_size;
+
+  EVP_CIPHER_CTX* ctx = cipher_ctx_get(&crypto_thread.decrypt, 0);
+
+  if(!ctx) return 2;
+
+  int length;
+  int status = 0;
+
+  if(EVP_DecryptInit_ex(ctx, NULL, NULL, secret, nonce) != 1 ||
+     EVP_DecryptUpdate(ctx, data, &length, text, text_size) != 1 ||
+     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, AEAD_TAG_SIZE, (void*) tag) != 1 ||
+     EVP_DecryptFinal_ex(ctx, (uint8_t*) data + length, &length) != 1)
+  {
+    status = 2;
+  }
+
+  return status;
+}
+
+/*
+ * Wrap (encrypt) a key with a shared secret
+ *
+ * PARAMS
+ * - uint8_t* wrap | Buffer of WRAP_SIZE bytes
+ *
+ * RETURN (same as data_encrypt)
+ */
+int key_wrap(uint8_t* wrap, const uint8_t* key, const uint8_t* secret)
+{
+  return data_encrypt(wrap, secret, key, SECRET_SIZE);
+}
+
+/*
+ * Unwrap (decrypt) a key with a shared secret
+ *
+ * RETURN (same as data_decrypt)
+ */
+int key_unwrap(uint8_t* key, const uint8_t* wrap, const uint8_t* secret)
+{
+  return data_decrypt(key, secret, wrap, WRAP_SIZE);
+}
+
+/*
+ * Create a new group key and wrap it for every member
+ *
+ * PARAMS
+ * - uint8_t*       wraps   | Buffer of (count * WRAP_SIZE) bytes
+ * - const uint8_t* secrets | The (count * SECRET_SIZE) shared secrets
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create key
+ * - 2 | Failed to wrap key
+ */
+int group_rekey(uint8_t* key, uint8_t* wraps, const uint8_t* secrets, size_t count)
+{
+  if(secret_create(key) != 0) return 1;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    if(key_wrap(wraps + index * WRAP_SIZE, key, secrets + index * SECRET_SIZE) != 0)
+    {
+      return 2;
+    }
+  }
+
+  return 0;
+}
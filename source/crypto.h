@@ -0,0 +1,96 @@
+/*
+ * crypto.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <openssl/evp.h>
+
+#define SIGN_PUBLIC_SIZE 32
+#define SIGN_SIZE        64
+
+#define WRAP_PUBLIC_SIZE 32
+
+#define SECRET_SIZE      32
+
+/*
+ * AEAD (AES-256-GCM) cipher text is the nonce,
+ * the encrypted data and the tag
+ */
+#define AEAD_NONCE_SIZE  12
+#define AEAD_TAG_SIZE    16
+#define AEAD_EXTRA_SIZE  (AEAD_NONCE_SIZE + AEAD_TAG_SIZE)
+
+#define WRAP_SIZE        (AEAD_EXTRA_SIZE + SECRET_SIZE)
+
+/*
+ * SHA-512 digest, of data that is signed in parts
+ */
+#define DIGEST_SIZE      64
+
+/*
+ * Ed25519 signing key
+ *
+ * The raw public key is kept next to the EVP key,
+ * so that it can be sent without asking openssl for it
+ */
+typedef struct
+{
+  EVP_PKEY* pkey;
+  uint8_t   public[SIGN_PUBLIC_SIZE];
+} sign_key_t;
+
+/*
+ * X25519 key, used to derive the secrets that wrap message keys
+ */
+typedef struct
+{
+  EVP_PKEY* pkey;
+  uint8_t   public[WRAP_PUBLIC_SIZE];
+} wrap_key_t;
+
+extern void crypto_thread_free(void);
+
+
+extern int  sign_key_create(sign_key_t* key);
+
+extern void sign_key_free(sign_key_t* key);
+
+
+extern int data_sign(uint8_t* sign, const sign_key_t* key, const void* data, size_t size);
+
+extern int data_verify(const uint8_t* sign, const uint8_t* public, const void* data, size_t size);
+
+extern int data_digest(uint8_t* digest, const void* head, size_t head_size, const void* data, size_t size);
+
+
+extern int  wrap_key_create(wrap_key_t* key);
+
+extern void wrap_key_free(wrap_key_t* key);
+
+extern int  wrap_secret_create(uint8_t* secret, const wrap_key_t* key, const uint8_t* public);
+
+
+extern int secret_create(uint8_t* secret);
+
+extern int data_encrypt(uint8_t* cipher, const uint8_t* secret, const void* data, size_t size);
+
+extern int data_decrypt(void* data, const uint8_t* secret, const uint8_t* cipher, size_t size);
+
+
+extern int key_wrap(uint8_t* wrap, const uint8_t* key, const uint8_t* secret);
+
+extern int key_unwrap(uint8_t* key, const uint8_t* wrap, const uint8_t* secret);
+
+extern int group_rekey(uint8_t* key, uint8_t* wraps, const uint8_t* secrets, size_t count);
+
+#endif // CRYPTO_H
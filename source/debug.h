@@ -3,10 +3,11 @@
  *
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-12-04
+ * Last updated: 2026-10-19
  *
  *
  * In main compilation unit; define DEBUG_IMPLEMENT
+ * and FORMAT_IMPLEMENT, because the messages use format.h
  *
  *
  * These are the available funtions:
@@ -17,12 +18,38 @@
  *
  * int info_print(const char* format, ...)
  *
+ * int error_subsystem_print(int subsystem, const char* format, ...)
+ *
+ * int info_subsystem_print(int subsystem, const char* format, ...)
+ *
+ * void debug_filter_set(unsigned int filter)
+ *
+ * int debug_filter_parse(unsigned int* filter, const char* string)
+ *
  * int debug_file_open(const char* filepath)
  *
+ * int debug_binary_open(const char* filepath)
+ *
  * void debug_file_close(void)
  *
  *
- * Uses va_list for argument parsing, like in getstr.c
+ * Uses format.h for argument parsing, like getstr.h
+ *
+ *
+ * While a debug file is open, messages to it are put in a ring buffer
+ * of the calling thread, and a writer thread writes them to the file.
+ * The calling thread only formats the message, and makes no syscall.
+ *
+ * error_print and info_print are macros, that give every call site
+ * a static dbg_site_t. When the debug file is opened in binary,
+ * the format is not printed; only the site, the time and the raw
+ * arguments are stored, and bunker-logdecode prints the file later.
+ * The format of those call sites must be a string literal.
+ *
+ * Call sites with a level above DEBUG_LEVEL compile to nothing,
+ * for example with -DDEBUG_LEVEL=1 only errors are left.
+ * The other call sites check the runtime filter of their subsystem,
+ * and the rate of the site, before any argument is formatted.
  */
 
 /*
@@ -34,16 +61,130 @@
 #define DEBUG_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * The maximum number of arguments of a call site in binary
+ */
+#define DEBUG_ARGS_MAX 16
+
+/*
+ * The maximum number of messages per second of a call site,
+ * where 0 is no limit
+ */
+#ifndef DEBUG_RATE_MAX
+#define DEBUG_RATE_MAX 100
+#endif
+
+/*
+ * A call site of error_print or info_print
+ *
+ * The argument types are parsed from the format once,
+ * and the id is given by the writer thread
+ *
+ * At most DEBUG_RATE_MAX messages per second are printed
+ */
+typedef struct
+{
+  const char* format;
+  const char* title;
+  atomic_int  state;
+  uint8_t     count;
+  uint8_t     types[DEBUG_ARGS_MAX];
+  uint32_t    id;
+  uint32_t    generation;
+  atomic_ullong rate;       // The second in the high half, and messages in the low
+  atomic_uint   suppressed; // Messages over DEBUG_RATE_MAX in the second
+} dbg_site_t;
+
+#define DEBUG_ERROR_TITLE "\e[1;31mERROR\e[0m"
+#define DEBUG_INFO_TITLE  "\e[1;37mINFO \e[0m"
+#define DEBUG_WARN_TITLE  "\e[1;33mWARN \e[0m"
+
+/*
+ * The levels of debug messages
+ *
+ * Call sites above DEBUG_LEVEL are removed when compiling
+ */
+#define DEBUG_LEVEL_NONE  0
+#define DEBUG_LEVEL_ERROR 1
+#define DEBUG_LEVEL_INFO  2
+
+#ifndef DEBUG_LEVEL
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#endif
+
+/*
+ * The subsystems that debug messages can be filtered by
+ *
+ * error_print and info_print use DEBUG_SUBSYSTEM,
+ * which a source file can define before including debug.h
+ */
+#define DEBUG_SOCKET 0
+#define DEBUG_ROOM   1
+#define DEBUG_CRYPTO 2
+#define DEBUG_UI     3
+
+#define DEBUG_SUBSYSTEM_COUNT 4
+
+#ifndef DEBUG_SUBSYSTEM
+#define DEBUG_SUBSYSTEM DEBUG_ROOM
+#endif
+
+/*
+ * The filter has one bit for every level of every subsystem
+ */
+#define DEBUG_FILTER_BIT(subsystem, level) (1U << ((subsystem) * 2 + (level) - 1))
+
+#define DEBUG_FILTER_NONE 0U
+#define DEBUG_FILTER_ALL  ((1U << (DEBUG_SUBSYSTEM_COUNT * 2)) - 1)
+
+extern atomic_uint debug_filter;
+
+/*
+ * A call site that is filtered out only loads the filter,
+ * and the arguments are not evaluated
+ */
+#define DEBUG_SITE_PRINT(stream, subsystem, level, site_title, site_format, ...) \
+  ({ \
+    static dbg_site_t dbg_site = { .format = site_format, .title = site_title }; \
+    (atomic_load_explicit(&debug_filter, memory_order_relaxed) & DEBUG_FILTER_BIT(subsystem, level)) ? \
+      dbg_site_print(&dbg_site, stream, ##__VA_ARGS__) : 0; \
+  })
+
+#if DEBUG_LEVEL >= DEBUG_LEVEL_ERROR
+#define error_subsystem_print(subsystem, ...) \
+  DEBUG_SITE_PRINT(stderr, subsystem, DEBUG_LEVEL_ERROR, DEBUG_ERROR_TITLE, __VA_ARGS__)
+#else
+#define error_subsystem_print(subsystem, ...) ((void) 0)
+#endif
+
+#if DEBUG_LEVEL >= DEBUG_LEVEL_INFO
+#define info_subsystem_print(subsystem, ...) \
+  DEBUG_SITE_PRINT(stdout, subsystem, DEBUG_LEVEL_INFO, DEBUG_INFO_TITLE, __VA_ARGS__)
+#else
+#define info_subsystem_print(subsystem, ...) ((void) 0)
+#endif
+
+#define error_print(...) error_subsystem_print(DEBUG_SUBSYSTEM, __VA_ARGS__)
+
+#define info_print(...)  info_subsystem_print(DEBUG_SUBSYSTEM, __VA_ARGS__)
 
 extern int debug_print(FILE* stream, const char* title, const char* format, ...);
 
-extern int error_print(const char* format, ...);
+extern int dbg_site_print(dbg_site_t* site, FILE* stream, ...);
 
-extern int info_print(const char* format, ...);
+
+extern void debug_filter_set(unsigned int filter);
+
+extern int  debug_filter_parse(unsigned int* filter, const char* string);
 
 
 extern int debug_file_open(const char* filepath);
 
+extern int debug_binary_open(const char* filepath);
+
 extern void debug_file_close(void);
 
 extern FILE* debug_file;
@@ -60,12 +201,46 @@ extern FILE* debug_file;
 
 #include <stdarg.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "format.h"
+#include "alloc.h"
 
 FILE* debug_file = NULL;
 
+atomic_uint debug_filter = DEBUG_FILTER_ALL;
+
+/*
+ * The names of the subsystems, in the order of their numbers
+ */
+static const char* dbg_subsystem_names[DEBUG_SUBSYSTEM_COUNT] =
+{
+  "socket", "room", "crypto", "ui"
+};
+
+/*
+ * Bytes in the ring buffer of every thread, must be a power of two
+ */
+#define DEBUG_RING_SIZE  262144
+
+/*
+ * Bytes that the writer thread collects before every write
+ */
+#define DEBUG_BATCH_SIZE 65536
+
+/*
+ * Nanoseconds that the writer thread sleeps, when there is nothing to write
+ */
+#define DEBUG_WRITER_SLEEP 1000000
+
 /*
  * The debug format must include:
  * - %s for the time string
@@ -99,110 +274,185 @@ static inline char* dbg_timestr_create(char* buffer)
 }
 
 /*
- * Parse va_list argument and print it to a buffer
+ * Types of the arguments of a call site
+ */
+typedef enum
+{
+  DBG_ARG_INT    = 1,
+  DBG_ARG_LONG   = 2,
+  DBG_ARG_LLONG  = 3,
+  DBG_ARG_CHAR   = 4,
+  DBG_ARG_DOUBLE = 5,
+  DBG_ARG_STRING = 6
+} dbg_arg_t;
+
+/*
+ * The maximum number of bytes of a string argument in binary
+ */
+#define DEBUG_STRING_MAX 255
+
+/*
+ * The states of a call site
+ */
+#define DBG_SITE_NEW     0
+#define DBG_SITE_PARSING 1
+#define DBG_SITE_BINARY  2
+#define DBG_SITE_TEXT    3
+
+/*
+ * Get the type of the format specifier after a '%'
  *
  * PARAMS
- * - char* buffer          | Buffer to store printed argument
- * - const char* specifier | Argument format specifier
- * - va_list args          | va_list argument list
+ * - const char* specifier | The characters after the '%'
+ * - int*        length    | Number of characters in specifier
  *
- * RETURN (int amount, same as sprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
+ * RETURN (int type)
+ * - >0 | dbg_arg_t type
+ * - -1 | Format specifier does not exist, or can't be stored in binary
  */
-static inline int dbg_specifier_append(char* buffer, const char* specifier, va_list args)
+static inline int dbg_specifier_type(const char* specifier, int* length)
 {
-  if(strncmp(specifier, "d", 1) == 0)
+  switch(format_specifier_parse(specifier, length))
   {
-    int arg = va_arg(args, int);
-
-    return sprintf(buffer, "%d", arg);
+    case FORMAT_INT:    return DBG_ARG_INT;
+    case FORMAT_LONG:   return DBG_ARG_LONG;
+    case FORMAT_LLONG:  return DBG_ARG_LLONG;
+    case FORMAT_CHAR:   return DBG_ARG_CHAR;
+    case FORMAT_DOUBLE: return DBG_ARG_DOUBLE;
+    case FORMAT_STRING: return DBG_ARG_STRING;
+
+    // The other specifiers are only printed as text
+    default: return -1;
   }
-  else if(strncmp(specifier, "ld", 2) == 0)
-  {
-    long int arg = va_arg(args, long int);
+}
 
-    return sprintf(buffer, "%ld", arg);
-  }
-  else if(strncmp(specifier, "lld", 2) == 0)
-  {
-    long long int arg = va_arg(args, long long int);
+/*
+ * Parse the argument types of the format of a call site
+ *
+ * If the format can't be stored in binary, the site prints text
+ *
+ * RETURN (int state)
+ * - DBG_SITE_BINARY | The arguments can be stored in binary
+ * - DBG_SITE_TEXT   | The site must print text
+ */
+static int dbg_site_parse(dbg_site_t* site)
+{
+  int state = DBG_SITE_NEW;
 
-    return sprintf(buffer, "%lld", arg);
-  }
-  else if(strncmp(specifier, "c", 1) == 0)
+  if(atomic_compare_exchange_strong(&site->state, &state, DBG_SITE_PARSING))
   {
-    // ‘char’ is promoted to ‘int’ when passed through ‘...’
-    int arg = va_arg(args, int);
+    state = DBG_SITE_BINARY;
 
-    return sprintf(buffer, "%c", arg);
-  }
-  else if(strncmp(specifier, "f", 1) == 0)
-  {
-    // ‘float’ is promoted to ‘double’ when passed through ‘...’
-    double arg = va_arg(args, double);
+    site->count = 0;
 
-    return sprintf(buffer, "%lf", arg);
-  }
-  else if(strncmp(specifier, "s", 1) == 0)
-  {
-    const char* arg = va_arg(args, const char*);
+    for(const char* format = site->format; *format; format++)
+    {
+      if(*format != '%') continue;
+
+      int length;
+      int type = dbg_specifier_type(format + 1, &length);
+
+      if(type < 0 || site->count >= DEBUG_ARGS_MAX)
+      {
+        state = DBG_SITE_TEXT;
+
+        break;
+      }
 
-    return sprintf(buffer, "%s", arg);
+      site->types[site->count++] = type;
+
+      format += length;
+    }
+
+    atomic_store_explicit(&site->state, state, memory_order_release);
+
+    return state;
   }
-  else return -1; // Specifier does not exist
+
+  // Another thread is parsing the site
+  while((state = atomic_load_explicit(&site->state, memory_order_acquire)) == DBG_SITE_PARSING);
+
+  return state;
 }
 
 /*
- * Formats just a single format specifier argument from va_list
+ * Print the raw arguments of a call site with its format
+ *
+ * PARAMS
+ * - char*          string | Buffer to store message
+ * - size_t         size   | Size of buffer
+ * - const char*    format | Format of the call site
+ * - const uint8_t* args   | Raw arguments, as stored by dbg_ring_event
+ * - size_t         length | Number of argument bytes
  *
- * RETURN (int amount, same as sprintf)
+ * RETURN (int length)
  * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
+ * -  -1 | Format specifier does not exist, or arguments are missing
  */
-static inline int dbg_arg_append(char* buffer, const char* format, int f_length, int* f_index, va_list args)
+static inline int dbg_event_string_create(char* string, size_t size, const char* format, const uint8_t* args, size_t length)
 {
-  char specifier[f_length + 1];
+  size_t s_index = 0;
+  size_t a_index = 0;
 
-  for(int s_index = 0; (*f_index)++ < f_length; s_index++)
+  for(; *format && s_index + 1 < size; format++)
   {
-    specifier[s_index] = format[*f_index];
-    specifier[s_index + 1] = '\0';
+    if(*format != '%')
+    {
+      string[s_index++] = *format;
 
-    int amount = dbg_specifier_append(buffer, specifier, args);
+      continue;
+    }
 
-    // If a valid format specifier has been found and parsed,
-    // return the status of the appended specifier
-    if(amount > 0) return amount;
-  }
+    int spec_length;
+    int type = dbg_specifier_type(format + 1, &spec_length);
 
-  return -1;
-}
+    format += spec_length;
 
-/*
- * sprintf, but with va_list as arguments
- *
- * RETURN (same as sprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
- */
-static inline int dbg_string_create(char* string, const char* format, va_list args)
-{
-  const size_t f_length = strlen(format);
+    size_t rest = size - s_index;
+    int    amount;
 
-  int s_index = 0;
+    if(type == DBG_ARG_INT && a_index + sizeof(int) <= length)
+    {
+      int arg;
+      memcpy(&arg, args + a_index, sizeof(arg));
+      a_index += sizeof(arg);
 
-  for(int f_index = 0; f_index < f_length; f_index++)
-  {
-    if(format[f_index] == '%')
+      amount = format_string(string + s_index, rest, "%d", arg);
+    }
+    else if((type == DBG_ARG_LONG || type == DBG_ARG_LLONG) && a_index + sizeof(long long) <= length)
+    {
+      long long arg;
+      memcpy(&arg, args + a_index, sizeof(arg));
+      a_index += sizeof(arg);
+
+      amount = format_string(string + s_index, rest, "%lld", arg);
+    }
+    else if(type == DBG_ARG_CHAR && a_index + 1 <= length)
+    {
+      amount = format_string(string + s_index, rest, "%c", args[a_index++]);
+    }
+    else if(type == DBG_ARG_DOUBLE && a_index + sizeof(double) <= length)
+    {
+      double arg;
+      memcpy(&arg, args + a_index, sizeof(arg));
+      a_index += sizeof(arg);
+
+      amount = format_string(string + s_index, rest, "%f", arg);
+    }
+    else if(type == DBG_ARG_STRING && a_index + 1 <= length && a_index + 1 + args[a_index] <= length)
     {
-      int amount = dbg_arg_append(string + s_index, format, f_length, &f_index, args);
+      int arg_length = args[a_index++];
 
-      if(amount < 0) return -1;
+      amount = (arg_length < rest) ? arg_length : rest - 1;
 
-      s_index += amount;
+      memcpy(string + s_index, args + a_index, amount);
+      a_index += arg_length;
     }
-    else string[s_index++] = format[f_index];
+    else return -1;
+
+    if(amount < 0) return -1;
+
+    s_index += ((size_t) amount < rest) ? (size_t) amount : rest - 1;
   }
 
   string[s_index] = '\0';
@@ -211,135 +461,1079 @@ static inline int dbg_string_create(char* string, const char* format, va_list ar
 }
 
 /*
- * Print custom debug message, taking in va_list
+ * A message in a ring buffer
  *
- * RETURN (same as fprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
+ * Text messages are followed by the title and the message,
+ * both with null terminators. Binary messages have a site,
+ * and are followed by the raw arguments. Both are padded to 8 bytes.
  */
-static inline int dbg_valist_print(FILE* stream, const char* title, const char* format, va_list args)
+typedef struct
 {
-  char timestr[32];
+  uint64_t          time;
+  const dbg_site_t* site;
+  int               fd;
+  uint32_t          size;
+  uint32_t          length; // Title length of text, or argument bytes of binary
+} dbg_record_t;
 
-  if(dbg_timestr_create(timestr) == NULL)
-  {
-    return -1;
-  }
+/*
+ * Ring buffer of one thread
+ *
+ * The thread is the only one to move head, and the writer
+ * thread is the only one to move tail and to unlink rings
+ */
+typedef struct dbg_ring_t
+{
+  _Atomic uint64_t head __attribute__((aligned(64)));
 
-  char string[1024];
+  _Atomic uint64_t tail __attribute__((aligned(64)));
 
-  if(dbg_string_create(string, format, args) < 0)
-  {
-    return -1;
-  }
+  _Atomic uint64_t dropped __attribute__((aligned(64)));
+  atomic_bool      closed;
+
+  struct dbg_ring_t* next;
+
+  uint8_t data[DEBUG_RING_SIZE] __attribute__((aligned(64)));
+} dbg_ring_t;
+
+static _Atomic(dbg_ring_t*) dbg_rings = NULL;
+
+static __thread dbg_ring_t* dbg_thread_ring = NULL;
+
+static pthread_once_t dbg_ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  dbg_ring_key;
+
+static pthread_t   dbg_writer;
+static atomic_bool dbg_writer_running = false;
+static atomic_bool dbg_writer_stop = false;
+
+/*
+ * If the debug file is binary, and the number of the file,
+ * which tells if the id of a site has been written to the file
+ */
+static bool     dbg_binary = false;
+static uint32_t dbg_generation = 0;
+static uint32_t dbg_site_count = 0;
 
-  return fprintf(stream, DEBUG_FORMAT, timestr, title, string);
+/*
+ * Wall clock and monotonic clock at the same instant,
+ * to get the wall clock time of a monotonic time stamp
+ */
+static struct timespec dbg_start_real;
+static struct timespec dbg_start_mono;
+
+/*
+ * Get monotonic time in nanoseconds
+ *
+ * clock_gettime is served by the vDSO, so this makes no syscall
+ */
+static inline uint64_t dbg_time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return (uint64_t) timespec.tv_sec * 1000000000 + timespec.tv_nsec;
+}
+
+/*
+ * Mark the ring of an exiting thread, so that the writer frees it
+ */
+static void dbg_ring_close(void* pointer)
+{
+  dbg_ring_t* ring = pointer;
+
+  atomic_store_explicit(&ring->closed, true, memory_order_release);
 }
 
 /*
- * Print own debug message to specified stream
  *
- * RETURN (same as fprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
  */
-int debug_print(FILE* stream, const char* title, const char* format, ...)
+static void dbg_ring_key_create(void)
 {
-  va_list args;
+  pthread_key_create(&dbg_ring_key, dbg_ring_close);
+}
 
-  va_start(args, format);
+/*
+ * Get the ring of the calling thread, and create it the first time
+ *
+ * RETURN (dbg_ring_t* ring)
+ * - NULL | Failed to allocate ring
+ */
+static inline dbg_ring_t* dbg_ring_get(void)
+{
+  if(dbg_thread_ring) return dbg_thread_ring;
 
-  int amount = dbg_valist_print(stream, title, format, args);
+  pthread_once(&dbg_ring_once, dbg_ring_key_create);
 
-  fflush(stream);
+  dbg_ring_t* ring;
 
-  va_end(args);
+  if(posix_memalign((void**) &ring, 64, sizeof(dbg_ring_t)) != 0) return NULL;
 
-  return amount;
+  tag_count_add(ALLOC_LOG, sizeof(dbg_ring_t));
+
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->dropped, 0);
+  atomic_init(&ring->closed, false);
+
+  // Push the ring to the front of the list of rings
+  ring->next = atomic_load_explicit(&dbg_rings, memory_order_relaxed);
+
+  while(!atomic_compare_exchange_weak_explicit(&dbg_rings, &ring->next, ring, memory_order_release, memory_order_relaxed));
+
+  pthread_setspecific(dbg_ring_key, ring);
+
+  dbg_thread_ring = ring;
+
+  return ring;
 }
 
 /*
- * Print debug error message to stderr
+ * Reserve a record of size bytes in the ring of the calling thread
  *
- * RETURN (same as fprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
+ * If the ring is full, the message is dropped and counted
+ *
+ * RETURN (dbg_record_t* record)
+ * - NULL | The ring is full
  */
-int error_print(const char* format, ...)
+static inline dbg_record_t* dbg_ring_reserve(dbg_ring_t* ring, uint32_t size)
 {
-  va_list args;
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
 
-  va_start(args, format);
+  size_t offset = head & (DEBUG_RING_SIZE - 1);
 
-  FILE* file = debug_file ? debug_file : stderr;
+  // Records don't wrap, so skip the end of the ring if it is too small
+  size_t skip = (offset + size > DEBUG_RING_SIZE) ? (DEBUG_RING_SIZE - offset) : 0;
 
-  int amount = dbg_valist_print(file, "\e[1;31mERROR\e[0m", format, args);
+  if(head + skip + size - tail > DEBUG_RING_SIZE)
+  {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
 
-  fflush(file);
+    return NULL;
+  }
 
-  va_end(args);
+  if(skip > 0)
+  {
+    // The skipped end is marked with an empty record, if one fits
+    if(skip >= sizeof(dbg_record_t))
+    {
+      ((dbg_record_t*) (ring->data + offset))->size = 0;
+    }
 
-  return amount;
+    // Only this thread moves head, so the skip can be published with the record
+    offset = 0;
+  }
+
+  dbg_record_t* record = (dbg_record_t*) (ring->data + offset);
+
+  record->size = size;
+
+  return record;
+}
+
+/*
+ * Publish the reserved record to the writer thread
+ */
+static inline void dbg_ring_commit(dbg_ring_t* ring, dbg_record_t* record)
+{
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  size_t offset = head & (DEBUG_RING_SIZE - 1);
+
+  // The record was put at the start of the ring, if the end was skipped
+  if((uint8_t*) record != ring->data + offset)
+  {
+    head += DEBUG_RING_SIZE - offset;
+  }
+
+  atomic_store_explicit(&ring->head, head + record->size, memory_order_release);
 }
 
 /*
- * Print debug info message to stdout
+ * Put text message in the ring of the calling thread
  *
- * RETURN (same as fprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
+ * RETURN (int amount)
+ * - >=0 | Number of characters in message
+ * -  -1 | Format specifier does not exist, or ring is full
  */
-int info_print(const char* format, ...)
+static inline int dbg_ring_print(int fd, const char* title, const char* format, va_list args)
 {
-  va_list args;
+  uint64_t time = dbg_time_get();
 
-  va_start(args, format);
+  char string[1024];
 
-  FILE* file = debug_file ? debug_file : stdout;
+  int length = format_vstring(string, sizeof(string), format, args);
 
-  int amount = dbg_valist_print(file, "\e[1;37mINFO \e[0m", format, args);
+  if(length < 0) return -1;
 
-  fflush(file);
+  // Long messages are cut at the end of the buffer
+  if(length >= sizeof(string)) length = sizeof(string) - 1;
 
-  va_end(args);
+  dbg_ring_t* ring = dbg_ring_get();
 
-  return amount;
+  if(!ring) return -1;
+
+  size_t title_length = strlen(title);
+
+  uint32_t size = (sizeof(dbg_record_t) + title_length + 1 + length + 1 + 7) & ~7;
+
+  dbg_record_t* record = dbg_ring_reserve(ring, size);
+
+  if(!record) return -1;
+
+  record->time   = time;
+  record->site   = NULL;
+  record->fd     = fd;
+  record->length = title_length;
+
+  char* text = (char*) (record + 1);
+
+  memcpy(text, title, title_length + 1);
+
+  memcpy(text + title_length + 1, string, length + 1);
+
+  dbg_ring_commit(ring, record);
+
+  return length;
 }
 
 /*
- * Open and start printing to debug file
+ * Put the raw arguments of a call site in the ring of the calling thread
  *
- * RETURN (int status)
- * - 0 | Success
- * - 1 | Failed to open file
+ * The arguments are stored in native byte order,
+ * and strings are stored with a one byte length
+ *
+ * RETURN (int size)
+ * - >=0 | Number of argument bytes
+ * -  -1 | The ring is full
  */
-int debug_file_open(const char* filepath)
+static inline int dbg_ring_event(int fd, const dbg_site_t* site, va_list args)
 {
-  FILE* stream = fopen(filepath, "a");
+  uint64_t time = dbg_time_get();
 
-  if(!stream) return 1;
+  uint8_t buffer[DEBUG_ARGS_MAX * (DEBUG_STRING_MAX + 1)];
+  size_t  length = 0;
 
-  if(debug_file) fclose(debug_file);
+  for(uint8_t index = 0; index < site->count; index++)
+  {
+    switch(site->types[index])
+    {
+      case DBG_ARG_INT:
+      {
+        int arg = va_arg(args, int);
+        memcpy(buffer + length, &arg, sizeof(arg));
+        length += sizeof(arg);
+        break;
+      }
+
+      case DBG_ARG_LONG:
+      case DBG_ARG_LLONG:
+      {
+        // long is stored as long long, so that the decoder knows the size
+        long long arg = (site->types[index] == DBG_ARG_LONG) ? va_arg(args, long) : va_arg(args, long long);
+        memcpy(buffer + length, &arg, sizeof(arg));
+        length += sizeof(arg);
+        break;
+      }
+
+      case DBG_ARG_CHAR:
+        // ‘char’ is promoted to ‘int’ when passed through ‘...’
+        buffer[length++] = va_arg(args, int);
+        break;
+
+      case DBG_ARG_DOUBLE:
+      {
+        double arg = va_arg(args, double);
+        memcpy(buffer + length, &arg, sizeof(arg));
+        length += sizeof(arg);
+        break;
+      }
+
+      case DBG_ARG_STRING:
+      {
+        const char* arg = va_arg(args, const char*);
+
+        // Short strings are copied and measured at once, without libc
+        uint8_t* string = buffer + length + 1;
+        size_t   arg_length = 0;
+
+        while(arg && arg_length < DEBUG_STRING_MAX && arg[arg_length])
+        {
+          string[arg_length] = arg[arg_length];
+
+          arg_length++;
+        }
+
+        buffer[length] = arg_length;
+
+        length += 1 + arg_length;
+        break;
+      }
+    }
+  }
 
-  debug_file = stream;
+  dbg_ring_t* ring = dbg_ring_get();
 
-  return 0;
+  if(!ring) return -1;
+
+  uint32_t size = (sizeof(dbg_record_t) + length + 7) & ~7;
+
+  dbg_record_t* record = dbg_ring_reserve(ring, size);
+
+  if(!record) return -1;
+
+  record->time   = time;
+  record->site   = site;
+  record->fd     = fd;
+  record->length = length;
+
+  memcpy(record + 1, buffer, length);
+
+  dbg_ring_commit(ring, record);
+
+  return length;
 }
 
 /*
- * Close the debug file
+ * Get the next record of a ring, stepping over the skipped end
+ *
+ * RETURN (dbg_record_t* record)
+ * - NULL | The ring is empty
  */
-void debug_file_close(void)
+static inline dbg_record_t* dbg_ring_peek(dbg_ring_t* ring)
 {
-  if(debug_file) fclose(debug_file);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
 
-  debug_file = NULL;
+  while(tail < head)
+  {
+    size_t offset = tail & (DEBUG_RING_SIZE - 1);
+
+    size_t rest = DEBUG_RING_SIZE - offset;
+
+    dbg_record_t* record = (dbg_record_t*) (ring->data + offset);
+
+    if(rest >= sizeof(dbg_record_t) && record->size > 0) return record;
+
+    tail += rest;
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+
+  return NULL;
+}
+
+/*
+ * Batch of formatted messages, waiting to be written
+ */
+typedef struct
+{
+  char   data[DEBUG_BATCH_SIZE];
+  size_t length;
+  int    fd;
+  time_t second;
+  char   secondstr[16];
+} dbg_batch_t;
+
+/*
+ * Write the batch to its file
+ */
+static void dbg_batch_flush(dbg_batch_t* batch)
+{
+  size_t index = 0;
+
+  while(index < batch->length)
+  {
+    ssize_t size = write(batch->fd, batch->data + index, batch->length - index);
+
+    if(size <= 0) break;
+
+    index += size;
+  }
+
+  batch->length = 0;
+}
+
+/*
+ * Format the wall clock time of a monotonic time stamp
+ *
+ * The "HH:MM:SS" part is only formatted once every second
+ */
+static void dbg_batch_timestr_create(dbg_batch_t* batch, char* buffer, uint64_t time)
+{
+  uint64_t start_mono = (uint64_t) dbg_start_mono.tv_sec * 1000000000 + dbg_start_mono.tv_nsec;
+  uint64_t start_real = (uint64_t) dbg_start_real.tv_sec * 1000000000 + dbg_start_real.tv_nsec;
+
+  uint64_t real = start_real + (time - start_mono);
+
+  time_t second = real / 1000000000;
+
+  if(second != batch->second)
+  {
+    struct tm timeinfo;
+
+    localtime_r(&second, &timeinfo);
+
+    strftime(batch->secondstr, sizeof(batch->secondstr), "%H:%M:%S", &timeinfo);
+
+    batch->second = second;
+  }
+
+  sprintf(buffer, "%s.%02d", batch->secondstr, (int) ((real / 10000000) % 100));
+}
+
+/*
+ * Append formatted message to batch, and flush the batch when needed
+ */
+static void dbg_batch_append(dbg_batch_t* batch, int fd, uint64_t time, const char* title, const char* message)
+{
+  if(fd != batch->fd)
+  {
+    dbg_batch_flush(batch);
+
+    batch->fd = fd;
+  }
+
+  char timestr[32];
+
+  dbg_batch_timestr_create(batch, timestr, time);
+
+  for(int attempt = 0; attempt < 2; attempt++)
+  {
+    size_t rest = DEBUG_BATCH_SIZE - batch->length;
+
+    int length = format_string(batch->data + batch->length, rest, DEBUG_FORMAT, timestr, title, message);
+
+    if(length < 0) return;
+
+    if(length < rest)
+    {
+      batch->length += length;
+
+      return;
+    }
+
+    // The message didn't fit, flush and try again
+    dbg_batch_flush(batch);
+  }
+
+  batch->length = DEBUG_BATCH_SIZE - 1;
+}
+
+/*
+ * The kinds of records in a binary debug file
+ *
+ * FILE
+ * - char     magic[8]   | DEBUG_BINARY_MAGIC
+ * - uint64_t start_real | Wall clock time in ns, at start_mono
+ * - uint64_t start_mono | Monotonic time in ns
+ * - records...
+ *
+ * SITE  | uint8_t kind, uint32_t id, uint16_t title_length, uint16_t format_length, title, format
+ * EVENT | uint8_t kind, uint32_t id, uint64_t time, uint16_t length, args
+ * TEXT  | uint8_t kind, uint64_t time, uint16_t title_length, uint16_t message_length, title, message
+ *
+ * All numbers are in native byte order
+ */
+#define DEBUG_BINARY_MAGIC "BUNKLOG"
+
+#define DBG_KIND_SITE  1
+#define DBG_KIND_EVENT 2
+#define DBG_KIND_TEXT  3
+
+/*
+ * Append raw bytes to batch, and flush the batch when needed
+ */
+static void dbg_batch_write(dbg_batch_t* batch, int fd, const void* data, size_t size)
+{
+  if(fd != batch->fd || batch->length + size > DEBUG_BATCH_SIZE)
+  {
+    dbg_batch_flush(batch);
+
+    batch->fd = fd;
+  }
+
+  if(size > DEBUG_BATCH_SIZE) return;
+
+  memcpy(batch->data + batch->length, data, size);
+
+  batch->length += size;
+}
+
+/*
+ * Append text message to batch, as text or as a binary record
+ */
+static void dbg_batch_text_append(dbg_batch_t* batch, int fd, uint64_t time, const char* title, const char* message)
+{
+  if(!dbg_binary)
+  {
+    dbg_batch_append(batch, fd, time, title, message);
+
+    return;
+  }
+
+  uint16_t title_length   = strlen(title);
+  uint16_t message_length = strlen(message);
+
+  uint8_t buffer[13];
+
+  buffer[0] = DBG_KIND_TEXT;
+  memcpy(buffer + 1,  &time,           sizeof(uint64_t));
+  memcpy(buffer + 9,  &title_length,   sizeof(uint16_t));
+  memcpy(buffer + 11, &message_length, sizeof(uint16_t));
+
+  dbg_batch_write(batch, fd, buffer, sizeof(buffer));
+  dbg_batch_write(batch, fd, title, title_length);
+  dbg_batch_write(batch, fd, message, message_length);
+}
+
+/*
+ * Append the binary record of a call site to batch
+ *
+ * The first time a site is seen in the file, it is given an id,
+ * and its title and format are written before the event
+ */
+static void dbg_batch_event_append(dbg_batch_t* batch, const dbg_record_t* record)
+{
+  dbg_site_t* site = (dbg_site_t*) record->site;
+
+  // Only the writer thread sets the id and generation of sites
+  if(site->generation != dbg_generation)
+  {
+    site->id = ++dbg_site_count;
+    site->generation = dbg_generation;
+
+    uint16_t title_length  = strlen(site->title);
+    uint16_t format_length = strlen(site->format);
+
+    uint8_t buffer[9];
+
+    buffer[0] = DBG_KIND_SITE;
+    memcpy(buffer + 1, &site->id,      sizeof(uint32_t));
+    memcpy(buffer + 5, &title_length,  sizeof(uint16_t));
+    memcpy(buffer + 7, &format_length, sizeof(uint16_t));
+
+    dbg_batch_write(batch, record->fd, buffer, sizeof(buffer));
+    dbg_batch_write(batch, record->fd, site->title, title_length);
+    dbg_batch_write(batch, record->fd, site->format, format_length);
+  }
+
+  uint16_t length = record->length;
+
+  uint8_t buffer[15];
+
+  buffer[0] = DBG_KIND_EVENT;
+  memcpy(buffer + 1,  &site->id,     sizeof(uint32_t));
+  memcpy(buffer + 5,  &record->time, sizeof(uint64_t));
+  memcpy(buffer + 13, &length,       sizeof(uint16_t));
+
+  dbg_batch_write(batch, record->fd, buffer, sizeof(buffer));
+  dbg_batch_write(batch, record->fd, record + 1, length);
+}
+
+/*
+ * Append record to batch, as text or binary
+ */
+static void dbg_batch_record_append(dbg_batch_t* batch, const dbg_record_t* record)
+{
+  const char* text = (const char*) (record + 1);
+
+  if(!record->site)
+  {
+    dbg_batch_text_append(batch, record->fd, record->time, text, text + record->length + 1);
+  }
+  else if(dbg_binary)
+  {
+    dbg_batch_event_append(batch, record);
+  }
+  else
+  {
+    char message[DEBUG_ARGS_MAX * (DEBUG_STRING_MAX + 1) + 1024];
+
+    if(dbg_event_string_create(message, sizeof(message), record->site->format, (const uint8_t*) text, record->length) < 0) return;
+
+    dbg_batch_append(batch, record->fd, record->time, record->site->title, message);
+  }
+}
+
+/*
+ * Write all messages in all rings, oldest message first
+ *
+ * RETURN (size_t count)
+ * - The number of written messages
+ */
+static size_t dbg_rings_drain(dbg_batch_t* batch)
+{
+  size_t count = 0;
+
+  while(true)
+  {
+    dbg_ring_t*   oldest_ring = NULL;
+    dbg_record_t* oldest = NULL;
+
+    for(dbg_ring_t* ring = atomic_load_explicit(&dbg_rings, memory_order_acquire); ring; ring = ring->next)
+    {
+      dbg_record_t* record = dbg_ring_peek(ring);
+
+      if(record && (!oldest || record->time < oldest->time))
+      {
+        oldest_ring = ring;
+        oldest = record;
+      }
+    }
+
+    if(!oldest) break;
+
+    dbg_batch_record_append(batch, oldest);
+
+    uint64_t tail = atomic_load_explicit(&oldest_ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&oldest_ring->tail, tail + oldest->size, memory_order_release);
+
+    count++;
+  }
+
+  dbg_batch_flush(batch);
+
+  return count;
+}
+
+/*
+ * Report dropped messages, and free the rings of exited threads
+ *
+ * The first ring in the list is never unlinked,
+ * because threads push new rings in front of it
+ */
+static void dbg_rings_clean(dbg_batch_t* batch)
+{
+  dbg_ring_t* prev = atomic_load_explicit(&dbg_rings, memory_order_acquire);
+
+  if(!prev) return;
+
+  for(dbg_ring_t* ring = prev; ring; ring = ring->next)
+  {
+    uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+
+    if(dropped > 0 && batch->fd != -1)
+    {
+      char message[64];
+
+      format_string(message, sizeof(message), "Dropped %lu messages", (unsigned long) dropped);
+
+      dbg_batch_text_append(batch, batch->fd, dbg_time_get(), DEBUG_WARN_TITLE, message);
+    }
+  }
+
+  dbg_batch_flush(batch);
+
+  dbg_ring_t* ring = prev->next;
+
+  while(ring)
+  {
+    dbg_ring_t* next = ring->next;
+
+    if(atomic_load_explicit(&ring->closed, memory_order_acquire) && !dbg_ring_peek(ring))
+    {
+      prev->next = next;
+
+      free(ring);
+
+      tag_count_sub(ALLOC_LOG, sizeof(dbg_ring_t));
+    }
+    else prev = ring;
+
+    ring = next;
+  }
+}
+
+/*
+ * The writer thread, that writes the messages of all rings
+ */
+static void* dbg_writer_routine(void* arg)
+{
+  dbg_batch_t* batch = tag_malloc(ALLOC_LOG, sizeof(dbg_batch_t));
+
+  if(!batch) return NULL;
+
+  batch->length = 0;
+  batch->fd     = -1;
+  batch->second = -1;
+
+  struct timespec sleep = { 0, DEBUG_WRITER_SLEEP };
+
+  while(!atomic_load_explicit(&dbg_writer_stop, memory_order_acquire))
+  {
+    if(dbg_rings_drain(batch) == 0)
+    {
+      dbg_rings_clean(batch);
+
+      nanosleep(&sleep, NULL);
+    }
+  }
+
+  dbg_rings_drain(batch);
+
+  dbg_rings_clean(batch);
+
+  tag_free(ALLOC_LOG, batch);
+
+  return NULL;
+}
+
+/*
+ * Start the writer thread
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create thread
+ */
+static int dbg_writer_start(void)
+{
+  atomic_store(&dbg_writer_stop, false);
+
+  if(pthread_create(&dbg_writer, NULL, dbg_writer_routine, NULL) != 0) return 1;
+
+  atomic_store(&dbg_writer_running, true);
+
+  return 0;
+}
+
+/*
+ * Stop the writer thread, after it has written all messages
+ *
+ * Note: A message that is put in a ring while the writer stops,
+ *       is written the next time the writer is started
+ */
+static void dbg_writer_stop_join(void)
+{
+  if(!atomic_exchange(&dbg_writer_running, false)) return;
+
+  atomic_store(&dbg_writer_stop, true);
+
+  pthread_join(dbg_writer, NULL);
+}
+
+/*
+ * Print custom debug message, taking in va_list
+ *
+ * Messages to the debug file are put in the ring of the thread
+ *
+ * RETURN (same as fprintf)
+ * - >=0 | Number of printed characters
+ * -  -1 | Format specifier does not exist
+ */
+static inline int dbg_valist_print(FILE* stream, const char* title, const char* format, va_list args)
+{
+  if(stream == debug_file && atomic_load_explicit(&dbg_writer_running, memory_order_acquire))
+  {
+    return dbg_ring_print(fileno(stream), title, format, args);
+  }
+
+  char timestr[32];
+
+  if(dbg_timestr_create(timestr) == NULL)
+  {
+    return -1;
+  }
+
+  char string[1024];
+
+  if(format_vstring(string, sizeof(string), format, args) < 0)
+  {
+    return -1;
+  }
+
+  int amount = fprintf(stream, DEBUG_FORMAT, timestr, title, string);
+
+  fflush(stream);
+
+  return amount;
+}
+
+/*
+ * Print own debug message to specified stream
+ *
+ * RETURN (same as fprintf)
+ * - >=0 | Number of printed characters
+ * -  -1 | Format specifier does not exist
+ */
+int debug_print(FILE* stream, const char* title, const char* format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+
+  int amount = dbg_valist_print(stream, title, format, args);
+
+  va_end(args);
+
+  return amount;
+}
+
+/*
+ * Count the message of a call site in the current second
+ *
+ * When a new second begins, the messages that were
+ * suppressed in the last one are reported
+ *
+ * RETURN (bool print)
+ * - true  | The message should be printed
+ * - false | The site has printed DEBUG_RATE_MAX messages this second
+ */
+static inline bool dbg_site_rate_check(dbg_site_t* site, FILE* file)
+{
+  if(DEBUG_RATE_MAX == 0) return true;
+
+  struct timespec timespec;
+
+  // The coarse clock is read from the vDSO, without a syscall
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &timespec);
+
+  unsigned long long second = timespec.tv_sec;
+
+  unsigned long long rate = atomic_load_explicit(&site->rate, memory_order_relaxed);
+
+  if((rate >> 32) == second)
+  {
+    if((rate & 0xffffffff) >= DEBUG_RATE_MAX)
+    {
+      atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+
+      return false;
+    }
+
+    atomic_fetch_add_explicit(&site->rate, 1, memory_order_relaxed);
+
+    return true;
+  }
+
+  // Only the thread that begins the second reports the suppressed messages
+  if(atomic_compare_exchange_strong(&site->rate, &rate, (second << 32) | 1))
+  {
+    unsigned int suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+
+    if(suppressed > 0)
+    {
+      debug_print(file, DEBUG_WARN_TITLE, "Suppressed %u messages: %s", suppressed, site->format);
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Print debug message of a call site, to the debug file or stream
+ *
+ * This is called by the error_print and info_print macros
+ *
+ * RETURN (same as fprintf)
+ * - >=0 | Number of printed characters, or argument bytes in binary
+ * -  -1 | Format specifier does not exist
+ */
+int dbg_site_print(dbg_site_t* site, FILE* stream, ...)
+{
+  FILE* file = debug_file ? debug_file : stream;
+
+  if(!dbg_site_rate_check(site, file)) return 0;
+
+  va_list args;
+
+  va_start(args, stream);
+
+  int amount;
+
+  if(dbg_binary && file == debug_file && atomic_load_explicit(&dbg_writer_running, memory_order_acquire))
+  {
+    int state = atomic_load_explicit(&site->state, memory_order_acquire);
+
+    if(state != DBG_SITE_BINARY && state != DBG_SITE_TEXT)
+    {
+      state = dbg_site_parse(site);
+    }
+
+    if(state == DBG_SITE_BINARY)
+    {
+      amount = dbg_ring_event(fileno(file), site, args);
+    }
+    else amount = dbg_valist_print(file, site->title, site->format, args);
+  }
+  else amount = dbg_valist_print(file, site->title, site->format, args);
+
+  va_end(args);
+
+  return amount;
+}
+
+/*
+ * Set which levels of which subsystems are printed
+ *
+ * The filter can be changed while other threads print
+ */
+void debug_filter_set(unsigned int filter)
+{
+  atomic_store_explicit(&debug_filter, filter & DEBUG_FILTER_ALL, memory_order_relaxed);
+}
+
+/*
+ * Parse a filter from a list of subsystems, like "socket,room:error"
+ *
+ * A subsystem with ":error" only prints errors,
+ * and "all" is every subsystem
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Unknown subsystem or level
+ */
+int debug_filter_parse(unsigned int* filter, const char* string)
+{
+  *filter = DEBUG_FILTER_NONE;
+
+  while(*string)
+  {
+    size_t length = strcspn(string, ",");
+
+    size_t name_length = strcspn(string, ":,");
+
+    unsigned int bits = 0;
+
+    if(name_length == 3 && strncmp(string, "all", 3) == 0)
+    {
+      bits = DEBUG_FILTER_ALL;
+    }
+
+    for(int subsystem = 0; subsystem < DEBUG_SUBSYSTEM_COUNT; subsystem++)
+    {
+      const char* name = dbg_subsystem_names[subsystem];
+
+      if(strlen(name) == name_length && strncmp(string, name, name_length) == 0)
+      {
+        bits = DEBUG_FILTER_BIT(subsystem, DEBUG_LEVEL_ERROR) | DEBUG_FILTER_BIT(subsystem, DEBUG_LEVEL_INFO);
+      }
+    }
+
+    if(bits == 0) return 1;
+
+    if(name_length < length)
+    {
+      const char* level = string + name_length + 1;
+
+      if(length - name_length - 1 != 5 || strncmp(level, "error", 5) != 0) return 1;
+
+      // Keep only the error bits, which are the even bits
+      bits &= 0x55555555;
+    }
+
+    *filter |= bits;
+
+    string += length;
+
+    if(*string == ',') string++;
+  }
+
+  return 0;
+}
+
+/*
+ * Open debug file, and start the writer thread
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to open file
+ * - 2 | Failed to start writer thread
+ * - 3 | Failed to write binary head
+ */
+static int dbg_file_open(const char* filepath, bool binary)
+{
+  FILE* stream = fopen(filepath, binary ? "wb" : "a");
+
+  if(!stream) return 1;
+
+  // The writer must not write to the old file after it is closed
+  dbg_writer_stop_join();
+
+  if(debug_file) fclose(debug_file);
+
+  debug_file = stream;
+
+  dbg_binary = binary;
+
+  dbg_generation++;
+
+  dbg_site_count = 0;
+
+  clock_gettime(CLOCK_REALTIME,  &dbg_start_real);
+  clock_gettime(CLOCK_MONOTONIC, &dbg_start_mono);
+
+  if(binary)
+  {
+    uint64_t start_real = (uint64_t) dbg_start_real.tv_sec * 1000000000 + dbg_start_real.tv_nsec;
+    uint64_t start_mono = (uint64_t) dbg_start_mono.tv_sec * 1000000000 + dbg_start_mono.tv_nsec;
+
+    char head[8] = DEBUG_BINARY_MAGIC;
+
+    if(fwrite(head, 1, sizeof(head), stream) != sizeof(head) ||
+       fwrite(&start_real, sizeof(uint64_t), 1, stream) != 1 ||
+       fwrite(&start_mono, sizeof(uint64_t), 1, stream) != 1 ||
+       fflush(stream) != 0)
+    {
+      return 3;
+    }
+  }
+
+  if(dbg_writer_start() != 0) return 2;
+
+  return 0;
+}
+
+/*
+ * Open and start printing to debug file
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to open file
+ * - 2 | Failed to start writer thread
+ */
+int debug_file_open(const char* filepath)
+{
+  return dbg_file_open(filepath, false);
+}
+
+/*
+ * Open debug file, and start storing messages in binary
+ *
+ * The file is read with bunker-logdecode
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to open file
+ * - 2 | Failed to start writer thread
+ * - 3 | Failed to write binary head
+ */
+int debug_binary_open(const char* filepath)
+{
+  return dbg_file_open(filepath, true);
+}
+
+/*
+ * Close the debug file
+ */
+void debug_file_close(void)
+{
+  dbg_writer_stop_join();
+
+  if(debug_file) fclose(debug_file);
+
+  debug_file = NULL;
+
+  dbg_binary = false;
 }
 
 #endif // DEBUG_IMPLEMENT
 
 /*
  * Maybe: 
- * - Add pthread mutex locks to make global "file" thread safe
  * - Create multiple debug files for [stderr, stdout]
+ * - Wake the writer thread, instead of letting it sleep
  */
@@ -3,7 +3,7 @@
  *
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-11-21
+ * Last updated: 2026-10-19
  */
 
 #include "file.h"
@@ -95,6 +95,75 @@ size_t file_read(void* pointer, size_t size, const char* filepath)
   return status;
 }
 
+/*
+ * Read a chunk of a file, of at most size bytes from offset,
+ * so that a large file never has to fit in memory
+ *
+ * PARAMS
+ * - void*       pointer  | Address to store read data
+ * - size_t      size     | Most bytes to read
+ * - const char* filepath | Path to file
+ * - size_t      offset   | Where in the file to start reading
+ *
+ * RETURN (size_t read_size)
+ * - 0  | Error, or offset is at the end of the file
+ * - >0 | Success!
+ */
+size_t file_chunk_read(void* pointer, size_t size, const char* filepath, size_t offset)
+{
+  if(!pointer) return 0;
+
+  FILE* stream = fopen(filepath, "rb");
+
+  if(stream == NULL) return 0;
+
+  size_t read_size = 0;
+
+  if(fseeko(stream, offset, SEEK_SET) == 0)
+  {
+    read_size = fread(pointer, 1, size, stream);
+  }
+
+  fclose(stream);
+
+  return read_size;
+}
+
+/*
+ * Write a chunk of a file at offset, and keep the rest of the file
+ *
+ * The file is created if it doesn't exist
+ *
+ * PARAMS
+ * - const void* pointer  | Address of the data to write
+ * - size_t      size     | Number of bytes to write
+ * - const char* filepath | Path to file
+ * - size_t      offset   | Where in the file to start writing
+ *
+ * RETURN (size_t write_size)
+ * - 0  | Error
+ * - >0 | Success!
+ */
+size_t file_chunk_write(const void* pointer, size_t size, const char* filepath, size_t offset)
+{
+  if(!pointer) return 0;
+
+  FILE* stream = fopen(filepath, "r+b");
+
+  if(!stream && !(stream = fopen(filepath, "w+b"))) return 0;
+
+  size_t write_size = 0;
+
+  if(fseeko(stream, offset, SEEK_SET) == 0)
+  {
+    write_size = fwrite(pointer, 1, size, stream);
+  }
+
+  if(fclose(stream) != 0) write_size = 0;
+
+  return write_size;
+}
+
 /*
  *
  */
@@ -3,7 +3,7 @@
  *
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-11-21
+ * Last updated: 2026-10-19
  */
 
 #ifndef FILE_H
@@ -18,6 +18,10 @@ extern size_t file_read(void* pointer, size_t size, const char* filepath);
 
 extern size_t file_write(const void* pointer, size_t size, const char* filepath);
 
+extern size_t file_chunk_read(void* pointer, size_t size, const char* filepath, size_t offset);
+
+extern size_t file_chunk_write(const void* pointer, size_t size, const char* filepath, size_t offset);
+
 
 extern size_t dir_file_size_get(const char* dirpath, const char* name);
 
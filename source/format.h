@@ -0,0 +1,384 @@
+/*
+ * format.h - bounds checked string formatting
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * In main compilation unit; define FORMAT_IMPLEMENT
+ *
+ *
+ * These are the available functions:
+ *
+ * int format_string(char* buffer, size_t size, const char* format, ...)
+ *
+ * int format_vstring(char* buffer, size_t size, const char* format, va_list args)
+ *
+ * int format_specifier_parse(const char* specifier, int* length)
+ *
+ *
+ * The specifiers are: %d %i %u %x %c %f %s %%,
+ * and d, i, u and x can have the length modifiers l, ll and z
+ *
+ * Every specifier is parsed once, and integers are converted
+ * without sprintf. Only %f is passed on to snprintf.
+ *
+ * Like snprintf, at most size bytes are written, the string
+ * always ends with a null terminator, and the returned length
+ * is the length the string would have had without the bound
+ */
+
+/*
+ * From here on, until FORMAT_IMPLEMENT,
+ * it is like a normal header file with declarations
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+/*
+ * Types of format specifiers
+ */
+typedef enum
+{
+  FORMAT_INT     = 1,
+  FORMAT_LONG    = 2,
+  FORMAT_LLONG   = 3,
+  FORMAT_UINT    = 4,
+  FORMAT_ULONG   = 5,
+  FORMAT_ULLONG  = 6,
+  FORMAT_SIZE    = 7,
+  FORMAT_HEX     = 8,
+  FORMAT_LHEX    = 9,
+  FORMAT_LLHEX   = 10,
+  FORMAT_CHAR    = 11,
+  FORMAT_DOUBLE  = 12,
+  FORMAT_STRING  = 13,
+  FORMAT_PERCENT = 14
+} format_type_t;
+
+extern int format_string(char* buffer, size_t size, const char* format, ...);
+
+extern int format_vstring(char* buffer, size_t size, const char* format, va_list args);
+
+extern int format_specifier_parse(const char* specifier, int* length);
+
+#endif // FORMAT_H
+
+/*
+ * This header library file uses _IMPLEMENT guards
+ *
+ * If FORMAT_IMPLEMENT is defined, the definitions will be included
+ */
+
+#if defined(FORMAT_IMPLEMENT) && !defined(FORMAT_IMPLEMENTED)
+
+// format.h is included by both debug.h and getstr.h
+#define FORMAT_IMPLEMENTED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+/*
+ * The string being formatted
+ *
+ * length keeps counting after the buffer is full
+ */
+typedef struct
+{
+  char*  buffer;
+  size_t size;
+  size_t length;
+} fmt_out_t;
+
+/*
+ * Two digits at a time, for faster integer conversion
+ */
+static const char fmt_digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/*
+ * Append characters, as many as there is room for
+ */
+static inline void fmt_chars_append(fmt_out_t* out, const char* chars, size_t count)
+{
+  if(out->length + 1 < out->size)
+  {
+    size_t rest = out->size - 1 - out->length;
+
+    memcpy(out->buffer + out->length, chars, (count < rest) ? count : rest);
+  }
+
+  out->length += count;
+}
+
+/*
+ * Append a single character, if there is room for it
+ */
+static inline void fmt_char_append(fmt_out_t* out, char symbol)
+{
+  if(out->length + 1 < out->size) out->buffer[out->length] = symbol;
+
+  out->length++;
+}
+
+/*
+ * Append an unsigned integer in base 10, with a minus sign if negative
+ */
+static inline void fmt_decimal_append(fmt_out_t* out, unsigned long long value, bool negative)
+{
+  char digits[24];
+  char* pointer = digits + sizeof(digits);
+
+  while(value >= 100)
+  {
+    unsigned index = (value % 100) * 2;
+
+    value /= 100;
+
+    *--pointer = fmt_digit_pairs[index + 1];
+    *--pointer = fmt_digit_pairs[index];
+  }
+
+  if(value >= 10)
+  {
+    *--pointer = fmt_digit_pairs[value * 2 + 1];
+    *--pointer = fmt_digit_pairs[value * 2];
+  }
+  else *--pointer = '0' + value;
+
+  if(negative) *--pointer = '-';
+
+  fmt_chars_append(out, pointer, digits + sizeof(digits) - pointer);
+}
+
+/*
+ * Append a signed integer in base 10
+ */
+static inline void fmt_signed_append(fmt_out_t* out, long long value)
+{
+  // The negation is done unsigned, so that LLONG_MIN doesn't overflow
+  if(value < 0)
+  {
+    fmt_decimal_append(out, 0ULL - (unsigned long long) value, true);
+  }
+  else fmt_decimal_append(out, value, false);
+}
+
+/*
+ * Append an unsigned integer in base 16, with lowercase letters
+ */
+static inline void fmt_hex_append(fmt_out_t* out, unsigned long long value)
+{
+  char digits[16];
+  char* pointer = digits + sizeof(digits);
+
+  do
+  {
+    *--pointer = "0123456789abcdef"[value & 0xf];
+
+    value >>= 4;
+  }
+  while(value > 0);
+
+  fmt_chars_append(out, pointer, digits + sizeof(digits) - pointer);
+}
+
+/*
+ * Get the type of the format specifier after a '%'
+ *
+ * PARAMS
+ * - const char* specifier | The characters after the '%'
+ * - int*        length    | Number of characters in specifier
+ *
+ * RETURN (int type)
+ * - >0 | format_type_t type
+ * - -1 | Format specifier does not exist
+ */
+int format_specifier_parse(const char* specifier, int* length)
+{
+  int modifier = 0; // 0: none, 1: l, 2: ll, 3: z
+
+  if(specifier[0] == 'l')
+  {
+    modifier = (specifier[1] == 'l') ? 2 : 1;
+  }
+  else if(specifier[0] == 'z') modifier = 3;
+
+  int modifier_length = (modifier == 2) ? 2 : (modifier > 0) ? 1 : 0;
+
+  *length = modifier_length + 1;
+
+  switch(specifier[modifier_length])
+  {
+    case 'd':
+    case 'i':
+    {
+      static const int types[] = { FORMAT_INT, FORMAT_LONG, FORMAT_LLONG, FORMAT_SIZE };
+      return (modifier == 3) ? -1 : types[modifier];
+    }
+
+    case 'u':
+    {
+      static const int types[] = { FORMAT_UINT, FORMAT_ULONG, FORMAT_ULLONG, FORMAT_SIZE };
+      return types[modifier];
+    }
+
+    case 'x':
+    {
+      static const int types[] = { FORMAT_HEX, FORMAT_LHEX, FORMAT_LLHEX, FORMAT_LHEX };
+      return types[modifier];
+    }
+
+    // ‘%lf’ is the same as ‘%f’
+    case 'f': return (modifier <= 1) ? FORMAT_DOUBLE  : -1;
+    case 'c': return (modifier == 0) ? FORMAT_CHAR    : -1;
+    case 's': return (modifier == 0) ? FORMAT_STRING  : -1;
+    case '%': return (modifier == 0) ? FORMAT_PERCENT : -1;
+
+    default: return -1;
+  }
+}
+
+/*
+ * Append one argument from va_list
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to print double
+ */
+static inline int fmt_arg_append(fmt_out_t* out, int type, va_list* args)
+{
+  switch(type)
+  {
+    case FORMAT_INT:    fmt_signed_append(out, va_arg(*args, int));       break;
+    case FORMAT_LONG:   fmt_signed_append(out, va_arg(*args, long));      break;
+    case FORMAT_LLONG:  fmt_signed_append(out, va_arg(*args, long long)); break;
+
+    case FORMAT_UINT:   fmt_decimal_append(out, va_arg(*args, unsigned int),       false); break;
+    case FORMAT_ULONG:  fmt_decimal_append(out, va_arg(*args, unsigned long),      false); break;
+    case FORMAT_ULLONG: fmt_decimal_append(out, va_arg(*args, unsigned long long), false); break;
+    case FORMAT_SIZE:   fmt_decimal_append(out, va_arg(*args, size_t),             false); break;
+
+    case FORMAT_HEX:    fmt_hex_append(out, va_arg(*args, unsigned int));       break;
+    case FORMAT_LHEX:   fmt_hex_append(out, va_arg(*args, unsigned long));      break;
+    case FORMAT_LLHEX:  fmt_hex_append(out, va_arg(*args, unsigned long long)); break;
+
+    // ‘char’ is promoted to ‘int’ when passed through ‘...’
+    case FORMAT_CHAR:   fmt_char_append(out, va_arg(*args, int)); break;
+
+    case FORMAT_STRING:
+    {
+      const char* arg = va_arg(*args, const char*);
+
+      if(!arg) arg = "(null)";
+
+      fmt_chars_append(out, arg, strlen(arg));
+      break;
+    }
+
+    case FORMAT_DOUBLE:
+    {
+      // ‘float’ is promoted to ‘double’ when passed through ‘...’
+      char string[64];
+
+      int length = snprintf(string, sizeof(string), "%f", va_arg(*args, double));
+
+      if(length < 0) return 1;
+
+      // Doubles larger than the buffer are cut, like the bound of the string
+      fmt_chars_append(out, string, (length < sizeof(string)) ? length : sizeof(string) - 1);
+      break;
+    }
+
+    case FORMAT_PERCENT: fmt_char_append(out, '%'); break;
+  }
+
+  return 0;
+}
+
+/*
+ * snprintf, but with va_list as arguments
+ *
+ * RETURN (same as snprintf)
+ * - >=0 | Length of the string without the bound
+ * -  -1 | Format specifier does not exist
+ */
+int format_vstring(char* buffer, size_t size, const char* format, va_list args)
+{
+  fmt_out_t out = { buffer, size, 0 };
+
+  va_list copy;
+
+  // The va_list is passed by pointer, which va_copy makes portable
+  va_copy(copy, args);
+
+  int status = 0;
+
+  while(*format)
+  {
+    // Append the characters up to the next specifier at once
+    const char* percent = strchr(format, '%');
+
+    size_t count = percent ? (size_t) (percent - format) : strlen(format);
+
+    fmt_chars_append(&out, format, count);
+
+    if(!percent) break;
+
+    int length;
+    int type = format_specifier_parse(percent + 1, &length);
+
+    if(type < 0 || fmt_arg_append(&out, type, &copy) != 0)
+    {
+      status = -1;
+
+      break;
+    }
+
+    format = percent + 1 + length;
+  }
+
+  va_end(copy);
+
+  if(size > 0)
+  {
+    buffer[(out.length < size) ? out.length : size - 1] = '\0';
+  }
+
+  return (status == 0) ? (int) out.length : -1;
+}
+
+/*
+ * snprintf, but with the formatting of this library
+ *
+ * RETURN (same as format_vstring)
+ */
+int format_string(char* buffer, size_t size, const char* format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+
+  int length = format_vstring(buffer, size, format, args);
+
+  va_end(args);
+
+  return length;
+}
+
+#endif // FORMAT_IMPLEMENT
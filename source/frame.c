@@ -0,0 +1,405 @@
+/*
+ * frame.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "frame.h"
+
+#include "socket.h"
+#include "affinity.h"
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Write an integer of size bytes, big endian,
+ * like the integers in frames and their data
+ */
+void number_write(uint8_t* buffer, uint64_t number, size_t size)
+{
+  for(size_t index = 0; index < size; index++)
+  {
+    buffer[index] = (number >> ((size - 1 - index) * 8)) & 0xff;
+  }
+}
+
+/*
+ * Read an integer of size bytes, big endian
+ */
+uint64_t number_read(const uint8_t* buffer, size_t size)
+{
+  uint64_t number = 0;
+
+  for(size_t index = 0; index < size; index++)
+  {
+    number = (number << 8) | buffer[index];
+  }
+
+  return number;
+}
+
+/*
+ * Write frame head to buffer
+ */
+void frame_head_write(uint8_t* head, uint8_t type, uint8_t flags, uint16_t stream, uint32_t size)
+{
+  head[0] = (size >> 24) & 0xff;
+  head[1] = (size >> 16) & 0xff;
+  head[2] = (size >>  8) & 0xff;
+  head[3] = (size >>  0) & 0xff;
+
+  head[4] = type;
+  head[5] = flags;
+  head[6] = (stream >> 8) & 0xff;
+  head[7] = (stream >> 0) & 0xff;
+}
+
+/*
+ * Read frame head from buffer
+ */
+static void frame_head_read(frame_t* frame, const uint8_t* head)
+{
+  frame->size = ((uint32_t) head[0] << 24) | ((uint32_t) head[1] << 16) |
+                ((uint32_t) head[2] <<  8) | ((uint32_t) head[3] <<  0);
+
+  frame->type   = head[4];
+  frame->flags  = head[5];
+  frame->stream = ((uint16_t) head[6] << 8) | head[7];
+}
+
+/*
+ * Create buffer for incoming frames
+ *
+ * With a node, the buffer is placed on that NUMA node,
+ * which should be the node of the thread that reads into it
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate buffer
+ */
+int frame_buffer_create(frame_buffer_t* buffer, size_t size, int node)
+{
+  if(!buffer) return 1;
+
+  buffer->node = node;
+
+  if(node == NODE_NONE)
+  {
+    buffer->data = tag_malloc(ALLOC_SOCKET, sizeof(uint8_t) * size);
+  }
+  else if((buffer->data = node_alloc(sizeof(uint8_t) * size, node)))
+  {
+    tag_count_add(ALLOC_SOCKET, sizeof(uint8_t) * size);
+  }
+
+  if(!buffer->data) return 1;
+
+  buffer->size   = size;
+  buffer->length = 0;
+  buffer->offset = 0;
+
+  return 0;
+}
+
+/*
+ * Free buffer for incoming frames
+ */
+void frame_buffer_free(frame_buffer_t* buffer)
+{
+  if(!buffer) return;
+
+  if(buffer->node == NODE_NONE)
+  {
+    tag_free(ALLOC_SOCKET, buffer->data);
+  }
+  else if(buffer->data)
+  {
+    node_free(buffer->data, buffer->size);
+
+    tag_count_sub(ALLOC_SOCKET, buffer->size);
+  }
+
+  buffer->data = NULL;
+  buffer->size = 0;
+}
+
+/*
+ * Check if a whole frame is waiting in the buffer
+ *
+ * RETURN (int status)
+ * - 0 | A whole frame is available
+ * - 1 | More bytes are needed
+ * - 2 | The frame is too large
+ */
+static int frame_buffer_peek(const frame_buffer_t* buffer, frame_t* frame)
+{
+  size_t length = buffer->length - buffer->offset;
+
+  if(length < FRAME_HEAD_SIZE) return 1;
+
+  frame_head_read(frame, buffer->data + buffer->offset);
+
+  if(frame->size > FRAME_SIZE_MAX) return 2;
+
+  if(length < FRAME_HEAD_SIZE + frame->size) return 1;
+
+  frame->data = buffer->data + buffer->offset + FRAME_HEAD_SIZE;
+
+  return 0;
+}
+
+/*
+ * Check if frames_recv can return without reading the socket,
+ * because a whole or an invalid frame is waiting in the buffer
+ */
+bool frames_waiting(const frame_buffer_t* buffer)
+{
+  frame_t frame;
+
+  return frame_buffer_peek(buffer, &frame) != 1;
+}
+
+/*
+ * Recieve all whole frames from one read of the socket
+ *
+ * If a whole frame is already waiting in the buffer, nothing is read,
+ * so that callers who pass a small max do not starve the buffer
+ *
+ * RETURN (ssize_t count)
+ * - >0 | The number of recieved frames
+ * -  0 | End of file
+ * - -1 | Failed to read from socket
+ * - -2 | Invalid frame
+ * - -3 | Only a part of a frame has been recieved yet
+ */
+ssize_t frames_recv(int sockfd, frame_buffer_t* buffer, frame_t* frames, size_t max)
+{
+  if(!buffer || !frames) return -1;
+
+  // 1. Move the unparsed bytes to the start of the buffer
+  if(buffer->offset > 0)
+  {
+    memmove(buffer->data, buffer->data + buffer->offset, buffer->length - buffer->offset);
+
+    buffer->length -= buffer->offset;
+    buffer->offset = 0;
+  }
+
+  // 2. Read once, if no whole frame is waiting
+  frame_t frame;
+
+  int status = frame_buffer_peek(buffer, &frame);
+
+  if(status == 2) return -2;
+
+  if(status == 1)
+  {
+    ssize_t size = socket_read(sockfd, (char*) buffer->data + buffer->length, buffer->size - buffer->length);
+
+    if(size <= 0) return size;
+
+    buffer->length += size;
+  }
+
+  // 3. Parse all whole frames
+  size_t count = 0;
+
+  while(count < max && (status = frame_buffer_peek(buffer, &frame)) == 0)
+  {
+    frames[count++] = frame;
+
+    buffer->offset += FRAME_HEAD_SIZE + frame.size;
+  }
+
+  if(status == 2) return -2;
+
+  if(count == 0) return -3;
+
+  return count;
+}
+
+/*
+ * Send a frame with data to socket
+ *
+ * Small frames, like heartbeats, are created on the stack
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Frame is too large
+ * - 2 | Failed to allocate frame
+ * - 3 | Failed to write frame
+ */
+int frame_send(int sockfd, uint8_t type, const void* data, size_t size)
+{
+  if(size > FRAME_SIZE_MAX) return 1;
+
+  uint8_t small[FRAME_HEAD_SIZE + FRAME_SMALL_MAX];
+
+  uint8_t* buffer = small;
+
+  if(size > FRAME_SMALL_MAX && !(buffer = malloc(sizeof(uint8_t) * (FRAME_HEAD_SIZE + size))))
+  {
+    return 2;
+  }
+
+  frame_head_write(buffer, type, 0, 0, size);
+
+  if(data) memcpy(buffer + FRAME_HEAD_SIZE, data, size);
+
+  ssize_t status = socket_write(sockfd, (char*) buffer, FRAME_HEAD_SIZE + size);
+
+  if(buffer != small) free(buffer);
+
+  return (status == (ssize_t) (FRAME_HEAD_SIZE + size)) ? 0 : 3;
+}
+
+/*
+ * Hash what the signature of a frame covers:
+ * FRAME_SIGN_CONTEXT, the type, the stream and the data
+ *
+ * The flags are left out, since the mux sets the priority
+ * of a frame after it is signed
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to hash
+ */
+static int frame_digest_create(uint8_t* digest, uint8_t type, uint16_t stream, const uint8_t* data, size_t size)
+{
+  uint8_t head[FRAME_SIGN_CONTEXT_SIZE + 3];
+
+  memcpy(head, FRAME_SIGN_CONTEXT, FRAME_SIGN_CONTEXT_SIZE);
+
+  head[FRAME_SIGN_CONTEXT_SIZE]     = type;
+  head[FRAME_SIGN_CONTEXT_SIZE + 1] = (stream >> 8) & 0xff;
+  head[FRAME_SIGN_CONTEXT_SIZE + 2] = stream & 0xff;
+
+  return data_digest(digest, head, sizeof(head), data, size);
+}
+
+/*
+ * Sign a frame in buffer, whose data is already written
+ * at FRAME_HEAD_SIZE + FRAME_SIGN_SIZE, so it isn't copied
+ *
+ * The signature covers the type and stream together with the data,
+ * so that the data of one kind of frame can't be sent as another
+ *
+ * frame_size is set to the size of the frame with the head
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Frame is too large
+ * - 4 | Failed to sign data
+ */
+int frame_signed_write(uint8_t* buffer, size_t* frame_size, uint8_t type, uint16_t stream, const sign_key_t* key, size_t size)
+{
+  if(FRAME_SIGN_SIZE + size > FRAME_SIZE_MAX) return 1;
+
+  *frame_size = FRAME_HEAD_SIZE + FRAME_SIGN_SIZE + size;
+
+  frame_head_write(buffer, type, 0, stream, FRAME_SIGN_SIZE + size);
+
+  uint8_t* public = buffer + FRAME_HEAD_SIZE;
+  uint8_t* sign   = public + SIGN_PUBLIC_SIZE;
+  uint8_t* body   = sign + SIGN_SIZE;
+
+  memcpy(public, key->public, SIGN_PUBLIC_SIZE);
+
+  uint8_t digest[DIGEST_SIZE];
+
+  if(frame_digest_create(digest, type, stream, body, size) != 0) return 4;
+
+  if(data_sign(sign, key, digest, DIGEST_SIZE) != 0) return 4;
+
+  return 0;
+}
+
+/*
+ * Sign data and create a frame of it, ready to be written
+ *
+ * The frame is allocated, and frame_size is its size with the head
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Frame is too large
+ * - 2 | Failed to allocate frame
+ * - 4 | Failed to sign data
+ */
+int frame_signed_create(uint8_t** frame, size_t* frame_size, uint8_t type, uint16_t stream, const sign_key_t* key, const void* data, size_t size)
+{
+  if(FRAME_SIGN_SIZE + size > FRAME_SIZE_MAX) return 1;
+
+  uint8_t* buffer = malloc(sizeof(uint8_t) * (FRAME_HEAD_SIZE + FRAME_SIGN_SIZE + size));
+
+  if(!buffer) return 2;
+
+  if(data) memcpy(buffer + FRAME_HEAD_SIZE + FRAME_SIGN_SIZE, data, size);
+
+  int status = frame_signed_write(buffer, frame_size, type, stream, key, size);
+
+  if(status != 0)
+  {
+    free(buffer);
+
+    return status;
+  }
+
+  *frame = buffer;
+
+  return 0;
+}
+
+/*
+ * Sign data and send it in a frame
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Frame is too large
+ * - 2 | Failed to allocate frame
+ * - 3 | Failed to write frame
+ * - 4 | Failed to sign data
+ */
+int frame_signed_send(int sockfd, uint8_t type, uint16_t stream, const sign_key_t* key, const void* data, size_t size)
+{
+  uint8_t* buffer;
+  size_t   frame_size;
+
+  int status = frame_signed_create(&buffer, &frame_size, type, stream, key, data, size);
+
+  if(status != 0) return status;
+
+  ssize_t amount = socket_write(sockfd, (char*) buffer, frame_size);
+
+  free(buffer);
+
+  return (amount == (ssize_t) frame_size) ? 0 : 3;
+}
+
+/*
+ * Split signed frame data into public key, signature and data,
+ * and hash the digest that the signature should be of
+ *
+ * The digest, and not the data, is what should be verified
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Frame is too small to be signed
+ * - 2 | Failed to hash the digest
+ */
+int frame_sign_get(frame_sign_t* sign, const frame_t* frame)
+{
+  if(!sign || !frame || frame->size < FRAME_SIGN_SIZE) return 1;
+
+  sign->public = frame->data;
+  sign->sign   = frame->data + SIGN_PUBLIC_SIZE;
+  sign->data   = frame->data + FRAME_SIGN_SIZE;
+  sign->size   = frame->size - FRAME_SIGN_SIZE;
+
+  if(frame_digest_create(sign->digest, frame->type, frame->stream, sign->data, sign->size) != 0) return 2;
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * frame.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "crypto.h"
+
+/*
+ * A frame on the wire is a head followed by size bytes of data
+ *
+ * HEAD (8 bytes)
+ * - uint32_t size   | Number of data bytes, big endian
+ * - uint8_t  type   | frame_type_t
+ * - uint8_t  flags  | frame_priority_t, and FRAME_FLAG_MORE
+ * - uint16_t stream | The logical stream of the connection, big endian
+ *
+ * Stream 0 is the chat of the room, and other streams are opened
+ * by the sender, see mux.h. A bulk frame may be cut into chunks,
+ * where every chunk but the last has FRAME_FLAG_MORE, and every
+ * chunk starts with the key of its sender and its offset
+ *
+ * Signed frames have their data prefixed with the sender's
+ * public key and the signature of the rest of the data,
+ * which is a signature of the SHA-512 digest of
+ * FRAME_SIGN_CONTEXT | type | stream (u16) | data
+ */
+#define FRAME_HEAD_SIZE 8
+
+#define FRAME_SIZE_MAX  65536
+
+#define FRAME_SIGN_SIZE (SIGN_PUBLIC_SIZE + SIGN_SIZE)
+
+#define FRAME_SIGN_CONTEXT      "bunker frame v1"
+#define FRAME_SIGN_CONTEXT_SIZE (sizeof(FRAME_SIGN_CONTEXT) - 1)
+
+/*
+ * Frames with at most this much data are sent from the stack
+ */
+#define FRAME_SMALL_MAX 256
+
+/*
+ * Control frames are not signed, and are not shown to the user
+ */
+#define FRAME_IS_CONTROL(type) ((type) == FRAME_PING || (type) == FRAME_PONG || (type) == FRAME_WINDOW)
+
+typedef enum
+{
+  FRAME_KEY    = 1, // Signed: name of sender
+  FRAME_TEXT   = 2, // Signed: text message
+  FRAME_PING   = 3, // Unsigned: heartbeat
+  FRAME_PONG   = 4, // Unsigned: answer to a heartbeat
+  FRAME_WINDOW = 5, // Unsigned: more bytes that may be sent on a stream
+  FRAME_FILE   = 6  // Signed: chunk of an attachment
+} frame_type_t;
+
+/*
+ * The class of a frame, where chat is 0, so that the frames
+ * of clients that don't set the flags are chat frames
+ */
+typedef enum
+{
+  FRAME_PRIORITY_CHAT    = 0,
+  FRAME_PRIORITY_CONTROL = 1,
+  FRAME_PRIORITY_BULK    = 2,
+  FRAME_PRIORITY_COUNT
+} frame_priority_t;
+
+#define FRAME_FLAG_PRIORITY 0x03
+#define FRAME_FLAG_MORE     0x80
+
+typedef struct
+{
+  uint8_t  type;
+  uint8_t  flags;
+  uint16_t stream;
+  uint32_t size;
+  uint8_t* data;
+} frame_t;
+
+/*
+ * Buffer for incoming bytes, that are parsed into frames
+ *
+ * The parsed frames point into the buffer,
+ * and are valid until the next call to frames_recv
+ */
+typedef struct
+{
+  uint8_t* data;
+  size_t   size;
+  size_t   length;
+  size_t   offset;
+  int      node;   // NUMA node of data, or NODE_NONE if it is malloced
+} frame_buffer_t;
+
+/*
+ * Signed frame data split into its parts
+ */
+typedef struct
+{
+  const uint8_t* public;
+  const uint8_t* sign;
+  const uint8_t* data;
+  size_t         size;
+  uint8_t        digest[DIGEST_SIZE]; // What the signature is of
+} frame_sign_t;
+
+extern int  frame_buffer_create(frame_buffer_t* buffer, size_t size, int node);
+
+extern void frame_buffer_free(frame_buffer_t* buffer);
+
+
+extern ssize_t frames_recv(int sockfd, frame_buffer_t* buffer, frame_t* frames, size_t max);
+
+extern bool    frames_waiting(const frame_buffer_t* buffer);
+
+extern void     number_write(uint8_t* buffer, uint64_t number, size_t size);
+
+extern uint64_t number_read(const uint8_t* buffer, size_t size);
+
+extern void frame_head_write(uint8_t* head, uint8_t type, uint8_t flags, uint16_t stream, uint32_t size);
+
+extern int frame_send(int sockfd, uint8_t type, const void* data, size_t size);
+
+
+extern int frame_signed_write(uint8_t* buffer, size_t* frame_size, uint8_t type, uint16_t stream, const sign_key_t* key, size_t size);
+
+extern int frame_signed_create(uint8_t** frame, size_t* frame_size, uint8_t type, uint16_t stream, const sign_key_t* key, const void* data, size_t size);
+
+extern int frame_signed_send(int sockfd, uint8_t type, uint16_t stream, const sign_key_t* key, const void* data, size_t size);
+
+extern int frame_sign_get(frame_sign_t* sign, const frame_t* frame);
+
+#endif // FRAME_H
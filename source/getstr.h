@@ -3,10 +3,11 @@
  *
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-12-05
+ * Last updated: 2026-10-19
  *
  *
  * In main compilation unit; define GETSTR_IMPLEMENT
+ * and FORMAT_IMPLEMENT, because the prompt uses format.h
  *
  *
  * These are the available functions:
@@ -14,7 +15,7 @@
  * char* getstr(const char* format, ...)
  *
  *
- * Uses va_list for argument parsing, like in debug.h
+ * Uses format.h for argument parsing, like debug.h
  */
 
 /*
@@ -41,117 +42,7 @@ extern char* getstr(const char* format, ...);
 #include <stdarg.h>
 #include <string.h>
 
-/*
- * Parse va_list argument and print it to a buffer
- *
- * PARAMS
- * - char* buffer          | Buffer to store printed argument
- * - const char* specifier | Argument format specifier
- * - va_list args          | va_list argument list
- *
- * RETURN (int amount, same as sprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
- */
-static inline int gstr_specifier_append(char* buffer, const char* specifier, va_list args)
-{
-  if(strncmp(specifier, "d", 1) == 0)
-  {
-    int arg = va_arg(args, int);
-
-    return sprintf(buffer, "%d", arg);
-  }
-  else if(strncmp(specifier, "ld", 2) == 0)
-  {
-    long int arg = va_arg(args, long int);
-
-    return sprintf(buffer, "%ld", arg);
-  }
-  else if(strncmp(specifier, "lld", 2) == 0)
-  {
-    long long int arg = va_arg(args, long long int);
-
-    return sprintf(buffer, "%lld", arg);
-  }
-  else if(strncmp(specifier, "c", 1) == 0)
-  {
-    // ‘char’ is promoted to ‘int’ when passed through ‘...’
-    int arg = va_arg(args, int);
-
-    return sprintf(buffer, "%c", arg);
-  }
-  else if(strncmp(specifier, "f", 1) == 0)
-  {
-    // ‘float’ is promoted to ‘double’ when passed through ‘...’
-    double arg = va_arg(args, double);
-
-    return sprintf(buffer, "%lf", arg);
-  }
-  else if(strncmp(specifier, "s", 1) == 0)
-  {
-    const char* arg = va_arg(args, const char*);
-
-    return sprintf(buffer, "%s", arg);
-  }
-  else return -1; // Specifier does not exist
-}
-
-/*
- * Formats just a single format specifier argument from va_list
- *
- * RETURN (int amount, same as sprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
- */
-static inline int gstr_arg_append(char* buffer, const char* format, int f_length, int* f_index, va_list args)
-{
-  char specifier[f_length + 1];
-
-  for(int s_index = 0; (*f_index)++ < f_length; s_index++)
-  {
-    specifier[s_index] = format[*f_index];
-    specifier[s_index + 1] = '\0';
-
-    int amount = gstr_specifier_append(buffer, specifier, args);
-
-    // If a valid format specifier has been found and parsed,
-    // return the status of the appended specifier
-    if(amount > 0) return amount;
-  }
-
-  return -1;
-}
-
-/*
- * sprintf, but with va_list as arguments
- *
- * RETURN (same as sprintf)
- * - >=0 | Number of printed characters
- * -  -1 | Format specifier does not exist, or sprintf error
- */
-static inline int gstr_prompt_create(char* prompt, const char* format, va_list args)
-{
-  const size_t f_length = strlen(format);
-
-  int p_index = 0;
-
-  for(int f_index = 0; f_index < f_length; f_index++)
-  {
-    if(format[f_index] == '%')
-    {
-      int amount = gstr_arg_append(prompt + p_index, format, f_length, &f_index, args);
-
-      if(amount < 0) return -1;
-
-      p_index += amount;
-    }
-    else prompt[p_index++] = format[f_index];
-  }
-
-  prompt[p_index] = '\0';
-
-  return p_index;
-}
+#include "format.h"
 
 /*
  * getstr - get string from stdin
@@ -174,7 +65,7 @@ char* getstr(const char* format, ...)
 
   char prompt[1024];
 
-  if(gstr_prompt_create(prompt, format, args) == -1)
+  if(format_vstring(prompt, sizeof(prompt), format, args) == -1)
   {
     va_end(args);
 
@@ -0,0 +1,141 @@
+/*
+ * hist.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "hist.h"
+
+#include <time.h>
+
+/*
+ * Get monotonic time in nanoseconds
+ *
+ * clock_gettime is read from the vDSO, without a syscall
+ */
+uint64_t hist_time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return (uint64_t) timespec.tv_sec * 1000000000 + timespec.tv_nsec;
+}
+
+/*
+ * Get the index of the bucket of a value
+ */
+static inline size_t hist_index_get(uint64_t value)
+{
+  if(value < HIST_LINEAR_COUNT) return value;
+
+  int magnitude = 63 - __builtin_clzll(value);
+
+  int shift = magnitude - HIST_SUB_BITS;
+
+  // The top bits are between HIST_SUB_COUNT and HIST_LINEAR_COUNT
+  size_t top = value >> shift;
+
+  return HIST_LINEAR_COUNT + (size_t) (shift - 1) * HIST_SUB_COUNT + (top - HIST_SUB_COUNT);
+}
+
+/*
+ * Get the highest value of the bucket at index
+ */
+static inline uint64_t hist_value_get(size_t index)
+{
+  if(index < HIST_LINEAR_COUNT) return index;
+
+  size_t offset = index - HIST_LINEAR_COUNT;
+
+  int shift = offset / HIST_SUB_COUNT + 1;
+
+  uint64_t top = offset % HIST_SUB_COUNT + HIST_SUB_COUNT;
+
+  return (top << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+/*
+ * Record a value in the histogram
+ */
+void hist_record(hist_t* hist, uint64_t value)
+{
+  atomic_fetch_add_explicit(&hist->buckets[hist_index_get(value)], 1, memory_order_relaxed);
+
+  atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+
+  unsigned long long max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+  while(value > max && !atomic_compare_exchange_weak_explicit(&hist->max, &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+/*
+ * Get the value that percentile percent of the values are below
+ *
+ * The value is the top of its bucket, but never above the max
+ *
+ * RETURN (uint64_t value)
+ * - 0 | The histogram is empty
+ */
+uint64_t hist_percentile_get(hist_t* hist, double percentile)
+{
+  uint64_t count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+
+  if(count == 0) return 0;
+
+  uint64_t rank = (uint64_t) (percentile / 100.0 * count + 0.5);
+
+  if(rank < 1) rank = 1;
+
+  uint64_t total = 0;
+
+  for(size_t index = 0; index < HIST_BUCKET_COUNT; index++)
+  {
+    total += atomic_load_explicit(&hist->buckets[index], memory_order_relaxed);
+
+    if(total >= rank)
+    {
+      uint64_t value = hist_value_get(index);
+
+      uint64_t max = hist_max_get(hist);
+
+      return (value < max) ? value : max;
+    }
+  }
+
+  // Values were recorded while the buckets were counted
+  return hist_max_get(hist);
+}
+
+/*
+ *
+ */
+uint64_t hist_count_get(hist_t* hist)
+{
+  return atomic_load_explicit(&hist->count, memory_order_relaxed);
+}
+
+/*
+ *
+ */
+uint64_t hist_max_get(hist_t* hist)
+{
+  return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+/*
+ * Remove all values from the histogram
+ */
+void hist_reset(hist_t* hist)
+{
+  for(size_t index = 0; index < HIST_BUCKET_COUNT; index++)
+  {
+    atomic_store_explicit(&hist->buckets[index], 0, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&hist->count, 0, memory_order_relaxed);
+
+  atomic_store_explicit(&hist->max, 0, memory_order_relaxed);
+}
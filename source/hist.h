@@ -0,0 +1,53 @@
+/*
+ * hist.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Values below HIST_LINEAR_COUNT have a bucket each,
+ * and every power of two above has HIST_SUB_COUNT buckets,
+ * so a bucket is at most 1/32 (3%) of its value wide
+ */
+#define HIST_SUB_BITS     5
+#define HIST_SUB_COUNT    (1 << HIST_SUB_BITS)
+#define HIST_LINEAR_COUNT (HIST_SUB_COUNT * 2)
+
+#define HIST_BUCKET_COUNT (HIST_LINEAR_COUNT + (64 - HIST_SUB_BITS - 1) * HIST_SUB_COUNT)
+
+/*
+ * HDR style histogram of nanoseconds
+ *
+ * Values are recorded with relaxed atomics, without locks,
+ * so any thread can record while another reads
+ */
+typedef struct
+{
+  atomic_ullong buckets[HIST_BUCKET_COUNT];
+  atomic_ullong count;
+  atomic_ullong max;
+} hist_t;
+
+extern uint64_t hist_time_get(void);
+
+
+extern void     hist_record(hist_t* hist, uint64_t value);
+
+extern uint64_t hist_percentile_get(hist_t* hist, double percentile);
+
+extern uint64_t hist_count_get(hist_t* hist);
+
+extern uint64_t hist_max_get(hist_t* hist);
+
+extern void     hist_reset(hist_t* hist);
+
+#endif // HIST_H
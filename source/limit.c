@@ -0,0 +1,125 @@
+/*
+ * limit.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "limit.h"
+
+/*
+ * Initialize a full bucket
+ */
+void bucket_init(bucket_t* bucket, double rate, double burst, uint64_t now)
+{
+  bucket->rate   = rate;
+  bucket->burst  = burst;
+  bucket->tokens = burst;
+  bucket->time   = now;
+}
+
+/*
+ * Add the tokens since the bucket was last filled
+ */
+static inline void bucket_fill(bucket_t* bucket, uint64_t now)
+{
+  if(now <= bucket->time) return;
+
+  bucket->tokens += (now - bucket->time) / 1e9 * bucket->rate;
+
+  if(bucket->tokens > bucket->burst) bucket->tokens = bucket->burst;
+
+  bucket->time = now;
+}
+
+/*
+ * Take amount tokens, if the bucket has them
+ *
+ * RETURN (bool is_taken)
+ * - true  | The tokens were taken, or the bucket has no limit
+ * - false | Too few tokens, and nothing was taken
+ */
+bool bucket_take(bucket_t* bucket, double amount, uint64_t now)
+{
+  if(bucket->rate <= 0) return true;
+
+  bucket_fill(bucket, now);
+
+  if(bucket->tokens < amount) return false;
+
+  bucket->tokens -= amount;
+
+  return true;
+}
+
+/*
+ * Get the time until the bucket has amount tokens
+ *
+ * RETURN (uint64_t time)
+ * - Nanoseconds to wait, 0 if the tokens are there
+ */
+uint64_t bucket_wait_get(bucket_t* bucket, double amount, uint64_t now)
+{
+  if(bucket->rate <= 0) return 0;
+
+  bucket_fill(bucket, now);
+
+  if(bucket->tokens >= amount) return 0;
+
+  return (amount - bucket->tokens) / bucket->rate * 1e9 + 1;
+}
+
+/*
+ * Initialize a limit of frames and bytes a second, where 0 is no limit
+ *
+ * The bytes of the burst must fit the largest frame,
+ * or that frame is never let through
+ */
+void limit_init(limit_t* limit, double frames, double bytes, uint64_t now)
+{
+  bucket_init(&limit->frames, frames, frames * LIMIT_BURST, now);
+  bucket_init(&limit->bytes,  bytes,  bytes  * LIMIT_BURST, now);
+
+  limit->dropped_frames = 0;
+  limit->dropped_bytes  = 0;
+}
+
+/*
+ * Take a frame of size bytes from both buckets,
+ * or count it as dropped if either is too low
+ *
+ * RETURN (bool is_taken)
+ * - true  | The frame is within the limit
+ * - false | The frame is over the limit
+ */
+bool limit_take(limit_t* limit, size_t size, uint64_t now)
+{
+  if(bucket_wait_get(&limit->frames, 1, now) > 0 ||
+     bucket_wait_get(&limit->bytes, size, now) > 0)
+  {
+    limit->dropped_frames++;
+    limit->dropped_bytes += size;
+
+    return false;
+  }
+
+  bucket_take(&limit->frames, 1, now);
+  bucket_take(&limit->bytes, size, now);
+
+  return true;
+}
+
+/*
+ * Get the time until a frame of size bytes is within the limit
+ *
+ * RETURN (uint64_t time)
+ * - Nanoseconds to wait, 0 if it is within the limit now
+ */
+uint64_t limit_wait_get(limit_t* limit, size_t size, uint64_t now)
+{
+  uint64_t frames_wait = bucket_wait_get(&limit->frames, 1, now);
+  uint64_t bytes_wait  = bucket_wait_get(&limit->bytes, size, now);
+
+  return (frames_wait > bytes_wait) ? frames_wait : bytes_wait;
+}
@@ -0,0 +1,58 @@
+/*
+ * limit.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef LIMIT_H
+#define LIMIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * A full bucket holds LIMIT_BURST seconds of tokens
+ */
+#define LIMIT_BURST 2.0
+
+/*
+ * A token bucket, that fills with rate tokens a second up to burst
+ *
+ * A bucket has no locks, and belongs to the thread that takes from it
+ */
+typedef struct
+{
+  double   tokens;
+  double   rate;   // Tokens a second, 0 is no limit
+  double   burst;
+  uint64_t time;   // When tokens was last filled, in nanoseconds
+} bucket_t;
+
+/*
+ * A limit of frames and bytes a second, with the traffic it has dropped
+ */
+typedef struct
+{
+  bucket_t frames;
+  bucket_t bytes;
+  uint64_t dropped_frames;
+  uint64_t dropped_bytes;
+} limit_t;
+
+extern void     bucket_init(bucket_t* bucket, double rate, double burst, uint64_t now);
+
+extern bool     bucket_take(bucket_t* bucket, double amount, uint64_t now);
+
+extern uint64_t bucket_wait_get(bucket_t* bucket, double amount, uint64_t now);
+
+
+extern void     limit_init(limit_t* limit, double frames, double bytes, uint64_t now);
+
+extern bool     limit_take(limit_t* limit, size_t size, uint64_t now);
+
+extern uint64_t limit_wait_get(limit_t* limit, size_t size, uint64_t now);
+
+#endif // LIMIT_H
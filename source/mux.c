@@ -0,0 +1,649 @@
+/*
+ * mux.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "mux.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define MUX_QUEUE_CONTROL 0
+#define MUX_QUEUE_CHAT    1
+
+/*
+ * Write to the socket, without waiting for it
+ *
+ * RETURN (ssize_t amount)
+ * - >0 | The number of written bytes
+ * -  0 | The socket is full
+ * - -1 | Failed to write to socket
+ */
+static ssize_t mux_send(mux_t* mux, const uint8_t* data, size_t size)
+{
+  while(true)
+  {
+    ssize_t amount = send(mux->sockfd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if(amount >= 0) return amount;
+
+    if(errno == EINTR) continue;
+
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      mux->blocked++;
+
+      return 0;
+    }
+
+    return -1;
+  }
+}
+
+/*
+ * Add bytes to the end of a queue
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The queue is full
+ */
+static int queue_push(mux_queue_t* queue, const uint8_t* data, size_t size)
+{
+  if(queue->length + size > MUX_QUEUE_SIZE) return 1;
+
+  size_t tail = (queue->head + queue->length) % MUX_QUEUE_SIZE;
+
+  size_t first = MUX_QUEUE_SIZE - tail;
+
+  if(first > size) first = size;
+
+  memcpy(queue->data + tail, data, first);
+
+  memcpy(queue->data, data + first, size - first);
+
+  queue->length += size;
+
+  return 0;
+}
+
+/*
+ * Remove the written bytes from the start of a queue,
+ * and keep count of where the frames in it end
+ */
+static void queue_pop(mux_queue_t* queue, size_t size)
+{
+  while(size > 0)
+  {
+    if(queue->frame_left == 0)
+    {
+      uint8_t head[4];
+
+      for(size_t index = 0; index < 4; index++)
+      {
+        head[index] = queue->data[(queue->head + index) % MUX_QUEUE_SIZE];
+      }
+
+      queue->frame_left = FRAME_HEAD_SIZE + number_read(head, 4);
+    }
+
+    size_t amount = (size < queue->frame_left) ? size : queue->frame_left;
+
+    queue->head = (queue->head + amount) % MUX_QUEUE_SIZE;
+
+    queue->length     -= amount;
+    queue->frame_left -= amount;
+
+    size -= amount;
+  }
+}
+
+/*
+ * Get a stream of the connection
+ */
+static mux_stream_t* mux_stream_get(mux_t* mux, uint16_t id)
+{
+  for(size_t index = 0; index < MUX_STREAMS; index++)
+  {
+    if(mux->streams[index].used && mux->streams[index].id == id) return &mux->streams[index];
+  }
+
+  return NULL;
+}
+
+/*
+ * Check if nothing is partly written, or waits in a queue
+ */
+static inline bool mux_idle(const mux_t* mux)
+{
+  return mux->queues[MUX_QUEUE_CONTROL].length == 0 &&
+         mux->queues[MUX_QUEUE_CHAT].length    == 0 &&
+         mux->chunk_offset == mux->chunk_size;
+}
+
+/*
+ * Create the mux of a connection, with the chat stream open,
+ * where public is the key that our bulk chunks are known by
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate memory
+ */
+int mux_init(mux_t* mux, int sockfd, const uint8_t* public)
+{
+  *mux = (mux_t) { .sockfd = sockfd };
+
+  memcpy(mux->public, public, SIGN_PUBLIC_SIZE);
+
+  // A bulk frame is allocated for every chunk of an attachment,
+  // so the frames are reused from the slab instead of malloced
+  slab_pool_create(&mux->slab, 0);
+
+  for(size_t index = 0; index < 2; index++)
+  {
+    if(!(mux->queues[index].data = malloc(MUX_QUEUE_SIZE)))
+    {
+      mux_free(mux);
+
+      return 1;
+    }
+  }
+
+  if(!(mux->chunk = malloc(FRAME_HEAD_SIZE + MUX_CHUNK_HEAD_SIZE + MUX_CHUNK_SIZE)))
+  {
+    mux_free(mux);
+
+    return 1;
+  }
+
+  mux_stream_open(mux, MUX_STREAM_CHAT, FRAME_PRIORITY_CHAT);
+
+  return 0;
+}
+
+/*
+ * Free the mux of a connection, and the frames that were never written
+ */
+void mux_free(mux_t* mux)
+{
+  for(size_t index = 0; index < 2; index++)
+  {
+    free(mux->queues[index].data);
+
+    mux->queues[index] = (mux_queue_t) { 0 };
+  }
+
+  for(size_t index = 0; index < MUX_STREAMS; index++)
+  {
+    mux_stream_t* stream = &mux->streams[index];
+
+    while(stream->head)
+    {
+      mux_bulk_t* next = stream->head->next;
+
+      slab_free(stream->head);
+
+      stream->head = next;
+    }
+
+    *stream = (mux_stream_t) { 0 };
+  }
+
+  for(size_t index = 0; index < MUX_SENDERS; index++)
+  {
+    slab_free(mux->senders[index].assembly);
+
+    mux->senders[index] = (mux_sender_t) { 0 };
+  }
+
+  free(mux->chunk);
+
+  mux->chunk = NULL;
+
+  slab_pool_free(&mux->slab);
+
+  mux->chunk_size   = 0;
+  mux->chunk_offset = 0;
+}
+
+/*
+ * Open a stream, or change the priority of an open stream
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Every stream is open
+ */
+int mux_stream_open(mux_t* mux, uint16_t id, uint8_t priority)
+{
+  mux_stream_t* stream = mux_stream_get(mux, id);
+
+  if(stream)
+  {
+    stream->priority = priority;
+
+    return 0;
+  }
+
+  for(size_t index = 0; index < MUX_STREAMS; index++)
+  {
+    stream = &mux->streams[index];
+
+    if(stream->used) continue;
+
+    *stream = (mux_stream_t)
+    {
+      .id       = id,
+      .priority = priority,
+      .used     = true,
+      .limit    = MUX_WINDOW
+    };
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Cut the next chunk from the bulk frames, taking turns between
+ * the streams, and skipping the streams whose window is closed
+ *
+ * The chunk starts with our key and the offset of its data in the stream
+ *
+ * RETURN (bool is_created)
+ */
+static bool mux_chunk_create(mux_t* mux)
+{
+  for(size_t count = 0; count < MUX_STREAMS; count++)
+  {
+    size_t index = (mux->bulk_next + count) % MUX_STREAMS;
+
+    mux_stream_t* stream = &mux->streams[index];
+
+    mux_bulk_t* bulk = stream->head;
+
+    if(!stream->used || !bulk) continue;
+
+    size_t   left   = bulk->size - bulk->offset;
+    uint64_t window = stream->limit - stream->sent;
+
+    size_t size = (left < MUX_CHUNK_SIZE) ? left : MUX_CHUNK_SIZE;
+
+    if(size > window) size = window;
+
+    if(size == 0 && left > 0) continue;
+
+    bool is_more = (size < left);
+
+    frame_head_write(mux->chunk, bulk->type, FRAME_PRIORITY_BULK | (is_more ? FRAME_FLAG_MORE : 0), stream->id, MUX_CHUNK_HEAD_SIZE + size);
+
+    uint8_t* head = mux->chunk + FRAME_HEAD_SIZE;
+
+    memcpy(head, mux->public, SIGN_PUBLIC_SIZE);
+
+    number_write(head + SIGN_PUBLIC_SIZE, stream->sent, 8);
+
+    memcpy(head + MUX_CHUNK_HEAD_SIZE, bulk->data + bulk->offset, size);
+
+    mux->chunk_size   = FRAME_HEAD_SIZE + MUX_CHUNK_HEAD_SIZE + size;
+    mux->chunk_offset = 0;
+
+    bulk->offset += size;
+    stream->sent += size;
+
+    if(!is_more)
+    {
+      if(!(stream->head = bulk->next)) stream->tail = NULL;
+
+      slab_free(bulk);
+    }
+
+    mux->bulk_next = index + 1;
+
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Get the queue to write from, where a partly written frame
+ * is finished first, and control frames go before chat frames
+ */
+static mux_queue_t* mux_queue_next(mux_t* mux)
+{
+  for(size_t index = 0; index < 2; index++)
+  {
+    if(mux->queues[index].frame_left > 0) return &mux->queues[index];
+  }
+
+  for(size_t index = 0; index < 2; index++)
+  {
+    if(mux->queues[index].length > 0) return &mux->queues[index];
+  }
+
+  return NULL;
+}
+
+/*
+ * Write what waits, until the socket is full
+ *
+ * RETURN (int status)
+ * -  0 | Everything that can be sent is written
+ * -  1 | The socket is full, so wait for it to be writable
+ * - -1 | Failed to write to socket
+ */
+int mux_flush(mux_t* mux)
+{
+  while(true)
+  {
+    ssize_t amount;
+
+    // 1. A chunk that is partly written is finished first
+    if(mux->chunk_offset < mux->chunk_size)
+    {
+      if((amount = mux_send(mux, mux->chunk + mux->chunk_offset, mux->chunk_size - mux->chunk_offset)) <= 0) return (amount == 0) ? 1 : -1;
+
+      mux->chunk_offset += amount;
+
+      continue;
+    }
+
+    // 2. Control and chat frames
+    mux_queue_t* queue = mux_queue_next(mux);
+
+    if(queue)
+    {
+      size_t size = MUX_QUEUE_SIZE - queue->head;
+
+      if(size > queue->length) size = queue->length;
+
+      if((amount = mux_send(mux, queue->data + queue->head, size)) <= 0) return (amount == 0) ? 1 : -1;
+
+      queue_pop(queue, amount);
+
+      continue;
+    }
+
+    // 3. A chunk of bulk frames, only when nothing else waits
+    if(!mux_chunk_create(mux)) return 0;
+  }
+}
+
+/*
+ * Check if something waits for the socket to be writable
+ *
+ * Bulk frames whose window is closed wait for the peer instead
+ */
+bool mux_waiting(const mux_t* mux)
+{
+  if(!mux_idle(mux)) return true;
+
+  for(size_t index = 0; index < MUX_STREAMS; index++)
+  {
+    const mux_stream_t* stream = &mux->streams[index];
+
+    if(!stream->used || !stream->head) continue;
+
+    if(stream->sent < stream->limit || stream->head->offset == stream->head->size) return true;
+  }
+
+  return false;
+}
+
+/*
+ * Get the bulk frames of a stream that are not written whole,
+ * so that a sender can keep a few waiting, and no more
+ */
+size_t mux_stream_queued(mux_t* mux, uint16_t id)
+{
+  mux_stream_t* stream = mux_stream_get(mux, id);
+
+  size_t count = 0;
+
+  for(const mux_bulk_t* bulk = stream ? stream->head : NULL; bulk; bulk = bulk->next) count++;
+
+  return count;
+}
+
+/*
+ * Write a whole frame on a stream, with the head of the frame
+ * changed to the stream and its priority
+ *
+ * Control and chat frames are written at once if nothing waits,
+ * and else they are copied to their queue. Bulk frames are copied,
+ * and are written a chunk at a time by mux_flush
+ *
+ * RETURN (int status)
+ * - 0 | Success, the frame is written or waits in the mux
+ * - 1 | The stream is not open
+ * - 2 | The queue is full
+ * - 3 | Failed to write to socket
+ * - 4 | Failed to allocate memory
+ */
+int mux_write(mux_t* mux, uint16_t id, uint8_t* frame, size_t size)
+{
+  mux_stream_t* stream = mux_stream_get(mux, id);
+
+  if(!stream) return 1;
+
+  uint8_t type = frame[4];
+
+  uint8_t priority = FRAME_IS_CONTROL(type) ? FRAME_PRIORITY_CONTROL : stream->priority;
+
+  if(priority == FRAME_PRIORITY_BULK)
+  {
+    mux_bulk_t* bulk = slab_alloc(&mux->slab, sizeof(mux_bulk_t) + size - FRAME_HEAD_SIZE);
+
+    if(!bulk) return 4;
+
+    *bulk = (mux_bulk_t) { .size = size - FRAME_HEAD_SIZE, .type = type };
+
+    memcpy(bulk->data, frame + FRAME_HEAD_SIZE, bulk->size);
+
+    if(stream->tail) stream->tail->next = bulk;
+    else             stream->head       = bulk;
+
+    stream->tail = bulk;
+
+    return (mux_flush(mux) < 0) ? 3 : 0;
+  }
+
+  frame[5] = priority;
+  frame[6] = (id >> 8) & 0xff;
+  frame[7] = (id >> 0) & 0xff;
+
+  mux_queue_t* queue = &mux->queues[(priority == FRAME_PRIORITY_CONTROL) ? MUX_QUEUE_CONTROL : MUX_QUEUE_CHAT];
+
+  size_t offset = 0;
+
+  if(mux_idle(mux))
+  {
+    ssize_t amount = mux_send(mux, frame, size);
+
+    if(amount < 0) return 3;
+
+    if((offset = amount) == size) return 0;
+  }
+
+  if(queue_push(queue, frame + offset, size - offset) != 0) return 2;
+
+  // The queue was empty, and starts in the middle of the frame
+  if(offset > 0) queue->frame_left = size - offset;
+
+  return (mux_flush(mux) < 0) ? 3 : 0;
+}
+
+/*
+ * Send a frame with data on a stream, like frame_send
+ *
+ * RETURN (same as mux_write)
+ */
+int mux_frame_send(mux_t* mux, uint16_t stream, uint8_t type, const void* data, size_t size)
+{
+  if(size > FRAME_SIZE_MAX) return 2;
+
+  uint8_t small[FRAME_HEAD_SIZE + FRAME_SMALL_MAX];
+
+  uint8_t* buffer = small;
+
+  if(size > FRAME_SMALL_MAX && !(buffer = malloc(sizeof(uint8_t) * (FRAME_HEAD_SIZE + size))))
+  {
+    return 4;
+  }
+
+  frame_head_write(buffer, type, 0, 0, size);
+
+  if(data) memcpy(buffer + FRAME_HEAD_SIZE, data, size);
+
+  int status = mux_write(mux, stream, buffer, FRAME_HEAD_SIZE + size);
+
+  if(buffer != small) free(buffer);
+
+  return status;
+}
+
+/*
+ * Get the sender of a chunk on a stream, or give a new sender
+ * the place of the one that was heard from the longest ago
+ */
+static mux_sender_t* mux_sender_get(mux_t* mux, uint16_t stream, const uint8_t* public)
+{
+  mux_sender_t* oldest = &mux->senders[0];
+
+  for(size_t index = 0; index < MUX_SENDERS; index++)
+  {
+    mux_sender_t* sender = &mux->senders[index];
+
+    if(sender->used && sender->stream == stream && memcmp(sender->public, public, SIGN_PUBLIC_SIZE) == 0)
+    {
+      return sender;
+    }
+
+    if(!sender->used || (oldest->used && sender->heard < oldest->heard)) oldest = sender;
+  }
+
+  // The assembly is kept for the new sender
+  oldest->used          = true;
+  oldest->stream        = stream;
+  oldest->recvd         = 0;
+  oldest->granted       = 0;
+  oldest->assembly_size = 0;
+
+  memcpy(oldest->public, public, SIGN_PUBLIC_SIZE);
+
+  return oldest;
+}
+
+/*
+ * Let a sender send more on a stream, when half of its window is used
+ */
+static void mux_window_grant(mux_t* mux, mux_sender_t* sender)
+{
+  if(sender->granted >= sender->recvd + MUX_WINDOW / 2) return;
+
+  sender->granted = sender->recvd + MUX_WINDOW;
+
+  uint8_t window[MUX_WINDOW_SIZE];
+
+  memcpy(window, sender->public, SIGN_PUBLIC_SIZE);
+
+  number_write(window + SIGN_PUBLIC_SIZE, sender->granted, 8);
+
+  mux_frame_send(mux, sender->stream, FRAME_WINDOW, window, MUX_WINDOW_SIZE);
+}
+
+/*
+ * Handle a frame that is read, before it is handed on
+ *
+ * Window frames are taken by the mux, and the chunks of a bulk
+ * frame are put together, apart for every sender. A bulk frame
+ * is handed on without the head of its chunk, and a frame that
+ * is put together points into the mux, and is only valid
+ * until the next chunk of its sender
+ *
+ * A chunk that doesn't follow the last chunk of its sender means
+ * that chunks were lost, so the frame that was not whole is dropped
+ *
+ * RETURN (int status)
+ * -  0 | The frame is whole, and is handed on
+ * -  1 | The frame is taken by the mux
+ * -  2 | The frame is put together from chunks
+ * - -1 | Bad frame
+ */
+int mux_frame_recv(mux_t* mux, frame_t* frame)
+{
+  if(frame->type == FRAME_WINDOW)
+  {
+    if(frame->size != MUX_WINDOW_SIZE) return -1;
+
+    // Windows that the recievers grant other senders
+    if(memcmp(frame->data, mux->public, SIGN_PUBLIC_SIZE) != 0) return 1;
+
+    mux_stream_t* stream = mux_stream_get(mux, frame->stream);
+
+    uint64_t limit = number_read(frame->data + SIGN_PUBLIC_SIZE, 8);
+
+    if(stream && limit > stream->limit) stream->limit = limit;
+
+    return 1;
+  }
+
+  if((frame->flags & FRAME_FLAG_PRIORITY) != FRAME_PRIORITY_BULK) return 0;
+
+  if(frame->size < MUX_CHUNK_HEAD_SIZE) return -1;
+
+  // The stream is opened by the first chunk, to grant windows on it
+  if(!mux_stream_get(mux, frame->stream) && mux_stream_open(mux, frame->stream, FRAME_PRIORITY_BULK) != 0) return -1;
+
+  mux_sender_t* sender = mux_sender_get(mux, frame->stream, frame->data);
+
+  uint64_t offset = number_read(frame->data + SIGN_PUBLIC_SIZE, 8);
+
+  uint8_t* data = frame->data + MUX_CHUNK_HEAD_SIZE;
+  size_t   size = frame->size - MUX_CHUNK_HEAD_SIZE;
+
+  if(offset != sender->recvd) sender->assembly_size = 0;
+
+  sender->recvd = offset + size;
+  sender->heard = ++mux->heard;
+
+  mux_window_grant(mux, sender);
+
+  bool is_more = (frame->flags & FRAME_FLAG_MORE);
+
+  if(!is_more && sender->assembly_size == 0)
+  {
+    frame->data = data;
+    frame->size = size;
+
+    return 0;
+  }
+
+  if(!sender->assembly && !(sender->assembly = slab_alloc(&mux->slab, FRAME_SIZE_MAX))) return -1;
+
+  if(sender->assembly_size + size > FRAME_SIZE_MAX)
+  {
+    sender->assembly_size = 0;
+
+    return -1;
+  }
+
+  memcpy(sender->assembly + sender->assembly_size, data, size);
+
+  sender->assembly_size += size;
+
+  if(is_more) return 1;
+
+  frame->data  = sender->assembly;
+  frame->size  = sender->assembly_size;
+  frame->flags = FRAME_PRIORITY_BULK;
+
+  sender->assembly_size = 0;
+
+  return 2;
+}
@@ -0,0 +1,163 @@
+/*
+ * mux.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef MUX_H
+#define MUX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "frame.h"
+#include "slab.h"
+
+/*
+ * The logical streams of one connection, and the order that
+ * their frames are written to the socket in
+ *
+ * Control frames are written first, then chat frames, and bulk
+ * frames only when nothing else waits. A bulk frame is written
+ * MUX_CHUNK_SIZE bytes at a time, so a chat frame never waits
+ * behind more than one chunk, however large the transfer is.
+ *
+ * In a room, the relay sends the frames of every peer to every other
+ * peer, so the chunks of different senders come in between each other
+ * on the same stream. Every chunk starts with the public key of its
+ * sender, and where in the stream of the sender it is, so the chunks
+ * are put together, and the windows are kept, apart for every sender.
+ *
+ * A bulk stream may only send MUX_WINDOW bytes more than a reciever
+ * has granted it with FRAME_WINDOW frames, which say what sender they
+ * are for. The mux of every reciever grants more as it reads the chunks,
+ * and the sender goes by the reciever that has read the most, so that
+ * a slower reciever falls behind in its socket, and drops nothing.
+ *
+ * Nothing blocks: what the socket doesn't take waits in the mux
+ * until mux_flush is called when the socket is writable again
+ */
+#define MUX_STREAMS     16
+
+#define MUX_CHUNK_SIZE  16384
+
+#define MUX_WINDOW      (256 * 1024)
+
+/*
+ * The senders of bulk chunks that are kept apart at a time,
+ * where the one heard from the longest ago gives its place
+ * to a new one, and only loses the frame it was sending
+ */
+#define MUX_SENDERS     16
+
+/*
+ * Bytes of control or chat frames that may wait for the socket
+ */
+#define MUX_QUEUE_SIZE  (4 * (FRAME_HEAD_SIZE + FRAME_SIZE_MAX))
+
+/*
+ * The chat stream of the room, that is always open
+ */
+#define MUX_STREAM_CHAT 0
+
+/*
+ * CHUNK HEAD (40 bytes), before the data of every bulk chunk
+ * - uint8_t  public[32] | The public key of the sender
+ * - uint64_t offset     | The bytes that the sender sent on the stream before
+ */
+#define MUX_CHUNK_HEAD_SIZE (SIGN_PUBLIC_SIZE + 8)
+
+/*
+ * WINDOW (40 bytes)
+ * - uint8_t  public[32] | The public key of the sender that may send more
+ * - uint64_t limit      | The bytes that may be sent on the stream in total
+ */
+#define MUX_WINDOW_SIZE (SIGN_PUBLIC_SIZE + 8)
+
+/*
+ * A ring of whole frames, that are written in order
+ */
+typedef struct
+{
+  uint8_t* data;
+  size_t   head;
+  size_t   length;
+  size_t   frame_left;  // Bytes of the frame at head, that are not written
+} mux_queue_t;
+
+/*
+ * A bulk frame, that is written a chunk at a time
+ */
+typedef struct mux_bulk_t
+{
+  struct mux_bulk_t* next;
+  size_t             size;    // Bytes of data
+  size_t             offset;  // Bytes of data that are written
+  uint8_t            type;
+  uint8_t            data[];
+} mux_bulk_t;
+
+typedef struct
+{
+  uint16_t    id;
+  uint8_t     priority;
+  bool        used;
+  uint64_t    sent;      // Bulk bytes sent
+  uint64_t    limit;     // Bulk bytes that the recievers let us send
+  mux_bulk_t* head;
+  mux_bulk_t* tail;
+} mux_stream_t;
+
+/*
+ * A sender of bulk chunks on a stream, as the reciever knows it
+ */
+typedef struct
+{
+  bool     used;
+  uint16_t stream;
+  uint8_t  public[SIGN_PUBLIC_SIZE];
+  uint64_t recvd;     // Bulk bytes of the sender, up to the last chunk
+  uint64_t granted;   // Bulk bytes that we let the sender send
+  uint64_t heard;     // When the last chunk came, in chunks of the mux
+  uint8_t* assembly;  // The chunks of a frame that is not whole
+  size_t   assembly_size;
+} mux_sender_t;
+
+typedef struct
+{
+  int          sockfd;
+  uint8_t      public[SIGN_PUBLIC_SIZE]; // The key that our chunks are sent with
+  mux_queue_t  queues[2];  // Control and chat frames
+  uint8_t*     chunk;      // The bulk chunk that is being written
+  size_t       chunk_size;
+  size_t       chunk_offset;
+  mux_stream_t streams[MUX_STREAMS];
+  mux_sender_t senders[MUX_SENDERS];
+  uint64_t     heard;      // Bulk chunks recieved
+  size_t       bulk_next;  // The stream that sends the next chunk
+  uint64_t     blocked;    // Times the socket was full
+  slab_pool_t  slab;       // Bulk frames and assemblies, only used by the thread of the mux
+} mux_t;
+
+extern int  mux_init(mux_t* mux, int sockfd, const uint8_t* public);
+
+extern void mux_free(mux_t* mux);
+
+extern int  mux_stream_open(mux_t* mux, uint16_t id, uint8_t priority);
+
+extern int  mux_write(mux_t* mux, uint16_t stream, uint8_t* frame, size_t size);
+
+extern int  mux_frame_send(mux_t* mux, uint16_t stream, uint8_t type, const void* data, size_t size);
+
+extern int  mux_flush(mux_t* mux);
+
+extern bool mux_waiting(const mux_t* mux);
+
+extern size_t mux_stream_queued(mux_t* mux, uint16_t id);
+
+extern int  mux_frame_recv(mux_t* mux, frame_t* frame);
+
+#endif // MUX_H
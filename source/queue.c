@@ -0,0 +1,349 @@
+/*
+ * queue.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "queue.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/*
+ * Round size up to a power of two
+ */
+static size_t queue_size_get(size_t size)
+{
+  size_t power = 1;
+
+  while(power < size) power <<= 1;
+
+  return power;
+}
+
+/*
+ * Wake the consumer, that waits on the eventfd
+ */
+static inline void queue_signal(int fd)
+{
+  uint64_t value = 1;
+
+  // The write only fails if the counter is full, and then it is readable
+  while(write(fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+/*
+ * Wait until the eventfd of a queue has been written
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to read eventfd
+ */
+int queue_wait(int fd)
+{
+  uint64_t value;
+
+  ssize_t size;
+
+  while((size = read(fd, &value, sizeof(value))) == -1 && errno == EINTR);
+
+  return (size == sizeof(value)) ? 0 : 1;
+}
+
+/*
+ * Create a SPSC queue, with room for at least size items
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate items
+ * - 2 | Failed to create eventfd
+ */
+int spsc_queue_create(spsc_queue_t* queue, size_t size)
+{
+  queue->size = queue_size_get(size);
+
+  queue->items = malloc(sizeof(void*) * queue->size);
+
+  if(!queue->items) return 1;
+
+  queue->fd = eventfd(0, EFD_CLOEXEC);
+
+  if(queue->fd == -1)
+  {
+    free(queue->items);
+
+    queue->items = NULL;
+
+    return 2;
+  }
+
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+
+  queue->head_cache = 0;
+  queue->tail_cache = 0;
+
+  return 0;
+}
+
+/*
+ *
+ */
+void spsc_queue_free(spsc_queue_t* queue)
+{
+  if(!queue->items) return;
+
+  free(queue->items);
+
+  queue->items = NULL;
+
+  close(queue->fd);
+
+  queue->fd = -1;
+}
+
+/*
+ * Push as many of the items as there is room for
+ *
+ * The tail is stored and the head is loaded in seq_cst order,
+ * and the consumer does the opposite before it waits,
+ * so either the producer sees that the queue was empty and
+ * signals, or the consumer sees the new items
+ *
+ * RETURN (size_t count)
+ * - The number of pushed items, 0 if the queue is full
+ */
+size_t spsc_queue_push(spsc_queue_t* queue, void* const* items, size_t count)
+{
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  size_t room = queue->size - (tail - queue->head_cache);
+
+  if(room < count)
+  {
+    queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    room = queue->size - (tail - queue->head_cache);
+  }
+
+  if(count > room) count = room;
+
+  if(count == 0) return 0;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    queue->items[(tail + index) & (queue->size - 1)] = items[index];
+  }
+
+  atomic_store_explicit(&queue->tail, tail + count, memory_order_seq_cst);
+
+  size_t head = atomic_load_explicit(&queue->head, memory_order_seq_cst);
+
+  queue->head_cache = head;
+
+  // The consumer had taken every item before these
+  if(head == tail) queue_signal(queue->fd);
+
+  return count;
+}
+
+/*
+ * Pop at most max items
+ *
+ * RETURN (size_t count)
+ * - The number of popped items, 0 if the queue is empty
+ */
+size_t spsc_queue_pop(spsc_queue_t* queue, void** items, size_t max)
+{
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+  if(queue->tail_cache == head)
+  {
+    queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_seq_cst);
+  }
+
+  size_t count = queue->tail_cache - head;
+
+  if(count > max) count = max;
+
+  if(count == 0) return 0;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    items[index] = queue->items[(head + index) & (queue->size - 1)];
+  }
+
+  atomic_store_explicit(&queue->head, head + count, memory_order_seq_cst);
+
+  return count;
+}
+
+/*
+ * Create a MPSC queue, with room for at least size items
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate slots
+ * - 2 | Failed to create eventfd
+ */
+int mpsc_queue_create(mpsc_queue_t* queue, size_t size)
+{
+  queue->size = queue_size_get(size);
+
+  queue->slots = malloc(sizeof(mpsc_slot_t) * queue->size);
+
+  if(!queue->slots) return 1;
+
+  queue->fd = eventfd(0, EFD_CLOEXEC);
+
+  if(queue->fd == -1)
+  {
+    free(queue->slots);
+
+    queue->slots = NULL;
+
+    return 2;
+  }
+
+  // Slot index is ready for the producer with ticket index
+  for(size_t index = 0; index < queue->size; index++)
+  {
+    atomic_init(&queue->slots[index].sequence, index);
+  }
+
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+
+  return 0;
+}
+
+/*
+ *
+ */
+void mpsc_queue_free(mpsc_queue_t* queue)
+{
+  if(!queue->slots) return;
+
+  free(queue->slots);
+
+  queue->slots = NULL;
+
+  close(queue->fd);
+
+  queue->fd = -1;
+}
+
+/*
+ * Push as many of the items as there is room for,
+ * in slots that follow each other
+ *
+ * RETURN (size_t count)
+ * - The number of pushed items, 0 if the queue is full
+ */
+size_t mpsc_queue_push(mpsc_queue_t* queue, void* const* items, size_t count)
+{
+  size_t mask = queue->size - 1;
+
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  size_t claimed;
+
+  while(true)
+  {
+    // Count the free slots after tail, up to count
+    claimed = 0;
+
+    while(claimed < count)
+    {
+      size_t sequence = atomic_load_explicit(&queue->slots[(tail + claimed) & mask].sequence, memory_order_acquire);
+
+      if(sequence != tail + claimed) break;
+
+      claimed++;
+    }
+
+    if(claimed == 0)
+    {
+      size_t sequence = atomic_load_explicit(&queue->slots[tail & mask].sequence, memory_order_acquire);
+
+      // The slot has not been popped since the last lap
+      if(sequence < tail) return 0;
+
+      // Another producer claimed the slot, try again at the new tail
+      tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+      continue;
+    }
+
+    if(atomic_compare_exchange_weak_explicit(&queue->tail, &tail, tail + claimed, memory_order_relaxed, memory_order_relaxed))
+    {
+      break;
+    }
+  }
+
+  for(size_t index = 0; index < claimed; index++)
+  {
+    mpsc_slot_t* slot = &queue->slots[(tail + index) & mask];
+
+    slot->item = items[index];
+
+    atomic_store_explicit(&slot->sequence, tail + index + 1, memory_order_seq_cst);
+  }
+
+  size_t head = atomic_load_explicit(&queue->head, memory_order_seq_cst);
+
+  // Only the producer of the slot that the consumer waits at signals,
+  // which can be any of the claimed slots, since the consumer can pop
+  // the first ones while the last ones are still being written
+  if(head - tail < claimed)
+  {
+    queue_signal(queue->fd);
+  }
+
+  return claimed;
+}
+
+/*
+ * Pop at most max items, stopping at the first slot
+ * that its producer has not written yet
+ *
+ * RETURN (size_t count)
+ * - The number of popped items, 0 if the queue is empty
+ */
+size_t mpsc_queue_pop(mpsc_queue_t* queue, void** items, size_t max)
+{
+  size_t mask = queue->size - 1;
+
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+  size_t count = 0;
+
+  while(count < max)
+  {
+    mpsc_slot_t* slot = &queue->slots[(head + count) & mask];
+
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_seq_cst);
+
+    if(sequence != head + count + 1) break;
+
+    items[count] = slot->item;
+
+    // The slot is ready for the producer of the next lap
+    atomic_store_explicit(&slot->sequence, head + count + queue->size, memory_order_release);
+
+    count++;
+  }
+
+  if(count > 0)
+  {
+    atomic_store_explicit(&queue->head, head + count, memory_order_seq_cst);
+  }
+
+  return count;
+}
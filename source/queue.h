@@ -0,0 +1,89 @@
+/*
+ * queue.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Bounded lock-free queues of pointers
+ *
+ * Every queue has an eventfd, that is only written when
+ * the queue goes from empty to non-empty. The consumer pops
+ * until the queue is empty, and then waits on the fd,
+ * either with queue_wait or by polling it with other fds.
+ *
+ * A wakeup can come when the queue is already empty again,
+ * so after waking the consumer must handle an empty pop.
+ */
+
+/*
+ * Single producer, single consumer
+ *
+ * Both sides keep a copy of the other index,
+ * so that the shared cache line is only read when needed
+ */
+typedef struct
+{
+  _Alignas(64) atomic_size_t head; // Written by the consumer
+  size_t tail_cache;
+  _Alignas(64) atomic_size_t tail; // Written by the producer
+  size_t head_cache;
+  _Alignas(64) void** items;
+  size_t size;
+  int    fd;
+} spsc_queue_t;
+
+/*
+ * A slot of the MPSC queue
+ *
+ * The sequence tells which lap of the ring the slot is ready for
+ */
+typedef struct
+{
+  atomic_size_t sequence;
+  void*         item;
+} mpsc_slot_t;
+
+/*
+ * Multiple producers, single consumer
+ *
+ * The producers claim slots by moving the tail with CAS
+ */
+typedef struct
+{
+  _Alignas(64) atomic_size_t tail; // Written by the producers
+  _Alignas(64) atomic_size_t head; // Written by the consumer
+  _Alignas(64) mpsc_slot_t* slots;
+  size_t size;
+  int    fd;
+} mpsc_queue_t;
+
+extern int    spsc_queue_create(spsc_queue_t* queue, size_t size);
+
+extern void   spsc_queue_free(spsc_queue_t* queue);
+
+extern size_t spsc_queue_push(spsc_queue_t* queue, void* const* items, size_t count);
+
+extern size_t spsc_queue_pop(spsc_queue_t* queue, void** items, size_t max);
+
+
+extern int    mpsc_queue_create(mpsc_queue_t* queue, size_t size);
+
+extern void   mpsc_queue_free(mpsc_queue_t* queue);
+
+extern size_t mpsc_queue_push(mpsc_queue_t* queue, void* const* items, size_t count);
+
+extern size_t mpsc_queue_pop(mpsc_queue_t* queue, void** items, size_t max);
+
+
+extern int    queue_wait(int fd);
+
+#endif // QUEUE_H
@@ -0,0 +1,674 @@
+/*
+ * rudp.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "rudp.h"
+#include "frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#define RUDP_WINDOW_MASK (RUDP_WINDOW - 1)
+
+/*
+ * Check if packet number a comes before b, where the numbers wrap around
+ */
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+  return (int32_t) (a - b) < 0;
+}
+
+static inline uint64_t time_diff(uint64_t a, uint64_t b)
+{
+  return (a > b) ? (a - b) : (b - a);
+}
+
+/*
+ * Get the reorder window, that a packet may come after a later one
+ */
+static uint64_t reorder_window_get(const rudp_t* rudp)
+{
+  if(!rudp->reorder_seen) return 0;
+
+  uint64_t window = rudp->reorder_steps * (rudp->min_rtt >> RUDP_REORDER_SHIFT);
+
+  return (window < rudp->srtt) ? window : rudp->srtt;
+}
+
+/*
+ * Add a round trip of a packet that was only sent once,
+ * and set the retransmission timeout like RFC 6298
+ *
+ * The timeout also waits for the reorder window, so that a reordered
+ * packet doesn't time out before it could be called lost
+ */
+static void rtt_sample(rudp_t* rudp, uint64_t rtt)
+{
+  if(rudp->srtt == 0)
+  {
+    rudp->srtt   = rtt;
+    rudp->rttvar = rtt / 2;
+  }
+  else
+  {
+    rudp->rttvar = (3 * rudp->rttvar + time_diff(rudp->srtt, rtt)) / 4;
+    rudp->srtt   = (7 * rudp->srtt + rtt) / 8;
+  }
+
+  if(rudp->min_rtt == 0 || rtt < rudp->min_rtt) rudp->min_rtt = rtt;
+
+  rudp->rto = rudp->srtt + 4 * rudp->rttvar + reorder_window_get(rudp);
+
+  if(rudp->rto < RUDP_RTO_MIN) rudp->rto = RUDP_RTO_MIN;
+
+  if(rudp->rto > RUDP_RTO_MAX) rudp->rto = RUDP_RTO_MAX;
+}
+
+/*
+ * Let a packet wait for the pacer, if it doesn't already
+ */
+static void queue_push(rudp_t* rudp, rudp_sent_t* sent)
+{
+  if(sent->queued) return;
+
+  rudp->queue[(rudp->queue_head + rudp->queue_count) & RUDP_WINDOW_MASK] = sent->seq;
+
+  rudp->queue_count++;
+
+  sent->queued = true;
+}
+
+/*
+ * Send a packet again, when it has not been acknowledged in time
+ *
+ * The timeout is doubled until the next round trip, like RFC 6298
+ */
+static void timeout_routine(wheel_timer_t* timer, void* arg)
+{
+  rudp_sent_t* sent = arg;
+
+  rudp_t* rudp = sent->rudp;
+
+  if(sent->acked) return;
+
+  rudp->stats.timeouts++;
+
+  // The packets after the first one time out in the same round
+  if(sent->seq == rudp->send_unacked)
+  {
+    rudp->rto *= 2;
+
+    if(rudp->rto > RUDP_RTO_MAX) rudp->rto = RUDP_RTO_MAX;
+  }
+
+  sent->fast = false;
+
+  queue_push(rudp, sent);
+}
+
+/*
+ * Send the missing packets again, that were sent before an acknowledged
+ * packet, and have waited for their round trip and the reorder window,
+ * without waiting for the timeout
+ *
+ * The reorder timer is armed for the first packet that is still
+ * in its reorder window
+ */
+static void lost_resend(rudp_t* rudp, uint64_t now)
+{
+  uint64_t deadline_min = 0;
+
+  uint64_t window = reorder_window_get(rudp);
+
+  for(uint32_t seq = rudp->send_unacked; seq_before(seq, rudp->send_next); seq++)
+  {
+    rudp_sent_t* sent = &rudp->sent[seq & RUDP_WINDOW_MASK];
+
+    if(sent->acked || sent->fast || sent->queued || sent->sends == 0) continue;
+
+    // Only a packet that was sent before an acknowledged one can be lost
+    if(sent->time >= rudp->rack_time) continue;
+
+    uint64_t deadline = sent->time + rudp->rack_rtt + window;
+
+    if(now < deadline)
+    {
+      if(deadline_min == 0 || deadline < deadline_min) deadline_min = deadline;
+
+      continue;
+    }
+
+    sent->fast = true;
+
+    queue_push(rudp, sent);
+  }
+
+  if(deadline_min != 0) wheel_timer_arm(rudp->wheel, &rudp->reorder, deadline_min - now);
+}
+
+/*
+ * Look for lost packets again, when a reorder window has passed
+ */
+static void reorder_routine(wheel_timer_t* timer, void* arg)
+{
+  rudp_t* rudp = arg;
+
+  wheel_t* wheel = rudp->wheel;
+
+  lost_resend(rudp, wheel->start + wheel->tick * wheel->tick_size);
+}
+
+/*
+ * Create a connection, that sends at most rate bytes a second
+ *
+ * The timers of the connection are armed in wheel,
+ * and it is only used by the thread of the wheel
+ *
+ * RETURN (rudp_t* rudp)
+ * - NULL | Failed to allocate memory
+ */
+rudp_t* rudp_create(wheel_t* wheel, double rate, rudp_output_t output, rudp_deliver_t deliver, void* arg, uint64_t now)
+{
+  rudp_t* rudp = calloc(1, sizeof(rudp_t));
+
+  if(!rudp) return NULL;
+
+  rudp->wheel   = wheel;
+  rudp->output  = output;
+  rudp->deliver = deliver;
+  rudp->arg     = arg;
+  rudp->rto     = RUDP_RTO_INIT;
+
+  rudp->reorder_steps = 1;
+
+  if(getrandom(&rudp->conn, sizeof(rudp->conn), 0) != sizeof(rudp->conn))
+  {
+    rudp->conn = (uint32_t) (now ^ (now >> 32));
+  }
+
+  bucket_init(&rudp->pacer, rate, RUDP_PACE_BURST * RUDP_DATAGRAM_MAX, now);
+
+  for(size_t index = 0; index < RUDP_WINDOW; index++)
+  {
+    rudp_sent_t* sent = &rudp->sent[index];
+
+    sent->rudp  = rudp;
+    sent->acked = true;
+
+    wheel_timer_init(&sent->timer, timeout_routine, sent);
+  }
+
+  wheel_timer_init(&rudp->reorder, reorder_routine, rudp);
+
+  return rudp;
+}
+
+/*
+ * Free a connection, and cancel its timers
+ */
+void rudp_free(rudp_t** rudp)
+{
+  if(!rudp || !(*rudp)) return;
+
+  for(size_t index = 0; index < RUDP_WINDOW; index++)
+  {
+    wheel_timer_cancel((*rudp)->wheel, &(*rudp)->sent[index].timer);
+  }
+
+  wheel_timer_cancel((*rudp)->wheel, &(*rudp)->reorder);
+
+  for(size_t index = 0; index < RUDP_STREAMS; index++)
+  {
+    free((*rudp)->streams[index].message);
+  }
+
+  free(*rudp);
+
+  *rudp = NULL;
+}
+
+/*
+ * Get the number of packets that can be sent before the window is full
+ */
+size_t rudp_space_get(const rudp_t* rudp)
+{
+  return RUDP_WINDOW - (uint32_t) (rudp->send_next - rudp->send_unacked);
+}
+
+/*
+ * Check if every packet is acknowledged, and nothing waits to be sent
+ */
+bool rudp_idle(const rudp_t* rudp)
+{
+  return rudp->send_unacked == rudp->send_next && rudp->queue_count == 0 && !rudp->ack_pending;
+}
+
+/*
+ * Send a message on a stream, as packets that wait for rudp_flush
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad stream or message size
+ * - 2 | The window has no space for the message
+ */
+int rudp_send(rudp_t* rudp, uint16_t stream, const void* message, size_t size, uint64_t now)
+{
+  if(stream >= RUDP_STREAMS || size > RUDP_MESSAGE_MAX) return 1;
+
+  size_t count = (size == 0) ? 1 : (size + RUDP_DATA_MAX - 1) / RUDP_DATA_MAX;
+
+  if(count > rudp_space_get(rudp)) return 2;
+
+  const uint8_t* data = message;
+
+  for(size_t index = 0; index < count; index++)
+  {
+    size_t part = size - index * RUDP_DATA_MAX;
+
+    if(part > RUDP_DATA_MAX) part = RUDP_DATA_MAX;
+
+    rudp_sent_t* sent = &rudp->sent[rudp->send_next & RUDP_WINDOW_MASK];
+
+    sent->seq    = rudp->send_next++;
+    sent->index  = rudp->streams[stream].send_index++;
+    sent->stream = stream;
+    sent->size   = part;
+    sent->flags  = (index + 1 == count) ? RUDP_FLAG_END : 0;
+    sent->sends  = 0;
+    sent->acked  = false;
+    sent->fast   = false;
+
+    memcpy(sent->data, data + index * RUDP_DATA_MAX, part);
+
+    queue_push(rudp, sent);
+  }
+
+  return 0;
+}
+
+/*
+ * Send a packet, and arm its retransmission timeout
+ */
+static void sent_transmit(rudp_t* rudp, rudp_sent_t* sent, uint64_t now)
+{
+  uint8_t datagram[RUDP_DATAGRAM_MAX];
+
+  number_write(datagram,      rudp->conn,   4);
+  number_write(datagram + 4,  RUDP_DATA,    1);
+  number_write(datagram + 5,  sent->flags,  1);
+  number_write(datagram + 6,  sent->stream, 2);
+  number_write(datagram + 8,  sent->seq,    4);
+  number_write(datagram + 12, sent->index,  4);
+
+  memcpy(datagram + RUDP_HEAD_SIZE, sent->data, sent->size);
+
+  if(sent->sends == 0) rudp->stats.sent++;
+  else                 rudp->stats.resent++;
+
+  sent->time = now;
+
+  if(sent->sends < UINT8_MAX) sent->sends++;
+
+  wheel_timer_arm(rudp->wheel, &sent->timer, rudp->rto);
+
+  rudp->output(rudp->arg, datagram, RUDP_HEAD_SIZE + sent->size);
+}
+
+/*
+ * Send an acknowledgement of what has been recieved,
+ * with blocks of the packets after the first missing one
+ */
+static void ack_send(rudp_t* rudp)
+{
+  uint8_t datagram[RUDP_DATAGRAM_MAX];
+
+  size_t count = 0;
+
+  uint8_t* block = datagram + RUDP_HEAD_SIZE;
+
+  uint32_t seq = rudp->recv_next;
+
+  while(seq_before(seq, rudp->recv_highest) && count < RUDP_SACK_MAX)
+  {
+    const rudp_recvd_t* recvd = &rudp->recvd[seq & RUDP_WINDOW_MASK];
+
+    if(!recvd->used || recvd->seq != seq)
+    {
+      seq++;
+
+      continue;
+    }
+
+    uint32_t start = seq;
+
+    while(seq_before(seq, rudp->recv_highest) &&
+          rudp->recvd[seq & RUDP_WINDOW_MASK].used &&
+          rudp->recvd[seq & RUDP_WINDOW_MASK].seq == seq) seq++;
+
+    number_write(block,     start, 4);
+    number_write(block + 4, seq,   4);
+
+    block += 8;
+
+    count++;
+  }
+
+  number_write(datagram,      rudp->conn,      4);
+  number_write(datagram + 4,  RUDP_ACK,        1);
+  number_write(datagram + 5,  count,           1);
+  number_write(datagram + 6,  0,               2);
+  number_write(datagram + 8,  rudp->recv_next, 4);
+  number_write(datagram + 12, 0,               4);
+
+  rudp->ack_pending = false;
+
+  rudp->stats.acks++;
+
+  rudp->output(rudp->arg, datagram, RUDP_HEAD_SIZE + count * 8);
+}
+
+/*
+ * Send the acknowledgement, if packets have been recieved,
+ * and the packets that wait, as fast as the pacer lets them
+ *
+ * This is called after rudp_input, rudp_send and advancing the wheel
+ *
+ * RETURN (uint64_t wait)
+ * - 0  | Nothing waits for the pacer
+ * - >0 | Nanoseconds until the pacer lets the next packet go
+ */
+uint64_t rudp_flush(rudp_t* rudp, uint64_t now)
+{
+  if(rudp->ack_pending) ack_send(rudp);
+
+  while(rudp->queue_count > 0)
+  {
+    rudp_sent_t* sent = &rudp->sent[rudp->queue[rudp->queue_head] & RUDP_WINDOW_MASK];
+
+    if(!sent->acked)
+    {
+      uint64_t wait = bucket_wait_get(&rudp->pacer, RUDP_HEAD_SIZE + sent->size, now);
+
+      if(wait > 0) return wait;
+
+      bucket_take(&rudp->pacer, RUDP_HEAD_SIZE + sent->size, now);
+    }
+
+    rudp->queue_head = (rudp->queue_head + 1) & RUDP_WINDOW_MASK;
+
+    rudp->queue_count--;
+
+    sent->queued = false;
+
+    if(!sent->acked) sent_transmit(rudp, sent, now);
+  }
+
+  return 0;
+}
+
+/*
+ * Mark the sent packets from start to end as acknowledged
+ */
+static void acked_range(rudp_t* rudp, uint32_t start, uint32_t end, uint64_t now)
+{
+  if(seq_before(start, rudp->send_unacked)) start = rudp->send_unacked;
+
+  if(seq_before(rudp->send_next, end)) end = rudp->send_next;
+
+  for(uint32_t seq = start; seq_before(seq, end); seq++)
+  {
+    rudp_sent_t* sent = &rudp->sent[seq & RUDP_WINDOW_MASK];
+
+    if(sent->acked) continue;
+
+    sent->acked = true;
+
+    wheel_timer_cancel(rudp->wheel, &sent->timer);
+
+    // Only a packet that was sent once has an unambiguous round trip
+    if(sent->sends == 1) rtt_sample(rudp, now - sent->time);
+
+    // A packet that was sent again and is acknowledged faster than a round trip
+    // was only reordered, so the reorder window was too short
+    else if(sent->fast && now - sent->time < rudp->min_rtt)
+    {
+      if(!rudp->reorder_seen) rudp->reorder_seen = true;
+
+      else if(reorder_window_get(rudp) < rudp->srtt) rudp->reorder_steps++;
+    }
+
+    // A packet that comes after a later one was reordered
+    if(sent->sends == 1 && sent->time < rudp->rack_time) rudp->reorder_seen = true;
+
+    // A packet that was sent again, and is acknowledged faster than
+    // a round trip, was acknowledged for an earlier send
+    if(sent->time >= rudp->rack_time && (sent->sends == 1 || now - sent->time >= rudp->min_rtt))
+    {
+      rudp->rack_time = sent->time;
+      rudp->rack_rtt  = now - sent->time;
+    }
+
+    if(!seq_before(seq, rudp->send_highest)) rudp->send_highest = seq + 1;
+  }
+}
+
+/*
+ * Handle an acknowledgement from the peer
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad acknowledgement
+ */
+static int ack_handle(rudp_t* rudp, const uint8_t* datagram, size_t size, uint64_t now)
+{
+  size_t count = number_read(datagram + 5, 1);
+
+  if(size != RUDP_HEAD_SIZE + count * 8) return 1;
+
+  uint32_t next = number_read(datagram + 8, 4);
+
+  acked_range(rudp, rudp->send_unacked, next, now);
+
+  const uint8_t* block = datagram + RUDP_HEAD_SIZE;
+
+  for(size_t index = 0; index < count; index++, block += 8)
+  {
+    acked_range(rudp, number_read(block, 4), number_read(block + 4, 4), now);
+  }
+
+  while(rudp->send_unacked != rudp->send_next &&
+        rudp->sent[rudp->send_unacked & RUDP_WINDOW_MASK].acked) rudp->send_unacked++;
+
+  if(seq_before(rudp->send_highest, rudp->send_unacked)) rudp->send_highest = rudp->send_unacked;
+
+  lost_resend(rudp, now);
+
+  return 0;
+}
+
+/*
+ * Add a packet to the message of its stream,
+ * and deliver the message after its last packet
+ */
+static void packet_deliver(rudp_t* rudp, rudp_stream_t* stream, const rudp_recvd_t* recvd)
+{
+  bool is_end = (recvd->flags & RUDP_FLAG_END);
+
+  // A message of one packet is delivered without a copy
+  if(stream->size == 0 && !stream->broken && is_end)
+  {
+    rudp->stats.delivered++;
+
+    rudp->deliver(rudp->arg, recvd->stream, recvd->data, recvd->size);
+
+    return;
+  }
+
+  if(!stream->message && !(stream->message = malloc(RUDP_MESSAGE_MAX)))
+  {
+    stream->broken = true;
+  }
+
+  if(stream->size + recvd->size > RUDP_MESSAGE_MAX) stream->broken = true;
+
+  if(!stream->broken)
+  {
+    memcpy(stream->message + stream->size, recvd->data, recvd->size);
+
+    stream->size += recvd->size;
+  }
+
+  if(!is_end) return;
+
+  if(!stream->broken)
+  {
+    rudp->stats.delivered++;
+
+    rudp->deliver(rudp->arg, recvd->stream, stream->message, stream->size);
+  }
+
+  stream->size   = 0;
+  stream->broken = false;
+}
+
+/*
+ * Deliver the recieved packets of a stream that are next in order
+ *
+ * Packets of a stream have increasing packet numbers,
+ * so a waiting packet is always after the first missing one
+ */
+static void stream_deliver(rudp_t* rudp, uint16_t number)
+{
+  rudp_stream_t* stream = &rudp->streams[number];
+
+  bool is_found = true;
+
+  while(is_found)
+  {
+    is_found = false;
+
+    for(uint32_t seq = rudp->recv_next; seq_before(seq, rudp->recv_highest); seq++)
+    {
+      rudp_recvd_t* recvd = &rudp->recvd[seq & RUDP_WINDOW_MASK];
+
+      if(!recvd->used || recvd->seq != seq || recvd->delivered) continue;
+
+      if(recvd->stream != number || recvd->index != stream->recv_index) continue;
+
+      recvd->delivered = true;
+
+      stream->recv_index++;
+
+      packet_deliver(rudp, stream, recvd);
+
+      is_found = true;
+
+      break;
+    }
+  }
+}
+
+/*
+ * Handle a packet of data from the peer
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad packet
+ */
+static int data_handle(rudp_t* rudp, const uint8_t* datagram, size_t size)
+{
+  uint16_t stream = number_read(datagram + 6, 2);
+
+  if(stream >= RUDP_STREAMS || size - RUDP_HEAD_SIZE > RUDP_DATA_MAX) return 1;
+
+  uint32_t seq = number_read(datagram + 8, 4);
+
+  // The acknowledgement of a packet may have been lost, so it is sent again
+  rudp->ack_pending = true;
+
+  if(seq_before(seq, rudp->recv_next))
+  {
+    rudp->stats.duplicates++;
+
+    return 0;
+  }
+
+  // The peer sends nothing after its window
+  if((uint32_t) (seq - rudp->recv_next) >= RUDP_WINDOW) return 1;
+
+  rudp_recvd_t* recvd = &rudp->recvd[seq & RUDP_WINDOW_MASK];
+
+  if(recvd->used && recvd->seq == seq)
+  {
+    rudp->stats.duplicates++;
+
+    return 0;
+  }
+
+  recvd->seq       = seq;
+  recvd->index     = number_read(datagram + 12, 4);
+  recvd->stream    = stream;
+  recvd->flags     = number_read(datagram + 5, 1);
+  recvd->size      = size - RUDP_HEAD_SIZE;
+  recvd->used      = true;
+  recvd->delivered = false;
+
+  memcpy(recvd->data, datagram + RUDP_HEAD_SIZE, recvd->size);
+
+  if(!seq_before(seq, rudp->recv_highest)) rudp->recv_highest = seq + 1;
+
+  // Every packet before the first missing one has been delivered
+  stream_deliver(rudp, stream);
+
+  while(rudp->recvd[rudp->recv_next & RUDP_WINDOW_MASK].used &&
+        rudp->recvd[rudp->recv_next & RUDP_WINDOW_MASK].seq == rudp->recv_next)
+  {
+    rudp->recvd[rudp->recv_next & RUDP_WINDOW_MASK].used = false;
+
+    rudp->recv_next++;
+  }
+
+  return 0;
+}
+
+/*
+ * Handle a datagram from the peer
+ *
+ * The first datagram gives the id of the peer, and a datagram
+ * of another id is from a peer that has started over
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad datagram
+ * - 2 | The datagram is from another connection
+ */
+int rudp_input(rudp_t* rudp, const uint8_t* datagram, size_t size, uint64_t now)
+{
+  if(size < RUDP_HEAD_SIZE) return 1;
+
+  uint32_t conn = number_read(datagram, 4);
+
+  if(!rudp->peer_known)
+  {
+    rudp->peer_conn  = conn;
+    rudp->peer_known = true;
+  }
+  else if(conn != rudp->peer_conn) return 2;
+
+  switch(number_read(datagram + 4, 1))
+  {
+    case RUDP_DATA:
+      return data_handle(rudp, datagram, size);
+
+    case RUDP_ACK:
+      return ack_handle(rudp, datagram, size, now);
+
+    default:
+      return 1;
+  }
+}
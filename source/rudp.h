@@ -0,0 +1,211 @@
+/*
+ * rudp.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef RUDP_H
+#define RUDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "wheel.h"
+#include "limit.h"
+
+/*
+ * A reliable connection over datagrams, that delivers the messages
+ * of a stream in order, but lets no stream wait for another, so a
+ * lost packet only holds back the later messages of its own stream
+ *
+ * The connection has no socket. It hands its datagrams to output,
+ * and is handed the datagrams of the peer with rudp_input, so the
+ * same connection runs over a UDP socket or a lossy test harness
+ *
+ * DATA (RUDP_HEAD_SIZE bytes, and up to RUDP_DATA_MAX bytes of data)
+ * - uint32_t conn   | The id of the sending connection
+ * - uint8_t  type   | RUDP_DATA
+ * - uint8_t  flags  | RUDP_FLAG_END on the last packet of a message
+ * - uint16_t stream | The stream of the message
+ * - uint32_t seq    | The packet number of the connection
+ * - uint32_t index  | The packet number of the stream
+ *
+ * ACK (RUDP_HEAD_SIZE bytes, and count blocks)
+ * - uint32_t conn   | The id of the sending connection
+ * - uint8_t  type   | RUDP_ACK
+ * - uint8_t  count  | The number of blocks
+ * - uint16_t unused | 0
+ * - uint32_t next   | Every packet before next is received
+ * - uint32_t unused | 0
+ * - blocks of uint32_t start and end, of packets after next that
+ *   are received, so that only the missing packets are sent again
+ *
+ * Numbers are big endian, and packet numbers wrap around
+ */
+#define RUDP_HEAD_SIZE     16
+
+#define RUDP_DATA_MAX      1200
+
+#define RUDP_DATAGRAM_MAX  (RUDP_HEAD_SIZE + RUDP_DATA_MAX)
+
+#define RUDP_DATA          1
+#define RUDP_ACK           2
+
+#define RUDP_FLAG_END      0x01
+
+/*
+ * The packets that may be in flight, and the packets that may be
+ * recieved ahead of a missing one, must be a power of two
+ */
+#define RUDP_WINDOW        256
+
+#define RUDP_STREAMS       16
+
+/*
+ * The largest message, that is bigger than any frame
+ */
+#define RUDP_MESSAGE_MAX   (128 * 1024)
+
+#define RUDP_SACK_MAX      ((RUDP_DATAGRAM_MAX - RUDP_HEAD_SIZE) / 8)
+
+/*
+ * The retransmission timeout, like RTO of RFC 6298, in nanoseconds
+ *
+ * The minimum is lower than the one second of the RFC, because
+ * the timer is only the fallback of the selective acknowledgements
+ */
+#define RUDP_RTO_INIT      250000000ULL
+#define RUDP_RTO_MIN       10000000ULL
+#define RUDP_RTO_MAX       2000000000ULL
+
+/*
+ * A packet is lost, like RACK of RFC 8985, when a packet that was sent
+ * after it is acknowledged, and the round trip of that packet and
+ * the reorder window have passed since it was sent. The reorder window
+ * is steps of the smallest round trip shifted right by RUDP_REORDER_SHIFT,
+ * so that reordered packets are not sent again. A step is added every
+ * time a packet was sent again for nothing, up to the smoothed round trip.
+ * Until a packet has come after a later one, the window is 0
+ */
+#define RUDP_REORDER_SHIFT 2
+
+/*
+ * The pacer lets this many datagrams go in a burst
+ */
+#define RUDP_PACE_BURST    16
+
+typedef struct rudp_t rudp_t;
+
+typedef void (*rudp_output_t)(void* arg, const uint8_t* datagram, size_t size);
+
+typedef void (*rudp_deliver_t)(void* arg, uint16_t stream, const uint8_t* message, size_t size);
+
+/*
+ * A sent packet, that is kept until it is acknowledged
+ */
+typedef struct
+{
+  wheel_timer_t timer;   // The retransmission timeout
+  rudp_t*       rudp;
+  uint64_t      time;    // When the packet was last sent
+  uint32_t      seq;
+  uint32_t      index;
+  uint16_t      stream;
+  uint16_t      size;
+  uint8_t       flags;
+  uint8_t       sends;   // Times the packet has been sent
+  bool          acked;
+  bool          queued;  // The packet waits for the pacer
+  bool          fast;    // The packet has been sent again by the acknowledgements
+  uint8_t       data[RUDP_DATA_MAX];
+} rudp_sent_t;
+
+/*
+ * A recieved packet, that is kept until it is delivered
+ */
+typedef struct
+{
+  uint32_t seq;
+  uint32_t index;
+  uint16_t stream;
+  uint16_t size;
+  uint8_t  flags;
+  bool     used;
+  bool     delivered;
+  uint8_t  data[RUDP_DATA_MAX];
+} rudp_recvd_t;
+
+typedef struct
+{
+  uint32_t send_index;  // The packet number of the next sent packet
+  uint32_t recv_index;  // The packet number of the next delivered packet
+  uint8_t* message;     // The packets of a message that is not complete
+  size_t   size;
+  bool     broken;      // The message is too big, and is dropped
+} rudp_stream_t;
+
+/*
+ * The counters of a connection
+ */
+typedef struct
+{
+  uint64_t sent;         // Packets sent for the first time
+  uint64_t resent;       // Packets sent again
+  uint64_t timeouts;     // Of the resent, after a timeout
+  uint64_t duplicates;   // Packets that were already recieved
+  uint64_t acks;         // Acknowledgements sent
+  uint64_t delivered;    // Messages delivered
+} rudp_stats_t;
+
+struct rudp_t
+{
+  rudp_sent_t    sent[RUDP_WINDOW];
+  rudp_recvd_t   recvd[RUDP_WINDOW];
+  rudp_stream_t  streams[RUDP_STREAMS];
+  uint32_t       queue[RUDP_WINDOW];  // Packets that wait for the pacer
+  size_t         queue_head;
+  size_t         queue_count;
+  uint32_t       send_next;           // The next new packet
+  uint32_t       send_unacked;        // The first packet that is not acknowledged
+  uint32_t       send_highest;        // After the last acknowledged packet
+  uint32_t       recv_next;           // The first packet that is not recieved
+  uint32_t       recv_highest;        // After the last recieved packet
+  uint32_t       conn;
+  uint32_t       peer_conn;
+  bool           peer_known;
+  bool           ack_pending;
+  uint64_t       srtt;                // Nanoseconds, 0 before the first sample
+  uint64_t       rttvar;
+  uint64_t       rto;
+  uint64_t       min_rtt;             // The smallest round trip, 0 before the first sample
+  uint64_t       rack_time;           // When the last sent of the acknowledged packets was sent
+  uint64_t       rack_rtt;            // The round trip of that packet
+  uint32_t       reorder_steps;       // Of the reorder window
+  bool           reorder_seen;        // A packet has been acknowledged after a later one
+  wheel_timer_t  reorder;             // Looks for lost packets when a reorder window has passed
+  bucket_t       pacer;               // Bytes a second
+  wheel_t*       wheel;
+  rudp_output_t  output;
+  rudp_deliver_t deliver;
+  void*          arg;
+  rudp_stats_t   stats;
+};
+
+extern rudp_t*  rudp_create(wheel_t* wheel, double rate, rudp_output_t output, rudp_deliver_t deliver, void* arg, uint64_t now);
+
+extern void     rudp_free(rudp_t** rudp);
+
+extern int      rudp_send(rudp_t* rudp, uint16_t stream, const void* message, size_t size, uint64_t now);
+
+extern int      rudp_input(rudp_t* rudp, const uint8_t* datagram, size_t size, uint64_t now);
+
+extern uint64_t rudp_flush(rudp_t* rudp, uint64_t now);
+
+extern size_t   rudp_space_get(const rudp_t* rudp);
+
+extern bool     rudp_idle(const rudp_t* rudp);
+
+#endif // RUDP_H
@@ -0,0 +1,211 @@
+/*
+ * shm.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#define _GNU_SOURCE
+
+#include "shm.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+/*
+ * Wake the other side, that waits on the eventfd
+ */
+static inline void shm_signal(int fd)
+{
+  uint64_t value = 1;
+
+  // The write only fails if the counter is full, and then it is readable
+  while(write(fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+/*
+ * Sleep until the other side writes the eventfd
+ */
+static inline void shm_sleep(int fd)
+{
+  uint64_t value;
+
+  while(read(fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+/*
+ * Create a pipe, with a ring of at least size bytes
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create memfd
+ * - 2 | Failed to map memory
+ * - 3 | Failed to create eventfds
+ */
+int shm_pipe_create(shm_pipe_t* pipe, size_t size)
+{
+  size_t power = 4096;
+
+  while(power < size) power <<= 1;
+
+  *pipe = (shm_pipe_t) { .size = power, .memfd = -1, .data_fd = -1, .space_fd = -1 };
+
+  size_t memory_size = sizeof(shm_ring_t) + power;
+
+  if((pipe->memfd = memfd_create("bunker-shm", MFD_CLOEXEC)) == -1) return 1;
+
+  if(ftruncate(pipe->memfd, memory_size) == -1)
+  {
+    shm_pipe_free(pipe);
+
+    return 1;
+  }
+
+  void* memory = mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, pipe->memfd, 0);
+
+  if(memory == MAP_FAILED)
+  {
+    shm_pipe_free(pipe);
+
+    return 2;
+  }
+
+  pipe->ring = memory;
+
+  atomic_init(&pipe->ring->head, 0);
+  atomic_init(&pipe->ring->tail, 0);
+  atomic_init(&pipe->ring->reader_waiting, 0);
+  atomic_init(&pipe->ring->writer_waiting, 0);
+
+  pipe->data_fd  = eventfd(0, EFD_CLOEXEC);
+  pipe->space_fd = eventfd(0, EFD_CLOEXEC);
+
+  if(pipe->data_fd == -1 || pipe->space_fd == -1)
+  {
+    shm_pipe_free(pipe);
+
+    return 3;
+  }
+
+  return 0;
+}
+
+/*
+ * Unmap the ring of a pipe, and close its fds
+ */
+void shm_pipe_free(shm_pipe_t* pipe)
+{
+  if(pipe->ring) munmap(pipe->ring, sizeof(shm_ring_t) + pipe->size);
+
+  if(pipe->memfd    != -1) close(pipe->memfd);
+  if(pipe->data_fd  != -1) close(pipe->data_fd);
+  if(pipe->space_fd != -1) close(pipe->space_fd);
+
+  *pipe = (shm_pipe_t) { .memfd = -1, .data_fd = -1, .space_fd = -1 };
+}
+
+/*
+ * Write every byte to the ring, and sleep while it is full
+ *
+ * RETURN (ssize_t size)
+ * - The number of written bytes, which is always size
+ */
+ssize_t shm_pipe_write(shm_pipe_t* pipe, const void* data, size_t size)
+{
+  shm_ring_t* ring = pipe->ring;
+
+  const uint8_t* bytes = data;
+
+  size_t written = 0;
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  while(written < size)
+  {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    size_t space = pipe->size - (tail - head);
+
+    if(space == 0)
+    {
+      atomic_store(&ring->writer_waiting, 1);
+
+      // The reader might have made space before it saw the flag
+      if(atomic_load(&ring->head) == head) shm_sleep(pipe->space_fd);
+
+      atomic_store(&ring->writer_waiting, 0);
+      continue;
+    }
+
+    size_t length = (size - written < space) ? size - written : space;
+
+    size_t offset = tail & (pipe->size - 1);
+
+    size_t first = (length < pipe->size - offset) ? length : pipe->size - offset;
+
+    memcpy(ring->data + offset, bytes + written, first);
+
+    memcpy(ring->data, bytes + written + first, length - first);
+
+    tail += length;
+
+    written += length;
+
+    atomic_store(&ring->tail, tail);
+
+    if(atomic_load(&ring->reader_waiting) && atomic_exchange(&ring->reader_waiting, 0))
+    {
+      shm_signal(pipe->data_fd);
+    }
+  }
+
+  return written;
+}
+
+/*
+ * Read at most size bytes from the ring, and sleep while it is empty
+ *
+ * RETURN (ssize_t size)
+ * - The number of read bytes, at least 1
+ */
+ssize_t shm_pipe_read(shm_pipe_t* pipe, void* buffer, size_t size)
+{
+  shm_ring_t* ring = pipe->ring;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  size_t tail;
+
+  while((tail = atomic_load_explicit(&ring->tail, memory_order_acquire)) == head)
+  {
+    atomic_store(&ring->reader_waiting, 1);
+
+    // The writer might have written before it saw the flag
+    if(atomic_load(&ring->tail) == head) shm_sleep(pipe->data_fd);
+
+    atomic_store(&ring->reader_waiting, 0);
+  }
+
+  size_t length = (tail - head < size) ? tail - head : size;
+
+  size_t offset = head & (pipe->size - 1);
+
+  size_t first = (length < pipe->size - offset) ? length : pipe->size - offset;
+
+  memcpy(buffer, ring->data + offset, first);
+
+  memcpy((uint8_t*) buffer + first, ring->data, length - first);
+
+  atomic_store(&ring->head, head + length);
+
+  if(atomic_load(&ring->writer_waiting) && atomic_exchange(&ring->writer_waiting, 0))
+  {
+    shm_signal(pipe->space_fd);
+  }
+
+  return length;
+}
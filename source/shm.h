@@ -0,0 +1,55 @@
+/*
+ * shm.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * A byte ring in shared memory, written by one process and read by another
+ *
+ * The ring is in a memfd, so it is shared with a forked child,
+ * or with another process that is sent the memfd and the eventfds
+ * over a unix socket. A pair of pipes is a duplex channel.
+ *
+ * A side that can't go on sets its waiting flag, checks the ring
+ * again and then sleeps on its eventfd. The other side wakes it
+ * after it has moved its index, if the flag is set. Both the flags
+ * and the indices are sequentially consistent, so no wakeup is lost
+ */
+typedef struct
+{
+  _Alignas(64) atomic_size_t head;           // Written by the reader
+  atomic_int                 reader_waiting;
+  _Alignas(64) atomic_size_t tail;           // Written by the writer
+  atomic_int                 writer_waiting;
+  _Alignas(64) uint8_t       data[];
+} shm_ring_t;
+
+typedef struct
+{
+  shm_ring_t* ring;
+  size_t      size;      // Bytes of data, a power of two
+  int         memfd;
+  int         data_fd;   // Written when there is data for a waiting reader
+  int         space_fd;  // Written when there is space for a waiting writer
+} shm_pipe_t;
+
+extern int     shm_pipe_create(shm_pipe_t* pipe, size_t size);
+
+extern void    shm_pipe_free(shm_pipe_t* pipe);
+
+extern ssize_t shm_pipe_write(shm_pipe_t* pipe, const void* data, size_t size);
+
+extern ssize_t shm_pipe_read(shm_pipe_t* pipe, void* buffer, size_t size);
+
+#endif // SHM_H
@@ -0,0 +1,338 @@
+/*
+ * slab.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#define _GNU_SOURCE
+
+#define DEBUG_SUBSYSTEM DEBUG_ROOM
+#include "debug.h"
+
+#include "slab.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * The items of a chunk start after the head, on a cache line
+ */
+#define SLAB_ITEMS_OFFSET ((sizeof(slab_chunk_t) + 63) & ~(size_t) 63)
+
+/*
+ * Map a chunk, that is aligned to SLAB_CHUNK_SIZE
+ *
+ * With SLAB_HUGE, a huge page is mapped if there are any reserved,
+ * and else the kernel is asked to use a transparent huge page
+ *
+ * RETURN (slab_chunk_t* chunk)
+ * - NULL | Failed to map chunk
+ */
+static slab_chunk_t* slab_chunk_map(int flags)
+{
+#ifdef MAP_HUGETLB
+  if(flags & SLAB_HUGE)
+  {
+    void* memory = mmap(NULL, SLAB_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    // Huge pages are aligned to their size
+    if(memory != MAP_FAILED) return memory;
+  }
+#endif
+
+  // Map twice the size, and unmap what is outside of the aligned chunk
+  uint8_t* memory = mmap(NULL, SLAB_CHUNK_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if(memory == MAP_FAILED) return NULL;
+
+  uint8_t* chunk = (uint8_t*) (((uintptr_t) memory + SLAB_CHUNK_SIZE - 1) & ~(uintptr_t) (SLAB_CHUNK_SIZE - 1));
+
+  if(chunk > memory) munmap(memory, chunk - memory);
+
+  size_t after = (memory + SLAB_CHUNK_SIZE * 2) - (chunk + SLAB_CHUNK_SIZE);
+
+  if(after > 0) munmap(chunk + SLAB_CHUNK_SIZE, after);
+
+#ifdef MADV_HUGEPAGE
+  if(flags & SLAB_HUGE) madvise(chunk, SLAB_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+
+  return (slab_chunk_t*) chunk;
+}
+
+/*
+ * Remove a chunk from a list
+ */
+static void slab_chunk_unlink(slab_chunk_t** list, slab_chunk_t* chunk)
+{
+  if(chunk->prev) chunk->prev->next = chunk->next;
+
+  else *list = chunk->next;
+
+  if(chunk->next) chunk->next->prev = chunk->prev;
+
+  chunk->prev = NULL;
+  chunk->next = NULL;
+}
+
+/*
+ * Add a chunk first in a list
+ */
+static void slab_chunk_link(slab_chunk_t** list, slab_chunk_t* chunk)
+{
+  chunk->prev = NULL;
+  chunk->next = *list;
+
+  if(*list) (*list)->prev = chunk;
+
+  *list = chunk;
+}
+
+/*
+ * Map a new chunk for a slab, and make it the first partial chunk
+ *
+ * The items are not touched, they are carved when they are needed,
+ * so the pages of a chunk are only used as it fills up
+ *
+ * RETURN (slab_chunk_t* chunk)
+ * - NULL | Failed to map chunk
+ */
+static slab_chunk_t* slab_chunk_create(slab_t* slab)
+{
+  slab_chunk_t* chunk = slab_chunk_map(slab->flags);
+
+  if(!chunk)
+  {
+    error_print("Failed to map slab chunk of %zu bytes", (size_t) SLAB_CHUNK_SIZE);
+
+    return NULL;
+  }
+
+  chunk->slab   = slab;
+  chunk->free   = NULL;
+  chunk->used   = 0;
+  chunk->carved = 0;
+
+  slab_chunk_link(&slab->partial, chunk);
+
+  slab->chunk_count++;
+
+  return chunk;
+}
+
+/*
+ * Get the size class of a size
+ *
+ * RETURN (int class)
+ * - >=0 | The index of the class
+ * -  -1 | The size is larger than SLAB_SIZE_MAX
+ */
+static int slab_class_get(size_t size)
+{
+  if(size > SLAB_SIZE_MAX) return -1;
+
+  if(size <= SLAB_SIZE_MIN) return 0;
+
+  // The number of bits of size - 1, less those of SLAB_SIZE_MIN - 1
+  return (64 - __builtin_clzll(size - 1)) - __builtin_ctz(SLAB_SIZE_MIN);
+}
+
+/*
+ * Create a pool with a slab for every size class
+ *
+ * No chunks are mapped until the first allocation of a class
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ */
+int slab_pool_create(slab_pool_t* pool, int flags)
+{
+  if(!pool) return 1;
+
+  pool->flags = flags;
+
+  for(int class = 0; class < SLAB_CLASS_COUNT; class++)
+  {
+    slab_t* slab = &pool->slabs[class];
+
+    slab->size        = (size_t) SLAB_SIZE_MIN << class;
+    slab->count       = (SLAB_CHUNK_SIZE - SLAB_ITEMS_OFFSET) / slab->size;
+    slab->partial     = NULL;
+    slab->full        = NULL;
+    slab->chunk_count = 0;
+    slab->in_use      = 0;
+    slab->high_water  = 0;
+    slab->flags       = flags;
+  }
+
+  return 0;
+}
+
+/*
+ * Unmap every chunk of the pool
+ *
+ * Items that are still allocated are lost
+ */
+void slab_pool_free(slab_pool_t* pool)
+{
+  if(!pool) return;
+
+  for(int class = 0; class < SLAB_CLASS_COUNT; class++)
+  {
+    slab_t* slab = &pool->slabs[class];
+
+    slab_chunk_t* lists[2] = { slab->partial, slab->full };
+
+    for(int index = 0; index < 2; index++)
+    {
+      slab_chunk_t* chunk = lists[index];
+
+      while(chunk)
+      {
+        slab_chunk_t* next = chunk->next;
+
+        munmap(chunk, SLAB_CHUNK_SIZE);
+
+        chunk = next;
+      }
+    }
+
+    slab->partial     = NULL;
+    slab->full        = NULL;
+    slab->chunk_count = 0;
+    slab->in_use      = 0;
+  }
+}
+
+/*
+ * Allocate an item of at least size bytes
+ *
+ * RETURN (void* item)
+ * - NULL | Too large, or failed to map chunk
+ */
+void* slab_alloc(slab_pool_t* pool, size_t size)
+{
+  int class = slab_class_get(size);
+
+  if(class < 0) return NULL;
+
+  slab_t* slab = &pool->slabs[class];
+
+  slab_chunk_t* chunk = slab->partial;
+
+  if(!chunk && !(chunk = slab_chunk_create(slab))) return NULL;
+
+  void* item;
+
+  if(chunk->free)
+  {
+    item = chunk->free;
+
+    chunk->free = *(void**) item;
+  }
+  else item = (uint8_t*) chunk + SLAB_ITEMS_OFFSET + chunk->carved++ * slab->size;
+
+  if(++chunk->used == slab->count)
+  {
+    slab_chunk_unlink(&slab->partial, chunk);
+
+    slab_chunk_link(&slab->full, chunk);
+  }
+
+  if(++slab->in_use > slab->high_water) slab->high_water = slab->in_use;
+
+  return item;
+}
+
+/*
+ * Free an item to the slab it was allocated from
+ *
+ * A chunk that becomes empty is unmapped if the other chunks
+ * have at least a chunk of free items, so that memory goes back
+ * to the system after a peak, without mapping and unmapping
+ * a chunk every time the use goes back and forth
+ */
+void slab_free(void* item)
+{
+  if(!item) return;
+
+  slab_chunk_t* chunk = (slab_chunk_t*) ((uintptr_t) item & ~(uintptr_t) (SLAB_CHUNK_SIZE - 1));
+
+  slab_t* slab = chunk->slab;
+
+  if(chunk->used == slab->count)
+  {
+    slab_chunk_unlink(&slab->full, chunk);
+
+    slab_chunk_link(&slab->partial, chunk);
+  }
+
+  *(void**) item = chunk->free;
+
+  chunk->free = item;
+
+  chunk->used--;
+
+  slab->in_use--;
+
+  size_t free_count = slab->chunk_count * slab->count - slab->in_use;
+
+  if(chunk->used == 0 && free_count >= slab->count * 2)
+  {
+    slab_chunk_unlink(&slab->partial, chunk);
+
+    munmap(chunk, SLAB_CHUNK_SIZE);
+
+    slab->chunk_count--;
+  }
+}
+
+/*
+ * Get the stats of the size class of size
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The size is larger than SLAB_SIZE_MAX
+ */
+int slab_stats_get(slab_stats_t* stats, const slab_pool_t* pool, size_t size)
+{
+  int class = slab_class_get(size);
+
+  if(class < 0) return 1;
+
+  const slab_t* slab = &pool->slabs[class];
+
+  *stats = (slab_stats_t)
+  {
+    .size       = slab->size,
+    .in_use     = slab->in_use,
+    .free       = slab->chunk_count * slab->count - slab->in_use,
+    .high_water = slab->high_water,
+    .chunks     = slab->chunk_count
+  };
+
+  return 0;
+}
+
+/*
+ * Print the stats of every size class that has been used
+ */
+void slab_stats_print(FILE* stream, const slab_pool_t* pool)
+{
+  fprintf(stream, "%8s %10s %10s %10s %8s\n", "size", "in use", "free", "high", "chunks");
+
+  for(int class = 0; class < SLAB_CLASS_COUNT; class++)
+  {
+    slab_stats_t stats;
+
+    slab_stats_get(&stats, pool, (size_t) SLAB_SIZE_MIN << class);
+
+    if(stats.high_water == 0) continue;
+
+    fprintf(stream, "%8zu %10zu %10zu %10zu %8zu\n", stats.size, stats.in_use, stats.free, stats.high_water, stats.chunks);
+  }
+}
@@ -0,0 +1,108 @@
+/*
+ * slab.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Items are carved from chunks of SLAB_CHUNK_SIZE bytes, that are
+ * aligned to their size, so the chunk of an item is found from its address.
+ * The size is that of a huge page, so a chunk can be one.
+ */
+#define SLAB_CHUNK_SIZE  (2 * 1024 * 1024)
+
+/*
+ * The size classes are powers of two, from SLAB_SIZE_MIN to SLAB_SIZE_MAX
+ */
+#define SLAB_SIZE_MIN    32
+#define SLAB_SIZE_MAX    (128 * 1024)
+#define SLAB_CLASS_COUNT 13
+
+/*
+ * Flags of slab_pool_create
+ *
+ * - SLAB_HUGE | Back chunks with huge pages, where available
+ */
+#define SLAB_HUGE 1
+
+typedef struct slab_chunk_t slab_chunk_t;
+
+typedef struct slab_t slab_t;
+
+/*
+ * The head of a chunk, at its start, followed by its items
+ */
+struct slab_chunk_t
+{
+  slab_t*       slab;
+  slab_chunk_t* prev;
+  slab_chunk_t* next;
+  void*         free;   // List of free items, linked through the items
+  size_t        used;   // Items that are allocated
+  size_t        carved; // Items that have been handed out, the rest are untouched
+};
+
+/*
+ * The chunks of one size class
+ *
+ * Chunks with free items are kept apart from full chunks,
+ * so allocation only looks at the first partial chunk
+ */
+struct slab_t
+{
+  size_t        size;       // Size of every item
+  size_t        count;      // Items in a chunk
+  slab_chunk_t* partial;
+  slab_chunk_t* full;
+  size_t        chunk_count;
+  size_t        in_use;
+  size_t        high_water; // The most items that have been in use
+  int           flags;
+};
+
+/*
+ * Slabs of every size class, for one thread
+ *
+ * A pool has no locks, so only the thread that owns it
+ * may allocate from it and free to it
+ *
+ * Every mux has a pool, for the bulk frames and assemblies
+ * of its streams, which are the same few sizes over and over
+ */
+typedef struct
+{
+  slab_t slabs[SLAB_CLASS_COUNT];
+  int    flags;
+} slab_pool_t;
+
+typedef struct
+{
+  size_t size;
+  size_t in_use;
+  size_t free;
+  size_t high_water;
+  size_t chunks;
+} slab_stats_t;
+
+extern int   slab_pool_create(slab_pool_t* pool, int flags);
+
+extern void  slab_pool_free(slab_pool_t* pool);
+
+extern void* slab_alloc(slab_pool_t* pool, size_t size);
+
+extern void  slab_free(void* item);
+
+extern int   slab_stats_get(slab_stats_t* stats, const slab_pool_t* pool, size_t size);
+
+extern void  slab_stats_print(FILE* stream, const slab_pool_t* pool);
+
+#endif // SLAB_H
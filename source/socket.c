@@ -1,22 +1,27 @@
 /*
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-11-27
+ * Last updated: 2026-10-19
  */
 
+// For struct ucred
+#define _GNU_SOURCE
+
+#define DEBUG_SUBSYSTEM DEBUG_SOCKET
 #include "debug.h"
 
 #include "socket.h"
 
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
 /*
  * Create sockaddr from address and port
  *
- * PARAMS
- * - bool debug | Print debug messages
- *
  * RETURN (struct sockaddr_in addr)
  */
-static struct sockaddr_in sockaddr_create(int sockfd, const char* address, int port, bool debug)
+static struct sockaddr_in sockaddr_create(int sockfd, const char* address, int port)
 {
   struct sockaddr_in addr;
 
@@ -26,7 +31,7 @@ static struct sockaddr_in sockaddr_create(int sockfd, const char* address, int p
 
     if(getsockname(sockfd, (struct sockaddr*) &addr, &addrlen) == -1)
     {
-      if(debug) error_print("Failed to get sock name: %s", strerror(errno));
+      error_print("Failed to get sock name: %s", strerror(errno));
     }
   }
   else addr.sin_addr.s_addr = inet_addr(address);
@@ -44,20 +49,20 @@ static struct sockaddr_in sockaddr_create(int sockfd, const char* address, int p
  * - >=0 | Success
  * -  -1 | Failed to create socket
  */
-static int socket_create(bool debug)
+static int socket_create(void)
 {
-  if(debug) info_print("Creating socket");
+  info_print("Creating socket");
 
   int sockfd = socket(AF_INET, SOCK_STREAM, 0);
 
   if(sockfd == -1)
   {
-    if(debug) error_print("Failed to create socket: %s", strerror(errno));
+    error_print("Failed to create socket: %s", strerror(errno));
 
     return -1;
   }
 
-  if(debug) info_print("Created socket (%d)", sockfd);
+  info_print("Created socket (%d)", sockfd);
 
   return sockfd;
 }
@@ -69,47 +74,276 @@ static int socket_create(bool debug)
  * -  0 | Success
  * - -1 | Failed to connect to server socket
  */
-static int socket_connect(int sockfd, const char* address, int port, bool debug)
+static int socket_connect(int sockfd, const char* address, int port)
 {
-  struct sockaddr_in addr = sockaddr_create(sockfd, address, port, debug);
+  struct sockaddr_in addr = sockaddr_create(sockfd, address, port);
 
-  if(debug) info_print("Connecting socket (%s:%d)", address, port);
+  info_print("Connecting socket (%s:%d)", address, port);
 
   if(connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)) == -1)
   {
-    if(debug) error_print("Failed to connect socket (%s:%d): %s", address, port, strerror(errno));
+    error_print("Failed to connect socket (%s:%d): %s", address, port, strerror(errno));
 
     return -1;
   }
 
-  if(debug) info_print("Connected socket (%s:%d)", address, port);
+  info_print("Connected socket (%s:%d)", address, port);
 
   return 0;
 }
 
+/*
+ * Check if an address is of a unix domain socket
+ */
+bool address_is_unix(const char* address)
+{
+  return strncmp(address, UNIX_ADDRESS_PREFIX, UNIX_ADDRESS_PREFIX_SIZE) == 0;
+}
+
+/*
+ * Check if an address is of a room that is reached over datagrams
+ */
+bool address_is_udp(const char* address)
+{
+  return strncmp(address, UDP_ADDRESS_PREFIX, UDP_ADDRESS_PREFIX_SIZE) == 0;
+}
+
+/*
+ * Create a non-blocking UDP socket, that is connected to address and port,
+ * so that it only recieves the datagrams of the server
+ *
+ * RETURN (int sockfd)
+ * - >=0 | Success
+ * -  -1 | Failed to create socket
+ */
+int udp_client_socket_create(const char* address, int port)
+{
+  int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if(sockfd == -1)
+  {
+    error_print("Failed to create udp socket: %s", strerror(errno));
+
+    return -1;
+  }
+
+  if(socket_connect(sockfd, address, port) == -1)
+  {
+    socket_close(&sockfd);
+
+    return -1;
+  }
+
+  return sockfd;
+}
+
 /*
  * Create a client socket and connect it to the server socket
  *
+ * A unix: address is connected to with a unix domain socket,
+ * which skips the TCP stack for rooms on the same host
+ *
  * RETURN (int sockfd)
  * - >=0 | Success
  * -  -1 | Failed to create server socket
  */
-int client_socket_create(const char* address, int port, bool debug)
+int client_socket_create(const char* address, int port)
 {
-  int sockfd = socket_create(debug);
+  if(address_is_unix(address))
+  {
+    return unix_client_socket_create(address + UNIX_ADDRESS_PREFIX_SIZE);
+  }
+
+  int sockfd = socket_create();
 
   if(sockfd == -1) return -1;
 
-  if(socket_connect(sockfd, address, port, debug) == -1)
+  if(socket_connect(sockfd, address, port) == -1)
+  {
+    socket_close(&sockfd);
+
+    return -1;
+  }
+
+  return sockfd;
+}
+
+/*
+ * Create sockaddr of a unix domain socket, at path
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The path is too long
+ */
+static int unix_sockaddr_create(struct sockaddr_un* addr, const char* path)
+{
+  memset(addr, 0, sizeof(struct sockaddr_un));
+
+  addr->sun_family = AF_UNIX;
+
+  if(strlen(path) >= sizeof(addr->sun_path))
+  {
+    error_print("Socket path is too long: %s", path);
+
+    return 1;
+  }
+
+  strcpy(addr->sun_path, path);
+
+  return 0;
+}
+
+/*
+ * Create a unix domain socket at path, that listens for local clients
+ *
+ * A file left at path by a server that is not running is removed,
+ * but the socket of a running server is not taken over
+ *
+ * The socket is bound with mode 0600, so that only the user can connect
+ *
+ * RETURN (int sockfd)
+ * - >=0 | Success
+ * -  -1 | Failed to create server socket
+ * -  -2 | Another server is listening at path
+ */
+int unix_server_socket_create(const char* path)
+{
+  struct sockaddr_un addr;
+
+  if(unix_sockaddr_create(&addr, path) != 0) return -1;
+
+  info_print("Creating unix socket (%s)", path);
+
+  int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if(sockfd == -1)
+  {
+    error_print("Failed to create unix socket: %s", strerror(errno));
+
+    return -1;
+  }
+
+  if(connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)) == 0)
   {
-    socket_close(&sockfd, debug);
+    error_print("Unix socket is in use (%s)", path);
+
+    socket_close(&sockfd);
+
+    return -2;
+  }
+
+  unlink(path);
+
+  close(sockfd);
+
+  if((sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+  {
+    error_print("Failed to create unix socket: %s", strerror(errno));
 
     return -1;
   }
 
+  // The mode of the socket file comes from the umask when it is bound
+  mode_t mask = umask(0177);
+
+  int status = bind(sockfd, (struct sockaddr*) &addr, sizeof(addr));
+
+  umask(mask);
+
+  if(status == -1 || listen(sockfd, 16) == -1)
+  {
+    error_print("Failed to listen on unix socket (%s): %s", path, strerror(errno));
+
+    socket_close(&sockfd);
+
+    return -1;
+  }
+
+  info_print("Listening on unix socket (%s)", path);
+
   return sockfd;
 }
 
+/*
+ * Check that the process at the other end of a unix socket
+ * is run by the same user as this process
+ *
+ * RETURN (bool is_user)
+ */
+bool unix_peer_is_user(int sockfd)
+{
+  struct ucred cred;
+
+  socklen_t size = sizeof(cred);
+
+  if(getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == -1)
+  {
+    error_print("Failed to get peer of unix socket: %s", strerror(errno));
+
+    return false;
+  }
+
+  return (cred.uid == getuid());
+}
+
+/*
+ * Create a unix domain socket and connect it to the server at path
+ *
+ * RETURN (int sockfd)
+ * - >=0 | Success
+ * -  -1 | Failed to connect to server socket
+ */
+int unix_client_socket_create(const char* path)
+{
+  struct sockaddr_un addr;
+
+  if(unix_sockaddr_create(&addr, path) != 0) return -1;
+
+  int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if(sockfd == -1)
+  {
+    error_print("Failed to create unix socket: %s", strerror(errno));
+
+    return -1;
+  }
+
+  if(connect(sockfd, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+  {
+    error_print("Failed to connect unix socket (%s): %s", path, strerror(errno));
+
+    socket_close(&sockfd);
+
+    return -1;
+  }
+
+  info_print("Connected unix socket (%s)", path);
+
+  return sockfd;
+}
+
+/*
+ * Fail the socket when written data is not acknowledged for timeout
+ * milliseconds, so that a dead connection is found while data is sent
+ *
+ * RETURN (int status)
+ * -  0 | Success
+ * - -1 | Failed to set timeout
+ */
+int socket_timeout_set(int sockfd, unsigned int timeout)
+{
+  if(setsockopt(sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout)) == -1)
+  {
+    error_print("Failed to set socket timeout: %s", strerror(errno));
+
+    return -1;
+  }
+
+  info_print("Set socket timeout (%u ms)", timeout);
+
+  return 0;
+}
+
 /*
  * close, but with pointer to file descriptor, and with debug messages
  *
@@ -119,20 +353,20 @@ int client_socket_create(const char* address, int port, bool debug)
  * - 0 | Success
  * - 1 | Failed to close socket
  */
-int socket_close(int* sockfd, bool debug)
+int socket_close(int* sockfd)
 {
   if(!sockfd || *sockfd == -1) return 0;
 
-  if(debug) info_print("Closing socket (%d)", *sockfd);
+  info_print("Closing socket (%d)", *sockfd);
 
   if(close(*sockfd) == -1)
   {
-    if(debug) error_print("Failed to close socket: %s", strerror(errno));
+    error_print("Failed to close socket: %s", strerror(errno));
 
     return -1;
   }
 
-  if(debug) info_print("Closed socket");
+  info_print("Closed socket");
 
   *sockfd = -1;
 
@@ -140,65 +374,57 @@ int socket_close(int* sockfd, bool debug)
 }
 
 /*
- * Recieve a single line to a buffer from a socket connection
+ * Write the whole buffer to a socket connection, used for binary frames
  *
  * RETURN (ssize_t size)
- * - >0 | The number of recieved characters
- * -  0 | Nothing to recieve, end of file
- * - -1 | Failed to recieve from socket
+ * - >0 | The number of written bytes
+ * -  0 | Nothing to write to, end of file
+ * - -1 | Failed to write to socket
  */
-ssize_t socket_recv(int sockfd, char* buffer, size_t size)
+ssize_t socket_write(int sockfd, const char* buffer, size_t size)
 {
-  if(errno != 0) return -1;
-
   if(!buffer) return 0;
 
-  char symbol = '\0';
-  ssize_t index;
+  size_t index = 0;
 
-  for(index = 0; index < size && symbol != '\n'; index++)
+  while(index < size)
   {
-    ssize_t status = recv(sockfd, &symbol, 1, 0);
+    ssize_t status = send(sockfd, buffer + index, size - index, MSG_NOSIGNAL);
 
-    if(status == -1 || errno != 0) return -1; // ERROR
+    if(status == -1)
+    {
+      if(errno == EINTR) continue;
 
-    buffer[index] = symbol;
+      return -1;
+    }
 
     if(status == 0) return 0; // End Of File
+
+    index += status;
   }
 
   return index;
 }
 
 /*
- * Send a single line from a buffer to a socket connection
+ * Read what is available, at most size bytes, from a socket connection
  *
  * RETURN (ssize_t size)
- * - >0 | The number of sent characters
- * -  0 | Nothing to send to, end of file
- * - -1 | Failed to send to socket
+ * - >0 | The number of read bytes
+ * -  0 | Nothing to read, end of file
+ * - -1 | Failed to read from socket
  */
-ssize_t socket_send(int sockfd, const char* buffer, size_t size)
+ssize_t socket_read(int sockfd, char* buffer, size_t size)
 {
-  if(errno != 0) return -1;
-
   if(!buffer) return 0;
 
-  ssize_t index;
-  char symbol = '\0';
+  ssize_t status;
 
-  for(index = 0; index < size && symbol != '\n'; index++)
+  do
   {
-    symbol = buffer[index];
-
-    ssize_t status = send(sockfd, &symbol, 1, 0);
-
-    if(status == -1 || errno != 0) return -1; // ERROR
-    
-    if(status == 0) return 0; // End Of File
-
-    if(symbol == '\0') break;
+    status = recv(sockfd, buffer, size, 0);
   }
+  while(status == -1 && errno == EINTR);
 
-  return index;
+  return status;
 }
@@ -1,7 +1,7 @@
 /*
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-11-27
+ * Last updated: 2026-10-19
  */
 
 #ifndef SOCKET_H
@@ -17,9 +17,37 @@
 #include <string.h>
 #include <stdbool.h>
 
-extern int client_socket_create(const char* address, int port, bool debug);
+/*
+ * A room on the same host can be at a unix domain socket,
+ * with an address like unix:/path/to/socket and no port
+ */
+#define UNIX_ADDRESS_PREFIX      "unix:"
+#define UNIX_ADDRESS_PREFIX_SIZE 5
+
+extern bool address_is_unix(const char* address);
+
+/*
+ * A room can be reached over datagrams, with an address like
+ * udp:127.0.0.1:8080, and then its frames go through rudp.h
+ */
+#define UDP_ADDRESS_PREFIX       "udp:"
+#define UDP_ADDRESS_PREFIX_SIZE  4
+
+extern bool address_is_udp(const char* address);
+
+extern int udp_client_socket_create(const char* address, int port);
+
+extern int client_socket_create(const char* address, int port);
+
+extern int unix_server_socket_create(const char* path);
+
+extern int unix_client_socket_create(const char* path);
+
+extern bool unix_peer_is_user(int sockfd);
+
+extern int socket_close(int* sockfd);
 
-extern int socket_close(int* sockfd, bool debug);
+extern int socket_timeout_set(int sockfd, unsigned int timeout);
 
 
 extern ssize_t socket_write(int sockfd, const char* buffer, size_t size);
@@ -1,71 +1,604 @@
 /*
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-09-07
+ * Last updated: 2026-10-19
  */
 
+#define DEBUG_SUBSYSTEM DEBUG_UI
 #include "debug.h"
 
+#include "format.h"
 #include "thread.h"
+#include "affinity.h"
+
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * Start threads with the routines, and join them when they are done
+ *
+ * If a thread can't be created, the created threads are interrupted
+ * and joined, so their routines must stop at SIGUSR1
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create threads
+ */
+int threads_start(pthread_t* threads, void *(*routines[]) (void *), size_t count)
+{
+  size_t created = 0;
+
+  for(; created < count; created++)
+  {
+    if(pthread_create(&threads[created], NULL, routines[created], NULL) != 0)
+    {
+      error_print("Failed to create thread %zu", created);
+
+      break;
+    }
+  }
+
+  if(created < count)
+  {
+    for(size_t index = 0; index < created; index++)
+    {
+      pthread_kill(threads[index], SIGUSR1);
+    }
+  }
+
+  for(size_t index = 0; index < created; index++)
+  {
+    if(pthread_join(threads[index], NULL) != 0)
+    {
+      error_print("Failed to join thread %zu", index);
+    }
+  }
+
+  return (created == count) ? 0 : 1;
+}
 
 /*
- * Create stdin and stdout threads
+ * Start stdin and stdout thread
+ *
+ * bunker starts its threads with threads_start, but this is kept
+ * for programs that only have a stdin and a stdout thread
  *
  * RETURN (int status)
  * - 0 | Success
- * - 1 | Failed to create stdin thread
- * - 2 | Failed to create stdout thread
+ * - 1 | Failed to create stdin and stdout threads
+ */
+int stdin_stdout_thread_start(pthread_t* stdin_thread, void *(*stdin_routine) (void *), pthread_t* stdout_thread, void *(*stdout_routine) (void *))
+{
+  pthread_t threads[2];
+
+  void *(*routines[2]) (void *) = { stdin_routine, stdout_routine };
+
+  int status = threads_start(threads, routines, 2);
+
+  *stdin_thread  = threads[0];
+  *stdout_thread = threads[1];
+
+  return status;
+}
+
+/*
+ * Returned by task_deque_steal when another worker took the task first
+ */
+#define TASK_ABORT ((task_t*) 1)
+
+/*
+ * The worker of the calling thread, if it is a worker
+ */
+static __thread pool_worker_t* pool_self = NULL;
+
+/*
+ * Sleep while the futex has value
+ */
+static inline void futex_wait(atomic_int* futex, int value)
+{
+  syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+/*
+ * Wake at most count threads sleeping on the futex
+ */
+static inline void futex_wake(atomic_int* futex, int count)
+{
+  syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/*
+ * Push a task at the bottom, only called by the owner
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The deque is full
+ */
+static int task_deque_push(task_deque_t* deque, task_t* task)
+{
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  long top    = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+  if(bottom - top >= POOL_DEQUE_SIZE) return 1;
+
+  // The slot is released too, which publishes the task to thieves
+  atomic_store_explicit(&deque->tasks[bottom & (POOL_DEQUE_SIZE - 1)], task, memory_order_release);
+
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+
+  return 0;
+}
+
+/*
+ * Take the last pushed task at the bottom, only called by the owner
+ *
+ * RETURN (task_t* task)
+ * - NULL | The deque is empty
+ */
+static task_t* task_deque_take(task_deque_t* deque)
+{
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+
+  atomic_thread_fence(memory_order_seq_cst);
+
+  long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if(top > bottom)
+  {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+
+    return NULL;
+  }
+
+  task_t* task = atomic_load_explicit(&deque->tasks[bottom & (POOL_DEQUE_SIZE - 1)], memory_order_relaxed);
+
+  // The last task can be stolen at the same time
+  if(top == bottom)
+  {
+    if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+      task = NULL;
+    }
+
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+
+  return task;
+}
+
+/*
+ * Steal the first pushed task at the top, called by other workers
+ *
+ * RETURN (task_t* task)
+ * - NULL       | The deque is empty
+ * - TASK_ABORT | Another worker took the task first
+ */
+static task_t* task_deque_steal(task_deque_t* deque)
+{
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+  atomic_thread_fence(memory_order_seq_cst);
+
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if(top >= bottom) return NULL;
+
+  task_t* task = atomic_load_explicit(&deque->tasks[top & (POOL_DEQUE_SIZE - 1)], memory_order_acquire);
+
+  if(!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+  {
+    return TASK_ABORT;
+  }
+
+  return task;
+}
+
+/*
+ *
+ */
+static void task_queue_push(task_queue_t* queue, task_t* task)
+{
+  task->next = NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if(queue->tail)
+  {
+    queue->tail->next = task;
+  }
+  else queue->head = task;
+
+  queue->tail = task;
+
+  atomic_fetch_add_explicit(&queue->count, 1, memory_order_release);
+
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/*
+ * Pop the first task of the queue, without locking an empty queue
+ *
+ * RETURN (task_t* task)
+ * - NULL | The queue is empty
+ */
+static task_t* task_queue_pop(task_queue_t* queue)
+{
+  if(atomic_load_explicit(&queue->count, memory_order_acquire) == 0) return NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  task_t* task = queue->head;
+
+  if(task)
+  {
+    queue->head = task->next;
+
+    if(!queue->head) queue->tail = NULL;
+
+    atomic_fetch_sub_explicit(&queue->count, 1, memory_order_relaxed);
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return task;
+}
+
+/*
+ *
+ */
+static void task_queue_init(task_queue_t* queue)
+{
+  pthread_mutex_init(&queue->lock, NULL);
+
+  queue->head = NULL;
+  queue->tail = NULL;
+
+  atomic_init(&queue->count, 0);
+}
+
+/*
+ * Free the tasks that were never run, and the lock
+ */
+static void task_queue_free(task_queue_t* queue)
+{
+  task_t* task;
+
+  while((task = task_queue_pop(queue))) free(task);
+
+  pthread_mutex_destroy(&queue->lock);
+}
+
+/*
+ * Steal a task of priority from another worker,
+ * starting at a random worker to spread the thieves
+ *
+ * RETURN (task_t* task)
+ * - NULL | No other worker had a task
+ */
+static task_t* pool_task_steal(pool_worker_t* worker, int priority)
+{
+  pool_t* pool = worker->pool;
+
+  size_t start = rand_r(&worker->seed) % pool->worker_count;
+
+  for(size_t offset = 0; offset < pool->worker_count; offset++)
+  {
+    pool_worker_t* victim = &pool->workers[(start + offset) % pool->worker_count];
+
+    if(victim == worker) continue;
+
+    task_t* task;
+
+    // Try again while other thieves win the same task
+    while((task = task_deque_steal(&victim->deques[priority])) == TASK_ABORT);
+
+    if(task) return task;
+  }
+
+  return NULL;
+}
+
+/*
+ * Find the next task of a worker
+ *
+ * For every priority, from high to normal:
+ * 1. The own deque, newest task first
+ * 2. The mailbox, of tasks for only this worker
+ * 3. The shared queue of the pool
+ * 4. The deques of other workers, oldest task first
+ *
+ * RETURN (task_t* task)
+ * - NULL | There is no task
  */
-static int stdin_stdout_thread_create(pthread_t* stdin_thread, void *(*stdin_routine) (void *), pthread_t* stdout_thread, void *(*stdout_routine) (void *), bool debug)
+static task_t* pool_task_find(pool_worker_t* worker)
 {
-  if(pthread_create(stdin_thread, NULL, stdin_routine, NULL) != 0)
+  pool_t* pool = worker->pool;
+
+  for(int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
   {
-    if(debug) error_print("Failed to create stdin thread");
+    task_t* task;
+
+    if((task = task_deque_take(&worker->deques[priority]))) return task;
+
+    if((task = task_queue_pop(&worker->mailboxes[priority]))) return task;
+
+    if((task = task_queue_pop(&pool->queues[priority]))) return task;
 
-    return 1;
+    if((task = pool_task_steal(worker, priority))) return task;
   }
 
-  if(pthread_create(stdout_thread, NULL, stdout_routine, NULL) != 0)
+  return NULL;
+}
+
+/*
+ * Run the workers tasks, and park on the epoch futex when there are none
+ */
+static void* pool_worker_routine(void* arg)
+{
+  pool_worker_t* worker = arg;
+  pool_t*        pool   = worker->pool;
+
+  pool_self = worker;
+
+  while(true)
   {
-    if(debug) error_print("Failed to create stdout thread");
+    // A task submitted after this load changes the epoch,
+    // so the futex_wait below returns at once
+    int epoch = atomic_load(&pool->epoch);
+
+    task_t* task = pool_task_find(worker);
 
-    // Interrupt stdin thread
-    pthread_kill(*stdin_thread, SIGUSR1);
+    if(task)
+    {
+      task->routine(task->arg);
 
+      free(task);
+
+      if(atomic_fetch_sub(&pool->pending, 1) == 1)
+      {
+        futex_wake(&pool->pending, INT_MAX);
+      }
+
+      continue;
+    }
+
+    if(atomic_load(&pool->stop)) break;
+
+    atomic_fetch_add(&pool->sleepers, 1);
+
+    futex_wait(&pool->epoch, epoch);
+
+    atomic_fetch_sub(&pool->sleepers, 1);
+  }
+
+  pool_self = NULL;
+
+  return NULL;
+}
+
+/*
+ * Stop the workers, after they have run every task
+ */
+static void pool_workers_stop(pool_t* pool, size_t count)
+{
+  atomic_store(&pool->stop, true);
+
+  atomic_fetch_add(&pool->epoch, 1);
+
+  futex_wake(&pool->epoch, INT_MAX);
+
+  for(size_t index = 0; index < count; index++)
+  {
+    pthread_join(pool->workers[index].thread, NULL);
+  }
+}
+
+/*
+ * Create a pool with worker_count worker threads
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | Failed to allocate workers
+ * - 3 | Failed to create worker thread
+ */
+int pool_create(pool_t* pool, size_t worker_count)
+{
+  if(!pool || worker_count == 0) return 1;
+
+  // The deques are aligned to cache lines
+  if(posix_memalign((void**) &pool->workers, 64, sizeof(pool_worker_t) * worker_count) != 0)
+  {
     return 2;
   }
 
+  pool->worker_count = worker_count;
+
+  for(int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+  {
+    task_queue_init(&pool->queues[priority]);
+  }
+
+  atomic_init(&pool->epoch, 0);
+  atomic_init(&pool->sleepers, 0);
+  atomic_init(&pool->pending, 0);
+  atomic_init(&pool->stop, false);
+
+  for(size_t index = 0; index < worker_count; index++)
+  {
+    pool_worker_t* worker = &pool->workers[index];
+
+    for(int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+      atomic_init(&worker->deques[priority].top, 0);
+      atomic_init(&worker->deques[priority].bottom, 0);
+
+      task_queue_init(&worker->mailboxes[priority]);
+    }
+
+    worker->pool  = pool;
+    worker->index = index;
+    worker->seed  = index + 1;
+  }
+
+  for(size_t index = 0; index < worker_count; index++)
+  {
+    pool_worker_t* worker = &pool->workers[index];
+
+    if(pthread_create(&worker->thread, NULL, pool_worker_routine, worker) != 0)
+    {
+      error_print("Failed to create worker thread");
+
+      // Only the created workers are joined, but the mailboxes
+      // of every worker are freed, since they were all initialized
+      pool_workers_stop(pool, index);
+
+      pool_free(pool);
+
+      return 3;
+    }
+  }
+
   return 0;
 }
 
 /*
- * Join stdin and stdout threads
+ * Pin the workers to CPUs, worker index to cpus[index % count],
+ * and report the workers whose deques are on another NUMA node
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ * - 2 | Failed to pin a worker
  */
-static void stdin_stdout_thread_join(pthread_t stdin_thread, pthread_t stdout_thread, bool debug)
+int pool_cpus_set(pool_t* pool, const int* cpus, size_t count)
 {
-  if(pthread_join(stdin_thread, NULL) != 0)
+  if(!pool || !cpus || count == 0) return 1;
+
+  int status = 0;
+
+  for(size_t index = 0; index < pool->worker_count; index++)
   {
-    if(debug) error_print("Failed to join stdin thread");
+    pool_worker_t* worker = &pool->workers[index];
+
+    int cpu = cpus[index % count];
+
+    if(thread_cpu_set(worker->thread, cpu) != 0)
+    {
+      status = 2;
+
+      continue;
+    }
+
+    char name[32];
+
+    format_string(name, sizeof(name), "worker %zu", index);
+
+    placement_check(name, cpu, worker->deques);
   }
 
-  if(pthread_join(stdout_thread, NULL) != 0)
+  return status;
+}
+
+/*
+ * Stop the workers and free the pool
+ *
+ * The tasks that are left are run first
+ */
+void pool_free(pool_t* pool)
+{
+  if(!pool || !pool->workers) return;
+
+  if(!atomic_load(&pool->stop))
   {
-    if(debug) error_print("Failed to join stdout thread");
+    pool_workers_stop(pool, pool->worker_count);
   }
+
+  for(size_t index = 0; index < pool->worker_count; index++)
+  {
+    for(int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+    {
+      task_queue_free(&pool->workers[index].mailboxes[priority]);
+    }
+  }
+
+  for(int priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+  {
+    task_queue_free(&pool->queues[priority]);
+  }
+
+  free(pool->workers);
+
+  pool->workers = NULL;
 }
 
 /*
- * Start stdin and stdout thread
+ * Submit a task to the pool
+ *
+ * With worker as POOL_ANY_WORKER, a task submitted by a worker
+ * is pushed to its own deque, and other tasks to the shared queue.
+ * Otherwise the task is only run by that worker.
  *
  * RETURN (int status)
  * - 0 | Success
- * - 1 | Failed to create stdin and stdout threads
+ * - 1 | Bad input
+ * - 2 | Failed to allocate task
  */
-int stdin_stdout_thread_start(pthread_t* stdin_thread, void *(*stdin_routine) (void *), pthread_t* stdout_thread, void *(*stdout_routine) (void *), bool debug)
+int pool_submit(pool_t* pool, void (*routine)(void* arg), void* arg, int priority, int worker)
 {
-  if(stdin_stdout_thread_create(stdin_thread, stdin_routine, stdout_thread, stdout_routine, debug) != 0) return 1;
-  
-  stdin_stdout_thread_join(*stdin_thread, *stdout_thread, debug);
+  if(!pool || !routine) return 1;
+
+  if(priority < 0 || priority >= TASK_PRIORITY_COUNT) return 1;
+
+  if(worker < POOL_ANY_WORKER || worker >= (int) pool->worker_count) return 1;
+
+  task_t* task = malloc(sizeof(task_t));
+
+  if(!task) return 2;
+
+  *task = (task_t) { routine, arg, priority, NULL };
+
+  atomic_fetch_add(&pool->pending, 1);
+
+  if(worker != POOL_ANY_WORKER)
+  {
+    task_queue_push(&pool->workers[worker].mailboxes[priority], task);
+  }
+  else if(!pool_self || pool_self->pool != pool ||
+          task_deque_push(&pool_self->deques[priority], task) != 0)
+  {
+    task_queue_push(&pool->queues[priority], task);
+  }
+
+  atomic_fetch_add(&pool->epoch, 1);
+
+  if(atomic_load(&pool->sleepers) > 0)
+  {
+    // A worker on a mailbox task must be woken, so every worker is
+    futex_wake(&pool->epoch, (worker != POOL_ANY_WORKER) ? INT_MAX : 1);
+  }
 
   return 0;
 }
+
+/*
+ * Wait until every submitted task has been run
+ *
+ * This must not be called by a task, which would wait for itself
+ */
+void pool_wait(pool_t* pool)
+{
+  int pending;
+
+  while((pending = atomic_load(&pool->pending)) != 0)
+  {
+    futex_wait(&pool->pending, pending);
+  }
+}
@@ -1,7 +1,7 @@
 /*
  * Written by Hampus Fridholm
  *
- * Last updated: 2024-09-07
+ * Last updated: 2026-10-19
  */
 
 #ifndef THREAD_H
@@ -9,8 +9,105 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include <signal.h>
 
-extern int  stdin_stdout_thread_start(pthread_t* stdin_thread, void *(*stdin_routine) (void *), pthread_t* stdout_thread, void *(*stdout_routine) (void *), bool debug);
+/*
+ * The number of tasks in the deque of a worker, must be a power of two
+ *
+ * A task that doesn't fit goes to the shared queue of the pool
+ */
+#define POOL_DEQUE_SIZE 4096
+
+/*
+ * Submit a task to any worker
+ */
+#define POOL_ANY_WORKER -1
+
+typedef enum
+{
+  TASK_HIGH   = 0,
+  TASK_NORMAL = 1,
+  TASK_PRIORITY_COUNT
+} task_priority_t;
+
+typedef struct task_t
+{
+  void          (*routine)(void* arg);
+  void*           arg;
+  uint8_t         priority;
+  struct task_t*  next;
+} task_t;
+
+/*
+ * A list of tasks behind a lock, for tasks that can't be
+ * pushed to a deque, like the tasks of other threads
+ */
+typedef struct
+{
+  pthread_mutex_t lock;
+  task_t*         head;
+  task_t*         tail;
+  atomic_size_t   count;
+} task_queue_t;
+
+/*
+ * Chase-Lev deque
+ *
+ * Only the owning worker pushes and takes at the bottom,
+ * and other workers steal from the top
+ */
+typedef struct
+{
+  _Alignas(64) atomic_long top;
+  _Alignas(64) atomic_long bottom;
+  _Atomic(task_t*) tasks[POOL_DEQUE_SIZE];
+} task_deque_t;
+
+typedef struct pool_t pool_t;
+
+typedef struct
+{
+  task_deque_t  deques[TASK_PRIORITY_COUNT];
+  task_queue_t  mailboxes[TASK_PRIORITY_COUNT]; // Tasks for only this worker
+  pool_t*       pool;
+  size_t        index;
+  unsigned int  seed;
+  pthread_t     thread;
+} pool_worker_t;
+
+/*
+ * A work-stealing pool of worker threads
+ *
+ * The client doesn't use it yet, since its threads each do one thing.
+ * It is only run by bench-pool, for work that can be split up
+ */
+struct pool_t
+{
+  pool_worker_t* workers;
+  size_t         worker_count;
+  task_queue_t   queues[TASK_PRIORITY_COUNT];
+  atomic_int     epoch;    // Futex that idle workers park on
+  atomic_int     sleepers;
+  atomic_int     pending;  // Futex that pool_wait waits on
+  atomic_bool    stop;
+};
+
+extern int  threads_start(pthread_t* threads, void *(*routines[]) (void *), size_t count);
+
+extern int  stdin_stdout_thread_start(pthread_t* stdin_thread, void *(*stdin_routine) (void *), pthread_t* stdout_thread, void *(*stdout_routine) (void *));
+
+
+extern int  pool_create(pool_t* pool, size_t worker_count);
+
+extern void pool_free(pool_t* pool);
+
+extern int  pool_cpus_set(pool_t* pool, const int* cpus, size_t count);
+
+extern int  pool_submit(pool_t* pool, void (*routine)(void* arg), void* arg, int priority, int worker);
+
+extern void pool_wait(pool_t* pool);
 
 #endif // THREAD_H
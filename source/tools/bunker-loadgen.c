@@ -0,0 +1,1082 @@
+/*
+ * bunker-loadgen - simulated clients to load a room server
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bunker-loadgen [OPTION...] ADDRESS:PORT
+ *
+ * Thousands of clients are connected from a few threads, each with
+ * an epoll loop. A client joins by connecting and announcing a key,
+ * like bunker does, and then sends signed text frames at the rate.
+ * With churn, clients leave and join again during the run.
+ *
+ * A text frame of loadgen has no recipients, and carries the time
+ * it was sent, so its delivery latency is measured when any other
+ * client recieves it. Other clients in the room drop these frames.
+ *
+ * The report is printed as "metric,value" lines, in the same order
+ * every run, so that the reports of two builds of a server can be diffed
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../bunker.h"
+
+#include <argp.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+/*
+ * The size of the read buffer of a client
+ *
+ * Larger frames, like messages from real clients, are skipped
+ */
+#define CLIENT_BUFFER_SIZE 2048
+
+/*
+ * The largest frame that a client sends
+ */
+#define CLIENT_FRAME_MAX   1024
+
+/*
+ * The tick of the timer wheel of a thread, in nanoseconds
+ */
+#define LOADGEN_TICK_SIZE  1000000
+
+/*
+ * The events handled by one epoll_wait
+ */
+#define LOADGEN_EVENTS_MAX 256
+
+/*
+ * On loopback, every LOADGEN_PORTS_MAX clients bind to another
+ * source address, so that there are enough ephemeral ports
+ */
+#define LOADGEN_PORTS_MAX  20000
+
+/*
+ * The mark at the start of a loadgen message body
+ */
+#define LOADGEN_MAGIC      "LOADGEN1"
+#define LOADGEN_MAGIC_SIZE 8
+
+#define LOADGEN_BODY_MIN   (1 + LOADGEN_MAGIC_SIZE + 8 + 4)
+
+static char doc[] = "bunker-loadgen - simulated clients to load a room server";
+
+static char args_doc[] = "ADDRESS:PORT";
+
+static struct argp_option options[] =
+{
+  { "clients",  'c', "COUNT",   0, "Number of clients (default 1000)" },
+  { "threads",  't', "COUNT",   0, "Number of threads (default 4)" },
+  { "rate",     'r', "RATE",    0, "Messages a second, from all clients (default 100)" },
+  { "size",     's', "BYTES",   0, "Size of a message body (default 64)" },
+  { "churn",    'C', "RATE",    0, "Clients that leave and join again a second (default 0)" },
+  { "ramp",     'R', "RATE",    0, "Clients that join a second, at the start (default 2000)" },
+  { "duration", 'd', "SECONDS", 0, "Seconds to send messages, after the clients have joined (default 10)" },
+  { "keys",     'k', "COUNT",   0, "Number of key pairs, shared by the clients (default 256)" },
+  { "seed",     'S', "SEED",    0, "Seed of the random choices (default 1)" },
+  { 0 }
+};
+
+struct args
+{
+  char*  address;
+  long   clients;
+  long   threads;
+  double rate;
+  long   size;
+  double churn;
+  double ramp;
+  double duration;
+  long   keys;
+  long   seed;
+};
+
+static struct args args =
+{
+  .address  = NULL,
+  .clients  = 1000,
+  .threads  = 4,
+  .rate     = 100,
+  .size     = 64,
+  .churn    = 0,
+  .ramp     = 2000,
+  .duration = 10,
+  .keys     = 256,
+  .seed     = 1
+};
+
+/*
+ * The states of a client
+ */
+typedef enum
+{
+  CLIENT_IDLE,        // Not connected
+  CLIENT_CONNECTING,  // Waiting for connect
+  CLIENT_JOINED       // Connected, and the key is announced
+} client_state_t;
+
+typedef struct
+{
+  sign_key_t sign;
+  wrap_key_t wrap;
+} loadgen_key_t;
+
+typedef struct
+{
+  int            fd;
+  client_state_t state;
+  uint32_t       index;
+  uint64_t       connect_time;
+  loadgen_key_t* key;
+
+  uint8_t*       buffer;       // Bytes that are read, but not parsed
+  size_t         length;
+  size_t         skip;         // Bytes of a large frame that are left to skip
+
+  uint8_t*       out;          // The rest of a frame that did not fit the socket
+  size_t         out_length;
+  size_t         out_offset;
+} client_t;
+
+/*
+ * The counters of a thread, summed up for the report
+ */
+typedef struct
+{
+  uint64_t joins;
+  uint64_t connect_failures;
+  uint64_t disconnects;
+  uint64_t churned;
+  uint64_t sent;
+  uint64_t skipped;       // Messages not sent, since the socket was full
+  uint64_t expected;      // Deliveries that the sent messages should give
+  uint64_t delivered;
+  uint64_t delivered_bytes;
+  uint64_t keys;          // Key announces that were recieved
+  uint64_t skipped_frames;
+} counters_t;
+
+typedef struct
+{
+  pthread_t     thread;
+  int           epfd;
+  client_t*     clients;
+  size_t        count;
+  size_t        started;     // Clients that have been connected the first time
+  size_t        next;        // The next client to send a message
+  wheel_t       wheel;
+  wheel_timer_t ramp_timer;
+  wheel_timer_t send_timer;
+  wheel_timer_t churn_timer;
+  double        send_credit;
+  double        churn_credit;
+  uint64_t      seed;
+  counters_t    counters;
+} loadgen_thread_t;
+
+/*
+ * The phases of a run, set by the main thread
+ */
+typedef enum
+{
+  PHASE_RAMP,   // Clients join
+  PHASE_RUN,    // Clients send messages and churn
+  PHASE_DRAIN,  // Clients only recieve the last messages
+  PHASE_STOP
+} phase_t;
+
+static atomic_int phase = PHASE_RAMP;
+
+static atomic_long joined = 0;
+
+static struct sockaddr_in server_addr;
+
+static bool is_loopback = false;
+
+static loadgen_key_t* keys = NULL;
+
+static hist_t latency_hist;
+
+static hist_t connect_hist;
+
+/*
+ * This is the option parsing function used by argp
+ */
+static error_t opt_parse(int key, char* arg, struct argp_state* state)
+{
+  struct args* args = state->input;
+
+  switch(key)
+  {
+    case 'c':
+      args->clients = atol(arg);
+      break;
+
+    case 't':
+      args->threads = atol(arg);
+      break;
+
+    case 'r':
+      args->rate = atof(arg);
+      break;
+
+    case 's':
+      args->size = atol(arg);
+      break;
+
+    case 'C':
+      args->churn = atof(arg);
+      break;
+
+    case 'R':
+      args->ramp = atof(arg);
+      break;
+
+    case 'd':
+      args->duration = atof(arg);
+      break;
+
+    case 'k':
+      args->keys = atol(arg);
+      break;
+
+    case 'S':
+      args->seed = atol(arg);
+      break;
+
+    case ARGP_KEY_ARG:
+      if(state->arg_num >= 1) argp_usage(state);
+
+      args->address = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if(!args->address) argp_usage(state);
+
+      if(args->clients < 1 || args->threads < 1 || args->rate < 0 || args->churn < 0 ||
+         args->ramp <= 0 || args->duration <= 0 || args->keys < 1 ||
+         args->size < LOADGEN_BODY_MIN || args->size > CLIENT_FRAME_MAX - FRAME_HEAD_SIZE - FRAME_SIGN_SIZE)
+      {
+        argp_error(state, "Bad option value");
+      }
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+static struct argp argp = { options, opt_parse, args_doc, doc };
+
+/*
+ * Fast random numbers, that are the same with the same seed
+ */
+static uint64_t random_get(uint64_t* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+/*
+ * Raise the limit of open files to fit every client
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The limit can not be raised enough
+ */
+static int files_limit_raise(rlim_t count)
+{
+  struct rlimit limit;
+
+  if(getrlimit(RLIMIT_NOFILE, &limit) != 0) return 1;
+
+  if(limit.rlim_cur >= count) return 0;
+
+  // Only root can raise the hard limit
+  if(limit.rlim_max < count) limit.rlim_max = count;
+
+  limit.rlim_cur = count;
+
+  if(setrlimit(RLIMIT_NOFILE, &limit) == 0) return 0;
+
+  getrlimit(RLIMIT_NOFILE, &limit);
+
+  limit.rlim_cur = limit.rlim_max;
+
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  fprintf(stderr, "bunker-loadgen: Open files are limited to %llu, and %llu are needed\n",
+    (unsigned long long) limit.rlim_cur, (unsigned long long) count);
+
+  return 1;
+}
+
+/*
+ * Close the socket of a client
+ */
+static void client_close(loadgen_thread_t* thread, client_t* client)
+{
+  if(client->fd != -1)
+  {
+    epoll_ctl(thread->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+
+    close(client->fd);
+  }
+
+  if(client->state == CLIENT_JOINED) atomic_fetch_sub(&joined, 1);
+
+  client->fd         = -1;
+  client->state      = CLIENT_IDLE;
+  client->length     = 0;
+  client->skip       = 0;
+  client->out_length = 0;
+  client->out_offset = 0;
+}
+
+/*
+ * Write what is left of the last frame of a client
+ *
+ * RETURN (int status)
+ * - 0 | Everything is written, or the socket is full
+ * - 1 | Failed to write
+ */
+static int client_flush(client_t* client)
+{
+  while(client->out_offset < client->out_length)
+  {
+    ssize_t amount = write(client->fd, client->out + client->out_offset, client->out_length - client->out_offset);
+
+    if(amount == -1)
+    {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+
+      if(errno == EINTR) continue;
+
+      return 1;
+    }
+
+    client->out_offset += amount;
+  }
+
+  client->out_length = 0;
+  client->out_offset = 0;
+
+  return 0;
+}
+
+/*
+ * Sign a frame, whose body is written in the out buffer of the client,
+ * and start writing it
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to sign or to write
+ */
+static int client_frame_send(loadgen_thread_t* thread, client_t* client, uint8_t type, size_t size)
+{
+  size_t frame_size;
+
+  if(frame_signed_write(client->out, &frame_size, type, MUX_STREAM_CHAT, &client->key->sign, size) != 0) return 1;
+
+  client->out_length = frame_size;
+  client->out_offset = 0;
+
+  if(client_flush(client) != 0) return 1;
+
+  // Wait for the socket, if the frame did not fit
+  struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+
+  if(client->out_length > 0) event.events |= EPOLLOUT;
+
+  epoll_ctl(thread->epfd, EPOLL_CTL_MOD, client->fd, &event);
+
+  return 0;
+}
+
+/*
+ * Announce the key of a client, like bunker does when joining
+ *
+ * BODY
+ * - wrap public key
+ * - name
+ */
+static int client_key_send(loadgen_thread_t* thread, client_t* client)
+{
+  uint8_t* body = client->out + FRAME_HEAD_SIZE + FRAME_SIGN_SIZE;
+
+  memcpy(body, client->key->wrap.public, WRAP_PUBLIC_SIZE);
+
+  int length = format_string((char*) body + WRAP_PUBLIC_SIZE, 32, "loadgen-%u", client->index);
+
+  return client_frame_send(thread, client, FRAME_KEY, WRAP_PUBLIC_SIZE + length);
+}
+
+/*
+ * Send a message from a client, with the time it was sent
+ *
+ * BODY
+ * - uint8_t  count   | 0, no recipients
+ * - magic[8]         | LOADGEN_MAGIC
+ * - uint64_t time    | When the message was sent
+ * - uint32_t index   | The client that sent it
+ * - padding          | Up to args.size bytes
+ */
+static int client_message_send(loadgen_thread_t* thread, client_t* client)
+{
+  uint8_t* body = client->out + FRAME_HEAD_SIZE + FRAME_SIGN_SIZE;
+
+  body[0] = 0;
+
+  memcpy(body + 1, LOADGEN_MAGIC, LOADGEN_MAGIC_SIZE);
+
+  number_write(body + 1 + LOADGEN_MAGIC_SIZE,     hist_time_get(), 8);
+  number_write(body + 1 + LOADGEN_MAGIC_SIZE + 8, client->index,   4);
+
+  memset(body + LOADGEN_BODY_MIN, 'x', args.size - LOADGEN_BODY_MIN);
+
+  return client_frame_send(thread, client, FRAME_TEXT, args.size);
+}
+
+/*
+ * Start connecting a client
+ *
+ * RETURN (int status)
+ * - 0 | Success, or connecting
+ * - 1 | Failed to connect
+ */
+static int client_connect(loadgen_thread_t* thread, client_t* client)
+{
+  client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  if(client->fd == -1) return 1;
+
+  int flag = 1;
+
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  if(is_loopback)
+  {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+
+    // 127.1.0.1 and up, a new address every LOADGEN_PORTS_MAX clients
+    addr.sin_addr.s_addr = htonl(0x7f010001 + client->index / LOADGEN_PORTS_MAX);
+
+    bind(client->fd, (struct sockaddr*) &addr, sizeof(addr));
+  }
+
+  client->connect_time = hist_time_get();
+
+  client->state = CLIENT_CONNECTING;
+
+  if(connect(client->fd, (struct sockaddr*) &server_addr, sizeof(server_addr)) != 0 && errno != EINPROGRESS)
+  {
+    client_close(thread, client);
+
+    return 1;
+  }
+
+  struct epoll_event event = { .events = EPOLLOUT, .data.ptr = client };
+
+  if(epoll_ctl(thread->epfd, EPOLL_CTL_ADD, client->fd, &event) != 0)
+  {
+    client_close(thread, client);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Finish connecting a client, and announce its key
+ */
+static void client_connected(loadgen_thread_t* thread, client_t* client)
+{
+  int error = 0;
+
+  socklen_t length = sizeof(error);
+
+  getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+  if(error != 0)
+  {
+    thread->counters.connect_failures++;
+
+    client_close(thread, client);
+
+    return;
+  }
+
+  hist_record(&connect_hist, hist_time_get() - client->connect_time);
+
+  client->state = CLIENT_JOINED;
+
+  atomic_fetch_add(&joined, 1);
+
+  thread->counters.joins++;
+
+  if(client_key_send(thread, client) != 0)
+  {
+    thread->counters.disconnects++;
+
+    client_close(thread, client);
+  }
+}
+
+/*
+ * Count a frame that a client recieved
+ */
+static void client_frame_handle(loadgen_thread_t* thread, uint8_t type, const uint8_t* data, size_t size)
+{
+  if(type == FRAME_KEY)
+  {
+    thread->counters.keys++;
+
+    return;
+  }
+
+  if(type != FRAME_TEXT || size < FRAME_SIGN_SIZE + LOADGEN_BODY_MIN) return;
+
+  const uint8_t* body = data + FRAME_SIGN_SIZE;
+
+  if(body[0] != 0 || memcmp(body + 1, LOADGEN_MAGIC, LOADGEN_MAGIC_SIZE) != 0) return;
+
+  uint64_t time = number_read(body + 1 + LOADGEN_MAGIC_SIZE, 8);
+
+  uint64_t now = hist_time_get();
+
+  if(now >= time) hist_record(&latency_hist, now - time);
+
+  thread->counters.delivered++;
+
+  thread->counters.delivered_bytes += FRAME_HEAD_SIZE + size;
+}
+
+/*
+ * Read from the socket of a client, and handle the whole frames
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | End of file, or failed to read
+ */
+static int client_read(loadgen_thread_t* thread, client_t* client)
+{
+  ssize_t amount = read(client->fd, client->buffer + client->length, CLIENT_BUFFER_SIZE - client->length);
+
+  if(amount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+
+  if(amount <= 0) return 1;
+
+  client->length += amount;
+
+  size_t offset = 0;
+
+  while(offset < client->length)
+  {
+    if(client->skip > 0)
+    {
+      size_t length = client->length - offset;
+
+      if(length > client->skip) length = client->skip;
+
+      client->skip -= length;
+      offset       += length;
+      continue;
+    }
+
+    if(client->length - offset < FRAME_HEAD_SIZE) break;
+
+    const uint8_t* head = client->buffer + offset;
+
+    size_t  size = number_read(head, 4);
+    uint8_t type = head[4];
+
+    if(FRAME_HEAD_SIZE + size > CLIENT_BUFFER_SIZE)
+    {
+      thread->counters.skipped_frames++;
+
+      client->skip = FRAME_HEAD_SIZE + size;
+      continue;
+    }
+
+    if(client->length - offset < FRAME_HEAD_SIZE + size) break;
+
+    client_frame_handle(thread, type, head + FRAME_HEAD_SIZE, size);
+
+    offset += FRAME_HEAD_SIZE + size;
+  }
+
+  memmove(client->buffer, client->buffer + offset, client->length - offset);
+
+  client->length -= offset;
+
+  return 0;
+}
+
+/*
+ * Connect the next clients of the thread, at the ramp rate
+ */
+static void ramp_routine(wheel_timer_t* timer, void* arg)
+{
+  loadgen_thread_t* thread = arg;
+
+  double per_tick = args.ramp / args.threads * LOADGEN_TICK_SIZE / 1e9;
+
+  size_t count = (per_tick < 1) ? 1 : (size_t) per_tick;
+
+  for(size_t index = 0; index < count && thread->started < thread->count; index++)
+  {
+    client_t* client = &thread->clients[thread->started++];
+
+    if(client_connect(thread, client) != 0) thread->counters.connect_failures++;
+  }
+
+  if(thread->started < thread->count)
+  {
+    uint64_t delay = (per_tick < 1) ? (uint64_t) (LOADGEN_TICK_SIZE / per_tick) : LOADGEN_TICK_SIZE;
+
+    wheel_timer_arm(&thread->wheel, timer, delay);
+  }
+}
+
+/*
+ * Send the messages that are due, from the joined clients in turn
+ */
+static void send_routine(wheel_timer_t* timer, void* arg)
+{
+  loadgen_thread_t* thread = arg;
+
+  wheel_timer_arm(&thread->wheel, timer, LOADGEN_TICK_SIZE);
+
+  if(atomic_load(&phase) != PHASE_RUN) return;
+
+  thread->send_credit += args.rate / args.threads * LOADGEN_TICK_SIZE / 1e9;
+
+  for(size_t tries = 0; thread->send_credit >= 1 && tries < thread->count; tries++)
+  {
+    client_t* client = &thread->clients[thread->next];
+
+    thread->next = (thread->next + 1) % thread->count;
+
+    if(client->state != CLIENT_JOINED) continue;
+
+    thread->send_credit -= 1;
+
+    if(client->out_length > 0)
+    {
+      thread->counters.skipped++;
+      continue;
+    }
+
+    // Every other joined client should get the message
+    long others = atomic_load(&joined) - 1;
+
+    if(client_message_send(thread, client) != 0)
+    {
+      thread->counters.disconnects++;
+
+      client_close(thread, client);
+      continue;
+    }
+
+    thread->counters.sent++;
+
+    thread->counters.expected += (others > 0) ? others : 0;
+  }
+}
+
+/*
+ * Make random joined clients leave and join again, at the churn rate
+ */
+static void churn_routine(wheel_timer_t* timer, void* arg)
+{
+  loadgen_thread_t* thread = arg;
+
+  wheel_timer_arm(&thread->wheel, timer, LOADGEN_TICK_SIZE);
+
+  if(atomic_load(&phase) != PHASE_RUN) return;
+
+  thread->churn_credit += args.churn / args.threads * LOADGEN_TICK_SIZE / 1e9;
+
+  while(thread->churn_credit >= 1)
+  {
+    thread->churn_credit -= 1;
+
+    client_t* client = &thread->clients[random_get(&thread->seed) % thread->count];
+
+    if(client->state != CLIENT_JOINED) continue;
+
+    client_close(thread, client);
+
+    thread->counters.churned++;
+
+    if(client_connect(thread, client) != 0) thread->counters.connect_failures++;
+  }
+}
+
+/*
+ * Run the clients of a thread, until the phase is PHASE_STOP
+ */
+static void* loadgen_routine(void* arg)
+{
+  loadgen_thread_t* thread = arg;
+
+  struct epoll_event events[LOADGEN_EVENTS_MAX];
+
+  wheel_init(&thread->wheel, LOADGEN_TICK_SIZE, hist_time_get());
+
+  wheel_timer_init(&thread->ramp_timer,  ramp_routine,  thread);
+  wheel_timer_init(&thread->send_timer,  send_routine,  thread);
+  wheel_timer_init(&thread->churn_timer, churn_routine, thread);
+
+  wheel_timer_arm(&thread->wheel, &thread->ramp_timer,  0);
+  wheel_timer_arm(&thread->wheel, &thread->send_timer,  LOADGEN_TICK_SIZE);
+  wheel_timer_arm(&thread->wheel, &thread->churn_timer, LOADGEN_TICK_SIZE);
+
+  while(atomic_load(&phase) != PHASE_STOP)
+  {
+    int timeout = wheel_timeout_get(&thread->wheel, hist_time_get());
+
+    int count = epoll_wait(thread->epfd, events, LOADGEN_EVENTS_MAX, (timeout < 0 || timeout > 100) ? 100 : timeout);
+
+    for(int index = 0; index < count; index++)
+    {
+      client_t* client = events[index].data.ptr;
+
+      if(client->state == CLIENT_CONNECTING)
+      {
+        client_connected(thread, client);
+        continue;
+      }
+
+      if(client->state != CLIENT_JOINED) continue;
+
+      bool is_closed = (events[index].events & (EPOLLERR | EPOLLHUP));
+
+      if(!is_closed && (events[index].events & EPOLLOUT) && client->out_length > 0)
+      {
+        is_closed = (client_flush(client) != 0);
+
+        if(!is_closed && client->out_length == 0)
+        {
+          struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+
+          epoll_ctl(thread->epfd, EPOLL_CTL_MOD, client->fd, &event);
+        }
+      }
+
+      if(!is_closed && (events[index].events & EPOLLIN))
+      {
+        is_closed = (client_read(thread, client) != 0);
+      }
+
+      if(is_closed)
+      {
+        thread->counters.disconnects++;
+
+        client_close(thread, client);
+      }
+    }
+
+    wheel_advance(&thread->wheel, hist_time_get());
+  }
+
+  for(size_t index = 0; index < thread->count; index++)
+  {
+    client_close(thread, &thread->clients[index]);
+  }
+
+  return NULL;
+}
+
+/*
+ * Create the key pairs of the clients
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to create keys
+ */
+static int keys_create(long count)
+{
+  if(!(keys = calloc(count, sizeof(loadgen_key_t)))) return 1;
+
+  for(long index = 0; index < count; index++)
+  {
+    if(sign_key_create(&keys[index].sign) != 0 || wrap_key_create(&keys[index].wrap) != 0) return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * Free the key pairs of the clients
+ */
+static void keys_free(long count)
+{
+  if(!keys) return;
+
+  for(long index = 0; index < count; index++)
+  {
+    sign_key_free(&keys[index].sign);
+
+    wrap_key_free(&keys[index].wrap);
+  }
+
+  free(keys);
+
+  keys = NULL;
+}
+
+/*
+ * Create the threads, and give each its part of the clients
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate
+ */
+static int threads_create(loadgen_thread_t* threads, client_t* clients, uint8_t* buffers)
+{
+  size_t first = 0;
+
+  for(long index = 0; index < args.threads; index++)
+  {
+    loadgen_thread_t* thread = &threads[index];
+
+    size_t count = args.clients / args.threads + ((index < args.clients % args.threads) ? 1 : 0);
+
+    thread->clients = clients + first;
+    thread->count   = count;
+    thread->seed    = args.seed * 0x9e3779b97f4a7c15ULL + index + 1;
+
+    if((thread->epfd = epoll_create1(0)) == -1) return 1;
+
+    for(size_t client_index = first; client_index < first + count; client_index++)
+    {
+      client_t* client = &clients[client_index];
+
+      client->fd     = -1;
+      client->state  = CLIENT_IDLE;
+      client->index  = client_index;
+      client->key    = &keys[client_index % args.keys];
+      client->buffer = buffers + client_index * (CLIENT_BUFFER_SIZE + CLIENT_FRAME_MAX);
+      client->out    = client->buffer + CLIENT_BUFFER_SIZE;
+    }
+
+    first += count;
+  }
+
+  return 0;
+}
+
+/*
+ * Sum the counters of every thread
+ */
+static counters_t counters_sum(const loadgen_thread_t* threads)
+{
+  counters_t sum = { 0 };
+
+  for(long index = 0; index < args.threads; index++)
+  {
+    const counters_t* counters = &threads[index].counters;
+
+    sum.joins            += counters->joins;
+    sum.connect_failures += counters->connect_failures;
+    sum.disconnects      += counters->disconnects;
+    sum.churned          += counters->churned;
+    sum.sent             += counters->sent;
+    sum.skipped          += counters->skipped;
+    sum.expected         += counters->expected;
+    sum.delivered        += counters->delivered;
+    sum.delivered_bytes  += counters->delivered_bytes;
+    sum.keys             += counters->keys;
+    sum.skipped_frames   += counters->skipped_frames;
+  }
+
+  return sum;
+}
+
+/*
+ * Print the report, one "metric,value" line for every metric
+ */
+static void report_print(const counters_t* sum, long peak, double ramp_time)
+{
+  printf("clients,%ld\n",  args.clients);
+  printf("threads,%ld\n",  args.threads);
+  printf("rate,%.1f\n",    args.rate);
+  printf("size,%ld\n",     args.size);
+  printf("churn,%.1f\n",   args.churn);
+  printf("duration,%.1f\n", args.duration);
+  printf("seed,%ld\n",     args.seed);
+
+  printf("joined_peak,%ld\n",      peak);
+  printf("ramp_seconds,%.2f\n",    ramp_time);
+  printf("joins,%llu\n",           (unsigned long long) sum->joins);
+  printf("connect_failures,%llu\n", (unsigned long long) sum->connect_failures);
+  printf("disconnects,%llu\n",     (unsigned long long) sum->disconnects);
+  printf("churned,%llu\n",         (unsigned long long) sum->churned);
+  printf("connect_p50_us,%.1f\n",  hist_percentile_get(&connect_hist, 50.0) / 1e3);
+  printf("connect_p99_us,%.1f\n",  hist_percentile_get(&connect_hist, 99.0) / 1e3);
+  printf("keys_recieved,%llu\n",   (unsigned long long) sum->keys);
+
+  printf("sent,%llu\n",            (unsigned long long) sum->sent);
+  printf("send_skipped,%llu\n",    (unsigned long long) sum->skipped);
+  printf("expected,%llu\n",        (unsigned long long) sum->expected);
+  printf("delivered,%llu\n",       (unsigned long long) sum->delivered);
+  printf("delivery_ratio,%.4f\n",  sum->expected ? (double) sum->delivered / sum->expected : 0.0);
+  printf("deliveries_per_second,%.1f\n", sum->delivered / args.duration);
+  printf("megabytes_per_second,%.3f\n",  sum->delivered_bytes / args.duration / 1e6);
+  printf("frames_skipped,%llu\n",  (unsigned long long) sum->skipped_frames);
+
+  printf("latency_p50_us,%.1f\n",  hist_percentile_get(&latency_hist, 50.0) / 1e3);
+  printf("latency_p99_us,%.1f\n",  hist_percentile_get(&latency_hist, 99.0) / 1e3);
+  printf("latency_p999_us,%.1f\n", hist_percentile_get(&latency_hist, 99.9) / 1e3);
+  printf("latency_max_us,%.1f\n",  hist_max_get(&latency_hist) / 1e3);
+}
+
+/*
+ * Sleep for seconds, and keep the peak of joined clients
+ */
+static void run_sleep(double seconds, long* peak)
+{
+  uint64_t end = hist_time_get() + seconds * 1e9;
+
+  while(hist_time_get() < end)
+  {
+    long count = atomic_load(&joined);
+
+    if(count > *peak) *peak = count;
+
+    usleep(10000);
+  }
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  argp_parse(&argp, argc, argv, 0, 0, &args);
+
+  char* address;
+  int   port;
+
+  if(address_and_port_split(&address, &port, args.address) != 0)
+  {
+    fprintf(stderr, "bunker-loadgen: Bad address: %s\n", args.address);
+
+    return 1;
+  }
+
+  server_addr = (struct sockaddr_in) { .sin_family = AF_INET, .sin_port = htons(port) };
+
+  int status = inet_pton(AF_INET, address, &server_addr.sin_addr);
+
+  is_loopback = (strncmp(address, "127.", 4) == 0);
+
+  free(address);
+
+  if(status != 1)
+  {
+    fprintf(stderr, "bunker-loadgen: Bad address: %s\n", args.address);
+
+    return 1;
+  }
+
+  // Every client has a socket, and every thread an epoll
+  if(files_limit_raise(args.clients + args.threads + 64) != 0) return 1;
+
+  if(args.keys > args.clients) args.keys = args.clients;
+
+  if(keys_create(args.keys) != 0)
+  {
+    fprintf(stderr, "bunker-loadgen: Failed to create keys\n");
+
+    keys_free(args.keys);
+
+    return 1;
+  }
+
+  loadgen_thread_t* threads = calloc(args.threads, sizeof(loadgen_thread_t));
+  client_t*         clients = calloc(args.clients, sizeof(client_t));
+  uint8_t*          buffers = malloc((size_t) args.clients * (CLIENT_BUFFER_SIZE + CLIENT_FRAME_MAX));
+
+  if(!threads || !clients || !buffers || threads_create(threads, clients, buffers) != 0)
+  {
+    fprintf(stderr, "bunker-loadgen: Failed to create clients\n");
+
+    return 1;
+  }
+
+  long started = 0;
+
+  for(; started < args.threads; started++)
+  {
+    if(pthread_create(&threads[started].thread, NULL, loadgen_routine, &threads[started]) != 0) break;
+  }
+
+  // 1. Wait for the clients to join, for at most twice the ramp time
+  long   peak      = 0;
+  double ramp_max  = 2.0 * args.clients / args.ramp + 1.0;
+  double ramp_time = 0;
+
+  uint64_t start = hist_time_get();
+
+  while(started == args.threads && atomic_load(&joined) < args.clients && ramp_time < ramp_max)
+  {
+    run_sleep(0.01, &peak);
+
+    ramp_time = (hist_time_get() - start) / 1e9;
+  }
+
+  fprintf(stderr, "bunker-loadgen: %ld of %ld clients joined in %.2f seconds\n", atomic_load(&joined), args.clients, ramp_time);
+
+  // 2. Send messages for the duration, and then recieve the last of them
+  atomic_store(&phase, PHASE_RUN);
+
+  run_sleep(args.duration, &peak);
+
+  atomic_store(&phase, PHASE_DRAIN);
+
+  run_sleep(1.0, &peak);
+
+  atomic_store(&phase, PHASE_STOP);
+
+  for(long index = 0; index < started; index++)
+  {
+    pthread_join(threads[index].thread, NULL);
+
+    close(threads[index].epfd);
+  }
+
+  counters_t sum = counters_sum(threads);
+
+  report_print(&sum, peak, ramp_time);
+
+  free(buffers);
+  free(clients);
+  free(threads);
+
+  crypto_thread_free();
+
+  keys_free(args.keys);
+
+  return (started == args.threads) ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+ * bunker-logdecode - print a binary debug file as text
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bunker-logdecode FILE
+ *
+ * The messages are printed to stdout with DEBUG_FORMAT,
+ * the same way as if the debug file was opened as text
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../file.h"
+
+/*
+ * Site ids are given in order, one per call site of the program,
+ * so a larger id is taken to be a corrupt file
+ */
+#define SITE_ID_MAX 65536
+
+typedef struct
+{
+  char* title;
+  char* format;
+} site_t;
+
+/*
+ * Add the title and format of a site, at its id
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate site, or the id is too large
+ */
+static int site_add(site_t** sites, size_t* count, uint32_t id, const char* title, size_t title_length, const char* format, size_t format_length)
+{
+  if(id > SITE_ID_MAX) return 1;
+
+  if(id >= *count)
+  {
+    site_t* new_sites = realloc(*sites, sizeof(site_t) * (id + 1));
+
+    if(!new_sites) return 1;
+
+    memset(new_sites + *count, 0, sizeof(site_t) * (id + 1 - *count));
+
+    *sites = new_sites;
+    *count = id + 1;
+  }
+
+  site_t* site = &(*sites)[id];
+
+  free(site->title);
+  free(site->format);
+
+  site->title  = strndup(title, title_length);
+  site->format = strndup(format, format_length);
+
+  return (site->title && site->format) ? 0 : 1;
+}
+
+/*
+ *
+ */
+static void sites_free(site_t** sites, size_t count)
+{
+  for(size_t index = 0; index < count; index++)
+  {
+    free((*sites)[index].title);
+    free((*sites)[index].format);
+  }
+
+  free(*sites);
+
+  *sites = NULL;
+}
+
+/*
+ * Print the records of the file, after the head
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | The file is cut off or corrupt
+ */
+static int records_print(dbg_batch_t* batch, const uint8_t* data, size_t size)
+{
+  site_t* sites = NULL;
+  size_t  site_count = 0;
+
+  char message[DEBUG_ARGS_MAX * (DEBUG_STRING_MAX + 1) + 1024];
+
+  size_t index = 0;
+  int status = 0;
+
+  while(status == 0 && index < size)
+  {
+    uint8_t kind = data[index];
+
+    if(kind == DBG_KIND_SITE && index + 9 <= size)
+    {
+      uint32_t id;
+      uint16_t title_length, format_length;
+
+      memcpy(&id,            data + index + 1, sizeof(uint32_t));
+      memcpy(&title_length,  data + index + 5, sizeof(uint16_t));
+      memcpy(&format_length, data + index + 7, sizeof(uint16_t));
+
+      const char* title  = (const char*) data + index + 9;
+      const char* format = title + title_length;
+
+      index += 9 + title_length + format_length;
+
+      if(index > size || site_add(&sites, &site_count, id, title, title_length, format, format_length) != 0)
+      {
+        status = 1;
+      }
+    }
+    else if(kind == DBG_KIND_EVENT && index + 15 <= size)
+    {
+      uint32_t id;
+      uint64_t time;
+      uint16_t length;
+
+      memcpy(&id,     data + index + 1,  sizeof(uint32_t));
+      memcpy(&time,   data + index + 5,  sizeof(uint64_t));
+      memcpy(&length, data + index + 13, sizeof(uint16_t));
+
+      const uint8_t* args = data + index + 15;
+
+      index += 15 + length;
+
+      if(index > size || id >= site_count || !sites[id].format)
+      {
+        status = 1;
+      }
+      else if(dbg_event_string_create(message, sizeof(message), sites[id].format, args, length) >= 0)
+      {
+        dbg_batch_append(batch, STDOUT_FILENO, time, sites[id].title, message);
+      }
+    }
+    else if(kind == DBG_KIND_TEXT && index + 13 <= size)
+    {
+      uint64_t time;
+      uint16_t title_length, message_length;
+
+      memcpy(&time,           data + index + 1,  sizeof(uint64_t));
+      memcpy(&title_length,   data + index + 9,  sizeof(uint16_t));
+      memcpy(&message_length, data + index + 11, sizeof(uint16_t));
+
+      const char* title = (const char*) data + index + 13;
+
+      index += 13 + title_length + message_length;
+
+      // The message is copied to be terminated, so it must fit
+      if(index > size || message_length >= sizeof(message))
+      {
+        status = 1;
+      }
+      else
+      {
+        char title_copy[title_length + 1];
+
+        memcpy(title_copy, title, title_length);
+        title_copy[title_length] = '\0';
+
+        memcpy(message, title + title_length, message_length);
+        message[message_length] = '\0';
+
+        dbg_batch_append(batch, STDOUT_FILENO, time, title_copy, message);
+      }
+    }
+    else status = 1;
+  }
+
+  dbg_batch_flush(batch);
+
+  sites_free(&sites, site_count);
+
+  return status;
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: bunker-logdecode FILE\n");
+
+    return 1;
+  }
+
+  size_t size = file_size_get(argv[1]);
+
+  uint8_t* data = malloc(sizeof(uint8_t) * (size + 1));
+
+  if(!data || size < 24 || file_read(data, size, argv[1]) != size)
+  {
+    fprintf(stderr, "bunker-logdecode: Failed to read file: %s\n", argv[1]);
+
+    free(data);
+
+    return 1;
+  }
+
+  if(memcmp(data, DEBUG_BINARY_MAGIC, sizeof(DEBUG_BINARY_MAGIC)) != 0)
+  {
+    fprintf(stderr, "bunker-logdecode: Not a binary debug file: %s\n", argv[1]);
+
+    free(data);
+
+    return 1;
+  }
+
+  // The time stamps are converted with the clocks of the file
+  uint64_t start_real, start_mono;
+
+  memcpy(&start_real, data + 8,  sizeof(uint64_t));
+  memcpy(&start_mono, data + 16, sizeof(uint64_t));
+
+  dbg_start_real = (struct timespec) { start_real / 1000000000, start_real % 1000000000 };
+  dbg_start_mono = (struct timespec) { start_mono / 1000000000, start_mono % 1000000000 };
+
+  dbg_batch_t* batch = malloc(sizeof(dbg_batch_t));
+
+  if(!batch)
+  {
+    free(data);
+
+    return 1;
+  }
+
+  batch->length = 0;
+  batch->fd     = STDOUT_FILENO;
+  batch->second = -1;
+
+  int status = records_print(batch, data + 24, size - 24);
+
+  if(status != 0)
+  {
+    fprintf(stderr, "bunker-logdecode: The file is cut off or corrupt\n");
+  }
+
+  free(batch);
+
+  free(data);
+
+  return status;
+}
@@ -0,0 +1,623 @@
+/*
+ * bunker-replay - send the frames of a capture to a room server
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ *
+ *
+ * bunker-replay [OPTION...] FILE ADDRESS:PORT
+ *
+ * The frames of a capture, written by bunker --capture, are sent
+ * on one connection at their recorded times, divided by the speed,
+ * or as fast as possible with speed 0. A second connection recieves
+ * them from the server, and the latency of every frame is measured.
+ * Control frames are not sent, since their answers would be stale.
+ *
+ * The report is printed as "metric,value" lines. With a baseline,
+ * a report of another build, every metric is printed as
+ * "metric,baseline,value,change" where change is in percent
+ */
+
+#define FORMAT_IMPLEMENT
+#include "../format.h"
+
+#define DEBUG_IMPLEMENT
+#include "../debug.h"
+
+#include "../bunker.h"
+
+#include <pthread.h>
+
+/*
+ * Frames that are due together are written with one write,
+ * of at most REPLAY_BATCH_SIZE bytes
+ */
+#define REPLAY_BATCH_SIZE 65536
+
+/*
+ * A recieved frame is matched to one of the next REPLAY_WINDOW
+ * frames that are not yet recieved, the ones before it are lost
+ */
+#define REPLAY_WINDOW 256
+
+/*
+ * The time to wait for the last frames, in nanoseconds
+ */
+#define REPLAY_DRAIN_TIME 1000000000ULL
+
+#define REPORT_METRICS_MAX 32
+
+static char doc[] = "bunker-replay - send the frames of a capture to a room server";
+
+static char args_doc[] = "FILE ADDRESS:PORT";
+
+static struct argp_option options[] =
+{
+  { "speed",    'x', "SPEED",  0, "Times the recorded speed, 0 for as fast as possible (default 1)" },
+  { "baseline", 'b', "REPORT", 0, "Compare with the report of another build" },
+  { 0 }
+};
+
+struct args
+{
+  char*  capture;
+  char*  address;
+  double speed;
+  char*  baseline;
+};
+
+static struct args args =
+{
+  .capture  = NULL,
+  .address  = NULL,
+  .speed    = 1,
+  .baseline = NULL
+};
+
+/*
+ * A frame to send, with the hash it is recognized by
+ */
+typedef struct
+{
+  uint64_t       time;
+  uint64_t       hash;
+  const uint8_t* wire;
+  size_t         wire_size;
+  atomic_ullong  sent;       // When it was sent, 0 if not yet
+} replay_frame_t;
+
+typedef struct
+{
+  char   name[32];
+  double value;
+} metric_t;
+
+typedef struct
+{
+  metric_t metrics[REPORT_METRICS_MAX];
+  size_t   count;
+} report_t;
+
+static replay_frame_t* frames = NULL;
+static size_t          frame_count = 0;
+
+static int recv_sockfd = -1;
+
+static hist_t latency_hist;
+
+/*
+ * The counters of the reciever thread, read after it is joined
+ */
+static size_t   recv_next = 0;
+static uint64_t recv_frames = 0;
+static uint64_t recv_bytes = 0;
+static uint64_t recv_lost = 0;
+static uint64_t recv_other = 0;
+static uint64_t recv_last = 0;
+
+/*
+ * This is the option parsing function used by argp
+ */
+static error_t opt_parse(int key, char* arg, struct argp_state* state)
+{
+  struct args* args = state->input;
+
+  switch(key)
+  {
+    case 'x':
+      if((args->speed = atof(arg)) < 0)
+      {
+        argp_error(state, "Bad speed: %s", arg);
+      }
+      break;
+
+    case 'b':
+      args->baseline = arg;
+      break;
+
+    case ARGP_KEY_ARG:
+      if(state->arg_num == 0) args->capture = arg;
+
+      else if(state->arg_num == 1) args->address = arg;
+
+      else argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if(!args->capture || !args->address) argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+static struct argp argp = { options, opt_parse, args_doc, doc };
+
+/*
+ * Hash a frame by its type and data, FNV-1a
+ */
+static uint64_t frame_hash_get(uint8_t type, const uint8_t* data, size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  hash = (hash ^ type) * 0x100000001b3ULL;
+
+  for(size_t index = 0; index < size; index++)
+  {
+    hash = (hash ^ data[index]) * 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+/*
+ * Load the frames of a capture, except control frames
+ *
+ * The frames point into data, which must live until they are freed
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Not a capture
+ * - 2 | Failed to allocate frames
+ */
+static int frames_load(const uint8_t* data, size_t size)
+{
+  if(capture_head_read(NULL, data, size) != 0) return 1;
+
+  size_t offset = CAPTURE_HEAD_SIZE;
+
+  size_t max = 0;
+
+  capture_record_t record;
+
+  int status;
+
+  while((status = capture_record_read(&record, data, size, &offset)) == 0)
+  {
+    if(FRAME_IS_CONTROL(record.frame.type)) continue;
+
+    if(frame_count == max)
+    {
+      max = max ? max * 2 : 1024;
+
+      replay_frame_t* new_frames = realloc(frames, sizeof(replay_frame_t) * max);
+
+      if(!new_frames) return 2;
+
+      frames = new_frames;
+    }
+
+    replay_frame_t* frame = &frames[frame_count++];
+
+    frame->time      = record.time;
+    frame->hash      = frame_hash_get(record.frame.type, record.frame.data, record.frame.size);
+    frame->wire      = record.wire;
+    frame->wire_size = record.wire_size;
+
+    atomic_init(&frame->sent, 0);
+  }
+
+  if(status == 2)
+  {
+    fprintf(stderr, "bunker-replay: The capture is cut short, after %zu frames\n", frame_count);
+  }
+
+  return 0;
+}
+
+/*
+ * Match a recieved frame to a sent frame, and record its latency
+ */
+static void frame_match(const frame_t* frame, uint64_t now)
+{
+  uint64_t hash = frame_hash_get(frame->type, frame->data, frame->size);
+
+  size_t end = recv_next + REPLAY_WINDOW;
+
+  if(end > frame_count) end = frame_count;
+
+  for(size_t index = recv_next; index < end; index++)
+  {
+    uint64_t sent = atomic_load_explicit(&frames[index].sent, memory_order_acquire);
+
+    if(sent == 0) break;
+
+    if(frames[index].hash != hash || frames[index].wire_size != FRAME_HEAD_SIZE + frame->size) continue;
+
+    if(now > sent) hist_record(&latency_hist, now - sent);
+
+    recv_lost += index - recv_next;
+
+    recv_next = index + 1;
+
+    recv_frames++;
+    recv_bytes += FRAME_HEAD_SIZE + frame->size;
+
+    recv_last = now;
+
+    return;
+  }
+
+  recv_other++;
+}
+
+/*
+ * Recieve frames from the server, until the socket is shut down
+ */
+static void* recv_routine(void* arg)
+{
+  frame_buffer_t buffer;
+
+  if(frame_buffer_create(&buffer, FRAME_HEAD_SIZE + FRAME_SIZE_MAX, NODE_NONE) != 0) return NULL;
+
+  frame_t buffer_frames[64];
+
+  ssize_t count;
+
+  while((count = frames_recv(recv_sockfd, &buffer, buffer_frames, 64)) > 0 || count == -3)
+  {
+    uint64_t now = hist_time_get();
+
+    for(ssize_t index = 0; index < count; index++)
+    {
+      frame_match(&buffer_frames[index], now);
+    }
+  }
+
+  frame_buffer_free(&buffer);
+
+  return NULL;
+}
+
+/*
+ * Sleep until the monotonic time, in nanoseconds
+ */
+static void time_sleep(uint64_t time)
+{
+  struct timespec timespec = { .tv_sec = time / 1000000000, .tv_nsec = time % 1000000000 };
+
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timespec, NULL) == EINTR);
+}
+
+/*
+ * Send the frames at their times, divided by the speed
+ *
+ * The frames that are due together are written together
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate
+ * - 2 | Failed to send
+ */
+static int frames_send(int sockfd, uint64_t* lag_max)
+{
+  uint8_t* batch = malloc(REPLAY_BATCH_SIZE);
+
+  if(!batch) return 1;
+
+  uint64_t start = hist_time_get();
+
+  uint64_t first = frame_count ? frames[0].time : 0;
+
+  size_t index = 0;
+
+  while(index < frame_count)
+  {
+    uint64_t due = (args.speed > 0) ? start + (frames[index].time - first) / args.speed : 0;
+
+    uint64_t now = hist_time_get();
+
+    if(due > now)
+    {
+      time_sleep(due);
+
+      now = hist_time_get();
+    }
+    else if(due > 0 && now - due > *lag_max) *lag_max = now - due;
+
+    // Take every frame that is due, that fits the batch
+    size_t length = 0;
+    size_t end    = index;
+
+    while(end < frame_count)
+    {
+      uint64_t end_due = (args.speed > 0) ? start + (frames[end].time - first) / args.speed : 0;
+
+      if(end_due > now) break;
+
+      if(length + frames[end].wire_size > REPLAY_BATCH_SIZE && end > index) break;
+
+      if(frames[end].wire_size > REPLAY_BATCH_SIZE) break;
+
+      memcpy(batch + length, frames[end].wire, frames[end].wire_size);
+
+      length += frames[end++].wire_size;
+    }
+
+    // A frame larger than the batch is written by itself
+    const uint8_t* data = batch;
+
+    if(end == index)
+    {
+      data   = frames[index].wire;
+      length = frames[end++].wire_size;
+    }
+
+    now = hist_time_get();
+
+    for(size_t sent = index; sent < end; sent++)
+    {
+      atomic_store_explicit(&frames[sent].sent, now, memory_order_release);
+    }
+
+    if(socket_write(sockfd, (const char*) data, length) != (ssize_t) length)
+    {
+      free(batch);
+
+      return 2;
+    }
+
+    index = end;
+  }
+
+  free(batch);
+
+  return 0;
+}
+
+/*
+ * Add a metric to the report
+ */
+static void report_add(report_t* report, const char* name, double value)
+{
+  if(report->count >= REPORT_METRICS_MAX) return;
+
+  metric_t* metric = &report->metrics[report->count++];
+
+  snprintf(metric->name, sizeof(metric->name), "%s", name);
+
+  metric->value = value;
+}
+
+/*
+ * Load the "metric,value" lines of another report
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to open file
+ */
+static int report_load(report_t* report, const char* filepath)
+{
+  FILE* file = fopen(filepath, "r");
+
+  if(!file) return 1;
+
+  char line[128];
+
+  while(fgets(line, sizeof(line), file))
+  {
+    char*  comma = strchr(line, ',');
+
+    if(!comma) continue;
+
+    *comma = '\0';
+
+    report_add(report, line, atof(comma + 1));
+  }
+
+  fclose(file);
+
+  return 0;
+}
+
+/*
+ * Print the report, compared with the baseline if there is one
+ */
+static void report_print(const report_t* report, const report_t* baseline)
+{
+  for(size_t index = 0; index < report->count; index++)
+  {
+    const metric_t* metric = &report->metrics[index];
+
+    const metric_t* base = NULL;
+
+    for(size_t base_index = 0; baseline && base_index < baseline->count; base_index++)
+    {
+      if(strcmp(baseline->metrics[base_index].name, metric->name) == 0)
+      {
+        base = &baseline->metrics[base_index];
+        break;
+      }
+    }
+
+    if(!baseline)
+    {
+      printf("%s,%.3f\n", metric->name, metric->value);
+    }
+    else if(base && base->value != 0)
+    {
+      printf("%s,%.3f,%.3f,%+.1f\n", metric->name, base->value, metric->value, (metric->value - base->value) / base->value * 100.0);
+    }
+    else
+    {
+      printf("%s,%s,%.3f,\n", metric->name, base ? "0.000" : "", metric->value);
+    }
+  }
+}
+
+/*
+ * This is the main function
+ */
+int main(int argc, char* argv[])
+{
+  argp_parse(&argp, argc, argv, 0, 0, &args);
+
+  // Only the report is printed
+  debug_filter_set(DEBUG_FILTER_NONE);
+
+  report_t baseline = { 0 };
+
+  if(args.baseline && report_load(&baseline, args.baseline) != 0)
+  {
+    fprintf(stderr, "bunker-replay: Failed to read baseline: %s\n", args.baseline);
+
+    return 1;
+  }
+
+  size_t size = file_size_get(args.capture);
+
+  uint8_t* data = size ? malloc(size) : NULL;
+
+  if(!data || file_read(data, size, args.capture) != size)
+  {
+    fprintf(stderr, "bunker-replay: Failed to read capture: %s\n", args.capture);
+
+    free(data);
+
+    return 1;
+  }
+
+  if(frames_load(data, size) != 0)
+  {
+    fprintf(stderr, "bunker-replay: Bad capture: %s\n", args.capture);
+
+    free(frames);
+    free(data);
+
+    return 1;
+  }
+
+  char* address;
+  int   port;
+
+  if(address_and_port_split(&address, &port, args.address) != 0)
+  {
+    fprintf(stderr, "bunker-replay: Bad address: %s\n", args.address);
+
+    free(frames);
+    free(data);
+
+    return 1;
+  }
+
+  // The reciever connects first, so that it gets every frame
+  int sockfd = -1;
+
+  recv_sockfd = client_socket_create(address, port);
+
+  if(recv_sockfd != -1) sockfd = client_socket_create(address, port);
+
+  free(address);
+
+  if(sockfd == -1)
+  {
+    fprintf(stderr, "bunker-replay: Failed to connect to %s\n", args.address);
+
+    socket_close(&recv_sockfd);
+
+    free(frames);
+    free(data);
+
+    return 1;
+  }
+
+  pthread_t thread;
+
+  if(pthread_create(&thread, NULL, recv_routine, NULL) != 0)
+  {
+    fprintf(stderr, "bunker-replay: Failed to create thread\n");
+
+    socket_close(&sockfd);
+    socket_close(&recv_sockfd);
+
+    free(frames);
+    free(data);
+
+    return 1;
+  }
+
+  uint64_t lag_max = 0;
+
+  uint64_t start = hist_time_get();
+
+  int status = frames_send(sockfd, &lag_max);
+
+  uint64_t send_time = hist_time_get() - start;
+
+  if(status != 0) fprintf(stderr, "bunker-replay: Failed to send frames\n");
+
+  // Wait for the last frames, then stop the reciever
+  time_sleep(hist_time_get() + REPLAY_DRAIN_TIME);
+
+  shutdown(recv_sockfd, SHUT_RDWR);
+
+  pthread_join(thread, NULL);
+
+  socket_close(&sockfd);
+  socket_close(&recv_sockfd);
+
+  // The frames that were never recieved are lost
+  recv_lost += frame_count - recv_next;
+
+  uint64_t capture_time = frame_count ? frames[frame_count - 1].time - frames[0].time : 0;
+
+  uint64_t recv_time = (recv_last > start) ? recv_last - start : 1;
+
+  double send_seconds = send_time ? send_time / 1e9 : 1e-9;
+  double recv_seconds = recv_time / 1e9;
+
+  uint64_t sent_bytes = 0;
+
+  for(size_t index = 0; index < frame_count; index++) sent_bytes += frames[index].wire_size;
+
+  report_t report = { 0 };
+
+  report_add(&report, "speed",                     args.speed);
+  report_add(&report, "frames",                    frame_count);
+  report_add(&report, "capture_seconds",           capture_time / 1e9);
+  report_add(&report, "send_seconds",              send_seconds);
+  report_add(&report, "sent_frames_per_second",    frame_count / send_seconds);
+  report_add(&report, "sent_megabytes_per_second", sent_bytes / send_seconds / 1e6);
+  report_add(&report, "schedule_lag_max_us",       lag_max / 1e3);
+  report_add(&report, "delivered",                 recv_frames);
+  report_add(&report, "lost",                      recv_lost);
+  report_add(&report, "other_frames",              recv_other);
+  report_add(&report, "delivery_ratio",            frame_count ? (double) recv_frames / frame_count : 0.0);
+  report_add(&report, "recv_frames_per_second",    recv_frames / recv_seconds);
+  report_add(&report, "recv_megabytes_per_second", recv_bytes / recv_seconds / 1e6);
+  report_add(&report, "latency_p50_us",            hist_percentile_get(&latency_hist, 50.0) / 1e3);
+  report_add(&report, "latency_p99_us",            hist_percentile_get(&latency_hist, 99.0) / 1e3);
+  report_add(&report, "latency_p999_us",           hist_percentile_get(&latency_hist, 99.9) / 1e3);
+  report_add(&report, "latency_max_us",            hist_max_get(&latency_hist) / 1e3);
+
+  report_print(&report, args.baseline ? &baseline : NULL);
+
+  free(frames);
+  free(data);
+
+  return (status == 0) ? 0 : 1;
+}
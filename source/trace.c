@@ -0,0 +1,206 @@
+/*
+ * trace.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "trace.h"
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/*
+ * An event of the Chrome trace-event format
+ *
+ * phase is 'B' for begin, 'E' for end, and 'X' for a whole span
+ */
+typedef struct
+{
+  const char* name;
+  uint64_t    time;
+  uint64_t    duration;
+  uint32_t    tid;
+  char        phase;
+} trace_event_t;
+
+bool trace_enabled = false;
+
+static trace_event_t* trace_events = NULL;
+
+static atomic_size_t trace_count = 0;
+
+static char* trace_filepath = NULL;
+
+static __thread uint32_t trace_tid = 0;
+
+/*
+ * Get monotonic time in nanoseconds, the same clock as hist_time_get
+ */
+static inline uint64_t trace_time_get(void)
+{
+  struct timespec timespec;
+
+  clock_gettime(CLOCK_MONOTONIC, &timespec);
+
+  return (uint64_t) timespec.tv_sec * 1000000000 + timespec.tv_nsec;
+}
+
+/*
+ * Get the id of the calling thread, which is the tid of perfetto
+ */
+static inline uint32_t trace_tid_get(void)
+{
+  if(trace_tid == 0) trace_tid = syscall(SYS_gettid);
+
+  return trace_tid;
+}
+
+/*
+ * Reserve the next event, or count it as dropped
+ *
+ * RETURN (trace_event_t* event)
+ * - NULL | The events are full
+ */
+static inline trace_event_t* trace_event_reserve(void)
+{
+  size_t index = atomic_fetch_add_explicit(&trace_count, 1, memory_order_relaxed);
+
+  if(index >= TRACE_EVENTS_MAX) return NULL;
+
+  return &trace_events[index];
+}
+
+/*
+ * Begin a span on the calling thread
+ */
+void trace_begin(const char* name)
+{
+  trace_event_t* event = trace_event_reserve();
+
+  if(!event) return;
+
+  *event = (trace_event_t) { name, trace_time_get(), 0, trace_tid_get(), 'B' };
+}
+
+/*
+ * End the last span that was begun on the calling thread
+ */
+void trace_end(const char* name)
+{
+  trace_event_t* event = trace_event_reserve();
+
+  if(!event) return;
+
+  *event = (trace_event_t) { name, trace_time_get(), 0, trace_tid_get(), 'E' };
+}
+
+/*
+ * Add a span that has already been timed, like a stage of a message
+ */
+void trace_span(const char* name, uint64_t start, uint64_t duration)
+{
+  trace_event_t* event = trace_event_reserve();
+
+  if(!event) return;
+
+  *event = (trace_event_t) { name, start, duration, trace_tid_get(), 'X' };
+}
+
+/*
+ * Start tracing, until trace_close writes the file
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Failed to allocate events
+ */
+int trace_open(const char* filepath)
+{
+  trace_events = tag_malloc(ALLOC_LOG, sizeof(trace_event_t) * TRACE_EVENTS_MAX);
+
+  if(!trace_events) return 1;
+
+  trace_filepath = tag_strdup(ALLOC_LOG, filepath);
+
+  if(!trace_filepath)
+  {
+    tag_free(ALLOC_LOG, trace_events);
+
+    trace_events = NULL;
+
+    return 1;
+  }
+
+  atomic_store(&trace_count, 0);
+
+  trace_enabled = true;
+
+  return 0;
+}
+
+/*
+ * Stop tracing and write the events as Chrome trace-event JSON
+ *
+ * The time stamps are in microseconds, which perfetto expects
+ *
+ * RETURN (int status)
+ * - 0 | Success, or tracing was not started
+ * - 1 | Failed to open file
+ */
+int trace_close(void)
+{
+  if(!trace_events) return 0;
+
+  trace_enabled = false;
+
+  size_t count = atomic_load(&trace_count);
+
+  size_t dropped = (count > TRACE_EVENTS_MAX) ? count - TRACE_EVENTS_MAX : 0;
+
+  if(count > TRACE_EVENTS_MAX) count = TRACE_EVENTS_MAX;
+
+  FILE* file = fopen(trace_filepath, "w");
+
+  if(file)
+  {
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%zu},\"traceEvents\":[\n", dropped);
+
+    pid_t pid = getpid();
+
+    for(size_t index = 0; index < count; index++)
+    {
+      const trace_event_t* event = &trace_events[index];
+
+      fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+        event->name, event->phase, event->time / 1e3, (int) pid, event->tid);
+
+      if(event->phase == 'X')
+      {
+        fprintf(file, ",\"dur\":%.3f", event->duration / 1e3);
+      }
+
+      fprintf(file, "}%s\n", (index + 1 < count) ? "," : "");
+    }
+
+    fprintf(file, "]}\n");
+
+    fclose(file);
+  }
+
+  tag_free(ALLOC_LOG, trace_events);
+
+  trace_events = NULL;
+
+  tag_free(ALLOC_LOG, trace_filepath);
+
+  trace_filepath = NULL;
+
+  return file ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+/*
+ * trace.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The maximum number of events kept until trace_close,
+ * the events after that are counted as dropped
+ */
+#define TRACE_EVENTS_MAX 1048576
+
+/*
+ * trace_enabled is only changed by trace_open and trace_close,
+ * when no other thread is tracing
+ */
+extern bool trace_enabled;
+
+/*
+ * When tracing is off, a span is one predictable branch.
+ * The names must be string literals, or live until trace_close
+ */
+#define TRACE_BEGIN(name) \
+  do { if(__builtin_expect(trace_enabled, 0)) trace_begin(name); } while(0)
+
+#define TRACE_END(name) \
+  do { if(__builtin_expect(trace_enabled, 0)) trace_end(name); } while(0)
+
+#define TRACE_SPAN(name, start, duration) \
+  do { if(__builtin_expect(trace_enabled, 0)) trace_span(name, start, duration); } while(0)
+
+extern int  trace_open(const char* filepath);
+
+extern int  trace_close(void);
+
+
+extern void trace_begin(const char* name);
+
+extern void trace_end(const char* name);
+
+extern void trace_span(const char* name, uint64_t start, uint64_t duration);
+
+#endif // TRACE_H
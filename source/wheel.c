@@ -0,0 +1,295 @@
+/*
+ * wheel.c
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#include "wheel.h"
+
+#include <limits.h>
+
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+
+/*
+ * The number of bits to shift a tick by, to get its slot in a level
+ */
+#define WHEEL_SHIFT(level) (WHEEL_SLOT_BITS * (level))
+
+/*
+ * Add a timer last in a list
+ */
+static inline void timer_link(wheel_timer_t* head, wheel_timer_t* timer)
+{
+  timer->prev = head->prev;
+  timer->next = head;
+
+  head->prev->next = timer;
+  head->prev       = timer;
+}
+
+/*
+ * Remove a timer from its list
+ */
+static inline void timer_unlink(wheel_timer_t* timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+
+  timer->prev = NULL;
+  timer->next = NULL;
+}
+
+/*
+ * Move every timer of a list to another, which must be empty
+ */
+static inline void timers_move(wheel_timer_t* to, wheel_timer_t* from)
+{
+  if(from->next == from)
+  {
+    to->prev = to;
+    to->next = to;
+
+    return;
+  }
+
+  to->next = from->next;
+  to->prev = from->prev;
+
+  to->next->prev = to;
+  to->prev->next = to;
+
+  from->prev = from;
+  from->next = from;
+}
+
+/*
+ * Put a timer in the lowest level that reaches its expiry
+ *
+ * The expiry must not be before the current tick
+ */
+static void timer_insert(wheel_t* wheel, wheel_timer_t* timer)
+{
+  uint64_t delta = timer->expire - wheel->tick;
+
+  int level = 0;
+
+  while(level < WHEEL_LEVELS - 1 && delta >= ((uint64_t) 1 << WHEEL_SHIFT(level + 1)))
+  {
+    level++;
+  }
+
+  size_t slot = (timer->expire >> WHEEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+
+  timer_link(&wheel->slots[level][slot], timer);
+}
+
+/*
+ * Initialize a wheel, with ticks of tick_size nanoseconds from now
+ *
+ * RETURN (int status)
+ * - 0 | Success
+ * - 1 | Bad input
+ */
+int wheel_init(wheel_t* wheel, uint64_t tick_size, uint64_t now)
+{
+  if(!wheel || tick_size == 0) return 1;
+
+  for(int level = 0; level < WHEEL_LEVELS; level++)
+  {
+    for(int slot = 0; slot < WHEEL_SLOTS; slot++)
+    {
+      wheel_timer_t* head = &wheel->slots[level][slot];
+
+      head->prev = head;
+      head->next = head;
+    }
+  }
+
+  wheel->tick      = 0;
+  wheel->tick_size = tick_size;
+  wheel->start     = now;
+  wheel->count     = 0;
+
+  return 0;
+}
+
+/*
+ * Initialize a timer, that is not armed
+ */
+void wheel_timer_init(wheel_timer_t* timer, wheel_routine_t routine, void* arg)
+{
+  timer->prev    = NULL;
+  timer->next    = NULL;
+  timer->expire  = 0;
+  timer->routine = routine;
+  timer->arg     = arg;
+}
+
+/*
+ * Check if a timer is armed
+ */
+bool wheel_timer_armed(const wheel_timer_t* timer)
+{
+  return timer->next != NULL;
+}
+
+/*
+ * Arm a timer to expire after delay nanoseconds,
+ * counted from the last tick, rounded up to whole ticks
+ *
+ * A timer that is already armed is moved
+ */
+void wheel_timer_arm(wheel_t* wheel, wheel_timer_t* timer, uint64_t delay)
+{
+  if(wheel_timer_armed(timer)) wheel_timer_cancel(wheel, timer);
+
+  uint64_t ticks = (delay + wheel->tick_size - 1) / wheel->tick_size;
+
+  if(ticks == 0) ticks = 1;
+
+  if(ticks > WHEEL_TICKS_MAX) ticks = WHEEL_TICKS_MAX;
+
+  timer->expire = wheel->tick + ticks;
+
+  timer_insert(wheel, timer);
+
+  wheel->count++;
+}
+
+/*
+ * Cancel a timer, if it is armed
+ */
+void wheel_timer_cancel(wheel_t* wheel, wheel_timer_t* timer)
+{
+  if(!wheel_timer_armed(timer)) return;
+
+  timer_unlink(timer);
+
+  wheel->count--;
+}
+
+/*
+ * Move the timers of the slots that have come up in the higher levels,
+ * after the level below has turned
+ */
+static void wheel_cascade(wheel_t* wheel)
+{
+  for(int level = 1; level < WHEEL_LEVELS; level++)
+  {
+    // The level below has not turned
+    if(wheel->tick & (((uint64_t) 1 << WHEEL_SHIFT(level)) - 1)) break;
+
+    size_t slot = (wheel->tick >> WHEEL_SHIFT(level)) & WHEEL_SLOT_MASK;
+
+    wheel_timer_t list;
+
+    timers_move(&list, &wheel->slots[level][slot]);
+
+    while(list.next != &list)
+    {
+      wheel_timer_t* timer = list.next;
+
+      timer_unlink(timer);
+
+      timer_insert(wheel, timer);
+    }
+  }
+}
+
+/*
+ * Expire every timer up to now, a tick at a time
+ *
+ * The expired timers of a tick are taken out of the wheel before
+ * their routines are called, so a routine can arm any timer again
+ * or cancel any other timer
+ *
+ * RETURN (size_t count)
+ * - The number of expired timers
+ */
+size_t wheel_advance(wheel_t* wheel, uint64_t now)
+{
+  if(now < wheel->start) return 0;
+
+  uint64_t target = (now - wheel->start) / wheel->tick_size;
+
+  size_t count = 0;
+
+  while(wheel->tick < target)
+  {
+    // Without timers, there is nothing to do until target
+    if(wheel->count == 0)
+    {
+      wheel->tick = target;
+      break;
+    }
+
+    wheel->tick++;
+
+    wheel_cascade(wheel);
+
+    wheel_timer_t list;
+
+    timers_move(&list, &wheel->slots[0][wheel->tick & WHEEL_SLOT_MASK]);
+
+    while(list.next != &list)
+    {
+      wheel_timer_t* timer = list.next;
+
+      timer_unlink(timer);
+
+      wheel->count--;
+
+      count++;
+
+      if(timer->routine) timer->routine(timer, timer->arg);
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Get the time until the next timer can expire, for poll
+ *
+ * In the lowest level this is the exact tick of the next timer,
+ * and in the higher levels it is the start of the first slot with timers,
+ * which is at or before the expiry of them
+ *
+ * RETURN (int timeout)
+ * - >=0 | Milliseconds until the tick
+ * -  -1 | No timers are armed
+ */
+int wheel_timeout_get(const wheel_t* wheel, uint64_t now)
+{
+  if(wheel->count == 0) return -1;
+
+  uint64_t tick = 0;
+
+  for(int level = 0; level < WHEEL_LEVELS && tick == 0; level++)
+  {
+    uint64_t base = wheel->tick >> WHEEL_SHIFT(level);
+
+    for(uint64_t index = base + 1; index <= base + WHEEL_SLOTS; index++)
+    {
+      const wheel_timer_t* head = &wheel->slots[level][index & WHEEL_SLOT_MASK];
+
+      if(head->next != head)
+      {
+        tick = index << WHEEL_SHIFT(level);
+        break;
+      }
+    }
+  }
+
+  if(tick <= wheel->tick) tick = wheel->tick + 1;
+
+  uint64_t time = wheel->start + tick * wheel->tick_size;
+
+  if(time <= now) return 0;
+
+  uint64_t timeout = (time - now + 999999) / 1000000;
+
+  return (timeout > INT_MAX) ? INT_MAX : (int) timeout;
+}
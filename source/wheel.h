@@ -0,0 +1,79 @@
+/*
+ * wheel.h
+ *
+ * Written by Hampus Fridholm
+ *
+ * Last updated: 2026-10-19
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots,
+ * where a slot of a level spans a whole turn of the level below.
+ *
+ * A timer is put in the lowest level that reaches its expiry,
+ * and is moved down a level every time the level below has turned,
+ * until it is in the lowest level and expires
+ */
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS     (1 << WHEEL_SLOT_BITS)
+#define WHEEL_LEVELS    4
+
+/*
+ * The longest delay in ticks, longer delays are cut to this
+ */
+#define WHEEL_TICKS_MAX (((uint64_t) 1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1)
+
+typedef struct wheel_timer_t wheel_timer_t;
+
+typedef void (*wheel_routine_t)(wheel_timer_t* timer, void* arg);
+
+/*
+ * A timer, that is kept in the memory of its owner,
+ * so arming and cancelling only links and unlinks it
+ */
+struct wheel_timer_t
+{
+  wheel_timer_t*  prev;
+  wheel_timer_t*  next;
+  uint64_t        expire;  // The tick that the timer expires at
+  wheel_routine_t routine;
+  void*           arg;
+};
+
+/*
+ * A wheel belongs to one event loop, and has no locks
+ *
+ * The slots are the heads of circular lists of timers
+ */
+typedef struct
+{
+  wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  uint64_t      tick;       // The last tick that has been expired
+  uint64_t      tick_size;  // Nanoseconds of a tick
+  uint64_t      start;      // Nanoseconds at tick 0
+  size_t        count;      // Armed timers
+} wheel_t;
+
+extern int    wheel_init(wheel_t* wheel, uint64_t tick_size, uint64_t now);
+
+extern size_t wheel_advance(wheel_t* wheel, uint64_t now);
+
+extern int    wheel_timeout_get(const wheel_t* wheel, uint64_t now);
+
+
+extern void wheel_timer_init(wheel_timer_t* timer, wheel_routine_t routine, void* arg);
+
+extern void wheel_timer_arm(wheel_t* wheel, wheel_timer_t* timer, uint64_t delay);
+
+extern void wheel_timer_cancel(wheel_t* wheel, wheel_timer_t* timer);
+
+extern bool wheel_timer_armed(const wheel_timer_t* timer);
+
+#endif // WHEEL_H